@@ -0,0 +1,194 @@
+#include "common.h"
+#include "llama.h"
+#include "ggml.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// measures the prompt and the single-token evals of a model, with the page and TLB behaviour of the memory
+// options, e.g.:
+//
+//  ./benchmark-eval -m model.bin -t 8 -b 64 -n 64
+//  ./benchmark-eval -m model.bin -t 8 -b 64 -n 64 --huge-pages --copy-weights
+//
+
+enum counter_kind {
+    COUNTER_DTLB_READ_MISSES,
+    COUNTER_PAGE_FAULTS,
+};
+
+// a counter of the process and the threads it creates, fd is -1 if the kernel or the CPU does not provide it
+struct counter {
+    int fd = -1;
+
+    counter(counter_kind kind) {
+#if defined(__linux__)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        if (kind == COUNTER_DTLB_READ_MISSES) {
+            attr.type   = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        } else {
+            attr.type   = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+        }
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.inherit        = 1;
+
+        fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void) kind;
+#endif
+    }
+
+    ~counter() {
+#if defined(__linux__)
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    long long read() const {
+        long long value = -1;
+#if defined(__linux__)
+        if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) {
+            value = -1;
+        }
+#endif
+        return value;
+    }
+};
+
+static void print_counters(const char * name, const counter & tlb, long long tlb0, const counter & faults, long long faults0, int n) {
+    if (tlb.fd >= 0) {
+        printf("%s: %12.0f dTLB load misses per token\n", name, double(tlb.read() - tlb0)/n);
+    } else {
+        printf("%s: %12s dTLB load misses per token\n", name, "n/a");
+    }
+    if (faults.fd >= 0) {
+        printf("%s: %12.0f page faults per token\n", name, double(faults.read() - faults0)/n);
+    }
+}
+
+// the memory of the process backed by transparent huge pages
+static long anon_huge_kb() {
+    long kb = 0;
+#if defined(__linux__)
+    FILE * f = fopen("/proc/self/smaps_rollup", "r");
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "AnonHugePages:", 14) == 0) {
+                kb = atol(line + 14);
+            }
+        }
+        fclose(f);
+    }
+#endif
+    return kb;
+}
+
+int main(int argc, char ** argv) {
+    gpt_params params;
+    params.n_batch   = 64;
+    params.n_predict = 64;
+
+    if (gpt_params_parse(argc, argv, params) == false) {
+        return 1;
+    }
+
+    auto lparams = llama_context_default_params();
+
+    lparams.n_ctx        = std::max(params.n_ctx, params.n_batch + params.n_predict);
+    lparams.n_batch      = params.n_batch;
+    lparams.n_parts      = params.n_parts;
+    lparams.seed         = params.seed;
+    lparams.f16_kv       = params.memory_f16;
+    lparams.kv_type      = params.memory_type;
+    lparams.use_mlock    = params.use_mlock;
+    lparams.prefault     = params.prefault;
+    lparams.huge_pages   = params.huge_pages;
+    lparams.copy_weights = params.copy_weights;
+    lparams.warmup       = params.warmup;
+    lparams.warmup_async = params.warmup_async;
+
+    const int64_t t_load_start_us = ggml_time_us();
+
+    llama_context * ctx = llama_init_from_file(params.model.c_str(), lparams);
+    if (ctx == NULL) {
+        fprintf(stderr, "%s: error: failed to load model '%s'\n", __func__, params.model.c_str());
+        return 1;
+    }
+
+    printf("load: %8.2f ms\n", (ggml_time_us() - t_load_start_us)/1000.0);
+    if (params.warmup_async) {
+        printf("load: %.0f%% of the weights warmed up\n", 100.0f*llama_warmup_progress(ctx));
+    }
+
+    const counter tlb(COUNTER_DTLB_READ_MISSES);
+    const counter faults(COUNTER_PAGE_FAULTS);
+
+    const int n_vocab = llama_n_vocab(ctx);
+
+    std::vector<llama_token> tokens(params.n_batch);
+    for (int i = 0; i < params.n_batch; i++) {
+        tokens[i] = 1 + (i*7919) % (n_vocab - 1);
+    }
+
+    // prompt
+    {
+        const long long tlb0    = tlb.read();
+        const long long faults0 = faults.read();
+        const int64_t   t_start = ggml_time_us();
+
+        if (llama_eval(ctx, tokens.data(), params.n_batch, 0, params.n_threads)) {
+            fprintf(stderr, "%s: failed to eval\n", __func__);
+            return 1;
+        }
+
+        const double t_ms = (ggml_time_us() - t_start)/1000.0;
+
+        printf("prompt: %8.2f ms for %d tokens, %8.2f tok/s\n", t_ms, params.n_batch, params.n_batch/t_ms*1000.0);
+        print_counters("prompt", tlb, tlb0, faults, faults0, params.n_batch);
+    }
+
+    // single tokens
+    {
+        const long long tlb0    = tlb.read();
+        const long long faults0 = faults.read();
+        const int64_t   t_start = ggml_time_us();
+
+        for (int i = 0; i < params.n_predict; i++) {
+            const llama_token token = 1 + (i*104729) % (n_vocab - 1);
+
+            if (llama_eval(ctx, &token, 1, params.n_batch + i, params.n_threads)) {
+                fprintf(stderr, "%s: failed to eval\n", __func__);
+                return 1;
+            }
+        }
+
+        const double t_ms = (ggml_time_us() - t_start)/1000.0;
+
+        printf("eval:   %8.2f ms per token, %8.2f tok/s\n", t_ms/params.n_predict, params.n_predict/t_ms*1000.0);
+        print_counters("eval  ", tlb, tlb0, faults, faults0, params.n_predict);
+    }
+
+    printf("anonymous memory in transparent huge pages: %.2f MB\n", anon_huge_kb()/1024.0);
+
+    llama_free(ctx);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "ggml.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// compares the quantized dot products specialised for the LLaMA row lengths with the generic ones
+// the rows of each shape fit in the L2 cache, so that the kernels and not the memory are measured
+//
+// usage:
+//  ./benchmark-fixed-dims [iterations]
+//
+
+// n_embd and n_ff of the 7B, 13B, 30B and 65B models
+static const int shapes[] = { 4096, 5120, 6656, 8192, 11008, 13824, 17920, 22016 };
+
+static double bench(vec_dot_q_t vec_dot, int n, int n_rows, int n_iter, const uint8_t * x, size_t x_row_size, const uint8_t * y, float * s) {
+    const int64_t t_start = ggml_time_us();
+
+    for (int it = 0; it < n_iter; ++it) {
+        for (int r = 0; r < n_rows; ++r) {
+            vec_dot(n, s + r, x + r*x_row_size, y);
+        }
+    }
+
+    return (ggml_time_us() - t_start)*1000.0/(double(n_iter)*n_rows);
+}
+
+int main(int argc, char ** argv) {
+    ggml_time_init();
+
+    const int n_iter = argc > 1 ? atoi(argv[1]) : 200;
+
+    // selects the kernels
+    {
+        struct ggml_init_params params = { 0, NULL, false };
+        struct ggml_context * ctx = ggml_init(params);
+        ggml_free(ctx);
+    }
+
+    printf("kernels: %s\n\n", ggml_cpu_isa());
+    printf("%6s %6s %12s %12s %8s\n", "type", "n", "generic ns", "fixed ns", "speedup");
+
+    const ggml_type types[] = { GGML_TYPE_Q4_0, GGML_TYPE_Q4_1 };
+    const char *    names[] = { "q4_0",         "q4_1"         };
+
+    for (int t = 0; t < 2; ++t) {
+        const ggml_type type = types[t];
+
+        for (const int n : shapes) {
+            const vec_dot_q_t vec_dot_fixed = ggml_internal_get_vec_dot_fixed(type, n);
+            if (vec_dot_fixed == NULL) {
+                continue;
+            }
+
+            const quantize_fns_t fns = ggml_internal_get_quantize_fn(type);
+
+            const size_t x_row_size = n/ggml_blck_size(type)*ggml_type_size(type);
+            const size_t y_row_size = n/32*(sizeof(float) + 32); // q8_0: one float delta and 32 int8 per block
+            const int    n_rows     = std::max(1, int((256*1024)/x_row_size));
+
+            std::vector<float>   src(n);
+            std::vector<uint8_t> x(n_rows*x_row_size);
+            std::vector<uint8_t> y(y_row_size);
+            std::vector<float>   s(n_rows);
+
+            for (int r = 0; r < n_rows; ++r) {
+                for (int i = 0; i < n; ++i) {
+                    src[i] = sinf(0.37f*(r*n + i));
+                }
+                fns.quantize_row_q(src.data(), x.data() + r*x_row_size, n);
+            }
+
+            for (int i = 0; i < n; ++i) {
+                src[i] = cosf(0.11f*i);
+            }
+            fns.quantize_row_q_dot(src.data(), y.data(), n);
+
+            // warm up the caches, then alternate the two kernels
+            bench(fns.vec_dot_q, n, n_rows, 1, x.data(), x_row_size, y.data(), s.data());
+
+            double t_generic = 0.0;
+            double t_fixed   = 0.0;
+            for (int rep = 0; rep < 4; ++rep) {
+                t_generic += bench(fns.vec_dot_q, n, n_rows, n_iter/4 + 1, x.data(), x_row_size, y.data(), s.data())/4;
+                t_fixed   += bench(vec_dot_fixed, n, n_rows, n_iter/4 + 1, x.data(), x_row_size, y.data(), s.data())/4;
+            }
+
+            printf("%6s %6d %12.1f %12.1f %7.2fx\n", names[t], n, t_generic, t_fixed, t_generic/t_fixed);
+        }
+    }
+
+    return 0;
+}
@@ -90,6 +90,12 @@ bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
             params.n_ctx = std::stoi(argv[i]);
         } else if (arg == "--memory_f32") {
             params.memory_f16 = false;
+        } else if (arg == "--memory_type") {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.memory_type = std::stoi(argv[i]);
         } else if (arg == "--top_p") {
             if (++i >= argc) {
                 invalid_param = true;
@@ -147,6 +153,17 @@ bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
             params.use_color = true;
         } else if (arg == "--mlock") {
             params.use_mlock = true;
+        } else if (arg == "--prefault") {
+            params.prefault = true;
+        } else if (arg == "--huge-pages") {
+            params.huge_pages = true;
+        } else if (arg == "--copy-weights") {
+            params.copy_weights = true;
+        } else if (arg == "--warmup") {
+            params.warmup = true;
+        } else if (arg == "--warmup-async") {
+            params.warmup = true;
+            params.warmup_async = true;
         } else if (arg == "--mtest") {
             params.mem_test = true;
         } else if (arg == "--verbose-prompt") {
@@ -221,6 +238,7 @@ void gpt_print_usage(int /*argc*/, char ** argv, const gpt_params & params) {
     fprintf(stderr, "  -c N, --ctx_size N    size of the prompt context (default: %d)\n", params.n_ctx);
     fprintf(stderr, "  --ignore-eos          ignore end of stream token and continue generating\n");
     fprintf(stderr, "  --memory_f32          use f32 instead of f16 for memory key+value\n");
+    fprintf(stderr, "  --memory_type N       type of memory key+value: 0 = f32, 1 = f16, 2 = q4_0, 3 = q4_1, 5 = q4_2, 6 = q4_3, 7 = q8_0, 8 = q2_1, 9 = q3_1\n");
     fprintf(stderr, "  --temp N              temperature (default: %.1f)\n", (double)params.temp);
     fprintf(stderr, "  --n_parts N           number of model parts (default: -1 = determine from dimensions)\n");
     fprintf(stderr, "  -b N, --batch_size N  batch size for prompt processing (default: %d)\n", params.n_batch);
@@ -229,6 +247,11 @@ void gpt_print_usage(int /*argc*/, char ** argv, const gpt_params & params) {
     if (ggml_mlock_supported()) {
         fprintf(stderr, "  --mlock               force system to keep model in RAM rather than swapping or compressing\n");
     }
+    fprintf(stderr, "  --prefault            commit the kv cache and compute buffers at startup, on all cores\n");
+    fprintf(stderr, "  --huge-pages          back the kv cache, compute buffers and copied weights with huge pages\n");
+    fprintf(stderr, "  --copy-weights        copy the weights out of the file mapping into anonymous memory\n");
+    fprintf(stderr, "  --warmup              read the weights into memory at startup, on all cores\n");
+    fprintf(stderr, "  --warmup-async        read the weights into memory in the background while the model is used\n");
     fprintf(stderr, "  --mtest               compute maximum memory usage\n");
     fprintf(stderr, "  --verbose-prompt      print prompt before generation\n");
     fprintf(stderr, "  -m FNAME, --model FNAME\n");
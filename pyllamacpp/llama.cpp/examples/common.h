@@ -22,6 +22,7 @@ struct gpt_params {
     int32_t n_ctx         = 512;  // context size
     int32_t n_batch       = 8;    // batch size for prompt processing
     int32_t n_keep        = 0;    // number of tokens to keep from initial prompt
+    int32_t memory_type   = -1;   // type of the memory kv (-1 = f16 or f32 from memory_f16)
 
     // sampling parameters
     int32_t top_k = 40;
@@ -48,6 +49,11 @@ struct gpt_params {
     bool ignore_eos        = false; // do not stop generating after eos
     bool perplexity        = false; // compute perplexity over the prompt
     bool use_mlock         = false; // use mlock to keep model in memory
+    bool prefault          = false; // commit the kv cache and compute buffers at startup
+    bool huge_pages        = false; // back the kv cache, compute buffers and copied weights with huge pages
+    bool copy_weights      = false; // copy the weights out of the file mapping
+    bool warmup            = false; // read the weights into memory at startup
+    bool warmup_async      = false; // read the weights into memory in the background
     bool mem_test          = false; // compute maximum memory usage
     bool verbose_prompt    = false; // print prompt tokens before generation
 };
@@ -33,13 +33,20 @@ int main(int argc, char ** argv) {
     {
         auto lparams = llama_context_default_params();
 
-        lparams.n_ctx      = params.n_ctx;
-        lparams.n_parts    = params.n_parts;
-        lparams.seed       = params.seed;
-        lparams.f16_kv     = params.memory_f16;
-        lparams.logits_all = params.perplexity;
-        lparams.use_mlock  = params.use_mlock;
-        lparams.embedding  = params.embedding;
+        lparams.n_ctx        = params.n_ctx;
+        lparams.n_batch      = params.n_ctx;
+        lparams.n_parts      = params.n_parts;
+        lparams.seed         = params.seed;
+        lparams.f16_kv       = params.memory_f16;
+        lparams.kv_type      = params.memory_type;
+        lparams.logits_all   = params.perplexity;
+        lparams.use_mlock    = params.use_mlock;
+        lparams.prefault     = params.prefault;
+        lparams.huge_pages   = params.huge_pages;
+        lparams.copy_weights = params.copy_weights;
+        lparams.warmup       = params.warmup;
+        lparams.warmup_async = params.warmup_async;
+        lparams.embedding    = params.embedding;
 
         ctx = llama_init_from_file(params.model.c_str(), lparams);
 
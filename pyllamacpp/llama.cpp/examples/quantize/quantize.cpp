@@ -3,17 +3,44 @@
 
 #include <cstdio>
 #include <string>
+#include <vector>
 
 // usage:
-//  ./llama-quantize models/llama/ggml-model.bin models/llama/ggml-model-quant.bin type
+//  ./llama-quantize [-t threads] models/llama/ggml-model.bin models/llama/ggml-model-quant.bin type [pattern=type ...]
+//
+// the optional rules give the type of the weights whose name matches the pattern, for example
+//  ./llama-quantize ggml-model-f16.bin ggml-model-mixed.bin 2 'output\.weight=7' 'layers\.(0|31)\..*=7'
 //
 int main(int argc, char ** argv) {
     ggml_time_init();
 
-    if (argc != 4) {
-        fprintf(stderr, "usage: %s model-f32.bin model-quant.bin type\n", argv[0]);
+    // all the cores by default
+    int nthread = 0;
+
+    std::vector<char *> args;
+    for (int i = 0; i < argc; i++) {
+        const std::string arg = argv[i];
+        if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+            nthread = atoi(argv[++i]);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    argc = (int) args.size();
+    argv = args.data();
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s [-t threads] model-f32.bin model-quant.bin type [pattern=type ...]\n", argv[0]);
+        fprintf(stderr, "  type = 0 - f32 (in rules only)\n");
+        fprintf(stderr, "  type = 1 - f16 (in rules only)\n");
         fprintf(stderr, "  type = 2 - q4_0\n");
         fprintf(stderr, "  type = 3 - q4_1\n");
+        fprintf(stderr, "  type = 5 - q4_2 (q4_0 with fp16 scales, also converts q4_0 models)\n");
+        fprintf(stderr, "  type = 6 - q4_3 (q4_1 with fp16 scales, also converts q4_1 models)\n");
+        fprintf(stderr, "  type = 7 - q8_0\n");
+        fprintf(stderr, "  type = 8 - q2_1\n");
+        fprintf(stderr, "  type = 9 - q3_1\n");
+        fprintf(stderr, "  pattern   - regex on the tensor names, e.g. 'output\\.weight' or 'layers\\.(0|31)\\..*'\n");
         return 1;
     }
 
@@ -29,6 +56,22 @@ int main(int argc, char ** argv) {
 
     const int itype = atoi(argv[3]);
 
+    std::vector<std::string> patterns;
+    std::vector<llama_quantize_rule> rules;
+    for (int i = 4; i < argc; i++) {
+        const std::string arg = argv[i];
+        const size_t pos = arg.rfind('=');
+        if (pos == std::string::npos || pos == 0) {
+            fprintf(stderr, "%s: invalid rule '%s', expected pattern=type\n", __func__, argv[i]);
+            return 1;
+        }
+        patterns.push_back(arg.substr(0, pos));
+        rules.push_back({ NULL, atoi(arg.c_str() + pos + 1) });
+    }
+    for (size_t i = 0; i < rules.size(); i++) {
+        rules[i].pattern = patterns[i].c_str();
+    }
+
     const int64_t t_main_start_us = ggml_time_us();
 
     int64_t t_quantize_us = 0;
@@ -37,7 +80,7 @@ int main(int argc, char ** argv) {
     {
         const int64_t t_start_us = ggml_time_us();
 
-        if (llama_model_quantize(fname_inp.c_str(), fname_out.c_str(), itype)) {
+        if (llama_model_quantize_plan(fname_inp.c_str(), fname_out.c_str(), itype, rules.data(), (int) rules.size(), nthread)) {
             fprintf(stderr, "%s: failed to quantize model from '%s'\n", __func__, fname_inp.c_str());
             return 1;
         }
@@ -0,0 +1,3029 @@
+// Quantization, fp16 conversion, matrix multiplication and activation kernels - see ggml-kernels.h
+
+#include "ggml-kernels.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+
+// __FMA__ and __F16C__ are not defined in MSVC, however they are implied with AVX2/AVX512
+#if defined(_MSC_VER) && (defined(__AVX2__) || defined(__AVX512F__))
+#ifndef __FMA__
+#define __FMA__
+#endif
+#ifndef __F16C__
+#define __F16C__
+#endif
+#ifndef __SSE3__
+#define __SSE3__
+#endif
+#endif
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__POWER9_VECTOR__)
+#include <altivec.h>
+#undef bool
+#define bool _Bool
+#else
+#include <immintrin.h>
+#endif
+
+#undef MIN
+#undef MAX
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define UNUSED(x) (void)(x)
+
+// single fp16 values, for the scales of the 2-bit and 3-bit blocks
+// without F16C, these use the lookup tables of ggml_init() through the ggml.h API
+static inline float fp16_to_fp32(const ggml_fp16_t x) {
+#if defined(__F16C__) && !defined(_MSC_VER)
+    return _cvtsh_ss(x);
+#else
+    return ggml_fp16_to_fp32(x);
+#endif
+}
+
+static inline ggml_fp16_t fp32_to_fp16(const float x) {
+#if defined(__F16C__) && !defined(_MSC_VER)
+    return _cvtss_sh(x, 0);
+#else
+    return ggml_fp32_to_fp16(x);
+#endif
+}
+
+//
+// quantization
+//
+
+// AVX routines provided by GH user Const-me
+// ref: https://github.com/ggerganov/ggml/pull/27#issuecomment-1464934600
+#if __AVX2__ || __AVX512F__
+// Unpack 32 4-bit fields into 32 bytes
+// The output vector contains 32 bytes, each one in [ 0 .. 15 ] interval
+static inline __m256i bytesFromNibbles( const uint8_t* rsi )
+{
+    // Load 16 bytes from memory
+    __m128i tmp = _mm_loadu_si128( ( const __m128i* )rsi );
+
+    // Expand bytes into uint16_t values
+    __m256i bytes = _mm256_cvtepu8_epi16( tmp );
+
+    // Unpack values into individual bytes
+    const __m256i lowMask = _mm256_set1_epi8( 0xF );
+    __m256i high = _mm256_andnot_si256( lowMask, bytes );
+    __m256i low = _mm256_and_si256( lowMask, bytes );
+    high = _mm256_slli_epi16( high, 4 );
+    bytes = _mm256_or_si256( low, high );
+    return bytes;
+}
+
+static inline __m128i packNibbles( __m256i bytes )
+{
+    // Move bits within 16-bit lanes from 0000_abcd_0000_efgh into 0000_0000_abcd_efgh
+    const __m256i lowByte = _mm256_set1_epi16( 0xFF );
+    __m256i high = _mm256_andnot_si256( lowByte, bytes );
+    __m256i low = _mm256_and_si256( lowByte, bytes );
+    high = _mm256_srli_epi16( high, 4 );
+    bytes = _mm256_or_si256( low, high );
+
+    // Compress uint16_t lanes into bytes
+    __m128i r0 = _mm256_castsi256_si128( bytes );
+    __m128i r1 = _mm256_extracti128_si256( bytes, 1 );
+    return _mm_packus_epi16( r0, r1 );
+}
+
+// Multiply the unsigned bytes of ax with the signed bytes of sy and add each group of 4 products to an int32_t lane of acc
+static inline __m256i mul_add_us8_i32( const __m256i acc, const __m256i ax, const __m256i sy )
+{
+#if defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32( acc, ax, sy );
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpbusd_epi32( acc, ax, sy );
+#else
+    // Perform multiplication and create 16-bit values
+    const __m256i dot = _mm256_maddubs_epi16( ax, sy );
+
+    const __m256i ones = _mm256_set1_epi16( 1 );
+    return _mm256_add_epi32( acc, _mm256_madd_epi16( ones, dot ) );
+#endif
+}
+
+// Multiply the unsigned bytes of ax with the signed bytes of sy and add each group of 4 products into an int32_t lane
+static inline __m256i mul_sum_us8_i32( const __m256i ax, const __m256i sy )
+{
+    return mul_add_us8_i32( _mm256_setzero_si256(), ax, sy );
+}
+
+// Unpack 32 2-bit fields into 32 bytes in [ 0 .. 3 ], with the layout of block_q2_1
+static inline __m256i bytesFrom2Bits( const uint8_t * rsi )
+{
+    uint64_t tmp;
+    memcpy( &tmp, rsi, sizeof( tmp ) );
+
+    // 64-bit lane j shifts the fields of elements 8*j .. 8*j + 7 to the bottom of the bytes
+    const __m256i bytes = _mm256_srlv_epi64( _mm256_set1_epi64x( (int64_t) tmp ), _mm256_set_epi64x( 6, 4, 2, 0 ) );
+    return _mm256_and_si256( bytes, _mm256_set1_epi8( 3 ) );
+}
+
+// Expand 32 bits into 32 bytes, 0xFF where the bit is set and 0x00 elsewhere
+static inline __m256i bytesFromBits( const uint8_t * rsi )
+{
+    uint32_t tmp;
+    memcpy( &tmp, rsi, sizeof( tmp ) );
+
+    // byte l gets the byte of the input that holds bit l
+    const __m256i shuf = _mm256_set_epi64x( 0x0303030303030303, 0x0202020202020202, 0x0101010101010101, 0x0000000000000000 );
+    __m256i bytes = _mm256_shuffle_epi8( _mm256_set1_epi32( (int) tmp ), shuf );
+
+    // set all the other bits of byte l, so that it is all ones iff bit l%8 was set
+    bytes = _mm256_or_si256( bytes, _mm256_set1_epi64x( 0x7fbfdfeff7fbfdfe ) );
+    return _mm256_cmpeq_epi8( bytes, _mm256_set1_epi64x( -1 ) );
+}
+#elif __AVX__
+static inline __m128i bytesFromNibbles( const uint8_t* rsi )
+{
+    // Load 8 bytes from memory
+    __m128i tmp = _mm_loadu_si64( ( const __m128i* )rsi );
+
+    // Expand bytes into uint16_t values
+    __m128i bytes = _mm_cvtepu8_epi16( tmp );
+
+    // Unpack values into individual bytes
+    const __m128i lowMask = _mm_set1_epi8( 0xF );
+    __m128i high = _mm_andnot_si128( lowMask, bytes );
+    __m128i low = _mm_and_si128( lowMask, bytes );
+    high = _mm_slli_epi16( high, 4 );
+    bytes = _mm_or_si128( low, high );
+    return bytes;
+}
+
+static inline __m128i packNibbles( __m128i bytes1, __m128i bytes2 )
+{
+    // Move bits within 16-bit lanes from 0000_abcd_0000_efgh into 0000_0000_abcd_efgh
+    const __m128i lowByte = _mm_set1_epi16( 0xFF );
+    __m128i high = _mm_andnot_si128( lowByte, bytes1 );
+    __m128i low = _mm_and_si128( lowByte, bytes1 );
+    high = _mm_srli_epi16( high, 4 );
+    bytes1 = _mm_or_si128( low, high );
+    high = _mm_andnot_si128( lowByte, bytes2 );
+    low = _mm_and_si128( lowByte, bytes2 );
+    high = _mm_srli_epi16( high, 4 );
+    bytes2 = _mm_or_si128( low, high );
+
+    return _mm_packus_epi16( bytes1, bytes2);
+}
+#endif
+
+// reference implementation for deterministic creation of model files
+static void quantize_row_q4_0_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q4_0 * restrict y = vy;
+
+    uint8_t pp[QK/2];
+
+    for (int i = 0; i < nb; i++) {
+        float amax = 0.0f; // absolute max
+
+        for (int l = 0; l < QK; l++) {
+            const float v = x[i*QK + l];
+            amax = MAX(amax, fabsf(v));
+        }
+
+        const float d = amax / ((1 << 3) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = d;
+
+        for (int l = 0; l < QK; l += 2) {
+            const float v0 = x[i*QK + l + 0]*id;
+            const float v1 = x[i*QK + l + 1]*id;
+
+            const uint8_t vi0 = (int8_t)roundf(v0) + 8;
+            const uint8_t vi1 = (int8_t)roundf(v1) + 8;
+
+            assert(vi0 < 16);
+            assert(vi1 < 16);
+
+            pp[l/2] = vi0 | (vi1 << 4);
+        }
+
+        memcpy(y[i].qs, pp, sizeof(pp));
+    }
+}
+
+static void quantize_row_q4_0(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q4_0 * restrict y = vy;
+
+#if defined(__POWER9_VECTOR__)
+    const vector float v85 = vec_splats(8.5f);
+    for (int i = 0; i < nb; i++) {
+        float amax = 0.0f; // absolute max
+
+        vector float srcv [8];
+        vector float asrcv[8];
+        vector float amaxv[8];
+
+        for (int l = 0; l < 8; l++) srcv[l]  = *(vector float *)(x + i*32 + 4*l);
+        for (int l = 0; l < 8; l++) asrcv[l] = vec_abs(srcv[l]);
+
+        for (int l = 0; l < 4; l++) amaxv[2*l] = vec_max(asrcv[2*l], asrcv[2*l+1]);
+        //for (int l = 0; l < 2; l++) amaxv[4*l] = vec_max(amaxv[4*l], amaxv[4*l+2]);
+        amaxv[0] = vec_max(amaxv[0], amaxv[2]);
+        amaxv[4] = vec_max(amaxv[4], amaxv[6]);
+        //for (int l = 0; l < 1; l++) amaxv[8*l] = vec_max(amaxv[8*l], amaxv[8*l+4]);
+        amaxv[0] = vec_max(amaxv[0], amaxv[4]);
+
+        amax = MAX(
+                MAX(vec_extract(amaxv[0], 0), vec_extract(amaxv[0], 1)),
+                MAX(vec_extract(amaxv[0], 2), vec_extract(amaxv[0], 3)));
+
+        const float d = amax / ((1 << 3) - 1);
+        const float id = d ? 1.0/d : 0.0;
+
+        y[i].d = d;
+
+        const vector float vid = vec_splats(id);
+        uint8_t * restrict pb = y[i].qs;
+        for (int l = 0; l < 8; l++) {
+            const vector float vf  = vec_madd(srcv[l], vid, v85);
+            const vector signed int vi = vec_signed(vf);
+
+            pb[2*l + 0] = vec_extract(vi, 0) | (vec_extract(vi, 1) << 4);
+            pb[2*l + 1] = vec_extract(vi, 2) | (vec_extract(vi, 3) << 4);
+        }
+    }
+#elif __ARM_NEON
+    for (int i = 0; i < nb; i++) {
+        float32x4_t srcv [8];
+        float32x4_t asrcv[8];
+        float32x4_t amaxv[8];
+
+        for (int l = 0; l < 8; l++) srcv[l]  = vld1q_f32(x + i*32 + 4*l);
+        for (int l = 0; l < 8; l++) asrcv[l] = vabsq_f32(srcv[l]);
+
+        for (int l = 0; l < 4; l++) amaxv[2*l] = vmaxq_f32(asrcv[2*l], asrcv[2*l+1]);
+        for (int l = 0; l < 2; l++) amaxv[4*l] = vmaxq_f32(amaxv[4*l], amaxv[4*l+2]);
+        for (int l = 0; l < 1; l++) amaxv[8*l] = vmaxq_f32(amaxv[8*l], amaxv[8*l+4]);
+
+        // absolute max
+        const float amax = MAX(
+                MAX(vgetq_lane_f32(amaxv[0], 0), vgetq_lane_f32(amaxv[0], 1)),
+                MAX(vgetq_lane_f32(amaxv[0], 2), vgetq_lane_f32(amaxv[0], 3)));
+
+        const float d = amax / ((1 << 3) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = d;
+
+        for (int l = 0; l < 8; l++) {
+            const float32x4_t v  = vmulq_n_f32(srcv[l], id);
+            const float32x4_t vf = vaddq_f32(v, vdupq_n_f32(8.5f));
+            const int32x4_t   vi = vcvtq_s32_f32(vf);
+
+            y[i].qs[2*l + 0] = vgetq_lane_s32(vi, 0) | (vgetq_lane_s32(vi, 1) << 4);
+            y[i].qs[2*l + 1] = vgetq_lane_s32(vi, 2) | (vgetq_lane_s32(vi, 3) << 4);
+        }
+    }
+#elif defined(__AVX2__)
+    for (int i = 0; i < nb; i++) {
+        // Load elements into 4 AVX vectors
+        __m256 v0 = _mm256_loadu_ps( x );
+        __m256 v1 = _mm256_loadu_ps( x + 8 );
+        __m256 v2 = _mm256_loadu_ps( x + 16 );
+        __m256 v3 = _mm256_loadu_ps( x + 24 );
+        x += 32;
+
+        // Compute max(abs(e)) for the block
+        const __m256 signBit = _mm256_set1_ps( -0.0f );
+        __m256 maxAbs = _mm256_andnot_ps( signBit, v0 );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v1 ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v2 ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v3 ) );
+
+        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
+        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
+        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
+        const float maxScalar = _mm_cvtss_f32( max4 );
+
+        // Quantize these floats
+        const float d = maxScalar / 7.0f;
+        y[i].d = d;
+        const float id = ( maxScalar != 0.0f ) ? 7.0f / maxScalar : 0.0f;
+        const __m256 mul = _mm256_set1_ps( id );
+
+        // Apply the multiplier
+        v0 = _mm256_mul_ps( v0, mul );
+        v1 = _mm256_mul_ps( v1, mul );
+        v2 = _mm256_mul_ps( v2, mul );
+        v3 = _mm256_mul_ps( v3, mul );
+
+        // Round to nearest integer
+        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
+        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
+        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
+        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
+
+        // Convert floats to integers
+        __m256i i0 = _mm256_cvtps_epi32( v0 );
+        __m256i i1 = _mm256_cvtps_epi32( v1 );
+        __m256i i2 = _mm256_cvtps_epi32( v2 );
+        __m256i i3 = _mm256_cvtps_epi32( v3 );
+
+        // Convert int32 to int16
+        i0 = _mm256_packs_epi32( i0, i1 );	// 0, 1, 2, 3,  8, 9, 10, 11,  4, 5, 6, 7, 12, 13, 14, 15
+        i2 = _mm256_packs_epi32( i2, i3 );	// 16, 17, 18, 19,  24, 25, 26, 27,  20, 21, 22, 23, 28, 29, 30, 31
+                                            // Convert int16 to int8
+        i0 = _mm256_packs_epi16( i0, i2 );	// 0, 1, 2, 3,  8, 9, 10, 11,  16, 17, 18, 19,  24, 25, 26, 27,  4, 5, 6, 7, 12, 13, 14, 15, 20, 21, 22, 23, 28, 29, 30, 31
+
+        // We got our precious signed bytes, but the order is now wrong
+        // These AVX2 pack instructions process 16-byte pieces independently
+        // The following instruction is fixing the order
+        const __m256i perm = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+        i0 = _mm256_permutevar8x32_epi32( i0, perm );
+
+        // Apply offset to translate the range from [ -7 .. +7 ] into [ +1 .. +15 ]
+        const __m256i off = _mm256_set1_epi8( 8 );
+        i0 = _mm256_add_epi8( i0, off );
+
+        // Compress the vector into 4 bit/value, and store
+        __m128i res = packNibbles( i0 );
+        _mm_storeu_si128( ( __m128i* )y[i].qs, res );
+    }
+#elif defined(__AVX__)
+    for (int i = 0; i < nb; i++) {
+        // Load elements into 4 AVX vectors
+        __m256 v0 = _mm256_loadu_ps( x );
+        __m256 v1 = _mm256_loadu_ps( x + 8 );
+        __m256 v2 = _mm256_loadu_ps( x + 16 );
+        __m256 v3 = _mm256_loadu_ps( x + 24 );
+        x += 32;
+
+        // Compute max(abs(e)) for the block
+        const __m256 signBit = _mm256_set1_ps( -0.0f );
+        __m256 maxAbs = _mm256_andnot_ps( signBit, v0 );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v1 ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v2 ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v3 ) );
+
+        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
+        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
+        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
+        const float maxScalar = _mm_cvtss_f32( max4 );
+
+        // Quantize these floats
+        const float d = maxScalar / 7.0f;
+        y[i].d = d;
+        const float id = ( maxScalar != 0.0f ) ? 7.0f / maxScalar : 0.0f;
+        const __m256 mul = _mm256_set1_ps( id );
+
+        // Apply the multiplier
+        v0 = _mm256_mul_ps( v0, mul );
+        v1 = _mm256_mul_ps( v1, mul );
+        v2 = _mm256_mul_ps( v2, mul );
+        v3 = _mm256_mul_ps( v3, mul );
+
+        // Round to nearest integer
+        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
+        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
+        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
+        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
+
+        // Convert floats to integers
+        __m256i i0 = _mm256_cvtps_epi32( v0 );
+        __m256i i1 = _mm256_cvtps_epi32( v1 );
+        __m256i i2 = _mm256_cvtps_epi32( v2 );
+        __m256i i3 = _mm256_cvtps_epi32( v3 );
+
+        // Since we don't have in AVX some necessary functions,
+        // we split the registers in half and call AVX2 analogs from SSE
+        __m128i ni0 = _mm256_castsi256_si128( i0 );
+        __m128i ni1 = _mm256_extractf128_si256( i0, 1);
+        __m128i ni2 = _mm256_castsi256_si128( i1 );
+        __m128i ni3 = _mm256_extractf128_si256( i1, 1);
+        __m128i ni4 = _mm256_castsi256_si128( i2 );
+        __m128i ni5 = _mm256_extractf128_si256( i2, 1);
+        __m128i ni6 = _mm256_castsi256_si128( i3 );
+        __m128i ni7 = _mm256_extractf128_si256( i3, 1);
+
+        // Convert int32 to int16
+        ni0 = _mm_packs_epi32( ni0, ni1 );
+        ni2 = _mm_packs_epi32( ni2, ni3 );
+        ni4 = _mm_packs_epi32( ni4, ni5 );
+        ni6 = _mm_packs_epi32( ni6, ni7 );
+        // Convert int16 to int8
+        ni0 = _mm_packs_epi16( ni0, ni2 );
+        ni4 = _mm_packs_epi16( ni4, ni6 );
+
+        // Apply offset to translate the range from [ -7 .. +7 ] into [ +1 .. +15 ]
+        const __m128i off = _mm_set1_epi8( 8);
+        ni0 = _mm_add_epi8( ni0, off );
+        ni4 = _mm_add_epi8( ni4, off );
+
+        // Compress the vector into 4 bit/value, and store
+        __m128i res = packNibbles( ni0, ni4 );
+        _mm_storeu_si128( ( __m128i* )y[i].qs, res );
+    }
+#elif defined(__wasm_simd128__)
+    for (int i = 0; i < nb; i++) {
+        float amax = 0.0f; // absolute max
+
+        v128_t srcv [8];
+        v128_t asrcv[8];
+        v128_t amaxv[8];
+
+        for (int l = 0; l < 8; l++) srcv[l]  = wasm_v128_load(x + i*32 + 4*l);
+        for (int l = 0; l < 8; l++) asrcv[l] = wasm_f32x4_abs(srcv[l]);
+
+        for (int l = 0; l < 4; l++) amaxv[2*l] = wasm_f32x4_max(asrcv[2*l], asrcv[2*l+1]);
+        for (int l = 0; l < 2; l++) amaxv[4*l] = wasm_f32x4_max(amaxv[4*l], amaxv[4*l+2]);
+        for (int l = 0; l < 1; l++) amaxv[8*l] = wasm_f32x4_max(amaxv[8*l], amaxv[8*l+4]);
+
+        amax = MAX(
+                MAX(wasm_f32x4_extract_lane(amaxv[0], 0), wasm_f32x4_extract_lane(amaxv[0], 1)),
+                MAX(wasm_f32x4_extract_lane(amaxv[0], 2), wasm_f32x4_extract_lane(amaxv[0], 3)));
+
+        const float d = amax / ((1 << 3) - 1);
+        const float id = d ? 1.0/d : 0.0;
+
+        y[i].d = d;
+
+        for (int l = 0; l < 8; l++) {
+            const v128_t v  = wasm_f32x4_mul(srcv[l], wasm_f32x4_splat(id));
+            const v128_t vf = wasm_f32x4_add(v, wasm_f32x4_splat(8.5f));
+            const v128_t vi = wasm_i32x4_trunc_sat_f32x4(vf);
+
+            y[i].qs[2*l + 0] = wasm_i32x4_extract_lane(vi, 0) | (wasm_i32x4_extract_lane(vi, 1) << 4);
+            y[i].qs[2*l + 1] = wasm_i32x4_extract_lane(vi, 2) | (wasm_i32x4_extract_lane(vi, 3) << 4);
+        }
+    }
+#else
+    // scalar
+    UNUSED(nb);
+    quantize_row_q4_0_reference(x, y, k);
+#endif
+}
+
+static void quantize_row_q4_1_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q4_1 * restrict y = vy;
+
+    uint8_t pp[QK/2];
+
+    for (int i = 0; i < nb; i++) {
+        float min = FLT_MAX;
+        float max = -FLT_MAX;
+
+        for (int l = 0; l < QK; l++) {
+            const float v = x[i*QK + l];
+            if (v < min) min = v;
+            if (v > max) max = v;
+        }
+
+        const float d = (max - min) / ((1 << 4) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = d;
+        y[i].m = min;
+
+        for (int l = 0; l < QK; l += 2) {
+            const float v0 = (x[i*QK + l + 0] - min)*id;
+            const float v1 = (x[i*QK + l + 1] - min)*id;
+
+            const uint8_t vi0 = roundf(v0);
+            const uint8_t vi1 = roundf(v1);
+
+            assert(vi0 < 16);
+            assert(vi1 < 16);
+
+            pp[l/2] = vi0 | (vi1 << 4);
+        }
+
+        memcpy(y[i].qs, pp, sizeof(pp));
+    }
+}
+
+static void quantize_row_q4_1(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+
+    const int nb = k / QK;
+
+    block_q4_1 * restrict y = vy;
+
+#if defined(__AVX2__)
+    for (int i = 0; i < nb; i++) {
+        // Load elements into 4 AVX vectors
+        __m256 v0 = _mm256_loadu_ps( x );
+        __m256 v1 = _mm256_loadu_ps( x + 8 );
+        __m256 v2 = _mm256_loadu_ps( x + 16 );
+        __m256 v3 = _mm256_loadu_ps( x + 24 );
+        x += 32;
+
+        // Compute max for the block
+        __m256 vmax;
+        vmax = _mm256_max_ps( v0, v1 );
+        vmax = _mm256_max_ps( vmax, v2 );
+        vmax = _mm256_max_ps( vmax, v3 );
+
+        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( vmax, 1 ), _mm256_castps256_ps128( vmax ) );
+        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
+        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
+        const float maxScalar = _mm_cvtss_f32( max4 );
+
+        // Compute min for the block
+        __m256 vmin;
+        vmin = _mm256_min_ps( v0, v1 );
+        vmin = _mm256_min_ps( vmin, v2 );
+        vmin = _mm256_min_ps( vmin, v3 );
+
+        __m128 min4 = _mm_min_ps( _mm256_extractf128_ps( vmin, 1 ), _mm256_castps256_ps128( vmin ) );
+        min4 = _mm_min_ps( min4, _mm_movehl_ps( min4, min4 ) );
+        min4 = _mm_min_ss( min4, _mm_movehdup_ps( min4 ) );
+        const float minScalar = _mm_cvtss_f32( min4 );
+
+        // Quantize these floats
+        const float d = (maxScalar - minScalar) / ((1 << 4) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].m = minScalar;
+        y[i].d = d;
+
+        // x = (x-min)*id
+        const __m256 mul = _mm256_set1_ps( id );
+        const __m256 off = _mm256_set1_ps( minScalar );
+        v0 = _mm256_mul_ps( _mm256_sub_ps( v0, off ), mul );
+        v1 = _mm256_mul_ps( _mm256_sub_ps( v1, off ), mul );
+        v2 = _mm256_mul_ps( _mm256_sub_ps( v2, off ), mul );
+        v3 = _mm256_mul_ps( _mm256_sub_ps( v3, off ), mul );
+
+        // Round to nearest integer
+        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
+        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
+        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
+        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
+
+        // Convert floats to integers
+        __m256i i0 = _mm256_cvtps_epi32( v0 );
+        __m256i i1 = _mm256_cvtps_epi32( v1 );
+        __m256i i2 = _mm256_cvtps_epi32( v2 );
+        __m256i i3 = _mm256_cvtps_epi32( v3 );
+
+        // Convert int32 to int16
+        i0 = _mm256_packs_epi32( i0, i1 );	// 0, 1, 2, 3,  8, 9, 10, 11,  4, 5, 6, 7, 12, 13, 14, 15
+        i2 = _mm256_packs_epi32( i2, i3 );	// 16, 17, 18, 19,  24, 25, 26, 27,  20, 21, 22, 23, 28, 29, 30, 31
+                                            // Convert int16 to int8
+        i0 = _mm256_packs_epi16( i0, i2 );	// 0, 1, 2, 3,  8, 9, 10, 11,  16, 17, 18, 19,  24, 25, 26, 27,  4, 5, 6, 7, 12, 13, 14, 15, 20, 21, 22, 23, 28, 29, 30, 31
+
+        // We got our precious signed bytes, but the order is now wrong
+        // These AVX2 pack instructions process 16-byte pieces independently
+        // The following instruction is fixing the order
+        const __m256i perm = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+        i0 = _mm256_permutevar8x32_epi32( i0, perm );
+
+        // Compress the vector into 4 bit/value, and store
+        __m128i res = packNibbles( i0 );
+        _mm_storeu_si128( ( __m128i* )y[i].qs, res );
+    }
+#elif __ARM_NEON
+    for (int i = 0; i < nb; i++) {
+        float32x4_t srcv[8];
+        float32x4_t minv[8];
+        float32x4_t maxv[8];
+
+        for (int l = 0; l < 8; l++) srcv[l] = vld1q_f32(x + i*32 + 4*l);
+
+        for (int l = 0; l < 4; l++) minv[2*l] = vminq_f32(srcv[2*l], srcv[2*l + 1]);
+        for (int l = 0; l < 2; l++) minv[4*l] = vminq_f32(minv[4*l], minv[4*l + 2]);
+        for (int l = 0; l < 1; l++) minv[8*l] = vminq_f32(minv[8*l], minv[8*l + 4]);
+
+        for (int l = 0; l < 4; l++) maxv[2*l] = vmaxq_f32(srcv[2*l], srcv[2*l + 1]);
+        for (int l = 0; l < 2; l++) maxv[4*l] = vmaxq_f32(maxv[4*l], maxv[4*l + 2]);
+        for (int l = 0; l < 1; l++) maxv[8*l] = vmaxq_f32(maxv[8*l], maxv[8*l + 4]);
+
+        const float min = vminvq_f32(minv[0]);
+        const float max = vmaxvq_f32(maxv[0]);
+
+        const float d = (max - min) / ((1 << 4) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = d;
+        y[i].m = min;
+
+        const float32x4_t minv0 = vdupq_n_f32(min);
+
+        for (int l = 0; l < 8; l++) {
+            const float32x4_t v  = vmulq_n_f32(vsubq_f32(srcv[l], minv0), id);
+            const int32x4_t   vi = vcvtq_s32_f32(v);
+
+            y[i].qs[2*l + 0] = vgetq_lane_s32(vi, 0) | (vgetq_lane_s32(vi, 1) << 4);
+            y[i].qs[2*l + 1] = vgetq_lane_s32(vi, 2) | (vgetq_lane_s32(vi, 3) << 4);
+        }
+    }
+#else
+    // scalar
+    UNUSED(nb);
+    UNUSED(y);
+    quantize_row_q4_1_reference(x, vy, k);
+#endif
+}
+
+// reference implementation for deterministic creation of model files
+static void quantize_row_q8_0_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q8_0 * restrict y = vy;
+
+    for (int i = 0; i < nb; i++) {
+        float amax = 0.0f; // absolute max
+
+        for (int l = 0; l < QK; l++) {
+            const float v = x[i*QK + l];
+            amax = MAX(amax, fabsf(v));
+        }
+
+        const float d = amax / ((1 << 7) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = d;
+
+        for (int l = 0; l < QK; ++l) {
+            const float v = x[i*QK + l]*id;
+            y[i].qs[l] = roundf(v);
+        }
+    }
+}
+
+static void quantize_row_q8_0(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q8_0 * restrict y = vy;
+
+#if defined(__ARM_NEON)
+    for (int i = 0; i < nb; i++) {
+        float32x4_t srcv [8];
+        float32x4_t asrcv[8];
+        float32x4_t amaxv[8];
+
+        for (int l = 0; l < 8; l++) srcv[l]  = vld1q_f32(x + i*32 + 4*l);
+        for (int l = 0; l < 8; l++) asrcv[l] = vabsq_f32(srcv[l]);
+
+        for (int l = 0; l < 4; l++) amaxv[2*l] = vmaxq_f32(asrcv[2*l], asrcv[2*l+1]);
+        for (int l = 0; l < 2; l++) amaxv[4*l] = vmaxq_f32(amaxv[4*l], amaxv[4*l+2]);
+        for (int l = 0; l < 1; l++) amaxv[8*l] = vmaxq_f32(amaxv[8*l], amaxv[8*l+4]);
+
+        const float amax = vmaxvq_f32(amaxv[0]);
+
+        const float d = amax / ((1 << 7) - 1);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = d;
+
+        for (int l = 0; l < 8; l++) {
+            const float32x4_t v  = vmulq_n_f32(srcv[l], id);
+            const int32x4_t   vi = vcvtnq_s32_f32(v);
+
+            y[i].qs[4*l + 0] = vgetq_lane_s32(vi, 0);
+            y[i].qs[4*l + 1] = vgetq_lane_s32(vi, 1);
+            y[i].qs[4*l + 2] = vgetq_lane_s32(vi, 2);
+            y[i].qs[4*l + 3] = vgetq_lane_s32(vi, 3);
+        }
+    }
+#elif defined(__AVX2__) || defined(__AVX__)
+    for (int i = 0; i < nb; i++) {
+        // Load elements into 4 AVX vectors
+        __m256 v0 = _mm256_loadu_ps( x );
+        __m256 v1 = _mm256_loadu_ps( x + 8 );
+        __m256 v2 = _mm256_loadu_ps( x + 16 );
+        __m256 v3 = _mm256_loadu_ps( x + 24 );
+        x += 32;
+
+        // Compute max(abs(e)) for the block
+        const __m256 signBit = _mm256_set1_ps( -0.0f );
+        __m256 maxAbs = _mm256_andnot_ps( signBit, v0 );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v1 ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v2 ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v3 ) );
+
+        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
+        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
+        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
+        const float maxScalar = _mm_cvtss_f32( max4 );
+
+        // Quantize these floats
+        const float d = maxScalar / 127.f;
+        y[i].d = d;
+        const float id = ( maxScalar != 0.0f ) ? 127.f / maxScalar : 0.0f;
+        const __m256 mul = _mm256_set1_ps( id );
+
+        // Apply the multiplier
+        v0 = _mm256_mul_ps( v0, mul );
+        v1 = _mm256_mul_ps( v1, mul );
+        v2 = _mm256_mul_ps( v2, mul );
+        v3 = _mm256_mul_ps( v3, mul );
+
+        // Round to nearest integer
+        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
+        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
+        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
+        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
+
+        // Convert floats to integers
+        __m256i i0 = _mm256_cvtps_epi32( v0 );
+        __m256i i1 = _mm256_cvtps_epi32( v1 );
+        __m256i i2 = _mm256_cvtps_epi32( v2 );
+        __m256i i3 = _mm256_cvtps_epi32( v3 );
+
+#if defined(__AVX2__)
+        // Convert int32 to int16
+        i0 = _mm256_packs_epi32( i0, i1 );	// 0, 1, 2, 3,  8, 9, 10, 11,  4, 5, 6, 7, 12, 13, 14, 15
+        i2 = _mm256_packs_epi32( i2, i3 );	// 16, 17, 18, 19,  24, 25, 26, 27,  20, 21, 22, 23, 28, 29, 30, 31
+                                            // Convert int16 to int8
+        i0 = _mm256_packs_epi16( i0, i2 );	// 0, 1, 2, 3,  8, 9, 10, 11,  16, 17, 18, 19,  24, 25, 26, 27,  4, 5, 6, 7, 12, 13, 14, 15, 20, 21, 22, 23, 28, 29, 30, 31
+
+        // We got our precious signed bytes, but the order is now wrong
+        // These AVX2 pack instructions process 16-byte pieces independently
+        // The following instruction is fixing the order
+        const __m256i perm = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+        i0 = _mm256_permutevar8x32_epi32( i0, perm );
+
+        _mm256_storeu_si256((__m256i *)y[i].qs, i0);
+#else
+        // Since we don't have in AVX some necessary functions,
+        // we split the registers in half and call AVX2 analogs from SSE
+        __m128i ni0 = _mm256_castsi256_si128( i0 );
+        __m128i ni1 = _mm256_extractf128_si256( i0, 1);
+        __m128i ni2 = _mm256_castsi256_si128( i1 );
+        __m128i ni3 = _mm256_extractf128_si256( i1, 1);
+        __m128i ni4 = _mm256_castsi256_si128( i2 );
+        __m128i ni5 = _mm256_extractf128_si256( i2, 1);
+        __m128i ni6 = _mm256_castsi256_si128( i3 );
+        __m128i ni7 = _mm256_extractf128_si256( i3, 1);
+
+        // Convert int32 to int16
+        ni0 = _mm_packs_epi32( ni0, ni1 );
+        ni2 = _mm_packs_epi32( ni2, ni3 );
+        ni4 = _mm_packs_epi32( ni4, ni5 );
+        ni6 = _mm_packs_epi32( ni6, ni7 );
+        // Convert int16 to int8
+        ni0 = _mm_packs_epi16( ni0, ni2 );
+        ni4 = _mm_packs_epi16( ni4, ni6 );
+
+        _mm_storeu_si128((__m128i *)(y[i].qs +  0), ni0);
+        _mm_storeu_si128((__m128i *)(y[i].qs + 16), ni4);
+#endif
+    }
+#else
+    // scalar
+    UNUSED(nb);
+    quantize_row_q8_0_reference(x, y, k);
+#endif
+}
+
+// quantize_row_q4_0_reference with the delta rounded to fp16 first, so that the quants are rounded with the stored delta
+static void quantize_row_q4_2_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q4_2 * restrict y = vy;
+
+    for (int i = 0; i < nb; i++) {
+        float amax = 0.0f; // absolute max
+
+        for (int l = 0; l < QK; l++) {
+            amax = MAX(amax, fabsf(x[i*QK + l]));
+        }
+
+        y[i].d = fp32_to_fp16(amax / ((1 << 3) - 1));
+
+        const float d  = fp16_to_fp32(y[i].d);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        for (int l = 0; l < QK; l += 2) {
+            const int vi0 = MIN(15, MAX(0, (int) roundf(x[i*QK + l + 0]*id) + 8));
+            const int vi1 = MIN(15, MAX(0, (int) roundf(x[i*QK + l + 1]*id) + 8));
+
+            y[i].qs[l/2] = vi0 | (vi1 << 4);
+        }
+    }
+}
+
+// quantize_row_q4_1_reference with the delta and min rounded to fp16 first
+static void quantize_row_q4_3_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q4_3 * restrict y = vy;
+
+    for (int i = 0; i < nb; i++) {
+        float min = FLT_MAX;
+        float max = -FLT_MAX;
+
+        for (int l = 0; l < QK; l++) {
+            min = MIN(min, x[i*QK + l]);
+            max = MAX(max, x[i*QK + l]);
+        }
+
+        y[i].d = fp32_to_fp16((max - min) / ((1 << 4) - 1));
+        y[i].m = fp32_to_fp16(min);
+
+        const float d  = fp16_to_fp32(y[i].d);
+        const float m  = fp16_to_fp32(y[i].m);
+        const float id = d ? 1.0f/d : 0.0f;
+
+        for (int l = 0; l < QK; l += 2) {
+            const int vi0 = MIN(15, MAX(0, (int) roundf((x[i*QK + l + 0] - m)*id)));
+            const int vi1 = MIN(15, MAX(0, (int) roundf((x[i*QK + l + 1] - m)*id)));
+
+            y[i].qs[l/2] = vi0 | (vi1 << 4);
+        }
+    }
+}
+
+// fits the QK values of x as d*q + m with q in [0, nmax]
+// starts from the min/max fit, then alternates between rounding the quants and a least squares fit of d and m while
+// the error decreases - with 4 or 8 levels, the min/max fit spends too many of them on the outliers of the block
+static void quantize_block_min_delta(const float * restrict x, const int nmax, uint8_t * restrict q, ggml_fp16_t * restrict pd, ggml_fp16_t * restrict pm) {
+    float min = x[0];
+    float max = x[0];
+
+    for (int l = 1; l < QK; l++) {
+        min = MIN(min, x[l]);
+        max = MAX(max, x[l]);
+    }
+
+    float d = (max - min) / nmax;
+    float m = min;
+
+    float err_best = FLT_MAX;
+    float d_best   = d;
+    float m_best   = m;
+
+    for (int iter = 0; iter < 5 && d > 0.0f; iter++) {
+        const float id = 1.0f/d;
+
+        int   sq  = 0;
+        int   sqq = 0;
+        float sx  = 0.0f;
+        float sqx = 0.0f;
+        float err = 0.0f;
+
+        for (int l = 0; l < QK; l++) {
+            const int vi = MIN(nmax, MAX(0, (int) roundf((x[l] - m)*id)));
+            const float diff = d*vi + m - x[l];
+
+            err += diff*diff;
+            sq  += vi;
+            sqq += vi*vi;
+            sx  += x[l];
+            sqx += vi*x[l];
+        }
+
+        if (err >= err_best) {
+            break;
+        }
+
+        err_best = err;
+        d_best   = d;
+        m_best   = m;
+
+        // least squares d and m for these quants
+        const int det = QK*sqq - sq*sq;
+        if (det <= 0) {
+            break;
+        }
+
+        d = (QK*sqx - sq*sx)/det;
+        m = (sx - d*sq)/QK;
+    }
+
+    d = d_best;
+    m = m_best;
+
+    // the quants are rounded with the fp16 values of the scales
+    *pd = fp32_to_fp16(d);
+    *pm = fp32_to_fp16(m);
+
+    const float df = fp16_to_fp32(*pd);
+    const float mf = fp16_to_fp32(*pm);
+    const float id = df ? 1.0f/df : 0.0f;
+
+    for (int l = 0; l < QK; l++) {
+        q[l] = MIN(nmax, MAX(0, (int) roundf((x[l] - mf)*id)));
+    }
+}
+
+// reference implementation for deterministic creation of model files
+static void quantize_row_q2_1_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q2_1 * restrict y = vy;
+
+    uint8_t q[QK];
+
+    for (int i = 0; i < nb; i++) {
+        quantize_block_min_delta(x + i*QK, 3, q, &y[i].d, &y[i].m);
+
+        for (int j = 0; j < QK/4; j++) {
+            y[i].qs[j] = q[j] | (q[j + 8] << 2) | (q[j + 16] << 4) | (q[j + 24] << 6);
+        }
+    }
+}
+
+// reference implementation for deterministic creation of model files
+static void quantize_row_q3_1_reference(const float * restrict x, void * restrict vy, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    block_q3_1 * restrict y = vy;
+
+    uint8_t q[QK];
+
+    for (int i = 0; i < nb; i++) {
+        quantize_block_min_delta(x + i*QK, 7, q, &y[i].d, &y[i].m);
+
+        for (int j = 0; j < QK/4; j++) {
+            y[i].qs[j] = (q[j] & 3) | ((q[j + 8] & 3) << 2) | ((q[j + 16] & 3) << 4) | ((q[j + 24] & 3) << 6);
+        }
+
+        memset(y[i].qh, 0, sizeof(y[i].qh));
+        for (int l = 0; l < QK; l++) {
+            y[i].qh[l/8] |= (q[l] >> 2) << (l%8);
+        }
+    }
+}
+
+static void dequantize_row_q4_0(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q4_0 * restrict x = vx;
+
+#if defined(__AVX512F__)
+    for (int i = 0; i < nb; i++) {
+        // scale factor
+        const __m512 d_v = _mm512_set1_ps(x[i].d);
+
+        // Load 32x4-bit integers into 32x8-bit integers and subtract 8
+        const __m256i vx8 = _mm256_sub_epi8(bytesFromNibbles(x[i].qs), _mm256_set1_epi8(8));
+
+        // Convert to 32-bit int -> float 32, scale and store
+        const __m512 vf0 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm256_castsi256_si128(vx8)));
+        const __m512 vf1 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm256_extracti128_si256(vx8, 1)));
+
+        _mm512_storeu_ps(y + i*QK +  0, _mm512_mul_ps(vf0, d_v));
+        _mm512_storeu_ps(y + i*QK + 16, _mm512_mul_ps(vf1, d_v));
+    }
+#elif defined(__AVX2__)
+    for (int i = 0; i < nb; i++) {
+        // scale factor
+        const __m256 d_v = _mm256_broadcast_ss(&x[i].d);
+
+        const uint8_t * restrict pp = x[i].qs;
+
+        for (int l = 0; l < QK; l += 32) {
+            // Load 32x4-bit integers into 32x8-bit integers
+            __m256i vx8 = bytesFromNibbles(pp+l/2);
+
+            // Subtract 8 from the integers
+            vx8 = _mm256_sub_epi8(vx8, _mm256_set1_epi8(8));
+
+            // Convert to 16-bit int
+            const __m256i vx16_lo = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 0));
+            const __m256i vx16_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 1));
+
+            // Convert to 32-bit int -> float 32
+            const __m256 vf[4] = {
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 0))),
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 1))),
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 0))),
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 1)))
+            };
+
+            // Scale and store
+            for (int j = 0; j < 4; j++) {
+                const __m256 result = _mm256_mul_ps(vf[j], d_v);
+                _mm256_storeu_ps(y + i * QK + l + j*8, result);
+            }
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (int i = 0; i < nb; i++) {
+        const float32x4_t vd = vdupq_n_f32(x[i].d);
+
+        const uint8_t * restrict pp = x[i].qs;
+
+        for (int l = 0; l < QK; l += 16) {
+            // Load 16x4-bit integers into 8x8-bit integers
+            const uint8x8_t v8 = vld1_u8(pp + l/2);
+
+            // Expand 4-bit qs to 8-bit bytes
+            const uint8x8_t v0 = vand_u8(v8, vdup_n_u8(0x0f));
+            const uint8x8_t v1 = vshr_n_u8(v8, 4);
+
+            // Convert to signed 8-bit integers
+            const int8x8_t vs_0 = vreinterpret_s8_u8(v0);
+            const int8x8_t vs_1 = vreinterpret_s8_u8(v1);
+
+            // Subtract 8 from each byte
+            const int8x8_t vb_0 = vsub_s8(vs_0, vdup_n_s8(8));
+            const int8x8_t vb_1 = vsub_s8(vs_1, vdup_n_s8(8));
+
+            // Interleave and combine
+            const int8x8_t vx_0 = vzip1_s8(vb_0, vb_1);
+            const int8x8_t vx_1 = vzip2_s8(vb_0, vb_1);
+
+            const int8x16_t vq = vcombine_s8(vx_0, vx_1);
+
+            // convert to 2x int16x8_t
+            const int16x8_t vi_0 = vmovl_s8(vget_low_s8 (vq));
+            const int16x8_t vi_1 = vmovl_s8(vget_high_s8(vq));
+
+            // convert to 4x float32x4_t
+            const float32x4_t vf_0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16 (vi_0)));
+            const float32x4_t vf_1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi_0)));
+            const float32x4_t vf_2 = vcvtq_f32_s32(vmovl_s16(vget_low_s16 (vi_1)));
+            const float32x4_t vf_3 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi_1)));
+
+            // Multiply by d
+            const float32x4_t r0 = vmulq_f32(vf_0, vd);
+            const float32x4_t r1 = vmulq_f32(vf_1, vd);
+            const float32x4_t r2 = vmulq_f32(vf_2, vd);
+            const float32x4_t r3 = vmulq_f32(vf_3, vd);
+
+            // Store
+            vst1q_f32(y + i*QK + l +  0, r0);
+            vst1q_f32(y + i*QK + l +  4, r1);
+            vst1q_f32(y + i*QK + l +  8, r2);
+            vst1q_f32(y + i*QK + l + 12, r3);
+        }
+    }
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d = x[i].d;
+
+        const uint8_t * restrict pp = x[i].qs;
+
+        for (int l = 0; l < QK; l += 2) {
+            const uint8_t vi = pp[l/2];
+
+            const int8_t vi0 = vi & 0xf;
+            const int8_t vi1 = vi >> 4;
+
+            const float v0 = (vi0 - 8)*d;
+            const float v1 = (vi1 - 8)*d;
+
+            //printf("d = %f, vi = %d, vi0 = %d, vi1 = %d, v0 = %f, v1 = %f\n", d, vi, vi0, vi1, v0, v1);
+
+            y[i*QK + l + 0] = v0;
+            y[i*QK + l + 1] = v1;
+
+            assert(!isnan(y[i*QK + l + 0]));
+            assert(!isnan(y[i*QK + l + 1]));
+        }
+    }
+#endif
+}
+
+static void dequantize_row_q4_1(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q4_1 * restrict x = vx;
+
+#if defined(__AVX512F__)
+    for (int i = 0; i < nb; i++) {
+        const __m512 d_v = _mm512_set1_ps(x[i].d);
+        const __m512 d_m = _mm512_set1_ps(x[i].m);
+
+        // Load 32x4-bit integers into 32x8-bit integers
+        const __m256i vx8 = bytesFromNibbles(x[i].qs);
+
+        // Convert to 32-bit int -> float 32
+        const __m512 vf0 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm256_castsi256_si128(vx8)));
+        const __m512 vf1 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm256_extracti128_si256(vx8, 1)));
+
+        // Scale, add m and store
+        _mm512_storeu_ps(y + i*QK +  0, _mm512_fmadd_ps(vf0, d_v, d_m));
+        _mm512_storeu_ps(y + i*QK + 16, _mm512_fmadd_ps(vf1, d_v, d_m));
+    }
+#elif defined(__AVX2__)
+    for (int i = 0; i < nb; i++) {
+        const __m256 d_v = _mm256_broadcast_ss(&x[i].d);
+        const __m256 d_m = _mm256_broadcast_ss(&x[i].m);
+
+        const uint8_t * restrict pp = x[i].qs;
+
+        for (int l = 0; l < QK; l += 32) {
+            // Load 32x4-bit integers into 32x8-bit integers
+            __m256i vx8 = bytesFromNibbles(pp+l/2);
+
+            // Convert to 16-bit int
+            const __m256i vx16_lo = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 0));
+            const __m256i vx16_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 1));
+
+            // Convert to 32-bit int -> float 32
+            const __m256 vf[4] = {
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 0))),
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 1))),
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 0))),
+                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 1)))
+            };
+
+            // Scale, add m and store
+            for (int j = 0; j < 4; j++) {
+                const __m256 result = _mm256_add_ps(_mm256_mul_ps(vf[j], d_v), d_m);
+                _mm256_storeu_ps(y + i * QK + l + j*8, result);
+            }
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (int i = 0; i < nb; i++) {
+        const float32x4_t vd = vdupq_n_f32(x[i].d);
+        const float32x4_t vm = vdupq_n_f32(x[i].m);
+
+        const uint8_t * restrict pp = x[i].qs;
+
+        for (int l = 0; l < QK; l += 16) {
+            // Load 16x4-bit integers into 8x8-bit integers
+            const uint8x8_t v8 = vld1_u8(pp + l/2);
+
+            // Expand 4-bit qs to 8-bit bytes
+            const uint8x8_t v0 = vand_u8(v8, vdup_n_u8(0x0f));
+            const uint8x8_t v1 = vshr_n_u8(v8, 4);
+
+            // Interleave and combine
+            const uint8x8_t vx_0 = vzip1_u8(v0, v1);
+            const uint8x8_t vx_1 = vzip2_u8(v0, v1);
+
+            const uint8x16_t vq = vcombine_u8(vx_0, vx_1);
+
+            // convert to 2x uint16x8_t
+            const uint16x8_t vi_0 = vmovl_u8(vget_low_u8 (vq));
+            const uint16x8_t vi_1 = vmovl_u8(vget_high_u8(vq));
+
+            // convert to 4x float32x4_t
+            const float32x4_t vf_0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16 (vi_0)));
+            const float32x4_t vf_1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(vi_0)));
+            const float32x4_t vf_2 = vcvtq_f32_u32(vmovl_u16(vget_low_u16 (vi_1)));
+            const float32x4_t vf_3 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(vi_1)));
+
+            // multiply by d and add m
+            const float32x4_t r0 = vmlaq_f32(vm, vf_0, vd);
+            const float32x4_t r1 = vmlaq_f32(vm, vf_1, vd);
+            const float32x4_t r2 = vmlaq_f32(vm, vf_2, vd);
+            const float32x4_t r3 = vmlaq_f32(vm, vf_3, vd);
+
+            // Store
+            vst1q_f32(y + i*QK + l +  0, r0);
+            vst1q_f32(y + i*QK + l +  4, r1);
+            vst1q_f32(y + i*QK + l +  8, r2);
+            vst1q_f32(y + i*QK + l + 12, r3);
+        }
+    }
+#else
+    for (int i = 0; i < nb; i++) {
+        const float d = x[i].d;
+        const float m = x[i].m;
+
+        const uint8_t * restrict pp = x[i].qs;
+
+        for (int l = 0; l < QK; l += 2) {
+            const uint8_t vi = pp[l/2];
+
+            const int8_t vi0 = vi & 0xf;
+            const int8_t vi1 = vi >> 4;
+
+            const float v0 = vi0*d + m;
+            const float v1 = vi1*d + m;
+
+            y[i*QK + l + 0] = v0;
+            y[i*QK + l + 1] = v1;
+
+            assert(!isnan(y[i*QK + l + 0]));
+            assert(!isnan(y[i*QK + l + 1]));
+        }
+    }
+#endif
+}
+
+static void dequantize_row_q8_0(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q8_0 * restrict x = vx;
+
+#if defined(__AVX512F__)
+    for (int i = 0; i < nb; i++) {
+        const __m512 d_v = _mm512_set1_ps(x[i].d);
+
+        const __m512 vf0 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(x[i].qs +  0))));
+        const __m512 vf1 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(x[i].qs + 16))));
+
+        _mm512_storeu_ps(y + i*QK +  0, _mm512_mul_ps(vf0, d_v));
+        _mm512_storeu_ps(y + i*QK + 16, _mm512_mul_ps(vf1, d_v));
+    }
+#elif defined(__AVX2__)
+    for (int i = 0; i < nb; i++) {
+        const __m256 d_v = _mm256_set1_ps(x[i].d);
+
+        // Sign-extend 8 int8 at a time to int32, convert to float, scale and store
+        for (int l = 0; l < QK; l += 8) {
+            const __m256i vi = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(x[i].qs + l)));
+            _mm256_storeu_ps(y + i*QK + l, _mm256_mul_ps(_mm256_cvtepi32_ps(vi), d_v));
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (int i = 0; i < nb; i++) {
+        const float32x4_t vd = vdupq_n_f32(x[i].d);
+
+        for (int l = 0; l < QK; l += 16) {
+            const int8x16_t vq = vld1q_s8(x[i].qs + l);
+
+            const int16x8_t vl = vmovl_s8(vget_low_s8 (vq));
+            const int16x8_t vh = vmovl_s8(vget_high_s8(vq));
+
+            vst1q_f32(y + i*QK + l +  0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16 (vl))), vd));
+            vst1q_f32(y + i*QK + l +  4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vl))), vd));
+            vst1q_f32(y + i*QK + l +  8, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16 (vh))), vd));
+            vst1q_f32(y + i*QK + l + 12, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vh))), vd));
+        }
+    }
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d = x[i].d;
+
+        for (int l = 0; l < QK; ++l) {
+            y[i*QK + l] = x[i].qs[l]*d;
+        }
+    }
+#endif
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+// y = d*q + m for the 32 unsigned bytes of bx
+static inline void dequantize_bytes_min_delta(const __m256i bx, const float d, const float m, float * restrict y) {
+    const __m256 d_v = _mm256_set1_ps(d);
+    const __m256 m_v = _mm256_set1_ps(m);
+
+    const __m128i lo = _mm256_castsi256_si128(bx);
+    const __m128i hi = _mm256_extracti128_si256(bx, 1);
+
+    const __m256 q0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(lo));
+    const __m256 q1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+    const __m256 q2 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(hi));
+    const __m256 q3 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+
+    _mm256_storeu_ps(y +  0, _mm256_fmadd_ps(q0, d_v, m_v));
+    _mm256_storeu_ps(y +  8, _mm256_fmadd_ps(q1, d_v, m_v));
+    _mm256_storeu_ps(y + 16, _mm256_fmadd_ps(q2, d_v, m_v));
+    _mm256_storeu_ps(y + 24, _mm256_fmadd_ps(q3, d_v, m_v));
+}
+#endif
+
+static void dequantize_row_q2_1(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q2_1 * restrict x = vx;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    for (int i = 0; i < nb; i++) {
+        dequantize_bytes_min_delta(bytesFrom2Bits(x[i].qs), fp16_to_fp32(x[i].d), fp16_to_fp32(x[i].m), y + i*QK);
+    }
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d = fp16_to_fp32(x[i].d);
+        const float m = fp16_to_fp32(x[i].m);
+
+        for (int l = 0; l < QK; l++) {
+            const int vi = (x[i].qs[l%8] >> (2*(l/8))) & 3;
+
+            y[i*QK + l] = vi*d + m;
+        }
+    }
+#endif
+}
+
+static void dequantize_row_q3_1(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q3_1 * restrict x = vx;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    for (int i = 0; i < nb; i++) {
+        const __m256i bh = _mm256_and_si256(bytesFromBits(x[i].qh), _mm256_set1_epi8(4));
+        const __m256i bx = _mm256_or_si256(bytesFrom2Bits(x[i].qs), bh);
+
+        dequantize_bytes_min_delta(bx, fp16_to_fp32(x[i].d), fp16_to_fp32(x[i].m), y + i*QK);
+    }
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d = fp16_to_fp32(x[i].d);
+        const float m = fp16_to_fp32(x[i].m);
+
+        for (int l = 0; l < QK; l++) {
+            const int vi = ((x[i].qs[l%8] >> (2*(l/8))) & 3) | (((x[i].qh[l/8] >> (l%8)) & 1) << 2);
+
+            y[i*QK + l] = vi*d + m;
+        }
+    }
+#endif
+}
+
+static void dequantize_row_q4_2(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q4_2 * restrict x = vx;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    for (int i = 0; i < nb; i++) {
+        const float d = fp16_to_fp32(x[i].d);
+
+        // d*(q - 8) = d*q - 8*d
+        dequantize_bytes_min_delta(bytesFromNibbles(x[i].qs), d, -8.0f*d, y + i*QK);
+    }
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d = fp16_to_fp32(x[i].d);
+
+        for (int l = 0; l < QK; l += 2) {
+            const uint8_t vi = x[i].qs[l/2];
+
+            y[i*QK + l + 0] = ((int8_t) (vi & 0xf) - 8)*d;
+            y[i*QK + l + 1] = ((int8_t) (vi >> 4)  - 8)*d;
+        }
+    }
+#endif
+}
+
+static void dequantize_row_q4_3(const void * restrict vx, float * restrict y, int k) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    const block_q4_3 * restrict x = vx;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    for (int i = 0; i < nb; i++) {
+        dequantize_bytes_min_delta(bytesFromNibbles(x[i].qs), fp16_to_fp32(x[i].d), fp16_to_fp32(x[i].m), y + i*QK);
+    }
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d = fp16_to_fp32(x[i].d);
+        const float m = fp16_to_fp32(x[i].m);
+
+        for (int l = 0; l < QK; l += 2) {
+            const uint8_t vi = x[i].qs[l/2];
+
+            y[i*QK + l + 0] = (vi & 0xf)*d + m;
+            y[i*QK + l + 1] = (vi >> 4)*d + m;
+        }
+    }
+#endif
+}
+
+// k values of 8 interleaved rows: row r goes to y[r*k/8 .. (r + 1)*k/8 - 1]
+static void dequantize_row_q4_0x8(const void * restrict vx, float * restrict y, int k) {
+    assert(k % (8*QK) == 0);
+    const int nr = k / 8;
+    const int nb = nr / QK;
+
+    const block_q4_0x8 * restrict x = vx;
+
+    for (int i = 0; i < nb; i++) {
+        for (int r = 0; r < 8; r++) {
+            const float d = x[i].d[r];
+
+            float * restrict yr = y + r*nr + i*QK;
+
+            for (int j = 0; j < 4; j++) {
+                for (int t = 0; t < 4; t++) {
+                    const uint8_t vi = x[i].qs[32*j + 4*r + t];
+
+                    yr[4*j + t]      = ((int8_t) (vi & 0xf) - 8)*d;
+                    yr[16 + 4*j + t] = ((int8_t) (vi >> 4)  - 8)*d;
+                }
+            }
+        }
+    }
+}
+
+//
+// dot products
+//
+
+static void ggml_vec_dot_q4_0_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+    assert(nb % 2 == 0);
+
+    const block_q4_0 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+#if defined(__ARM_NEON)
+    float sum0 = 0.0f;
+    float sum1 = 0.0f;
+
+    for (int i = 0; i < nb; i += 2) {
+        const block_q4_0 * restrict x0 = &x[i + 0];
+        const block_q4_0 * restrict x1 = &x[i + 1];
+        const block_q8_0 * restrict y0 = &y[i + 0];
+        const block_q8_0 * restrict y1 = &y[i + 1];
+
+        const uint8x16_t m4b = vdupq_n_u8(0xf);
+        const int8x16_t  s8b = vdupq_n_s8(0x8);
+
+        const uint8x16_t v0_0 = vld1q_u8(x0->qs);
+        const uint8x16_t v0_1 = vld1q_u8(x1->qs);
+
+        // 4-bit -> 8-bit
+        const int8x16_t v0_0l = vreinterpretq_s8_u8(vandq_u8  (v0_0, m4b));
+        const int8x16_t v0_0h = vreinterpretq_s8_u8(vshrq_n_u8(v0_0, 4));
+        const int8x16_t v0_1l = vreinterpretq_s8_u8(vandq_u8  (v0_1, m4b));
+        const int8x16_t v0_1h = vreinterpretq_s8_u8(vshrq_n_u8(v0_1, 4));
+
+        // sub 8
+        const int8x16_t v0_0ls = vsubq_s8(v0_0l, s8b);
+        const int8x16_t v0_0hs = vsubq_s8(v0_0h, s8b);
+        const int8x16_t v0_1ls = vsubq_s8(v0_1l, s8b);
+        const int8x16_t v0_1hs = vsubq_s8(v0_1h, s8b);
+
+        // load y, splitting the even and odd elements to match the nibble order of x
+        const int8x16x2_t v1_0 = vld2q_s8(y0->qs);
+        const int8x16x2_t v1_1 = vld2q_s8(y1->qs);
+
+#if defined(__ARM_FEATURE_DOTPROD)
+        // dot product into int32x4_t
+        int32x4_t p_0 = vdotq_s32(vdupq_n_s32(0), v0_0ls, v1_0.val[0]);
+        int32x4_t p_1 = vdotq_s32(vdupq_n_s32(0), v0_1ls, v1_1.val[0]);
+
+        p_0 = vdotq_s32(p_0, v0_0hs, v1_0.val[1]);
+        p_1 = vdotq_s32(p_1, v0_1hs, v1_1.val[1]);
+#else
+        const int16x8_t pl0l = vmull_s8(vget_low_s8 (v0_0ls), vget_low_s8 (v1_0.val[0]));
+        const int16x8_t pl0h = vmull_s8(vget_high_s8(v0_0ls), vget_high_s8(v1_0.val[0]));
+
+        const int16x8_t ph0l = vmull_s8(vget_low_s8 (v0_0hs), vget_low_s8 (v1_0.val[1]));
+        const int16x8_t ph0h = vmull_s8(vget_high_s8(v0_0hs), vget_high_s8(v1_0.val[1]));
+
+        const int16x8_t pl1l = vmull_s8(vget_low_s8 (v0_1ls), vget_low_s8 (v1_1.val[0]));
+        const int16x8_t pl1h = vmull_s8(vget_high_s8(v0_1ls), vget_high_s8(v1_1.val[0]));
+
+        const int16x8_t ph1l = vmull_s8(vget_low_s8 (v0_1hs), vget_low_s8 (v1_1.val[1]));
+        const int16x8_t ph1h = vmull_s8(vget_high_s8(v0_1hs), vget_high_s8(v1_1.val[1]));
+
+        // the 8-bit products do not fit a 16-bit sum over the whole block, widen them pairwise
+        const int32x4_t p_0 = vaddq_s32(
+                vaddq_s32(vpaddlq_s16(pl0l), vpaddlq_s16(pl0h)),
+                vaddq_s32(vpaddlq_s16(ph0l), vpaddlq_s16(ph0h)));
+        const int32x4_t p_1 = vaddq_s32(
+                vaddq_s32(vpaddlq_s16(pl1l), vpaddlq_s16(pl1h)),
+                vaddq_s32(vpaddlq_s16(ph1l), vpaddlq_s16(ph1h)));
+#endif
+
+        // scalar
+#if defined(__ARM_FEATURE_QRDMX)
+        sum0 += x0->d * y0->d * vaddvq_s32(p_0);
+        sum1 += x1->d * y1->d * vaddvq_s32(p_1);
+#else
+        sum0 += x0->d * y0->d * (vgetq_lane_s32(p_0, 0) + vgetq_lane_s32(p_0, 1) + vgetq_lane_s32(p_0, 2) + vgetq_lane_s32(p_0, 3));
+        sum1 += x1->d * y1->d * (vgetq_lane_s32(p_1, 0) + vgetq_lane_s32(p_1, 1) + vgetq_lane_s32(p_1, 2) + vgetq_lane_s32(p_1, 3));
+#endif
+    }
+
+    sumf = sum0 + sum1;
+#elif defined(__AVX2__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    // Main loop
+    // TODO: figure a way to do this in a portable way
+    #ifdef __GNUC__
+    #pragma GCC unroll 16
+    #endif
+    for (int i = 0; i < nb; ++i) {
+        // Compute combined scale for the block
+        const __m256 d = _mm256_mul_ps( _mm256_broadcast_ss( &x[i].d ), _mm256_broadcast_ss( &y[i].d ) );
+
+        // Load 16 bytes, and unpack 4 bit fields into bytes, making 32 bytes
+        __m256i bx = bytesFromNibbles( x[i].qs );
+
+        // Now we have a vector with bytes in [ 0 .. 15 ] interval. Offset them into [ -8 .. +7 ] interval.
+        const __m256i off = _mm256_set1_epi8( 8 );
+        bx = _mm256_sub_epi8( bx, off );
+
+        // The 8-bit quants of y are already in the same order
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // Get absolute values of x vectors
+        const __m256i ax = _mm256_sign_epi8( bx, bx );
+
+        // Sign the values of the y vectors
+        const __m256i sy = _mm256_sign_epi8( by, bx );
+
+        // Multiply and sum into 32-bit values
+        const __m256i i32 = mul_sum_us8_i32( ax, sy );
+
+        // Convert int32_t to float
+        const __m256 p = _mm256_cvtepi32_ps( i32 );
+
+        // Apply the scale, and accumulate
+        acc = _mm256_fmadd_ps( d, p, acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#elif defined(__AVX__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    // Main loop
+    for (int i = 0; i < nb; ++i) {
+        // Compute combined scale for the block
+        const __m256 d = _mm256_mul_ps( _mm256_broadcast_ss( &x[i].d ), _mm256_broadcast_ss( &y[i].d ) );
+
+        __m128i i32[2];
+        for (int j = 0; j < 2; ++j) {
+            // Load 8 bytes, and unpack 4 bit fields into bytes, making 16 bytes
+            __m128i bx = bytesFromNibbles( x[i].qs + 8*j );
+
+            // Now we have a vector with bytes in [ 0 .. 15 ] interval. Offset them into [ -8 .. +7 ] interval.
+            const __m128i off = _mm_set1_epi8( 8 );
+            bx = _mm_sub_epi8( bx, off );
+
+            const __m128i by = _mm_loadu_si128( (const __m128i *) (y[i].qs + 16*j) );
+
+            // Get absolute values of x vectors
+            const __m128i ax = _mm_sign_epi8( bx, bx );
+
+            // Sign the values of the y vectors
+            const __m128i sy = _mm_sign_epi8( by, bx );
+
+            // Perform multiplication and create 16-bit values
+            const __m128i dot = _mm_maddubs_epi16( ax, sy );
+
+            const __m128i ones = _mm_set1_epi16( 1 );
+            i32[j] = _mm_madd_epi16( ones, dot );
+        }
+
+        // Convert int32_t to float
+        __m256 p = _mm256_cvtepi32_ps( _mm256_set_m128i( i32[0], i32[1] ));
+        // Apply the scale, and accumulate
+        acc = _mm256_add_ps(_mm256_mul_ps( d, p ), acc);
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d0 = x[i].d;
+        const float d1 = y[i].d;
+
+        const uint8_t * restrict p0 = x[i].qs;
+        const  int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        for (int j = 0; j < QK/2; j++) {
+            const uint8_t v0 = p0[j];
+
+            const int i0 = (int8_t) (v0 & 0xf) - 8;
+            const int i1 = (int8_t) (v0 >> 4)  - 8;
+
+            const int i2 = p1[2*j + 0];
+            const int i3 = p1[2*j + 1];
+
+            sumi += i0*i2 + i1*i3;
+        }
+        sumf += d0*d1*sumi;
+    }
+#endif
+
+    *s = sumf;
+}
+
+static void ggml_vec_dot_q4_1_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q4_1 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+    // x = d0*q0 + m0 and y = d1*q1, so the block dot product is
+    //   d0*d1*sum(q0*q1) + m0*d1*sum(q1)
+
+#if defined(__AVX2__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    // Main loop
+    for (int i = 0; i < nb; ++i) {
+        const __m256 d0v = _mm256_broadcast_ss( &x[i].d );
+        const __m256 m0v = _mm256_broadcast_ss( &x[i].m );
+        const __m256 d1v = _mm256_broadcast_ss( &y[i].d );
+
+        // Compute combined scales for the block
+        const __m256 scale_01 = _mm256_mul_ps( d0v, d1v );
+        const __m256 scale_m  = _mm256_mul_ps( m0v, d1v );
+
+        // Load 16 bytes, and unpack 4 bit fields into bytes, making 32 bytes in [ 0 .. 15 ]
+        const __m256i bx = bytesFromNibbles( x[i].qs );
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // The x quants are unsigned, so they can be the first operand as-is
+        const __m256i dot   = mul_sum_us8_i32( bx, by );
+        const __m256i sum_y = mul_sum_us8_i32( _mm256_set1_epi8( 1 ), by );
+
+        // Apply the scales, and accumulate
+        acc = _mm256_fmadd_ps( scale_01, _mm256_cvtepi32_ps( dot ),   acc );
+        acc = _mm256_fmadd_ps( scale_m,  _mm256_cvtepi32_ps( sum_y ), acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#elif defined(__ARM_NEON)
+    float sum01 = 0.0f;
+    float summ  = 0.0f;
+
+    for (int i = 0; i < nb; ++i) {
+        const block_q4_1 * restrict x0 = &x[i];
+        const block_q8_0 * restrict y0 = &y[i];
+
+        const uint8x16_t m4b = vdupq_n_u8(0xf);
+
+        const uint8x16_t v0_0 = vld1q_u8(x0->qs);
+
+        // 4-bit -> 8-bit
+        const int8x16_t v0_0l = vreinterpretq_s8_u8(vandq_u8  (v0_0, m4b));
+        const int8x16_t v0_0h = vreinterpretq_s8_u8(vshrq_n_u8(v0_0, 4));
+
+        // load y, splitting the even and odd elements to match the nibble order of x
+        const int8x16x2_t v1_0 = vld2q_s8(y0->qs);
+
+#if defined(__ARM_FEATURE_DOTPROD)
+        int32x4_t p_0 = vdotq_s32(vdupq_n_s32(0), v0_0l, v1_0.val[0]);
+        p_0 = vdotq_s32(p_0, v0_0h, v1_0.val[1]);
+#else
+        const int16x8_t pl0l = vmull_s8(vget_low_s8 (v0_0l), vget_low_s8 (v1_0.val[0]));
+        const int16x8_t pl0h = vmull_s8(vget_high_s8(v0_0l), vget_high_s8(v1_0.val[0]));
+
+        const int16x8_t ph0l = vmull_s8(vget_low_s8 (v0_0h), vget_low_s8 (v1_0.val[1]));
+        const int16x8_t ph0h = vmull_s8(vget_high_s8(v0_0h), vget_high_s8(v1_0.val[1]));
+
+        const int32x4_t p_0 = vaddq_s32(
+                vaddq_s32(vpaddlq_s16(pl0l), vpaddlq_s16(pl0h)),
+                vaddq_s32(vpaddlq_s16(ph0l), vpaddlq_s16(ph0h)));
+#endif
+
+        sum01 += x0->d*y0->d*vaddvq_s32(p_0);
+        summ  += x0->m*y0->d*(vaddlvq_s8(v1_0.val[0]) + vaddlvq_s8(v1_0.val[1]));
+    }
+
+    sumf = sum01 + summ;
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const float d0 = x[i].d;
+        const float m0 = x[i].m;
+        const float d1 = y[i].d;
+
+        const uint8_t * restrict p0 = x[i].qs;
+        const  int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        int sumy = 0;
+        for (int j = 0; j < QK/2; j++) {
+            const uint8_t v0 = p0[j];
+
+            const int i0 = v0 & 0xf;
+            const int i1 = v0 >> 4;
+
+            const int i2 = p1[2*j + 0];
+            const int i3 = p1[2*j + 1];
+
+            sumi += i0*i2 + i1*i3;
+            sumy += i2 + i3;
+        }
+        sumf += d0*d1*sumi + m0*d1*sumy;
+    }
+#endif
+
+    *s = sumf;
+}
+
+static void ggml_vec_dot_q8_0_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q8_0 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+#if defined(__AVX2__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        // Compute combined scale for the block
+        const __m256 d = _mm256_mul_ps( _mm256_broadcast_ss( &x[i].d ), _mm256_broadcast_ss( &y[i].d ) );
+
+        const __m256i bx = _mm256_loadu_si256( (const __m256i *) x[i].qs );
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // Move the sign of x to y, so that x can be multiplied as unsigned bytes
+        const __m256i ax = _mm256_sign_epi8( bx, bx );
+        const __m256i sy = _mm256_sign_epi8( by, bx );
+
+        // Multiply and sum into 32-bit values
+        const __m256i i32 = mul_sum_us8_i32( ax, sy );
+
+        // Apply the scale, and accumulate
+        acc = _mm256_fmadd_ps( d, _mm256_cvtepi32_ps( i32 ), acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#elif defined(__AVX__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        // Compute combined scale for the block
+        const __m256 d = _mm256_mul_ps( _mm256_broadcast_ss( &x[i].d ), _mm256_broadcast_ss( &y[i].d ) );
+
+        __m128i i32[2];
+        for (int j = 0; j < 2; ++j) {
+            const __m128i bx = _mm_loadu_si128( (const __m128i *) (x[i].qs + 16*j) );
+            const __m128i by = _mm_loadu_si128( (const __m128i *) (y[i].qs + 16*j) );
+
+            const __m128i ax = _mm_sign_epi8( bx, bx );
+            const __m128i sy = _mm_sign_epi8( by, bx );
+
+            // Perform multiplication and create 16-bit values, then sum pairs into 32-bit values
+            const __m128i dot = _mm_maddubs_epi16( ax, sy );
+
+            const __m128i ones = _mm_set1_epi16( 1 );
+            i32[j] = _mm_madd_epi16( ones, dot );
+        }
+
+        // Convert int32_t to float
+        __m256 p = _mm256_cvtepi32_ps( _mm256_set_m128i( i32[0], i32[1] ));
+        // Apply the scale, and accumulate
+        acc = _mm256_add_ps(_mm256_mul_ps( d, p ), acc);
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#elif defined(__ARM_NEON)
+    float32x4_t sumv = vdupq_n_f32(0.0f);
+
+    for (int i = 0; i < nb; ++i) {
+        const int8x16_t x0 = vld1q_s8(x[i].qs);
+        const int8x16_t x1 = vld1q_s8(x[i].qs + 16);
+        const int8x16_t y0 = vld1q_s8(y[i].qs);
+        const int8x16_t y1 = vld1q_s8(y[i].qs + 16);
+
+#if defined(__ARM_FEATURE_DOTPROD)
+        const int32x4_t p = vdotq_s32(vdotq_s32(vdupq_n_s32(0), x0, y0), x1, y1);
+#else
+        const int16x8_t p0 = vmlal_s8(vmull_s8(vget_low_s8 (x0), vget_low_s8 (y0)), vget_high_s8(x0), vget_high_s8(y0));
+        const int16x8_t p1 = vmlal_s8(vmull_s8(vget_low_s8 (x1), vget_low_s8 (y1)), vget_high_s8(x1), vget_high_s8(y1));
+
+        const int32x4_t p = vaddq_s32(vpaddlq_s16(p0), vpaddlq_s16(p1));
+#endif
+        sumv = vmlaq_n_f32(sumv, vcvtq_f32_s32(p), x[i].d*y[i].d);
+    }
+
+    sumf = vaddvq_f32(sumv);
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const int8_t * restrict p0 = x[i].qs;
+        const int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        for (int j = 0; j < QK; j++) {
+            sumi += p0[j]*p1[j];
+        }
+        sumf += x[i].d*y[i].d*sumi;
+    }
+#endif
+
+    *s = sumf;
+}
+
+static void ggml_vec_dot_q2_1_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q2_1 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+    // as for q4_1: d0*d1*sum(q0*q1) + m0*d1*sum(q1) per block
+
+#if defined(__AVX2__) && defined(__FMA__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        const __m256 d1v = _mm256_broadcast_ss( &y[i].d );
+
+        // Compute combined scales for the block
+        const __m256 scale_01 = _mm256_mul_ps( _mm256_set1_ps( fp16_to_fp32( x[i].d ) ), d1v );
+        const __m256 scale_m  = _mm256_mul_ps( _mm256_set1_ps( fp16_to_fp32( x[i].m ) ), d1v );
+
+        // Unpack the 2-bit fields into 32 bytes in [ 0 .. 3 ]
+        const __m256i bx = bytesFrom2Bits( x[i].qs );
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // The x quants are unsigned, so they can be the first operand as-is
+        const __m256i dot   = mul_sum_us8_i32( bx, by );
+        const __m256i sum_y = mul_sum_us8_i32( _mm256_set1_epi8( 1 ), by );
+
+        // Apply the scales, and accumulate
+        acc = _mm256_fmadd_ps( scale_01, _mm256_cvtepi32_ps( dot ),   acc );
+        acc = _mm256_fmadd_ps( scale_m,  _mm256_cvtepi32_ps( sum_y ), acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        int sumy = 0;
+        for (int l = 0; l < QK; l++) {
+            const int vi = (x[i].qs[l%8] >> (2*(l/8))) & 3;
+            sumi += vi*p1[l];
+            sumy += p1[l];
+        }
+
+        sumf += fp16_to_fp32(x[i].d)*y[i].d*sumi + fp16_to_fp32(x[i].m)*y[i].d*sumy;
+    }
+#endif
+
+    *s = sumf;
+}
+
+static void ggml_vec_dot_q3_1_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q3_1 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+    // as for q4_1: d0*d1*sum(q0*q1) + m0*d1*sum(q1) per block
+
+#if defined(__AVX2__) && defined(__FMA__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        const __m256 d1v = _mm256_broadcast_ss( &y[i].d );
+
+        // Compute combined scales for the block
+        const __m256 scale_01 = _mm256_mul_ps( _mm256_set1_ps( fp16_to_fp32( x[i].d ) ), d1v );
+        const __m256 scale_m  = _mm256_mul_ps( _mm256_set1_ps( fp16_to_fp32( x[i].m ) ), d1v );
+
+        // Unpack the 2-bit fields and add the high bits, making 32 bytes in [ 0 .. 7 ]
+        const __m256i bh = _mm256_and_si256( bytesFromBits( x[i].qh ), _mm256_set1_epi8( 4 ) );
+        const __m256i bx = _mm256_or_si256( bytesFrom2Bits( x[i].qs ), bh );
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // The x quants are unsigned, so they can be the first operand as-is
+        const __m256i dot   = mul_sum_us8_i32( bx, by );
+        const __m256i sum_y = mul_sum_us8_i32( _mm256_set1_epi8( 1 ), by );
+
+        // Apply the scales, and accumulate
+        acc = _mm256_fmadd_ps( scale_01, _mm256_cvtepi32_ps( dot ),   acc );
+        acc = _mm256_fmadd_ps( scale_m,  _mm256_cvtepi32_ps( sum_y ), acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        int sumy = 0;
+        for (int l = 0; l < QK; l++) {
+            const int vi = ((x[i].qs[l%8] >> (2*(l/8))) & 3) | (((x[i].qh[l/8] >> (l%8)) & 1) << 2);
+            sumi += vi*p1[l];
+            sumy += p1[l];
+        }
+
+        sumf += fp16_to_fp32(x[i].d)*y[i].d*sumi + fp16_to_fp32(x[i].m)*y[i].d*sumy;
+    }
+#endif
+
+    *s = sumf;
+}
+
+static void ggml_vec_dot_q4_2_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q4_2 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        // Compute combined scale for the block
+        const __m256 d = _mm256_set1_ps( fp16_to_fp32( x[i].d )*y[i].d );
+
+        // Unpack the nibbles into bytes, and offset them into [ -8 .. +7 ]
+        const __m256i bx = _mm256_sub_epi8( bytesFromNibbles( x[i].qs ), _mm256_set1_epi8( 8 ) );
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // Move the sign of x to y, so that x can be multiplied as unsigned bytes
+        const __m256i ax = _mm256_sign_epi8( bx, bx );
+        const __m256i sy = _mm256_sign_epi8( by, bx );
+
+        // Multiply and sum into 32-bit values
+        const __m256i i32 = mul_sum_us8_i32( ax, sy );
+
+        // Apply the scale, and accumulate
+        acc = _mm256_fmadd_ps( d, _mm256_cvtepi32_ps( i32 ), acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const uint8_t * restrict p0 = x[i].qs;
+        const  int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        for (int j = 0; j < QK/2; j++) {
+            const int i0 = (int8_t) (p0[j] & 0xf) - 8;
+            const int i1 = (int8_t) (p0[j] >> 4)  - 8;
+
+            sumi += i0*p1[2*j + 0] + i1*p1[2*j + 1];
+        }
+
+        sumf += fp16_to_fp32(x[i].d)*y[i].d*sumi;
+    }
+#endif
+
+    *s = sumf;
+}
+
+static void ggml_vec_dot_q4_3_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q4_3 * restrict x = vx;
+    const block_q8_0 * restrict y = vy;
+
+    float sumf = 0.0;
+
+    // as for q4_1: d0*d1*sum(q0*q1) + m0*d1*sum(q1) per block
+
+#if defined(__AVX2__) && defined(__FMA__)
+    // Initialize accumulator with zeros
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        const __m256 d1v = _mm256_broadcast_ss( &y[i].d );
+
+        // Compute combined scales for the block
+        const __m256 scale_01 = _mm256_mul_ps( _mm256_set1_ps( fp16_to_fp32( x[i].d ) ), d1v );
+        const __m256 scale_m  = _mm256_mul_ps( _mm256_set1_ps( fp16_to_fp32( x[i].m ) ), d1v );
+
+        // Load 16 bytes, and unpack 4 bit fields into bytes, making 32 bytes in [ 0 .. 15 ]
+        const __m256i bx = bytesFromNibbles( x[i].qs );
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+
+        // The x quants are unsigned, so they can be the first operand as-is
+        const __m256i dot   = mul_sum_us8_i32( bx, by );
+        const __m256i sum_y = mul_sum_us8_i32( _mm256_set1_epi8( 1 ), by );
+
+        // Apply the scales, and accumulate
+        acc = _mm256_fmadd_ps( scale_01, _mm256_cvtepi32_ps( dot ),   acc );
+        acc = _mm256_fmadd_ps( scale_m,  _mm256_cvtepi32_ps( sum_y ), acc );
+    }
+
+    // Return horizontal sum of the acc vector
+    __m128 res = _mm256_extractf128_ps( acc, 1 );
+    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
+    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
+    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
+
+    sumf = _mm_cvtss_f32( res );
+#else
+    // scalar
+    for (int i = 0; i < nb; i++) {
+        const int8_t * restrict p1 = y[i].qs;
+
+        int sumi = 0;
+        int sumy = 0;
+        for (int l = 0; l < QK; l++) {
+            const int vi = (l % 2) ? (x[i].qs[l/2] >> 4) : (x[i].qs[l/2] & 0xf);
+            sumi += vi*p1[l];
+            sumy += p1[l];
+        }
+
+        sumf += fp16_to_fp32(x[i].d)*y[i].d*sumi + fp16_to_fp32(x[i].m)*y[i].d*sumy;
+    }
+#endif
+
+    *s = sumf;
+}
+
+// the dot products of the 8 rows of vx with vy, into s[0] .. s[7]
+static void ggml_vec_dot_q4_0x8_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+    const int nb = n / QK;
+
+    assert(n % QK == 0);
+
+    const block_q4_0x8 * restrict x = vx;
+    const block_q8_0   * restrict y = vy;
+
+#if defined(__AVX2__)
+    const __m256i lowMask = _mm256_set1_epi8( 0xF );
+    const __m256i ones8   = _mm256_set1_epi8( 1 );
+    const __m256i ones16  = _mm256_set1_epi16( 1 );
+
+    // one lane per row
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+        const __m256 d = _mm256_mul_ps( _mm256_loadu_ps( x[i].d ), _mm256_set1_ps( y[i].d ) );
+
+        // sum of the activations in every lane, for the offset of 8 of the nibbles
+        const __m256i by = _mm256_loadu_si256( (const __m256i *) y[i].qs );
+        __m256i sumy = _mm256_madd_epi16( _mm256_maddubs_epi16( ones8, by ), ones16 );
+        sumy = _mm256_add_epi32( sumy, _mm256_permute2x128_si256( sumy, sumy, 1 ) );
+        sumy = _mm256_add_epi32( sumy, _mm256_shuffle_epi32( sumy, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        sumy = _mm256_add_epi32( sumy, _mm256_shuffle_epi32( sumy, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+
+        // every 32-bit lane of bx holds 4 nibbles of one row: elements 4*j .. 4*j + 3 in the low nibbles and
+        // elements 16 + 4*j .. 16 + 4*j + 3 in the high nibbles - multiply them with the broadcast activations
+        __m256i sumi = _mm256_setzero_si256();
+
+        for (int j = 0; j < 4; ++j) {
+            const __m256i bx = _mm256_loadu_si256( (const __m256i *) (x[i].qs + 32*j) );
+
+            int32_t y0;
+            int32_t y1;
+            memcpy( &y0, y[i].qs + 4*j,      sizeof(y0) );
+            memcpy( &y1, y[i].qs + 16 + 4*j, sizeof(y1) );
+
+            sumi = mul_add_us8_i32( sumi, _mm256_and_si256( bx, lowMask ), _mm256_set1_epi32( y0 ) );
+            sumi = mul_add_us8_i32( sumi, _mm256_and_si256( _mm256_srli_epi16( bx, 4 ), lowMask ), _mm256_set1_epi32( y1 ) );
+        }
+
+        sumi = _mm256_sub_epi32( sumi, _mm256_slli_epi32( sumy, 3 ) );
+
+        acc = _mm256_fmadd_ps( d, _mm256_cvtepi32_ps( sumi ), acc );
+    }
+
+    _mm256_storeu_ps( s, acc );
+#elif defined(__ARM_NEON) && defined(__ARM_FEATURE_DOTPROD)
+    const uint8x16_t m4b = vdupq_n_u8(0xf);
+    const int8x16_t  s8b = vdupq_n_s8(0x8);
+
+    // rows 0 - 3 and 4 - 7
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+    for (int i = 0; i < nb; ++i) {
+        int32x4_t sumi0 = vdupq_n_s32(0);
+        int32x4_t sumi1 = vdupq_n_s32(0);
+
+        for (int j = 0; j < 4; ++j) {
+            const uint8x16_t v0 = vld1q_u8(x[i].qs + 32*j);
+            const uint8x16_t v1 = vld1q_u8(x[i].qs + 32*j + 16);
+
+            int32_t y0;
+            int32_t y1;
+            memcpy(&y0, y[i].qs + 4*j,      sizeof(y0));
+            memcpy(&y1, y[i].qs + 16 + 4*j, sizeof(y1));
+
+            const int8x16_t vy0 = vreinterpretq_s8_s32(vdupq_n_s32(y0));
+            const int8x16_t vy1 = vreinterpretq_s8_s32(vdupq_n_s32(y1));
+
+            // 4-bit -> 8-bit, sub 8
+            const int8x16_t v0l = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(v0, m4b)), s8b);
+            const int8x16_t v0h = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(v0, 4)), s8b);
+            const int8x16_t v1l = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(v1, m4b)), s8b);
+            const int8x16_t v1h = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(v1, 4)), s8b);
+
+            sumi0 = vdotq_s32(vdotq_s32(sumi0, v0l, vy0), v0h, vy1);
+            sumi1 = vdotq_s32(vdotq_s32(sumi1, v1l, vy0), v1h, vy1);
+        }
+
+        const float32x4_t dy = vdupq_n_f32(y[i].d);
+
+        acc0 = vmlaq_f32(acc0, vcvtq_f32_s32(sumi0), vmulq_f32(vld1q_f32(x[i].d),     dy));
+        acc1 = vmlaq_f32(acc1, vcvtq_f32_s32(sumi1), vmulq_f32(vld1q_f32(x[i].d + 4), dy));
+    }
+
+    vst1q_f32(s,     acc0);
+    vst1q_f32(s + 4, acc1);
+#else
+    // scalar
+    float sumf[8] = { 0.0f };
+
+    for (int i = 0; i < nb; i++) {
+        const int8_t * restrict p1 = y[i].qs;
+
+        for (int r = 0; r < 8; r++) {
+            int sumi = 0;
+
+            for (int j = 0; j < 4; j++) {
+                for (int t = 0; t < 4; t++) {
+                    const uint8_t v0 = x[i].qs[32*j + 4*r + t];
+
+                    const int i0 = (int8_t) (v0 & 0xf) - 8;
+                    const int i1 = (int8_t) (v0 >> 4)  - 8;
+
+                    sumi += i0*p1[4*j + t] + i1*p1[16 + 4*j + t];
+                }
+            }
+
+            sumf[r] += x[i].d[r]*y[i].d*sumi;
+        }
+    }
+
+    for (int r = 0; r < 8; r++) {
+        s[r] = sumf[r];
+    }
+#endif
+}
+
+//
+// rms_norm
+//
+
+static double vec_norm_sq_f32(const int n, const float * restrict x) {
+    int i = 0;
+    double sum = 0.0;
+
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+
+    for (; i + 64 <= n; i += 64) {
+        const __m512 x0 = _mm512_loadu_ps(x + i +  0);
+        const __m512 x1 = _mm512_loadu_ps(x + i + 16);
+        const __m512 x2 = _mm512_loadu_ps(x + i + 32);
+        const __m512 x3 = _mm512_loadu_ps(x + i + 48);
+
+        acc0 = _mm512_fmadd_ps(x0, x0, acc0);
+        acc1 = _mm512_fmadd_ps(x1, x1, acc1);
+        acc2 = _mm512_fmadd_ps(x2, x2, acc2);
+        acc3 = _mm512_fmadd_ps(x3, x3, acc3);
+    }
+    for (; i + 16 <= n; i += 16) {
+        const __m512 x0 = _mm512_loadu_ps(x + i);
+        acc0 = _mm512_fmadd_ps(x0, x0, acc0);
+    }
+
+    sum += (double) _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+#elif defined(__AVX__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+#if defined(__FMA__)
+    #define GGML_SQ_ACC(acc, v) _mm256_fmadd_ps(v, v, acc)
+#else
+    #define GGML_SQ_ACC(acc, v) _mm256_add_ps(_mm256_mul_ps(v, v), acc)
+#endif
+    for (; i + 32 <= n; i += 32) {
+        const __m256 x0 = _mm256_loadu_ps(x + i +  0);
+        const __m256 x1 = _mm256_loadu_ps(x + i +  8);
+        const __m256 x2 = _mm256_loadu_ps(x + i + 16);
+        const __m256 x3 = _mm256_loadu_ps(x + i + 24);
+
+        acc0 = GGML_SQ_ACC(acc0, x0);
+        acc1 = GGML_SQ_ACC(acc1, x1);
+        acc2 = GGML_SQ_ACC(acc2, x2);
+        acc3 = GGML_SQ_ACC(acc3, x3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x0 = _mm256_loadu_ps(x + i);
+        acc0 = GGML_SQ_ACC(acc0, x0);
+    }
+    #undef GGML_SQ_ACC
+
+    const __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+
+    __m128 res = _mm256_extractf128_ps(acc, 1);
+    res = _mm_add_ps(res, _mm256_castps256_ps128(acc));
+    res = _mm_add_ps(res, _mm_movehl_ps(res, res));
+    res = _mm_add_ss(res, _mm_movehdup_ps(res));
+
+    sum += (double) _mm_cvtss_f32(res);
+#endif
+
+    for (; i < n; ++i) {
+        sum += (double) (x[i]*x[i]);
+    }
+
+    return sum;
+}
+
+static void vec_scale_mul_f32(const int n, float * y, const float * x, const float s, const float * w) {
+    int i = 0;
+
+#if defined(__AVX512F__)
+    const __m512 vs = _mm512_set1_ps(s);
+    if (w) {
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_ps(y + i, _mm512_mul_ps(_mm512_mul_ps(_mm512_loadu_ps(x + i), vs), _mm512_loadu_ps(w + i)));
+        }
+    } else {
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_ps(y + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), vs));
+        }
+    }
+#elif defined(__AVX__)
+    const __m256 vs = _mm256_set1_ps(s);
+    if (w) {
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i), vs), _mm256_loadu_ps(w + i)));
+        }
+    } else {
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), vs));
+        }
+    }
+#endif
+
+    if (w) {
+        for (; i < n; ++i) {
+            y[i] = x[i]*s*w[i];
+        }
+    } else {
+        for (; i < n; ++i) {
+            y[i] = x[i]*s;
+        }
+    }
+}
+
+//
+// kernels for fixed row lengths
+//
+
+// the row length is a compile-time constant, so that the loops unroll completely, without a tail,
+// and with enough independent accumulators to hide the latency of the FMAs
+// the shapes are listed in GGML_FIXED_N - ggml.c uses these kernels when a row length matches
+
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+
+#if defined(__GNUC__)
+#define GGML_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define GGML_ALWAYS_INLINE inline
+#endif
+
+static inline float hsum_float_8(const __m256 x) {
+    __m128 res = _mm256_extractf128_ps(x, 1);
+    res = _mm_add_ps(res, _mm256_castps256_ps128(x));
+    res = _mm_add_ps(res, _mm_movehl_ps(res, res));
+    res = _mm_add_ss(res, _mm_movehdup_ps(res));
+    return _mm_cvtss_f32(res);
+}
+
+static inline __m256 dot_q4_0_q8_0_block(const block_q4_0 * restrict x, const block_q8_0 * restrict y, const __m256 acc) {
+    const __m256  d  = _mm256_mul_ps(_mm256_broadcast_ss(&x->d), _mm256_broadcast_ss(&y->d));
+    const __m256i bx = _mm256_sub_epi8(bytesFromNibbles(x->qs), _mm256_set1_epi8(8));
+    const __m256i by = _mm256_loadu_si256((const __m256i *) y->qs);
+
+    const __m256i i32 = mul_sum_us8_i32(_mm256_sign_epi8(bx, bx), _mm256_sign_epi8(by, bx));
+
+    return _mm256_fmadd_ps(d, _mm256_cvtepi32_ps(i32), acc);
+}
+
+static inline __m256 dot_q4_1_q8_0_block(const block_q4_1 * restrict x, const block_q8_0 * restrict y, const __m256 acc) {
+    const __m256  d1 = _mm256_broadcast_ss(&y->d);
+    const __m256i bx = bytesFromNibbles(x->qs);
+    const __m256i by = _mm256_loadu_si256((const __m256i *) y->qs);
+
+    const __m256i dot   = mul_sum_us8_i32(bx, by);
+    const __m256i sum_y = mul_sum_us8_i32(_mm256_set1_epi8(1), by);
+
+    const __m256 r = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_broadcast_ss(&x->d), d1), _mm256_cvtepi32_ps(dot), acc);
+    return _mm256_fmadd_ps(_mm256_mul_ps(_mm256_broadcast_ss(&x->m), d1), _mm256_cvtepi32_ps(sum_y), r);
+}
+
+// 4 blocks in flight - all the GGML_FIXED_N lengths are multiples of 4*QK
+static GGML_ALWAYS_INLINE float vec_dot_q4_0_q8_0_fixed(const int nb, const block_q4_0 * restrict x, const block_q8_0 * restrict y) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; i += 4) {
+        acc0 = dot_q4_0_q8_0_block(x + i + 0, y + i + 0, acc0);
+        acc1 = dot_q4_0_q8_0_block(x + i + 1, y + i + 1, acc1);
+        acc2 = dot_q4_0_q8_0_block(x + i + 2, y + i + 2, acc2);
+        acc3 = dot_q4_0_q8_0_block(x + i + 3, y + i + 3, acc3);
+    }
+
+    return hsum_float_8(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+}
+
+static GGML_ALWAYS_INLINE float vec_dot_q4_1_q8_0_fixed(const int nb, const block_q4_1 * restrict x, const block_q8_0 * restrict y) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; i += 4) {
+        acc0 = dot_q4_1_q8_0_block(x + i + 0, y + i + 0, acc0);
+        acc1 = dot_q4_1_q8_0_block(x + i + 1, y + i + 1, acc1);
+        acc2 = dot_q4_1_q8_0_block(x + i + 2, y + i + 2, acc2);
+        acc3 = dot_q4_1_q8_0_block(x + i + 3, y + i + 3, acc3);
+    }
+
+    return hsum_float_8(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+}
+
+// 32 elements per iteration
+static GGML_ALWAYS_INLINE float vec_dot_f16_fixed(const int n, const ggml_fp16_t * restrict x, const ggml_fp16_t * restrict y) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    for (int i = 0; i < n; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i +  0))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(y + i +  0))), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i +  8))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(y + i +  8))), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i + 16))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(y + i + 16))), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i + 24))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(y + i + 24))), acc3);
+    }
+
+    return hsum_float_8(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+}
+
+static GGML_ALWAYS_INLINE double vec_norm_sq_f32_fixed(const int n, const float * restrict x) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    for (int i = 0; i < n; i += 32) {
+        const __m256 x0 = _mm256_loadu_ps(x + i +  0);
+        const __m256 x1 = _mm256_loadu_ps(x + i +  8);
+        const __m256 x2 = _mm256_loadu_ps(x + i + 16);
+        const __m256 x3 = _mm256_loadu_ps(x + i + 24);
+
+        acc0 = _mm256_fmadd_ps(x0, x0, acc0);
+        acc1 = _mm256_fmadd_ps(x1, x1, acc1);
+        acc2 = _mm256_fmadd_ps(x2, x2, acc2);
+        acc3 = _mm256_fmadd_ps(x3, x3, acc3);
+    }
+
+    return hsum_float_8(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+}
+
+#define GGML_FIXED_KERNELS(N)                                                                                      \
+static void ggml_vec_dot_q4_0_q8_0_##N(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) { \
+    assert(n == N); (void) n;                                                                                      \
+    *s = vec_dot_q4_0_q8_0_fixed(N/QK, vx, vy);                                                                    \
+}                                                                                                                  \
+static void ggml_vec_dot_q4_1_q8_0_##N(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) { \
+    assert(n == N); (void) n;                                                                                      \
+    *s = vec_dot_q4_1_q8_0_fixed(N/QK, vx, vy);                                                                    \
+}                                                                                                                  \
+static void ggml_vec_dot_f16_##N(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) { \
+    assert(n == N); (void) n;                                                                                      \
+    *s = vec_dot_f16_fixed(N, vx, vy);                                                                             \
+}                                                                                                                  \
+static double ggml_vec_norm_sq_f32_##N(const int n, const float * x) {                                            \
+    assert(n == N); (void) n;                                                                                      \
+    return vec_norm_sq_f32_fixed(N, x);                                                                            \
+}
+
+GGML_FIXED_KERNELS(128)
+GGML_FIXED_KERNELS(4096)
+GGML_FIXED_KERNELS(5120)
+GGML_FIXED_KERNELS(6656)
+GGML_FIXED_KERNELS(8192)
+GGML_FIXED_KERNELS(11008)
+GGML_FIXED_KERNELS(13824)
+GGML_FIXED_KERNELS(17920)
+GGML_FIXED_KERNELS(22016)
+
+#define GGML_FIXED_ENTRY(N) {                                       \
+        .n               = N,                                       \
+        .vec_dot_q4_0    = ggml_vec_dot_q4_0_q8_0_##N,              \
+        .vec_dot_q4_1    = ggml_vec_dot_q4_1_q8_0_##N,              \
+        .vec_dot_f16     = ggml_vec_dot_f16_##N,                    \
+        .vec_norm_sq_f32 = ggml_vec_norm_sq_f32_##N,                \
+    }
+#else
+#define GGML_FIXED_ENTRY(N) { .n = N }
+#endif
+
+static const ggml_fixed_kernels_t ggml_fixed_kernels[GGML_FIXED_COUNT] = {
+    GGML_FIXED_ENTRY(128),
+    GGML_FIXED_ENTRY(4096),
+    GGML_FIXED_ENTRY(5120),
+    GGML_FIXED_ENTRY(6656),
+    GGML_FIXED_ENTRY(8192),
+    GGML_FIXED_ENTRY(11008),
+    GGML_FIXED_ENTRY(13824),
+    GGML_FIXED_ENTRY(17920),
+    GGML_FIXED_ENTRY(22016),
+};
+
+//
+// fp16 <-> fp32 rows
+//
+
+static void fp16_to_fp32_row(const ggml_fp16_t * restrict x, float * restrict y, int n) {
+    int i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(y + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(x + i))));
+    }
+#endif
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i))));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        y[i] = ggml_fp16_to_fp32(x[i]);
+    }
+}
+
+static void fp32_to_fp16_row(const float * restrict x, ggml_fp16_t * restrict y, int n) {
+    int i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        _mm256_storeu_si256((__m256i *)(y + i), _mm512_cvtps_ph(_mm512_loadu_ps(x + i), 0));
+    }
+#endif
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(y + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), 0));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        y[i] = ggml_fp32_to_fp16(x[i]);
+    }
+}
+
+// the strided source rows (e.g. a permuted src1 of mul_mat) are gathered 16 or 8 elements at a time
+static void fp16_to_fp32_row_strided(const ggml_fp16_t * restrict x, const size_t sx, float * restrict y, int n) {
+    if (sx == sizeof(ggml_fp16_t)) {
+        fp16_to_fp32_row(x, y, n);
+        return;
+    }
+
+    const char * xb = (const char *) x;
+
+    int i = 0;
+
+#if defined(__AVX512F__) || defined(__F16C__)
+#if defined(__AVX512F__)
+    #define GGML_CVT_STEP 16
+#else
+    #define GGML_CVT_STEP 8
+#endif
+    // there is no 16-bit gather, go through a small buffer instead
+    ggml_fp16_t tmp[GGML_CVT_STEP];
+
+    for (; i + GGML_CVT_STEP <= n; i += GGML_CVT_STEP) {
+        for (int j = 0; j < GGML_CVT_STEP; ++j) {
+            memcpy(&tmp[j], xb + (i + j)*sx, sizeof(ggml_fp16_t));
+        }
+#if defined(__AVX512F__)
+        _mm512_storeu_ps(y + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *) tmp)));
+#else
+        _mm256_storeu_ps(y + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) tmp)));
+#endif
+    }
+    #undef GGML_CVT_STEP
+#endif
+
+    for (; i < n; ++i) {
+        y[i] = ggml_fp16_to_fp32(*(const ggml_fp16_t *) (xb + i*sx));
+    }
+}
+
+static void fp32_to_fp16_row_strided(const float * restrict x, const size_t sx, ggml_fp16_t * restrict y, int n) {
+    if (sx == sizeof(float)) {
+        fp32_to_fp16_row(x, y, n);
+        return;
+    }
+
+    const char * xb = (const char *) x;
+
+    int i = 0;
+
+#if defined(__AVX512F__)
+    // the gather offsets are 32-bit
+    if (sx <= INT32_MAX/16) {
+        const __m512i idx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32((int) sx));
+        for (; i + 16 <= n; i += 16) {
+            const __m512 v = _mm512_i32gather_ps(idx, xb + i*sx, 1);
+            _mm256_storeu_si256((__m256i *)(y + i), _mm512_cvtps_ph(v, 0));
+        }
+    }
+#elif defined(__AVX2__) && defined(__F16C__)
+    if (sx <= INT32_MAX/8) {
+        const __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int) sx));
+        for (; i + 8 <= n; i += 8) {
+            const __m256 v = _mm256_i32gather_ps((const float *) (xb + i*sx), idx, 1);
+            _mm_storeu_si128((__m128i *)(y + i), _mm256_cvtps_ph(v, 0));
+        }
+    }
+#endif
+
+    for (; i < n; ++i) {
+        y[i] = ggml_fp32_to_fp16(*(const float *) (xb + i*sx));
+    }
+}
+
+//
+// matrix multiplication
+//
+
+#if defined(__AVX512F__)
+#define GGML_GEMM_MR 32
+#else
+#define GGML_GEMM_MR 16
+#endif
+#define GGML_GEMM_NR 6
+
+static_assert(GGML_GEMM_MR*GGML_GEMM_NR <= GGML_GEMM_TILE_MAX, "GGML_GEMM_TILE_MAX too small");
+
+// c[j*ldc + i] += sum_l a[l*GGML_GEMM_MR + i]*b[l*GGML_GEMM_NR + j], for the GGML_GEMM_MR x GGML_GEMM_NR tile
+// the accumulators of the tile stay in registers for the whole k loop, hence the named variables
+static void ggml_gemm_f32(const int k, const float * restrict a, const float * restrict b, float * restrict c, const int ldc) {
+#if defined(__AVX512F__) || defined(__AVX__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#if defined(__AVX512F__)
+    // 2 x 16 rows
+    #define GGML_GEMM_V            __m512
+    #define GGML_GEMM_VL           16
+    #define GGML_GEMM_LOAD(p)      _mm512_loadu_ps(p)
+    #define GGML_GEMM_STORE(p, v)  _mm512_storeu_ps(p, v)
+    #define GGML_GEMM_SET1(x)      _mm512_set1_ps(x)
+    #define GGML_GEMM_FMA(s, x, y) _mm512_fmadd_ps(x, y, s)
+#elif defined(__AVX__)
+    // 2 x 8 rows
+    #define GGML_GEMM_V            __m256
+    #define GGML_GEMM_VL           8
+    #define GGML_GEMM_LOAD(p)      _mm256_loadu_ps(p)
+    #define GGML_GEMM_STORE(p, v)  _mm256_storeu_ps(p, v)
+    #define GGML_GEMM_SET1(x)      _mm256_set1_ps(x)
+#if defined(__FMA__)
+    #define GGML_GEMM_FMA(s, x, y) _mm256_fmadd_ps(x, y, s)
+#else
+    #define GGML_GEMM_FMA(s, x, y) _mm256_add_ps(_mm256_mul_ps(x, y), s)
+#endif
+#else
+    // 4 x 4 rows
+    #define GGML_GEMM_V            float32x4_t
+    #define GGML_GEMM_VL           4
+    #define GGML_GEMM_LOAD(p)      vld1q_f32(p)
+    #define GGML_GEMM_STORE(p, v)  vst1q_f32(p, v)
+    #define GGML_GEMM_SET1(x)      vdupq_n_f32(x)
+    #define GGML_GEMM_FMA(s, x, y) vfmaq_f32(s, x, y)
+#endif
+
+#if GGML_GEMM_MR == 2*GGML_GEMM_VL
+    #define GGML_GEMM_COL(j)                                                                             \
+        GGML_GEMM_V c##j##0 = GGML_GEMM_LOAD(c + j*ldc);                                                 \
+        GGML_GEMM_V c##j##1 = GGML_GEMM_LOAD(c + j*ldc + GGML_GEMM_VL);
+    #define GGML_GEMM_STEP(j)                                                                            \
+        {                                                                                                \
+            const GGML_GEMM_V bj = GGML_GEMM_SET1(b[l*GGML_GEMM_NR + j]);                                \
+            c##j##0 = GGML_GEMM_FMA(c##j##0, a0, bj);                                                    \
+            c##j##1 = GGML_GEMM_FMA(c##j##1, a1, bj);                                                    \
+        }
+    #define GGML_GEMM_SAVE(j)                                                                            \
+        GGML_GEMM_STORE(c + j*ldc,                c##j##0);                                              \
+        GGML_GEMM_STORE(c + j*ldc + GGML_GEMM_VL, c##j##1);
+#else
+    #define GGML_GEMM_COL(j)                                                                             \
+        GGML_GEMM_V c##j##0 = GGML_GEMM_LOAD(c + j*ldc);                                                 \
+        GGML_GEMM_V c##j##1 = GGML_GEMM_LOAD(c + j*ldc + GGML_GEMM_VL);                                  \
+        GGML_GEMM_V c##j##2 = GGML_GEMM_LOAD(c + j*ldc + 2*GGML_GEMM_VL);                                \
+        GGML_GEMM_V c##j##3 = GGML_GEMM_LOAD(c + j*ldc + 3*GGML_GEMM_VL);
+    #define GGML_GEMM_STEP(j)                                                                            \
+        {                                                                                                \
+            const GGML_GEMM_V bj = GGML_GEMM_SET1(b[l*GGML_GEMM_NR + j]);                                \
+            c##j##0 = GGML_GEMM_FMA(c##j##0, a0, bj);                                                    \
+            c##j##1 = GGML_GEMM_FMA(c##j##1, a1, bj);                                                    \
+            c##j##2 = GGML_GEMM_FMA(c##j##2, a2, bj);                                                    \
+            c##j##3 = GGML_GEMM_FMA(c##j##3, a3, bj);                                                    \
+        }
+    #define GGML_GEMM_SAVE(j)                                                                            \
+        GGML_GEMM_STORE(c + j*ldc,                  c##j##0);                                            \
+        GGML_GEMM_STORE(c + j*ldc +   GGML_GEMM_VL, c##j##1);                                            \
+        GGML_GEMM_STORE(c + j*ldc + 2*GGML_GEMM_VL, c##j##2);                                            \
+        GGML_GEMM_STORE(c + j*ldc + 3*GGML_GEMM_VL, c##j##3);
+#endif
+
+    GGML_GEMM_COL(0) GGML_GEMM_COL(1) GGML_GEMM_COL(2)
+    GGML_GEMM_COL(3) GGML_GEMM_COL(4) GGML_GEMM_COL(5)
+
+    for (int l = 0; l < k; ++l) {
+        const float * al = a + l*GGML_GEMM_MR;
+
+        const GGML_GEMM_V a0 = GGML_GEMM_LOAD(al);
+        const GGML_GEMM_V a1 = GGML_GEMM_LOAD(al + GGML_GEMM_VL);
+#if GGML_GEMM_MR == 4*GGML_GEMM_VL
+        const GGML_GEMM_V a2 = GGML_GEMM_LOAD(al + 2*GGML_GEMM_VL);
+        const GGML_GEMM_V a3 = GGML_GEMM_LOAD(al + 3*GGML_GEMM_VL);
+#endif
+
+        GGML_GEMM_STEP(0) GGML_GEMM_STEP(1) GGML_GEMM_STEP(2)
+        GGML_GEMM_STEP(3) GGML_GEMM_STEP(4) GGML_GEMM_STEP(5)
+    }
+
+    GGML_GEMM_SAVE(0) GGML_GEMM_SAVE(1) GGML_GEMM_SAVE(2)
+    GGML_GEMM_SAVE(3) GGML_GEMM_SAVE(4) GGML_GEMM_SAVE(5)
+
+    #undef GGML_GEMM_V
+    #undef GGML_GEMM_VL
+    #undef GGML_GEMM_LOAD
+    #undef GGML_GEMM_STORE
+    #undef GGML_GEMM_SET1
+    #undef GGML_GEMM_FMA
+    #undef GGML_GEMM_COL
+    #undef GGML_GEMM_STEP
+    #undef GGML_GEMM_SAVE
+#else
+    float acc[GGML_GEMM_NR][GGML_GEMM_MR];
+
+    for (int j = 0; j < GGML_GEMM_NR; ++j) {
+        for (int i = 0; i < GGML_GEMM_MR; ++i) {
+            acc[j][i] = c[j*ldc + i];
+        }
+    }
+
+    for (int l = 0; l < k; ++l) {
+        for (int j = 0; j < GGML_GEMM_NR; ++j) {
+            const float bj = b[l*GGML_GEMM_NR + j];
+            for (int i = 0; i < GGML_GEMM_MR; ++i) {
+                acc[j][i] += a[l*GGML_GEMM_MR + i]*bj;
+            }
+        }
+    }
+
+    for (int j = 0; j < GGML_GEMM_NR; ++j) {
+        for (int i = 0; i < GGML_GEMM_MR; ++i) {
+            c[j*ldc + i] = acc[j][i];
+        }
+    }
+#endif
+}
+
+//
+// exp, silu, soft_max
+//
+
+// expf with the Cephes polynomial, max error ~2 ulp - inputs below -87.3 (including -inf) give 0
+// the input is clamped above at 88.0, where the result is ~1.6e38 instead of overflowing
+#define GGML_EXP_HI      88.0296919311f
+#define GGML_EXP_LO     -87.3365447506f
+#define GGML_EXP_LOG2EF  1.44269504088896341f
+#define GGML_EXP_C1      0.693359375f
+#define GGML_EXP_C2     -2.12194440e-4f
+#define GGML_EXP_P0      1.9875691500e-4f
+#define GGML_EXP_P1      1.3981999507e-3f
+#define GGML_EXP_P2      8.3334519073e-3f
+#define GGML_EXP_P3      4.1665795894e-2f
+#define GGML_EXP_P4      1.6666665459e-1f
+#define GGML_EXP_P5      5.0000001201e-1f
+
+#if defined(__AVX512F__)
+static inline __m512 ggml_v_expf_avx512(const __m512 x) {
+    const __m512 xc = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(GGML_EXP_LO)), _mm512_set1_ps(GGML_EXP_HI));
+
+    // x = n*ln2 + r, |r| <= ln2/2
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(xc, _mm512_set1_ps(GGML_EXP_LOG2EF)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(GGML_EXP_C1), xc);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(GGML_EXP_C2), r);
+
+    __m512 p = _mm512_set1_ps(GGML_EXP_P0);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GGML_EXP_P1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GGML_EXP_P2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GGML_EXP_P3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GGML_EXP_P4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GGML_EXP_P5));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    // 2^n
+    const __m512i e = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+
+    const __mmask16 m = _mm512_cmp_ps_mask(x, _mm512_set1_ps(GGML_EXP_LO), _CMP_GE_OQ);
+
+    return _mm512_maskz_mul_ps(m, p, _mm512_castsi512_ps(e));
+}
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+static inline __m256 ggml_v_expf_avx2(const __m256 x) {
+    const __m256 xc = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(GGML_EXP_LO)), _mm256_set1_ps(GGML_EXP_HI));
+
+    // x = n*ln2 + r, |r| <= ln2/2
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(xc, _mm256_set1_ps(GGML_EXP_LOG2EF)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(GGML_EXP_C1), xc);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(GGML_EXP_C2), r);
+
+    __m256 p = _mm256_set1_ps(GGML_EXP_P0);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GGML_EXP_P1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GGML_EXP_P2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GGML_EXP_P3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GGML_EXP_P4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GGML_EXP_P5));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    // 2^n
+    const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+
+    const __m256 m = _mm256_cmp_ps(x, _mm256_set1_ps(GGML_EXP_LO), _CMP_GE_OQ);
+
+    return _mm256_and_ps(m, _mm256_mul_ps(p, _mm256_castsi256_ps(e)));
+}
+#endif
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+static void vec_silu_f32(const int n, float * restrict y, const float * restrict x) {
+    int i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        const __m512 v = _mm512_loadu_ps(x + i);
+        _mm512_storeu_ps(y + i, _mm512_div_ps(v, _mm512_add_ps(_mm512_set1_ps(1.0f), ggml_v_expf_avx512(_mm512_sub_ps(_mm512_setzero_ps(), v)))));
+    }
+#else
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(x + i);
+        _mm256_storeu_ps(y + i, _mm256_div_ps(v, _mm256_add_ps(_mm256_set1_ps(1.0f), ggml_v_expf_avx2(_mm256_sub_ps(_mm256_setzero_ps(), v)))));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        y[i] = x[i]/(1.0f + expf(-x[i]));
+    }
+}
+
+static void vec_silu_mul_f32(const int n, float * restrict z, const float * restrict x, const float * restrict y) {
+    int i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        const __m512 v = _mm512_loadu_ps(x + i);
+        const __m512 s = _mm512_div_ps(v, _mm512_add_ps(_mm512_set1_ps(1.0f), ggml_v_expf_avx512(_mm512_sub_ps(_mm512_setzero_ps(), v))));
+        _mm512_storeu_ps(z + i, _mm512_mul_ps(s, _mm512_loadu_ps(y + i)));
+    }
+#else
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(x + i);
+        const __m256 s = _mm256_div_ps(v, _mm256_add_ps(_mm256_set1_ps(1.0f), ggml_v_expf_avx2(_mm256_sub_ps(_mm256_setzero_ps(), v))));
+        _mm256_storeu_ps(z + i, _mm256_mul_ps(s, _mm256_loadu_ps(y + i)));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        z[i] = x[i]/(1.0f + expf(-x[i]))*y[i];
+    }
+}
+
+// x and y can be the same array
+static double vec_soft_max_f32(const int n, float * y, const float * x, const float max) {
+    int i = 0;
+    double sum = 0.0;
+
+#if defined(__AVX512F__)
+    __m512 acc = _mm512_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        const __m512 v = ggml_v_expf_avx512(_mm512_sub_ps(_mm512_loadu_ps(x + i), _mm512_set1_ps(max)));
+        _mm512_storeu_ps(y + i, v);
+        acc = _mm512_add_ps(acc, v);
+    }
+    sum += (double) _mm512_reduce_add_ps(acc);
+#else
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = ggml_v_expf_avx2(_mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_set1_ps(max)));
+        _mm256_storeu_ps(y + i, v);
+        acc = _mm256_add_ps(acc, v);
+    }
+    __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+    acc4 = _mm_add_ss(acc4, _mm_movehdup_ps(acc4));
+    sum += (double) _mm_cvtss_f32(acc4);
+#endif
+
+    for (; i < n; ++i) {
+        const float v = x[i] == -INFINITY ? 0.0f : expf(x[i] - max);
+        y[i] = v;
+        sum += (double) v;
+    }
+
+    return sum;
+}
+#endif
+
+//
+// kernel table
+//
+
+#if defined(GGML_KERNELS_VARIANT)
+#define GGML_KERNELS_NAME_(variant) #variant
+#define GGML_KERNELS_NAME(variant)  GGML_KERNELS_NAME_(variant)
+#define GGML_KERNELS_INIT_(variant) ggml_kernels_init_ ## variant
+#define GGML_KERNELS_INIT(variant)  GGML_KERNELS_INIT_(variant)
+
+void GGML_KERNELS_INIT(GGML_KERNELS_VARIANT)(ggml_kernels_t * kernels) {
+    kernels->name = GGML_KERNELS_NAME(GGML_KERNELS_VARIANT);
+#else
+void ggml_kernels_init_generic(ggml_kernels_t * kernels) {
+    kernels->name = "generic";
+#endif
+
+    memset(kernels->quantize_fns, 0, sizeof(kernels->quantize_fns));
+
+    kernels->quantize_fns[GGML_TYPE_Q4_0] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q4_0,
+        .quantize_row_q           = quantize_row_q4_0,
+        .quantize_row_q_reference = quantize_row_q4_0_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q4_0_q8_0,
+    };
+    kernels->quantize_fns[GGML_TYPE_Q4_1] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q4_1,
+        .quantize_row_q           = quantize_row_q4_1,
+        .quantize_row_q_reference = quantize_row_q4_1_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q4_1_q8_0,
+    };
+
+    kernels->quantize_fns[GGML_TYPE_Q8_0] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q8_0,
+        .quantize_row_q           = quantize_row_q8_0,
+        .quantize_row_q_reference = quantize_row_q8_0_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q8_0_q8_0,
+    };
+
+    kernels->quantize_fns[GGML_TYPE_Q2_1] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q2_1,
+        .quantize_row_q           = quantize_row_q2_1_reference,
+        .quantize_row_q_reference = quantize_row_q2_1_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q2_1_q8_0,
+    };
+    kernels->quantize_fns[GGML_TYPE_Q3_1] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q3_1,
+        .quantize_row_q           = quantize_row_q3_1_reference,
+        .quantize_row_q_reference = quantize_row_q3_1_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q3_1_q8_0,
+    };
+
+    kernels->quantize_fns[GGML_TYPE_Q4_2] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q4_2,
+        .quantize_row_q           = quantize_row_q4_2_reference,
+        .quantize_row_q_reference = quantize_row_q4_2_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q4_2_q8_0,
+    };
+    kernels->quantize_fns[GGML_TYPE_Q4_3] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q4_3,
+        .quantize_row_q           = quantize_row_q4_3_reference,
+        .quantize_row_q_reference = quantize_row_q4_3_reference,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q4_3_q8_0,
+    };
+
+    kernels->quantize_fns[GGML_TYPE_Q4_0_X8] = (quantize_fns_t) {
+        .dequantize_row_q         = dequantize_row_q4_0x8,
+        .quantize_row_q           = NULL, // see ggml_repack_q4_0_x8
+        .quantize_row_q_reference = NULL,
+        .quantize_row_q_dot       = quantize_row_q8_0,
+        .vec_dot_q                = ggml_vec_dot_q4_0x8_q8_0,
+    };
+
+    kernels->fp16_to_fp32_row = fp16_to_fp32_row;
+    kernels->fp32_to_fp16_row = fp32_to_fp16_row;
+
+    kernels->fp16_to_fp32_row_strided = fp16_to_fp32_row_strided;
+    kernels->fp32_to_fp16_row_strided = fp32_to_fp16_row_strided;
+
+    memcpy(kernels->fixed, ggml_fixed_kernels, sizeof(ggml_fixed_kernels));
+
+    kernels->gemm_mr  = GGML_GEMM_MR;
+    kernels->gemm_nr  = GGML_GEMM_NR;
+    kernels->gemm_f32 = ggml_gemm_f32;
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+    kernels->vec_silu_f32     = vec_silu_f32;
+    kernels->vec_silu_mul_f32 = vec_silu_mul_f32;
+    kernels->vec_soft_max_f32 = vec_soft_max_f32;
+#else
+    kernels->vec_silu_f32     = NULL;
+    kernels->vec_silu_mul_f32 = NULL;
+    kernels->vec_soft_max_f32 = NULL;
+#endif
+
+    kernels->vec_norm_sq_f32   = vec_norm_sq_f32;
+    kernels->vec_scale_mul_f32 = vec_scale_mul_f32;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+//
+// Quantization, fp16 conversion, matrix multiplication and activation kernels (ggml-kernels.c)
+//
+// ggml-kernels.c is compiled once with the flags of the build. With GGML_USE_DISPATCH it is compiled again for
+// each of the x86 ISA levels declared below, and ggml_init() selects the best set supported by the CPU.
+// This header is internal to ggml.
+//
+
+#include "ggml.h"
+
+#include <stdint.h>
+
+// if C99 - static_assert is noop
+// ref: https://stackoverflow.com/a/53923785/4039976
+#ifndef static_assert
+#define static_assert(cond, msg) struct global_scope_noop_trick
+#endif
+
+#ifdef __HAIKU__
+#define static_assert(cond, msg) _Static_assert(cond, msg)
+#endif
+
+#define QK 32
+
+// method 5
+// blocks of QK elements
+// represented with a single float (delta) and QK/2 8-bit ints (i.e QK 4-bit signed integer factors)
+typedef struct {
+    float   d; // delta
+    uint8_t qs[QK / 2]; // nibbles / quants
+} block_q4_0;
+static_assert(sizeof(block_q4_0) == sizeof(float) + QK / 2, "wrong q4_0 block size/padding");
+
+// 8 rows of block_q4_0, interleaved for the multi-row dot product (GGML_TYPE_Q4_0_X8, see ggml_repack_q4_0_x8)
+// qs[32*j + 4*r + t] holds element 4*j + t of row r in the low nibble and element 16 + 4*j + t in the high nibble,
+// so each 32-bit lane of qs[32*j .. 32*j + 31] belongs to one row
+typedef struct {
+    float   d[8];       // deltas of the 8 rows
+    uint8_t qs[8*QK/2]; // nibbles / quants
+} block_q4_0x8;
+static_assert(sizeof(block_q4_0x8) == 8*sizeof(block_q4_0), "wrong q4_0x8 block size/padding");
+
+// method 4
+// blocks of QK elements
+// represented with 2 floats (delta + min) and QK/2 8-bit ints (i.e QK 4-bit unsigned integer factors)
+typedef struct {
+    float   d;
+    float   m;
+    uint8_t qs[QK / 2]; // nibbles / quants
+} block_q4_1;
+static_assert(sizeof(block_q4_1) == sizeof(float) * 2 + QK / 2, "wrong q4_1 block size/padding");
+
+// block_q4_0 with a fp16 delta - 18 bytes instead of 20
+typedef struct {
+    ggml_fp16_t d;          // delta
+    uint8_t     qs[QK / 2]; // nibbles / quants
+} block_q4_2;
+static_assert(sizeof(block_q4_2) == sizeof(ggml_fp16_t) + QK / 2, "wrong q4_2 block size/padding");
+
+// block_q4_1 with a fp16 delta and min - 20 bytes instead of 24
+typedef struct {
+    ggml_fp16_t d;
+    ggml_fp16_t m;
+    uint8_t     qs[QK / 2]; // nibbles / quants
+} block_q4_3;
+static_assert(sizeof(block_q4_3) == sizeof(ggml_fp16_t) * 2 + QK / 2, "wrong q4_3 block size/padding");
+
+// blocks of QK elements
+// represented with 2 fp16 (delta + min) and QK 2-bit unsigned integer factors
+// qs[j] holds elements j, j + 8, j + 16 and j + 24, from the low bits up
+typedef struct {
+    ggml_fp16_t d;
+    ggml_fp16_t m;
+    uint8_t     qs[QK / 4]; // 2-bit quants
+} block_q2_1;
+static_assert(sizeof(block_q2_1) == sizeof(ggml_fp16_t) * 2 + QK / 4, "wrong q2_1 block size/padding");
+
+// blocks of QK elements
+// represented with 2 fp16 (delta + min) and QK 3-bit unsigned integer factors
+// the low 2 bits are stored as in block_q2_1, bit l of qh is the high bit of element l
+typedef struct {
+    ggml_fp16_t d;
+    ggml_fp16_t m;
+    uint8_t     qs[QK / 4]; // low 2 bits of the quants
+    uint8_t     qh[QK / 8]; // high bit of the quants
+} block_q3_1;
+static_assert(sizeof(block_q3_1) == sizeof(ggml_fp16_t) * 2 + QK / 4 + QK / 8, "wrong q3_1 block size/padding");
+
+// blocks of QK elements
+// represented with a single float (delta) and QK 8-bit signed integer factors
+// used for the src1 rows of the quantized matrix multiplication
+typedef struct {
+    float   d;      // delta
+    int8_t  qs[QK]; // quants
+} block_q8_0;
+static_assert(sizeof(block_q8_0) == sizeof(float) + QK, "wrong q8_0 block size/padding");
+
+typedef void (*ggml_fp16_to_fp32_row_t)(const ggml_fp16_t * GGML_RESTRICT x, float * GGML_RESTRICT y, int n);
+typedef void (*ggml_fp32_to_fp16_row_t)(const float * GGML_RESTRICT x, ggml_fp16_t * GGML_RESTRICT y, int n);
+
+// same, with the elements of x sx bytes apart
+typedef void (*ggml_fp16_to_fp32_row_strided_t)(const ggml_fp16_t * GGML_RESTRICT x, size_t sx, float * GGML_RESTRICT y, int n);
+typedef void (*ggml_fp32_to_fp16_row_strided_t)(const float * GGML_RESTRICT x, size_t sx, ggml_fp16_t * GGML_RESTRICT y, int n);
+
+// C += A*B for one gemm_mr x gemm_nr tile of dst (see ggml_compute_forward_mul_mat_gemm)
+// A is packed as a[l*gemm_mr + i] and B as b[l*gemm_nr + j] for l < k, C is stored as c[j*ldc + i]
+typedef void (*ggml_gemm_f32_t)(int k, const float * GGML_RESTRICT a, const float * GGML_RESTRICT b, float * GGML_RESTRICT c, int ldc);
+
+// upper bound of gemm_mr*gemm_nr over all the kernel sets
+#define GGML_GEMM_TILE_MAX 256
+
+typedef void   (*ggml_vec_silu_f32_t)    (int n, float * y, const float * x);
+typedef void   (*ggml_vec_silu_mul_f32_t)(int n, float * z, const float * x, const float * y);
+typedef double (*ggml_vec_soft_max_f32_t)(int n, float * y, const float * x, float max);
+
+typedef double (*ggml_vec_norm_sq_f32_t)  (int n, const float * x); // sum(x[i]^2)
+typedef void   (*ggml_vec_scale_mul_f32_t)(int n, float * y, const float * x, float s, const float * w);
+
+// row lengths with kernels specialised at compile time: the head size and the n_embd and n_ff
+// of the LLaMA 7B, 13B, 30B and 65B models - all multiples of 4*QK
+#define GGML_FIXED_COUNT 9
+
+// NULL where the kernel set has no specialisation
+typedef struct {
+    int n;
+
+    vec_dot_q_t vec_dot_q4_0; // GGML_TYPE_Q4_0 x q8_0
+    vec_dot_q_t vec_dot_q4_1; // GGML_TYPE_Q4_1 x q8_0
+    vec_dot_q_t vec_dot_f16;  // GGML_TYPE_F16 x GGML_TYPE_F16
+
+    ggml_vec_norm_sq_f32_t vec_norm_sq_f32;
+} ggml_fixed_kernels_t;
+
+// the kernels of one ISA level
+typedef struct {
+    const char * name; // the value of GGML_ISA that selects this set
+
+    quantize_fns_t quantize_fns[GGML_TYPE_COUNT];
+
+    ggml_fp16_to_fp32_row_t fp16_to_fp32_row;
+    ggml_fp32_to_fp16_row_t fp32_to_fp16_row;
+
+    ggml_fp16_to_fp32_row_strided_t fp16_to_fp32_row_strided;
+    ggml_fp32_to_fp16_row_strided_t fp32_to_fp16_row_strided;
+
+    ggml_fixed_kernels_t fixed[GGML_FIXED_COUNT];
+
+    int             gemm_mr; // rows of the register tile, along the src0 rows (dst->ne[0])
+    int             gemm_nr; // columns of the register tile, along the src1 rows (dst->ne[1])
+    ggml_gemm_f32_t gemm_f32;
+
+    // f32 polynomial exp - NULL without a SIMD version, ggml.c then uses the fp16 lookup tables
+    ggml_vec_silu_f32_t     vec_silu_f32;     // y = x*sigmoid(x)
+    ggml_vec_silu_mul_f32_t vec_silu_mul_f32; // z = x*sigmoid(x)*y
+    ggml_vec_soft_max_f32_t vec_soft_max_f32; // y = exp(x - max), returns sum(y) - x may alias y
+
+    // rms_norm
+    ggml_vec_norm_sq_f32_t   vec_norm_sq_f32;   // sum(x[i]^2)
+    ggml_vec_scale_mul_f32_t vec_scale_mul_f32; // y = x*s*w, or x*s when w is NULL - x may alias y
+} ggml_kernels_t;
+
+// compiled with the flags of the build
+void ggml_kernels_init_generic(ggml_kernels_t * kernels);
+
+#if defined(GGML_USE_DISPATCH)
+// compiled with the flags of the corresponding ISA level - call only if the CPU supports it
+void ggml_kernels_init_avx        (ggml_kernels_t * kernels); // AVX + F16C
+void ggml_kernels_init_avx2       (ggml_kernels_t * kernels); // AVX2 + FMA + F16C
+void ggml_kernels_init_avx512     (ggml_kernels_t * kernels); // AVX2 + AVX512F/BW/VL
+void ggml_kernels_init_avx512_vnni(ggml_kernels_t * kernels); // AVX512 + AVX512_VNNI
+#endif
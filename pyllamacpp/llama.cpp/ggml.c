@@ -2,6 +2,7 @@
 #define _GNU_SOURCE
 
 #include "ggml.h"
+#include "ggml-kernels.h"
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #include <malloc.h> // using malloc.h with MSC/MINGW
@@ -115,6 +116,9 @@ typedef void* thread_ret_t;
 #define GGML_SOFT_MAX_UNROLL 4
 #define GGML_VEC_DOT_UNROLL  2
 
+// number of k/v rows processed at once by the online softmax in ggml_flash_attn
+#define GGML_FLASH_ATTN_BLOCK 64
+
 #ifdef GGML_USE_ACCELERATE
 // uncomment to use vDSP for soft max computation
 // note: not sure if it is actually faster
@@ -144,6 +148,14 @@ typedef void* thread_ret_t;
 #include <cblas.h>
 #endif
 
+#ifdef GGML_USE_DISPATCH
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
 #undef MIN
 #undef MAX
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -321,6 +333,9 @@ static ggml_fp16_t table_exp_f16[1 << 16];
 // precomputed f32 table for f16 (256 KB)
 static float table_f32_f16[1 << 16];
 
+// the kernels in use (ggml-kernels.c), selected once by ggml_init() or by the first function that needs them
+static ggml_kernels_t g_kernels;
+
 // On ARM NEON, it's quicker to directly convert x -> x instead of calling into ggml_lookup_fp16_to_fp32,
 // so we define GGML_FP16_TO_FP32 and GGML_FP32_TO_FP16 elsewhere for NEON.
 // This is also true for POWER9.
@@ -419,780 +434,6 @@ int64_t ggml_cycles_per_ms(void) {
 
 static const size_t CACHE_LINE_SIZE_F32 = CACHE_LINE_SIZE/sizeof(float);
 
-//
-// quantization
-//
-
-#define QK 32
-
-// AVX routines provided by GH user Const-me
-// ref: https://github.com/ggerganov/ggml/pull/27#issuecomment-1464934600
-#if __AVX2__ || __AVX512F__
-// Unpack 32 4-bit fields into 32 bytes
-// The output vector contains 32 bytes, each one in [ 0 .. 15 ] interval
-static inline __m256i bytesFromNibbles( const uint8_t* rsi )
-{
-    // Load 16 bytes from memory
-    __m128i tmp = _mm_loadu_si128( ( const __m128i* )rsi );
-
-    // Expand bytes into uint16_t values
-    __m256i bytes = _mm256_cvtepu8_epi16( tmp );
-
-    // Unpack values into individual bytes
-    const __m256i lowMask = _mm256_set1_epi8( 0xF );
-    __m256i high = _mm256_andnot_si256( lowMask, bytes );
-    __m256i low = _mm256_and_si256( lowMask, bytes );
-    high = _mm256_slli_epi16( high, 4 );
-    bytes = _mm256_or_si256( low, high );
-    return bytes;
-}
-
-static inline __m128i packNibbles( __m256i bytes )
-{
-    // Move bits within 16-bit lanes from 0000_abcd_0000_efgh into 0000_0000_abcd_efgh
-    const __m256i lowByte = _mm256_set1_epi16( 0xFF );
-    __m256i high = _mm256_andnot_si256( lowByte, bytes );
-    __m256i low = _mm256_and_si256( lowByte, bytes );
-    high = _mm256_srli_epi16( high, 4 );
-    bytes = _mm256_or_si256( low, high );
-
-    // Compress uint16_t lanes into bytes
-    __m128i r0 = _mm256_castsi256_si128( bytes );
-    __m128i r1 = _mm256_extracti128_si256( bytes, 1 );
-    return _mm_packus_epi16( r0, r1 );
-}
-#elif __AVX__
-static inline __m128i bytesFromNibbles( const uint8_t* rsi )
-{
-    // Load 8 bytes from memory
-    __m128i tmp = _mm_loadu_si64( ( const __m128i* )rsi );
-
-    // Expand bytes into uint16_t values
-    __m128i bytes = _mm_cvtepu8_epi16( tmp );
-
-    // Unpack values into individual bytes
-    const __m128i lowMask = _mm_set1_epi8( 0xF );
-    __m128i high = _mm_andnot_si128( lowMask, bytes );
-    __m128i low = _mm_and_si128( lowMask, bytes );
-    high = _mm_slli_epi16( high, 4 );
-    bytes = _mm_or_si128( low, high );
-    return bytes;
-}
-
-static inline __m128i packNibbles( __m128i bytes1, __m128i bytes2 )
-{
-    // Move bits within 16-bit lanes from 0000_abcd_0000_efgh into 0000_0000_abcd_efgh
-    const __m128i lowByte = _mm_set1_epi16( 0xFF );
-    __m128i high = _mm_andnot_si128( lowByte, bytes1 );
-    __m128i low = _mm_and_si128( lowByte, bytes1 );
-    high = _mm_srli_epi16( high, 4 );
-    bytes1 = _mm_or_si128( low, high );
-    high = _mm_andnot_si128( lowByte, bytes2 );
-    low = _mm_and_si128( lowByte, bytes2 );
-    high = _mm_srli_epi16( high, 4 );
-    bytes2 = _mm_or_si128( low, high );
-
-    return _mm_packus_epi16( bytes1, bytes2);
-}
-#endif
-
-// method 5
-// blocks of QK elements
-// represented with a single float (delta) and QK/2 8-bit ints (i.e QK 4-bit signed integer factors)
-typedef struct {
-    float   d; // delta
-    uint8_t qs[QK / 2]; // nibbles / quants
-} block_q4_0;
-static_assert(sizeof(block_q4_0) == sizeof(float) + QK / 2, "wrong q4_0 block size/padding");
-
-// method 4
-// blocks of QK elements
-// represented with 2 floats (delta + min) and QK/2 8-bit ints (i.e QK 4-bit unsigned integer factors)
-typedef struct {
-    float   d;
-    float   m;
-    uint8_t qs[QK / 2]; // nibbles / quants
-} block_q4_1;
-static_assert(sizeof(block_q4_1) == sizeof(float) * 2 + QK / 2, "wrong q4_1 block size/padding");
-
-// reference implementation for deterministic creation of model files
-static void quantize_row_q4_0_reference(const float * restrict x, block_q4_0 * restrict y, int k) {
-    assert(k % QK == 0);
-    const int nb = k / QK;
-
-    uint8_t pp[QK/2];
-
-    for (int i = 0; i < nb; i++) {
-        float amax = 0.0f; // absolute max
-
-        for (int l = 0; l < QK; l++) {
-            const float v = x[i*QK + l];
-            amax = MAX(amax, fabsf(v));
-        }
-
-        const float d = amax / ((1 << 3) - 1);
-        const float id = d ? 1.0f/d : 0.0f;
-
-        y[i].d = d;
-
-        for (int l = 0; l < QK; l += 2) {
-            const float v0 = x[i*QK + l + 0]*id;
-            const float v1 = x[i*QK + l + 1]*id;
-
-            const uint8_t vi0 = (int8_t)roundf(v0) + 8;
-            const uint8_t vi1 = (int8_t)roundf(v1) + 8;
-
-            assert(vi0 < 16);
-            assert(vi1 < 16);
-
-            pp[l/2] = vi0 | (vi1 << 4);
-        }
-
-        memcpy(y[i].qs, pp, sizeof(pp));
-    }
-}
-
-static void quantize_row_q4_0(const float * restrict x, void * restrict vy, int k) {
-    assert(k % QK == 0);
-    const int nb = k / QK;
-
-    block_q4_0 * restrict y = vy;
-
-#if defined(__POWER9_VECTOR__)
-    const vector float v85 = vec_splats(8.5f);
-    for (int i = 0; i < nb; i++) {
-        float amax = 0.0f; // absolute max
-
-        vector float srcv [8];
-        vector float asrcv[8];
-        vector float amaxv[8];
-
-        for (int l = 0; l < 8; l++) srcv[l]  = *(vector float *)(x + i*32 + 4*l);
-        for (int l = 0; l < 8; l++) asrcv[l] = vec_abs(srcv[l]);
-
-        for (int l = 0; l < 4; l++) amaxv[2*l] = vec_max(asrcv[2*l], asrcv[2*l+1]);
-        //for (int l = 0; l < 2; l++) amaxv[4*l] = vec_max(amaxv[4*l], amaxv[4*l+2]);
-        amaxv[0] = vec_max(amaxv[0], amaxv[2]);
-        amaxv[4] = vec_max(amaxv[4], amaxv[6]);
-        //for (int l = 0; l < 1; l++) amaxv[8*l] = vec_max(amaxv[8*l], amaxv[8*l+4]);
-        amaxv[0] = vec_max(amaxv[0], amaxv[4]);
-
-        amax = MAX(
-                MAX(vec_extract(amaxv[0], 0), vec_extract(amaxv[0], 1)),
-                MAX(vec_extract(amaxv[0], 2), vec_extract(amaxv[0], 3)));
-
-        const float d = amax / ((1 << 3) - 1);
-        const float id = d ? 1.0/d : 0.0;
-
-        y[i].d = d;
-
-        const vector float vid = vec_splats(id);
-        uint8_t * restrict pb = y[i].qs;
-        for (int l = 0; l < 8; l++) {
-            const vector float vf  = vec_madd(srcv[l], vid, v85);
-            const vector signed int vi = vec_signed(vf);
-
-            pb[2*l + 0] = vec_extract(vi, 0) | (vec_extract(vi, 1) << 4);
-            pb[2*l + 1] = vec_extract(vi, 2) | (vec_extract(vi, 3) << 4);
-        }
-    }
-#elif __ARM_NEON
-    for (int i = 0; i < nb; i++) {
-        float32x4_t srcv [8];
-        float32x4_t asrcv[8];
-        float32x4_t amaxv[8];
-
-        for (int l = 0; l < 8; l++) srcv[l]  = vld1q_f32(x + i*32 + 4*l);
-        for (int l = 0; l < 8; l++) asrcv[l] = vabsq_f32(srcv[l]);
-
-        for (int l = 0; l < 4; l++) amaxv[2*l] = vmaxq_f32(asrcv[2*l], asrcv[2*l+1]);
-        for (int l = 0; l < 2; l++) amaxv[4*l] = vmaxq_f32(amaxv[4*l], amaxv[4*l+2]);
-        for (int l = 0; l < 1; l++) amaxv[8*l] = vmaxq_f32(amaxv[8*l], amaxv[8*l+4]);
-
-        // absolute max
-        const float amax = MAX(
-                MAX(vgetq_lane_f32(amaxv[0], 0), vgetq_lane_f32(amaxv[0], 1)),
-                MAX(vgetq_lane_f32(amaxv[0], 2), vgetq_lane_f32(amaxv[0], 3)));
-
-        const float d = amax / ((1 << 3) - 1);
-        const float id = d ? 1.0f/d : 0.0f;
-
-        y[i].d = d;
-
-        for (int l = 0; l < 8; l++) {
-            const float32x4_t v  = vmulq_n_f32(srcv[l], id);
-            const float32x4_t vf = vaddq_f32(v, vdupq_n_f32(8.5f));
-            const int32x4_t   vi = vcvtq_s32_f32(vf);
-
-            y[i].qs[2*l + 0] = vgetq_lane_s32(vi, 0) | (vgetq_lane_s32(vi, 1) << 4);
-            y[i].qs[2*l + 1] = vgetq_lane_s32(vi, 2) | (vgetq_lane_s32(vi, 3) << 4);
-        }
-    }
-#elif defined(__AVX2__)
-    for (int i = 0; i < nb; i++) {
-        // Load elements into 4 AVX vectors
-        __m256 v0 = _mm256_loadu_ps( x );
-        __m256 v1 = _mm256_loadu_ps( x + 8 );
-        __m256 v2 = _mm256_loadu_ps( x + 16 );
-        __m256 v3 = _mm256_loadu_ps( x + 24 );
-        x += 32;
-
-        // Compute max(abs(e)) for the block
-        const __m256 signBit = _mm256_set1_ps( -0.0f );
-        __m256 maxAbs = _mm256_andnot_ps( signBit, v0 );
-        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v1 ) );
-        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v2 ) );
-        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v3 ) );
-
-        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
-        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
-        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
-        const float maxScalar = _mm_cvtss_f32( max4 );
-
-        // Quantize these floats
-        const float d = maxScalar / 7.0f;
-        y[i].d = d;
-        const float id = ( maxScalar != 0.0f ) ? 7.0f / maxScalar : 0.0f;
-        const __m256 mul = _mm256_set1_ps( id );
-
-        // Apply the multiplier
-        v0 = _mm256_mul_ps( v0, mul );
-        v1 = _mm256_mul_ps( v1, mul );
-        v2 = _mm256_mul_ps( v2, mul );
-        v3 = _mm256_mul_ps( v3, mul );
-
-        // Round to nearest integer
-        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
-        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
-        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
-        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
-
-        // Convert floats to integers
-        __m256i i0 = _mm256_cvtps_epi32( v0 );
-        __m256i i1 = _mm256_cvtps_epi32( v1 );
-        __m256i i2 = _mm256_cvtps_epi32( v2 );
-        __m256i i3 = _mm256_cvtps_epi32( v3 );
-
-        // Convert int32 to int16
-        i0 = _mm256_packs_epi32( i0, i1 );	// 0, 1, 2, 3,  8, 9, 10, 11,  4, 5, 6, 7, 12, 13, 14, 15
-        i2 = _mm256_packs_epi32( i2, i3 );	// 16, 17, 18, 19,  24, 25, 26, 27,  20, 21, 22, 23, 28, 29, 30, 31
-                                            // Convert int16 to int8
-        i0 = _mm256_packs_epi16( i0, i2 );	// 0, 1, 2, 3,  8, 9, 10, 11,  16, 17, 18, 19,  24, 25, 26, 27,  4, 5, 6, 7, 12, 13, 14, 15, 20, 21, 22, 23, 28, 29, 30, 31
-
-        // We got our precious signed bytes, but the order is now wrong
-        // These AVX2 pack instructions process 16-byte pieces independently
-        // The following instruction is fixing the order
-        const __m256i perm = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
-        i0 = _mm256_permutevar8x32_epi32( i0, perm );
-
-        // Apply offset to translate the range from [ -7 .. +7 ] into [ +1 .. +15 ]
-        const __m256i off = _mm256_set1_epi8( 8 );
-        i0 = _mm256_add_epi8( i0, off );
-
-        // Compress the vector into 4 bit/value, and store
-        __m128i res = packNibbles( i0 );
-        _mm_storeu_si128( ( __m128i* )y[i].qs, res );
-    }
-#elif defined(__AVX__)
-    for (int i = 0; i < nb; i++) {
-        // Load elements into 4 AVX vectors
-        __m256 v0 = _mm256_loadu_ps( x );
-        __m256 v1 = _mm256_loadu_ps( x + 8 );
-        __m256 v2 = _mm256_loadu_ps( x + 16 );
-        __m256 v3 = _mm256_loadu_ps( x + 24 );
-        x += 32;
-
-        // Compute max(abs(e)) for the block
-        const __m256 signBit = _mm256_set1_ps( -0.0f );
-        __m256 maxAbs = _mm256_andnot_ps( signBit, v0 );
-        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v1 ) );
-        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v2 ) );
-        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v3 ) );
-
-        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
-        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
-        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
-        const float maxScalar = _mm_cvtss_f32( max4 );
-
-        // Quantize these floats
-        const float d = maxScalar / 7.0f;
-        y[i].d = d;
-        const float id = ( maxScalar != 0.0f ) ? 7.0f / maxScalar : 0.0f;
-        const __m256 mul = _mm256_set1_ps( id );
-
-        // Apply the multiplier
-        v0 = _mm256_mul_ps( v0, mul );
-        v1 = _mm256_mul_ps( v1, mul );
-        v2 = _mm256_mul_ps( v2, mul );
-        v3 = _mm256_mul_ps( v3, mul );
-
-        // Round to nearest integer
-        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
-        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
-        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
-        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
-
-        // Convert floats to integers
-        __m256i i0 = _mm256_cvtps_epi32( v0 );
-        __m256i i1 = _mm256_cvtps_epi32( v1 );
-        __m256i i2 = _mm256_cvtps_epi32( v2 );
-        __m256i i3 = _mm256_cvtps_epi32( v3 );
-
-        // Since we don't have in AVX some necessary functions,
-        // we split the registers in half and call AVX2 analogs from SSE
-        __m128i ni0 = _mm256_castsi256_si128( i0 );
-        __m128i ni1 = _mm256_extractf128_si256( i0, 1);
-        __m128i ni2 = _mm256_castsi256_si128( i1 );
-        __m128i ni3 = _mm256_extractf128_si256( i1, 1);
-        __m128i ni4 = _mm256_castsi256_si128( i2 );
-        __m128i ni5 = _mm256_extractf128_si256( i2, 1);
-        __m128i ni6 = _mm256_castsi256_si128( i3 );
-        __m128i ni7 = _mm256_extractf128_si256( i3, 1);
-
-        // Convert int32 to int16
-        ni0 = _mm_packs_epi32( ni0, ni1 );
-        ni2 = _mm_packs_epi32( ni2, ni3 );
-        ni4 = _mm_packs_epi32( ni4, ni5 );
-        ni6 = _mm_packs_epi32( ni6, ni7 );
-        // Convert int16 to int8
-        ni0 = _mm_packs_epi16( ni0, ni2 );
-        ni4 = _mm_packs_epi16( ni4, ni6 );
-
-        // Apply offset to translate the range from [ -7 .. +7 ] into [ +1 .. +15 ]
-        const __m128i off = _mm_set1_epi8( 8);
-        ni0 = _mm_add_epi8( ni0, off );
-        ni4 = _mm_add_epi8( ni4, off );
-
-        // Compress the vector into 4 bit/value, and store
-        __m128i res = packNibbles( ni0, ni4 );
-        _mm_storeu_si128( ( __m128i* )y[i].qs, res );
-    }
-#elif defined(__wasm_simd128__)
-    for (int i = 0; i < nb; i++) {
-        float amax = 0.0f; // absolute max
-
-        v128_t srcv [8];
-        v128_t asrcv[8];
-        v128_t amaxv[8];
-
-        for (int l = 0; l < 8; l++) srcv[l]  = wasm_v128_load(x + i*32 + 4*l);
-        for (int l = 0; l < 8; l++) asrcv[l] = wasm_f32x4_abs(srcv[l]);
-
-        for (int l = 0; l < 4; l++) amaxv[2*l] = wasm_f32x4_max(asrcv[2*l], asrcv[2*l+1]);
-        for (int l = 0; l < 2; l++) amaxv[4*l] = wasm_f32x4_max(amaxv[4*l], amaxv[4*l+2]);
-        for (int l = 0; l < 1; l++) amaxv[8*l] = wasm_f32x4_max(amaxv[8*l], amaxv[8*l+4]);
-
-        amax = MAX(
-                MAX(wasm_f32x4_extract_lane(amaxv[0], 0), wasm_f32x4_extract_lane(amaxv[0], 1)),
-                MAX(wasm_f32x4_extract_lane(amaxv[0], 2), wasm_f32x4_extract_lane(amaxv[0], 3)));
-
-        const float d = amax / ((1 << 3) - 1);
-        const float id = d ? 1.0/d : 0.0;
-
-        y[i].d = d;
-
-        for (int l = 0; l < 8; l++) {
-            const v128_t v  = wasm_f32x4_mul(srcv[l], wasm_f32x4_splat(id));
-            const v128_t vf = wasm_f32x4_add(v, wasm_f32x4_splat(8.5f));
-            const v128_t vi = wasm_i32x4_trunc_sat_f32x4(vf);
-
-            y[i].qs[2*l + 0] = wasm_i32x4_extract_lane(vi, 0) | (wasm_i32x4_extract_lane(vi, 1) << 4);
-            y[i].qs[2*l + 1] = wasm_i32x4_extract_lane(vi, 2) | (wasm_i32x4_extract_lane(vi, 3) << 4);
-        }
-    }
-#else
-    // scalar
-    quantize_row_q4_0_reference(x, y, k);
-#endif
-}
-
-static void quantize_row_q4_1_reference(const float * restrict x, void * restrict vy, int k) {
-    assert(k % QK == 0);
-    const int nb = k / QK;
-
-    block_q4_1 * restrict y = vy;
-
-    uint8_t pp[QK/2];
-
-    for (int i = 0; i < nb; i++) {
-        float min = FLT_MAX;
-        float max = -FLT_MAX;
-
-        for (int l = 0; l < QK; l++) {
-            const float v = x[i*QK + l];
-            if (v < min) min = v;
-            if (v > max) max = v;
-        }
-
-        const float d = (max - min) / ((1 << 4) - 1);
-        const float id = d ? 1.0f/d : 0.0f;
-
-        y[i].d = d;
-        y[i].m = min;
-
-        for (int l = 0; l < QK; l += 2) {
-            const float v0 = (x[i*QK + l + 0] - min)*id;
-            const float v1 = (x[i*QK + l + 1] - min)*id;
-
-            const uint8_t vi0 = roundf(v0);
-            const uint8_t vi1 = roundf(v1);
-
-            assert(vi0 < 16);
-            assert(vi1 < 16);
-
-            pp[l/2] = vi0 | (vi1 << 4);
-        }
-
-        memcpy(y[i].qs, pp, sizeof(pp));
-    }
-}
-
-static void quantize_row_q4_1(const float * restrict x, void * restrict vy, int k) {
-    assert(k % QK == 0);
-
-    const int nb = k / QK;
-
-    block_q4_1 * restrict y = vy;
-
-#if defined(__AVX2__)
-    for (int i = 0; i < nb; i++) {
-        // Load elements into 4 AVX vectors
-        __m256 v0 = _mm256_loadu_ps( x );
-        __m256 v1 = _mm256_loadu_ps( x + 8 );
-        __m256 v2 = _mm256_loadu_ps( x + 16 );
-        __m256 v3 = _mm256_loadu_ps( x + 24 );
-        x += 32;
-
-        // Compute max for the block
-        __m256 vmax;
-        vmax = _mm256_max_ps( v0, v1 );
-        vmax = _mm256_max_ps( vmax, v2 );
-        vmax = _mm256_max_ps( vmax, v3 );
-
-        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( vmax, 1 ), _mm256_castps256_ps128( vmax ) );
-        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
-        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
-        const float maxScalar = _mm_cvtss_f32( max4 );
-
-        // Compute min for the block
-        __m256 vmin;
-        vmin = _mm256_min_ps( v0, v1 );
-        vmin = _mm256_min_ps( vmin, v2 );
-        vmin = _mm256_min_ps( vmin, v3 );
-
-        __m128 min4 = _mm_min_ps( _mm256_extractf128_ps( vmin, 1 ), _mm256_castps256_ps128( vmin ) );
-        min4 = _mm_min_ps( min4, _mm_movehl_ps( min4, min4 ) );
-        min4 = _mm_min_ss( min4, _mm_movehdup_ps( min4 ) );
-        const float minScalar = _mm_cvtss_f32( min4 );
-
-        // Quantize these floats
-        const float d = (maxScalar - minScalar) / ((1 << 4) - 1);
-        const float id = d ? 1.0f/d : 0.0f;
-
-        y[i].m = minScalar;
-        y[i].d = d;
-
-        // x = (x-min)*id
-        const __m256 mul = _mm256_set1_ps( id );
-        const __m256 off = _mm256_set1_ps( minScalar );
-        v0 = _mm256_mul_ps( _mm256_sub_ps( v0, off ), mul );
-        v1 = _mm256_mul_ps( _mm256_sub_ps( v1, off ), mul );
-        v2 = _mm256_mul_ps( _mm256_sub_ps( v2, off ), mul );
-        v3 = _mm256_mul_ps( _mm256_sub_ps( v3, off ), mul );
-
-        // Round to nearest integer
-        v0 = _mm256_round_ps( v0, _MM_ROUND_NEAREST );
-        v1 = _mm256_round_ps( v1, _MM_ROUND_NEAREST );
-        v2 = _mm256_round_ps( v2, _MM_ROUND_NEAREST );
-        v3 = _mm256_round_ps( v3, _MM_ROUND_NEAREST );
-
-        // Convert floats to integers
-        __m256i i0 = _mm256_cvtps_epi32( v0 );
-        __m256i i1 = _mm256_cvtps_epi32( v1 );
-        __m256i i2 = _mm256_cvtps_epi32( v2 );
-        __m256i i3 = _mm256_cvtps_epi32( v3 );
-
-        // Convert int32 to int16
-        i0 = _mm256_packs_epi32( i0, i1 );	// 0, 1, 2, 3,  8, 9, 10, 11,  4, 5, 6, 7, 12, 13, 14, 15
-        i2 = _mm256_packs_epi32( i2, i3 );	// 16, 17, 18, 19,  24, 25, 26, 27,  20, 21, 22, 23, 28, 29, 30, 31
-                                            // Convert int16 to int8
-        i0 = _mm256_packs_epi16( i0, i2 );	// 0, 1, 2, 3,  8, 9, 10, 11,  16, 17, 18, 19,  24, 25, 26, 27,  4, 5, 6, 7, 12, 13, 14, 15, 20, 21, 22, 23, 28, 29, 30, 31
-
-        // We got our precious signed bytes, but the order is now wrong
-        // These AVX2 pack instructions process 16-byte pieces independently
-        // The following instruction is fixing the order
-        const __m256i perm = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
-        i0 = _mm256_permutevar8x32_epi32( i0, perm );
-
-        // Compress the vector into 4 bit/value, and store
-        __m128i res = packNibbles( i0 );
-        _mm_storeu_si128( ( __m128i* )y[i].qs, res );
-    }
-#elif __ARM_NEON
-    for (int i = 0; i < nb; i++) {
-        float32x4_t srcv[8];
-        float32x4_t minv[8];
-        float32x4_t maxv[8];
-
-        for (int l = 0; l < 8; l++) srcv[l] = vld1q_f32(x + i*32 + 4*l);
-
-        for (int l = 0; l < 4; l++) minv[2*l] = vminq_f32(srcv[2*l], srcv[2*l + 1]);
-        for (int l = 0; l < 2; l++) minv[4*l] = vminq_f32(minv[4*l], minv[4*l + 2]);
-        for (int l = 0; l < 1; l++) minv[8*l] = vminq_f32(minv[8*l], minv[8*l + 4]);
-
-        for (int l = 0; l < 4; l++) maxv[2*l] = vmaxq_f32(srcv[2*l], srcv[2*l + 1]);
-        for (int l = 0; l < 2; l++) maxv[4*l] = vmaxq_f32(maxv[4*l], maxv[4*l + 2]);
-        for (int l = 0; l < 1; l++) maxv[8*l] = vmaxq_f32(maxv[8*l], maxv[8*l + 4]);
-
-        const float min = vminvq_f32(minv[0]);
-        const float max = vmaxvq_f32(maxv[0]);
-
-        const float d = (max - min) / ((1 << 4) - 1);
-        const float id = d ? 1.0f/d : 0.0f;
-
-        y[i].d = d;
-        y[i].m = min;
-
-        const float32x4_t minv0 = vdupq_n_f32(min);
-
-        for (int l = 0; l < 8; l++) {
-            const float32x4_t v  = vmulq_n_f32(vsubq_f32(srcv[l], minv0), id);
-            const int32x4_t   vi = vcvtq_s32_f32(v);
-
-            y[i].qs[2*l + 0] = vgetq_lane_s32(vi, 0) | (vgetq_lane_s32(vi, 1) << 4);
-            y[i].qs[2*l + 1] = vgetq_lane_s32(vi, 2) | (vgetq_lane_s32(vi, 3) << 4);
-        }
-    }
-#else
-    // scalar
-    quantize_row_q4_1_reference(x, vy, k);
-#endif
-}
-
-static void dequantize_row_q4_0(const void * restrict vx, float * restrict y, int k) {
-    assert(k % QK == 0);
-    const int nb = k / QK;
-
-    const block_q4_0 * restrict x = vx;
-
-#if defined(__AVX2__)
-    for (int i = 0; i < nb; i++) {
-        // scale factor
-        const __m256 d_v = _mm256_broadcast_ss(&x[i].d);
-
-        const uint8_t * restrict pp = x[i].qs;
-
-        for (int l = 0; l < QK; l += 32) {
-            // Load 32x4-bit integers into 32x8-bit integers
-            __m256i vx8 = bytesFromNibbles(pp+l/2);
-
-            // Subtract 8 from the integers
-            vx8 = _mm256_sub_epi8(vx8, _mm256_set1_epi8(8));
-
-            // Convert to 16-bit int
-            const __m256i vx16_lo = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 0));
-            const __m256i vx16_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 1));
-
-            // Convert to 32-bit int -> float 32
-            const __m256 vf[4] = {
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 0))),
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 1))),
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 0))),
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 1)))
-            };
-
-            // Scale and store
-            for (int j = 0; j < 4; j++) {
-                const __m256 result = _mm256_mul_ps(vf[j], d_v);
-                _mm256_storeu_ps(y + i * QK + l + j*8, result);
-            }
-        }
-    }
-#elif defined(__ARM_NEON)
-    for (int i = 0; i < nb; i++) {
-        const float32x4_t vd = vdupq_n_f32(x[i].d);
-
-        const uint8_t * restrict pp = x[i].qs;
-
-        for (int l = 0; l < QK; l += 16) {
-            // Load 16x4-bit integers into 8x8-bit integers
-            const uint8x8_t v8 = vld1_u8(pp + l/2);
-
-            // Expand 4-bit qs to 8-bit bytes
-            const uint8x8_t v0 = vand_u8(v8, vdup_n_u8(0x0f));
-            const uint8x8_t v1 = vshr_n_u8(v8, 4);
-
-            // Convert to signed 8-bit integers
-            const int8x8_t vs_0 = vreinterpret_s8_u8(v0);
-            const int8x8_t vs_1 = vreinterpret_s8_u8(v1);
-
-            // Subtract 8 from each byte
-            const int8x8_t vb_0 = vsub_s8(vs_0, vdup_n_s8(8));
-            const int8x8_t vb_1 = vsub_s8(vs_1, vdup_n_s8(8));
-
-            // Interleave and combine
-            const int8x8_t vx_0 = vzip1_s8(vb_0, vb_1);
-            const int8x8_t vx_1 = vzip2_s8(vb_0, vb_1);
-
-            const int8x16_t vq = vcombine_s8(vx_0, vx_1);
-
-            // convert to 2x int16x8_t
-            const int16x8_t vi_0 = vmovl_s8(vget_low_s8 (vq));
-            const int16x8_t vi_1 = vmovl_s8(vget_high_s8(vq));
-
-            // convert to 4x float32x4_t
-            const float32x4_t vf_0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16 (vi_0)));
-            const float32x4_t vf_1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi_0)));
-            const float32x4_t vf_2 = vcvtq_f32_s32(vmovl_s16(vget_low_s16 (vi_1)));
-            const float32x4_t vf_3 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi_1)));
-
-            // Multiply by d
-            const float32x4_t r0 = vmulq_f32(vf_0, vd);
-            const float32x4_t r1 = vmulq_f32(vf_1, vd);
-            const float32x4_t r2 = vmulq_f32(vf_2, vd);
-            const float32x4_t r3 = vmulq_f32(vf_3, vd);
-
-            // Store
-            vst1q_f32(y + i*QK + l +  0, r0);
-            vst1q_f32(y + i*QK + l +  4, r1);
-            vst1q_f32(y + i*QK + l +  8, r2);
-            vst1q_f32(y + i*QK + l + 12, r3);
-        }
-    }
-#else
-    // scalar
-    for (int i = 0; i < nb; i++) {
-        const float d = x[i].d;
-
-        const uint8_t * restrict pp = x[i].qs;
-
-        for (int l = 0; l < QK; l += 2) {
-            const uint8_t vi = pp[l/2];
-
-            const int8_t vi0 = vi & 0xf;
-            const int8_t vi1 = vi >> 4;
-
-            const float v0 = (vi0 - 8)*d;
-            const float v1 = (vi1 - 8)*d;
-
-            //printf("d = %f, vi = %d, vi0 = %d, vi1 = %d, v0 = %f, v1 = %f\n", d, vi, vi0, vi1, v0, v1);
-
-            y[i*QK + l + 0] = v0;
-            y[i*QK + l + 1] = v1;
-
-            assert(!isnan(y[i*QK + l + 0]));
-            assert(!isnan(y[i*QK + l + 1]));
-        }
-    }
-#endif
-}
-
-static void dequantize_row_q4_1(const void * restrict vx, float * restrict y, int k) {
-    assert(k % QK == 0);
-    const int nb = k / QK;
-
-    const block_q4_1 * restrict x = vx;
-
-#if defined(__AVX2__)
-    for (int i = 0; i < nb; i++) {
-        const __m256 d_v = _mm256_broadcast_ss(&x[i].d);
-        const __m256 d_m = _mm256_broadcast_ss(&x[i].m);
-
-        const uint8_t * restrict pp = x[i].qs;
-
-        for (int l = 0; l < QK; l += 32) {
-            // Load 32x4-bit integers into 32x8-bit integers
-            __m256i vx8 = bytesFromNibbles(pp+l/2);
-
-            // Convert to 16-bit int
-            const __m256i vx16_lo = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 0));
-            const __m256i vx16_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vx8, 1));
-
-            // Convert to 32-bit int -> float 32
-            const __m256 vf[4] = {
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 0))),
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_lo, 1))),
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 0))),
-                _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(vx16_hi, 1)))
-            };
-
-            // Scale, add m and store
-            for (int j = 0; j < 4; j++) {
-                const __m256 result = _mm256_add_ps(_mm256_mul_ps(vf[j], d_v), d_m);
-                _mm256_storeu_ps(y + i * QK + l + j*8, result);
-            }
-        }
-    }
-#elif defined(__ARM_NEON)
-    for (int i = 0; i < nb; i++) {
-        const float32x4_t vd = vdupq_n_f32(x[i].d);
-        const float32x4_t vm = vdupq_n_f32(x[i].m);
-
-        const uint8_t * restrict pp = x[i].qs;
-
-        for (int l = 0; l < QK; l += 16) {
-            // Load 16x4-bit integers into 8x8-bit integers
-            const uint8x8_t v8 = vld1_u8(pp + l/2);
-
-            // Expand 4-bit qs to 8-bit bytes
-            const uint8x8_t v0 = vand_u8(v8, vdup_n_u8(0x0f));
-            const uint8x8_t v1 = vshr_n_u8(v8, 4);
-
-            // Interleave and combine
-            const uint8x8_t vx_0 = vzip1_u8(v0, v1);
-            const uint8x8_t vx_1 = vzip2_u8(v0, v1);
-
-            const uint8x16_t vq = vcombine_u8(vx_0, vx_1);
-
-            // convert to 2x uint16x8_t
-            const uint16x8_t vi_0 = vmovl_u8(vget_low_u8 (vq));
-            const uint16x8_t vi_1 = vmovl_u8(vget_high_u8(vq));
-
-            // convert to 4x float32x4_t
-            const float32x4_t vf_0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16 (vi_0)));
-            const float32x4_t vf_1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(vi_0)));
-            const float32x4_t vf_2 = vcvtq_f32_u32(vmovl_u16(vget_low_u16 (vi_1)));
-            const float32x4_t vf_3 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(vi_1)));
-
-            // multiply by d and add m
-            const float32x4_t r0 = vmlaq_f32(vm, vf_0, vd);
-            const float32x4_t r1 = vmlaq_f32(vm, vf_1, vd);
-            const float32x4_t r2 = vmlaq_f32(vm, vf_2, vd);
-            const float32x4_t r3 = vmlaq_f32(vm, vf_3, vd);
-
-            // Store
-            vst1q_f32(y + i*QK + l +  0, r0);
-            vst1q_f32(y + i*QK + l +  4, r1);
-            vst1q_f32(y + i*QK + l +  8, r2);
-            vst1q_f32(y + i*QK + l + 12, r3);
-        }
-    }
-#else
-    for (int i = 0; i < nb; i++) {
-        const float d = x[i].d;
-        const float m = x[i].m;
-
-        const uint8_t * restrict pp = x[i].qs;
-
-        for (int l = 0; l < QK; l += 2) {
-            const uint8_t vi = pp[l/2];
-
-            const int8_t vi0 = vi & 0xf;
-            const int8_t vi1 = vi >> 4;
-
-            const float v0 = vi0*d + m;
-            const float v1 = vi1*d + m;
-
-            y[i*QK + l + 0] = v0;
-            y[i*QK + l + 1] = v1;
-
-            assert(!isnan(y[i*QK + l + 0]));
-            assert(!isnan(y[i*QK + l + 1]));
-        }
-    }
-#endif
-}
-
 //
 // simd mappings
 //
@@ -1710,14 +951,12 @@ inline static void ggml_vec_set_i32(const int n, int32_t * x, const int32_t v) {
 
 inline static void ggml_vec_set_f16(const int n, ggml_fp16_t * x, const int32_t v) { for (int i = 0; i < n; ++i) x[i] = v; }
 
-inline static void ggml_vec_add_f32 (const int n, float * z, const float * x, const float * y) { for (int i = 0; i < n; ++i) z[i]  = x[i] + y[i]; }
 inline static void ggml_vec_acc_f32 (const int n, float * y, const float * x)                  { for (int i = 0; i < n; ++i) y[i] += x[i];        }
 inline static void ggml_vec_acc1_f32(const int n, float * y, const float   v)                  { for (int i = 0; i < n; ++i) y[i] += v;           }
 inline static void ggml_vec_sub_f32 (const int n, float * z, const float * x, const float * y) { for (int i = 0; i < n; ++i) z[i]  = x[i] - y[i]; }
 inline static void ggml_vec_set_f32 (const int n, float * x, const float   v)                  { for (int i = 0; i < n; ++i) x[i]  = v;           }
 inline static void ggml_vec_cpy_f32 (const int n, float * y, const float * x)                  { for (int i = 0; i < n; ++i) y[i]  = x[i];        }
 inline static void ggml_vec_neg_f32 (const int n, float * y, const float * x)                  { for (int i = 0; i < n; ++i) y[i]  = -x[i];       }
-inline static void ggml_vec_mul_f32 (const int n, float * z, const float * x, const float * y) { for (int i = 0; i < n; ++i) z[i]  = x[i]*y[i];   }
 inline static void ggml_vec_div_f32 (const int n, float * z, const float * x, const float * y) { for (int i = 0; i < n; ++i) z[i]  = x[i]/y[i];   }
 
 inline static void ggml_vec_dot_f32(const int n, float * restrict s, const float * restrict x, const float * restrict y) {
@@ -1757,37 +996,6 @@ inline static void ggml_vec_dot_f32(const int n, float * restrict s, const float
     *s = sumf;
 }
 
-#if __AVX512F__ && QK == 32
-static inline __m512 dot_q4_0_oneblock_avx512(
-    __m512 acc,
-    const block_q4_0 * restrict x,
-    const block_q4_0 * restrict y,
-    int i
-) {
-    // Compute combined scale for the block
-    __m512 d = _mm512_set1_ps( x[i].d * y[i].d );
-
-    __m256i bx = bytesFromNibbles( x[i].qs );
-    __m256i by = bytesFromNibbles( y[i].qs );
-
-    // Now we have a vector with bytes in [ 0 .. 15 ] interval. Offset them into [ -8 .. +7 ] interval.
-    const __m256i off = _mm256_set1_epi8( 8 );
-    bx = _mm256_sub_epi8( bx, off );
-    by = _mm256_sub_epi8( by, off );
-
-    // Sign-extend 16 signed bytes into int16_t
-    __m512i x32 = _mm512_cvtepi8_epi16( bx );
-    __m512i y32 = _mm512_cvtepi8_epi16( by );
-    // Compute products of int16_t integers, add pairwise
-    __m512i i64 = _mm512_madd_epi16( x32, y32 );
-
-    // Convert int32_t to float
-    __m512 p = _mm512_cvtepi32_ps( i64 );
-    // Apply the scale, and accumulate
-    return _mm512_fmadd_ps( d, p, acc );
-}
-#endif
-
 inline static void ggml_vec_dot_f16(const int n, float * restrict s, ggml_fp16_t * restrict x, ggml_fp16_t * restrict y) {
     ggml_float sumf = 0.0;
 
@@ -1824,549 +1032,157 @@ inline static void ggml_vec_dot_f16(const int n, float * restrict s, ggml_fp16_t
     *s = sumf;
 }
 
-static void ggml_vec_dot_q4_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
-    const int nb = n / QK;
+// compute GGML_VEC_DOT_UNROLL dot products at once
+// xs - x row stride in bytes
+inline static void ggml_vec_dot_f16_unroll(const int n, const int xs, float * restrict s, void * restrict xv, ggml_fp16_t * restrict y) {
+    ggml_float sumf[GGML_VEC_DOT_UNROLL] = { 0.0 };
 
-    assert(n % QK == 0);
-    assert(nb % 2 == 0);
+    ggml_fp16_t * restrict x[GGML_VEC_DOT_UNROLL];
 
-    const block_q4_0 * restrict x = vx;
-    const block_q4_0 * restrict y = vy;
+    for (int i = 0; i < GGML_VEC_DOT_UNROLL; ++i) {
+        x[i] = (ggml_fp16_t *) ((char *) xv + i*xs);
+    }
 
-    float sumf = 0.0;
+#if defined(GGML_SIMD)
+    const int np = (n & ~(GGML_F16_STEP - 1));
 
-#if defined(__ARM_NEON)
-    float sum0 = 0.0f;
-    float sum1 = 0.0f;
+    GGML_F16_VEC sum[GGML_VEC_DOT_UNROLL][GGML_F16_ARR] = { { GGML_F16_VEC_ZERO } };
 
-    for (int i = 0; i < nb; i += 2) {
-        const block_q4_0 * restrict x0 = &x[i + 0];
-        const block_q4_0 * restrict y0 = &y[i + 0];
-        const block_q4_0 * restrict x1 = &x[i + 1];
-        const block_q4_0 * restrict y1 = &y[i + 1];
+    GGML_F16_VEC ax[GGML_F16_ARR];
+    GGML_F16_VEC ay[GGML_F16_ARR];
 
-        const uint8x16_t m4b = vdupq_n_u8(0xf);
-        const int8x16_t  s8b = vdupq_n_s8(0x8);
+    for (int i = 0; i < np; i += GGML_F16_STEP) {
+        for (int j = 0; j < GGML_F16_ARR; j++) {
+            ay[j] = GGML_F16_VEC_LOAD(y + i + j*GGML_F16_EPR, j);
 
-        const uint8x16_t v0_0 = vld1q_u8(x0->qs);
-        const uint8x16_t v1_0 = vld1q_u8(y0->qs);
-        const uint8x16_t v0_1 = vld1q_u8(x1->qs);
-        const uint8x16_t v1_1 = vld1q_u8(y1->qs);
+            for (int k = 0; k < GGML_VEC_DOT_UNROLL; ++k) {
+                ax[j] = GGML_F16_VEC_LOAD(x[k] + i + j*GGML_F16_EPR, j);
 
-        // 4-bit -> 8-bit
-        const int8x16_t v0_0l = vreinterpretq_s8_u8(vandq_u8(v0_0, m4b));
-        const int8x16_t v1_0l = vreinterpretq_s8_u8(vandq_u8(v1_0, m4b));
+                sum[k][j] = GGML_F16_VEC_FMA(sum[k][j], ax[j], ay[j]);
+            }
+        }
+    }
 
-        const int8x16_t v0_0h = vreinterpretq_s8_u8(vshrq_n_u8(v0_0, 4));
-        const int8x16_t v1_0h = vreinterpretq_s8_u8(vshrq_n_u8(v1_0, 4));
+    // reduce sum0..sum3 to sum0
+    for (int k = 0; k < GGML_VEC_DOT_UNROLL; ++k) {
+        GGML_F16_VEC_REDUCE(sumf[k], sum[k]);
+    }
 
-        const int8x16_t v0_1l = vreinterpretq_s8_u8(vandq_u8(v0_1, m4b));
-        const int8x16_t v1_1l = vreinterpretq_s8_u8(vandq_u8(v1_1, m4b));
+    // leftovers
+    for (int i = np; i < n; ++i) {
+        for (int j = 0; j < GGML_VEC_DOT_UNROLL; ++j) {
+            sumf[j] += (ggml_float)(GGML_FP16_TO_FP32(x[j][i])*GGML_FP16_TO_FP32(y[i]));
+        }
+    }
+#else
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < GGML_VEC_DOT_UNROLL; ++j) {
+            sumf[j] += (ggml_float)(GGML_FP16_TO_FP32(x[j][i])*GGML_FP16_TO_FP32(y[i]));
+        }
+    }
+#endif
 
-        const int8x16_t v0_1h = vreinterpretq_s8_u8(vshrq_n_u8(v0_1, 4));
-        const int8x16_t v1_1h = vreinterpretq_s8_u8(vshrq_n_u8(v1_1, 4));
-
-        // sub 8
-        const int8x16_t v0_0ls = vsubq_s8(v0_0l, s8b);
-        const int8x16_t v1_0ls = vsubq_s8(v1_0l, s8b);
-
-        const int8x16_t v0_0hs = vsubq_s8(v0_0h, s8b);
-        const int8x16_t v1_0hs = vsubq_s8(v1_0h, s8b);
-
-        const int8x16_t v0_1ls = vsubq_s8(v0_1l, s8b);
-        const int8x16_t v1_1ls = vsubq_s8(v1_1l, s8b);
-
-        const int8x16_t v0_1hs = vsubq_s8(v0_1h, s8b);
-        const int8x16_t v1_1hs = vsubq_s8(v1_1h, s8b);
-
-#if defined(__ARM_FEATURE_DOTPROD)
-        // dot product into int16x8_t
-        int32x4_t p_0 = vdotq_s32(vdupq_n_s32(0), v0_0ls, v1_0ls);
-        int32x4_t p_1 = vdotq_s32(vdupq_n_s32(0), v0_1ls, v1_1ls);
-
-        p_0 = vdotq_s32(p_0, v0_0hs, v1_0hs);
-        p_1 = vdotq_s32(p_1, v0_1hs, v1_1hs);
-
-        // scalar
-#if defined(__ARM_FEATURE_QRDMX)
-        sum0 += x0->d * y0->d * vaddvq_s32(p_0);
-        sum1 += x1->d * y1->d * vaddvq_s32(p_1);
-#else
-        sum0 += x0->d * y0->d * (vgetq_lane_s32(p_0, 0) + vgetq_lane_s32(p_0, 1) + vgetq_lane_s32(p_0, 2) + vgetq_lane_s32(p_0, 3));
-        sum1 += x1->d * y1->d * (vgetq_lane_s32(p_1, 0) + vgetq_lane_s32(p_1, 1) + vgetq_lane_s32(p_1, 2) + vgetq_lane_s32(p_1, 3));
-#endif
-#else
-	    const int16x8_t pl0l = vmull_s8(vget_low_s8 (v0_0ls), vget_low_s8 (v1_0ls));
-        const int16x8_t pl0h = vmull_s8(vget_high_s8(v0_0ls), vget_high_s8(v1_0ls));
-
-        const int16x8_t ph0l = vmull_s8(vget_low_s8 (v0_0hs), vget_low_s8 (v1_0hs));
-        const int16x8_t ph0h = vmull_s8(vget_high_s8(v0_0hs), vget_high_s8(v1_0hs));
-
-        const int16x8_t pl1l = vmull_s8(vget_low_s8 (v0_1ls), vget_low_s8 (v1_1ls));
-        const int16x8_t pl1h = vmull_s8(vget_high_s8(v0_1ls), vget_high_s8(v1_1ls));
-
-        const int16x8_t ph1l = vmull_s8(vget_low_s8 (v0_1hs), vget_low_s8 (v1_1hs));
-        const int16x8_t ph1h = vmull_s8(vget_high_s8(v0_1hs), vget_high_s8(v1_1hs));
-
-        const int16x8_t pl_0 = vaddq_s16(pl0l, pl0h);
-        const int16x8_t ph_0 = vaddq_s16(ph0l, ph0h);
-
-        const int16x8_t pl_1 = vaddq_s16(pl1l, pl1h);
-        const int16x8_t ph_1 = vaddq_s16(ph1l, ph1h);
-
-        const int16x8_t p_0 = vaddq_s16(pl_0, ph_0);
-        const int16x8_t p_1 = vaddq_s16(pl_1, ph_1);
-
-        // scalar
-#if defined(__ARM_FEATURE_QRDMX)
-        sum0 += x0->d * y0->d * vaddvq_s16(p_0);
-        sum1 += x1->d * y1->d * vaddvq_s16(p_1);
-#else
-        sum0 += x0->d * y0->d * (vgetq_lane_s16(p_0, 0) + vgetq_lane_s16(p_0, 1) + vgetq_lane_s16(p_0, 2) + vgetq_lane_s16(p_0, 3) + vgetq_lane_s16(p_0, 4) + vgetq_lane_s16(p_0, 5) + vgetq_lane_s16(p_0, 6) + vgetq_lane_s16(p_0, 7));
-        sum1 += x1->d * y1->d * (vgetq_lane_s16(p_1, 0) + vgetq_lane_s16(p_1, 1) + vgetq_lane_s16(p_1, 2) + vgetq_lane_s16(p_1, 3) + vgetq_lane_s16(p_1, 4) + vgetq_lane_s16(p_1, 5) + vgetq_lane_s16(p_1, 6) + vgetq_lane_s16(p_1, 7));
-#endif
-#endif
-    }
-
-    sumf = sum0 + sum1;
-#elif defined(__AVX512F__)
-    // Initialize accumulator with zeros
-    __m512 acc0 = _mm512_setzero_ps();
-    __m512 acc1 = _mm512_setzero_ps();
-
-    const int superblock_size = 8;
-    const int superblock_count = nb / superblock_size;
-
-    for (int superblock_ix = 0; superblock_ix < superblock_count; superblock_ix += 1) {
-        int i = superblock_ix * superblock_size;
-
-        acc0 = dot_q4_0_oneblock_avx512( acc0, x, y, i+0 );
-        acc1 = dot_q4_0_oneblock_avx512( acc1, x, y, i+1 );
-        acc0 = dot_q4_0_oneblock_avx512( acc0, x, y, i+2 );
-        acc1 = dot_q4_0_oneblock_avx512( acc1, x, y, i+3 );
-        acc0 = dot_q4_0_oneblock_avx512( acc0, x, y, i+4 );
-        acc1 = dot_q4_0_oneblock_avx512( acc1, x, y, i+5 );
-        acc0 = dot_q4_0_oneblock_avx512( acc0, x, y, i+6 );
-        acc1 = dot_q4_0_oneblock_avx512( acc1, x, y, i+7 );
-    }
-
-    // Remainders
-    for (int i = superblock_count * superblock_size; i < nb; ++i) {
-        acc0 = dot_q4_0_oneblock_avx512( acc0, x, y, i );
-    }
-
-    // Horizontal sum of all lanes of the accumulator
-    sumf = _mm512_reduce_add_ps( acc0 ) + _mm512_reduce_add_ps( acc1 );
-#elif defined(__AVX2__)
-    // Initialize accumulator with zeros
-    __m256 acc = _mm256_setzero_ps();
-
-    // Main loop
-    // TODO: figure a way to do this in a portable way
-    #ifdef __GNUC__
-    #pragma GCC unroll 16
-    #endif
-    for (int i = 0; i < nb; ++i) {
-        // Compute combined scale for the block
-        const __m256 d = _mm256_mul_ps( _mm256_broadcast_ss( &x[i].d ), _mm256_broadcast_ss( &y[i].d ) );
-
-        // Load 16 bytes, and unpack 4 bit fields into bytes, making 32 bytes
-        __m256i bx = bytesFromNibbles( x[i].qs );
-        __m256i by = bytesFromNibbles( y[i].qs );
-
-        // Now we have a vector with bytes in [ 0 .. 15 ] interval. Offset them into [ -8 .. +7 ] interval.
-        const __m256i off = _mm256_set1_epi8( 8 );
-        bx = _mm256_sub_epi8( bx, off );
-        by = _mm256_sub_epi8( by, off );
-
-        // Get absolute values of x vectors
-        const __m256i ax = _mm256_sign_epi8(bx, bx);
-
-        // Sign the values of the y vectors
-        const __m256i sy = _mm256_sign_epi8(by, bx);
-
-        // Perform multiplication and create 16-bit values
-        const __m256i dot = _mm256_maddubs_epi16(ax, sy);
-
-        const __m256i ones = _mm256_set1_epi16(1);
-        const __m256i i32 = _mm256_madd_epi16(ones, dot);
-
-        // Convert int32_t to float
-        const __m256 p = _mm256_cvtepi32_ps( i32 );
-
-        // Apply the scale, and accumulate
-        acc = _mm256_fmadd_ps( d, p, acc );
+    for (int i = 0; i < GGML_VEC_DOT_UNROLL; ++i) {
+        s[i] = sumf[i];
     }
+}
 
-    // Return horizontal sum of the acc vector
-    __m128 res = _mm256_extractf128_ps( acc, 1 );
-    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
-    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
-    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
-
-    sumf = _mm_cvtss_f32( res );
-#elif defined(__AVX__)
-    // Initialize accumulator with zeros
-    __m256 acc = _mm256_setzero_ps();
-
-    // Main loop
-    for (int i = 0; i < nb; ++i) {
-        // Compute combined scale for the block
-        const __m256 d = _mm256_mul_ps( _mm256_broadcast_ss( &x[i].d ), _mm256_broadcast_ss( &y[i].d ) );
-
-        __m128i i32[2];
-        for (int j = 0; j < 2; ++j) {
-            // Load 8 bytes, and unpack 4 bit fields into bytes, making 16 bytes
-            __m128i bx = bytesFromNibbles( x[i].qs + 8*j );
-            __m128i by = bytesFromNibbles( y[i].qs + 8*j );
-
-            // Now we have a vector with bytes in [ 0 .. 15 ] interval. Offset them into [ -8 .. +7 ] interval.
-            const __m128i off = _mm_set1_epi8( 8 );
-            bx = _mm_sub_epi8( bx, off );
-            by = _mm_sub_epi8( by, off );
+inline static void ggml_vec_mad_f32(const int n, float * restrict y, const float * restrict x, const float v) {
+#if defined(GGML_SIMD)
+    const int np = (n & ~(GGML_F32_STEP - 1));
 
-	    // Get absolute values of x vectors
-            const __m128i ax = _mm_sign_epi8(bx, bx);
+    GGML_F32_VEC vx = GGML_F32_VEC_SET1(v);
 
-            // Sign the values of the y vectors
-            const __m128i sy = _mm_sign_epi8(by, bx);
+    GGML_F32_VEC ax[GGML_F32_ARR];
+    GGML_F32_VEC ay[GGML_F32_ARR];
 
-            // Perform multiplication and create 16-bit values
-            const __m128i dot = _mm_maddubs_epi16(ax, sy);
+    for (int i = 0; i < np; i += GGML_F32_STEP) {
+        for (int j = 0; j < GGML_F32_ARR; j++) {
+            ax[j] = GGML_F32_VEC_LOAD(x + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_LOAD(y + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_FMA(ay[j], ax[j], vx);
 
-            const __m128i ones = _mm_set1_epi16(1);
-            i32[j] = _mm_madd_epi16(ones, dot);
+            GGML_F32_VEC_STORE(y + i + j*GGML_F32_EPR, ay[j]);
         }
-
-        // Convert int32_t to float
-        __m256 p = _mm256_cvtepi32_ps( _mm256_set_m128i( i32[0], i32[1] ));
-        // Apply the scale, and accumulate
-        acc = _mm256_add_ps(_mm256_mul_ps( d, p ), acc);
     }
 
-    // Return horizontal sum of the acc vector
-    __m128 res = _mm256_extractf128_ps( acc, 1 );
-    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
-    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
-    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
-
-    sumf = _mm_cvtss_f32( res );
-#elif defined(__wasm_simd128__)
-    // wasm simd
-    float sum0 = 0.0f;
-    float sum1 = 0.0f;
-
-    for (int i = 0; i < nb; i += 2) {
-        const block_q4_0 * restrict x0 = &px[i + 0];
-        const block_q4_0 * restrict y0 = &py[i + 0];
-        const block_q4_0 * restrict x1 = &px[i + 1];
-        const block_q4_0 * restrict y1 = &py[i + 1];
-
-        const v128_t m4b = wasm_u8x16_splat(0xf);
-        const v128_t s8b = wasm_i8x16_splat(0x8);
-
-        const v128_t v0_0 = wasm_v128_load(x0.qs);
-        const v128_t v0_1 = wasm_v128_load(y0.qs);
-        const v128_t v1_0 = wasm_v128_load(x1.qs);
-        const v128_t v1_1 = wasm_v128_load(y1.qs);
-
-        // 4-bit -> 8-bit
-        const v128_t v0_0l = wasm_v128_and(v0_0, m4b);
-        const v128_t v1_0l = wasm_v128_and(v1_0, m4b);
-
-        const v128_t v0_0h = wasm_u8x16_shr(v0_0, 4);
-        const v128_t v1_0h = wasm_u8x16_shr(v1_0, 4);
-
-        const v128_t v0_1l = wasm_v128_and(v0_1, m4b);
-        const v128_t v1_1l = wasm_v128_and(v1_1, m4b);
-
-        const v128_t v0_1h = wasm_u8x16_shr(v0_1, 4);
-        const v128_t v1_1h = wasm_u8x16_shr(v1_1, 4);
-
-        // sub 8
-        const v128_t v0_0ls = wasm_i8x16_sub(v0_0l, s8b);
-        const v128_t v1_0ls = wasm_i8x16_sub(v1_0l, s8b);
-
-        const v128_t v0_0hs = wasm_i8x16_sub(v0_0h, s8b);
-        const v128_t v1_0hs = wasm_i8x16_sub(v1_0h, s8b);
-
-        const v128_t v0_1ls = wasm_i8x16_sub(v0_1l, s8b);
-        const v128_t v1_1ls = wasm_i8x16_sub(v1_1l, s8b);
-
-        const v128_t v0_1hs = wasm_i8x16_sub(v0_1h, s8b);
-        const v128_t v1_1hs = wasm_i8x16_sub(v1_1h, s8b);
-
-        // dot product into int16x8_t
-        const v128_t pl0l = wasm_i16x8_mul(wasm_i16x8_extend_low_i8x16(v0_0ls), wasm_i16x8_extend_low_i8x16(v1_0ls));
-        const v128_t pl0h = wasm_i16x8_mul(wasm_i16x8_extend_high_i8x16(v0_0ls), wasm_i16x8_extend_high_i8x16(v1_0ls));
-
-        const v128_t ph0l = wasm_i16x8_mul(wasm_i16x8_extend_low_i8x16(v0_0hs), wasm_i16x8_extend_low_i8x16(v1_0hs));
-        const v128_t ph0h = wasm_i16x8_mul(wasm_i16x8_extend_high_i8x16(v0_0hs), wasm_i16x8_extend_high_i8x16(v1_0hs));
-
-        const v128_t pl1l = wasm_i16x8_mul(wasm_i16x8_extend_low_i8x16(v0_1ls), wasm_i16x8_extend_low_i8x16(v1_1ls));
-        const v128_t pl1h = wasm_i16x8_mul(wasm_i16x8_extend_high_i8x16(v0_1ls), wasm_i16x8_extend_high_i8x16(v1_1ls));
-
-        const v128_t ph1l = wasm_i16x8_mul(wasm_i16x8_extend_low_i8x16(v0_1hs), wasm_i16x8_extend_low_i8x16(v1_1hs));
-        const v128_t ph1h = wasm_i16x8_mul(wasm_i16x8_extend_high_i8x16(v0_1hs), wasm_i16x8_extend_high_i8x16(v1_1hs));
-
-        const v128_t pl_0 = wasm_i16x8_add(pl0l, pl0h);
-        const v128_t ph_0 = wasm_i16x8_add(ph0l, ph0h);
-
-        const v128_t pl_1 = wasm_i16x8_add(pl1l, pl1h);
-        const v128_t ph_1 = wasm_i16x8_add(ph1l, ph1h);
-
-        const v128_t p_0 = wasm_i16x8_add(pl_0, ph_0);
-        const v128_t p_1 = wasm_i16x8_add(pl_1, ph_1);
-
-        sum0 += x0->d * y0->d * (
-                wasm_i16x8_extract_lane(p_0, 0) + wasm_i16x8_extract_lane(p_0, 1) +
-                wasm_i16x8_extract_lane(p_0, 2) + wasm_i16x8_extract_lane(p_0, 3) +
-                wasm_i16x8_extract_lane(p_0, 4) + wasm_i16x8_extract_lane(p_0, 5) +
-                wasm_i16x8_extract_lane(p_0, 6) + wasm_i16x8_extract_lane(p_0, 7));
-        sum1 += x1->d * y1->d * (
-                wasm_i16x8_extract_lane(p_1, 0) + wasm_i16x8_extract_lane(p_1, 1) +
-                wasm_i16x8_extract_lane(p_1, 2) + wasm_i16x8_extract_lane(p_1, 3) +
-                wasm_i16x8_extract_lane(p_1, 4) + wasm_i16x8_extract_lane(p_1, 5) +
-                wasm_i16x8_extract_lane(p_1, 6) + wasm_i16x8_extract_lane(p_1, 7));
+    // leftovers
+    for (int i = np; i < n; ++i) {
+        y[i] += x[i]*v;
     }
-
-    sumf = sum0 + sum1;
 #else
     // scalar
-    for (int i = 0; i < nb; i++) {
-        const float d0 = x[i].d;
-        const float d1 = y[i].d;
+    for (int i = 0; i < n; ++i) {
+        y[i] += x[i]*v;
+    }
+#endif
+}
 
-        const uint8_t * restrict p0 = x[i].qs;
-        const uint8_t * restrict p1 = y[i].qs;
+// y += x*v, with F16 x and F32 y
+inline static void ggml_vec_mad_f32_f16(const int n, float * restrict y, ggml_fp16_t * restrict x, const float v) {
+#if defined(__AVX__)
+    const int np = (n & ~(GGML_F32_STEP - 1));
 
-        for (int j = 0; j < QK/2; j++) {
-            const uint8_t v0 = p0[j];
-            const uint8_t v1 = p1[j];
+    GGML_F32_VEC vx = GGML_F32_VEC_SET1(v);
 
-            const float f0 = d0*((int8_t) (v0 & 0xf) - 8);
-            const float f1 = d0*((int8_t) (v0 >> 4)  - 8);
+    GGML_F32_VEC ax[GGML_F32_ARR];
+    GGML_F32_VEC ay[GGML_F32_ARR];
 
-            const float f2 = d1*((int8_t) (v1 & 0xf) - 8);
-            const float f3 = d1*((int8_t) (v1 >> 4)  - 8);
+    for (int i = 0; i < np; i += GGML_F32_STEP) {
+        for (int j = 0; j < GGML_F32_ARR; j++) {
+            ax[j] = GGML_F32Cx8_LOAD(x + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_LOAD(y + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_FMA(ay[j], ax[j], vx);
 
-            sumf += f0*f2 + f1*f3;
+            GGML_F32_VEC_STORE(y + i + j*GGML_F32_EPR, ay[j]);
         }
     }
-#endif
 
-    *s = sumf;
-}
-
-static void ggml_vec_dot_q4_1(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
-    const int nb = n / QK;
-
-    const block_q4_1 * restrict x = vx;
-    const block_q4_1 * restrict y = vy;
-
-    float sumf = 0.0;
-
-#if defined(__AVX2__)
-    // Initialize accumulator with zeros
-    __m256 acc = _mm256_setzero_ps();
-    // Accumulator for constant offsets
-    float acc_offset = 0.0f;
-
-    // Main loop
-    for (int i = 0; i < nb; ++i) {
-        const float * d0 = &x[i].d;
-        const float * d1 = &y[i].d;
-
-        const float * m0 = &x[i].m;
-        const float * m1 = &y[i].m;
-
-        const __m256 d0v = _mm256_broadcast_ss( d0 );
-        const __m256 d1v = _mm256_broadcast_ss( d1 );
-        const __m256 m0v = _mm256_broadcast_ss( m0 );
-        const __m256 m1v = _mm256_broadcast_ss( m1 );
-
-        // Compute combined scale for the block
-        const __m256 scale_01 = _mm256_mul_ps( d0v, d1v );
-
-        // Compute cross scales for the block
-        const __m256 scale_0 = _mm256_mul_ps( d0v, m1v );
-        const __m256 scale_1 = _mm256_mul_ps( m0v, d1v );
-        const __m256 cross_scales = _mm256_blend_ps( scale_0, scale_1, 0xAA /* 0b10101010 */ );
-
-        // Load 16 bytes, and unpack 4 bit fields into bytes, making 32 bytes
-        __m256i bx = bytesFromNibbles( x[i].qs );
-        __m256i by = bytesFromNibbles( y[i].qs );
-
-        // Now we have a vector with bytes in [ 0 .. 15 ] interval.
-
-        // Sign-extend first 16 signed bytes into int16_t
-        __m256i x16 = _mm256_cvtepi8_epi16( _mm256_castsi256_si128( bx ) );
-        __m256i y16 = _mm256_cvtepi8_epi16( _mm256_castsi256_si128( by ) );
-        // Compute products of int16_t integers, add pairwise
-        __m256i i32 = _mm256_madd_epi16( x16, y16 );
-
-        // Sign-extend last 16 signed bytes into int16_t vectors
-        __m256i x16_h = _mm256_cvtepi8_epi16( _mm256_extracti128_si256( bx, 1 ) );
-        __m256i y16_h = _mm256_cvtepi8_epi16( _mm256_extracti128_si256( by, 1 ) );
-        // Accumulate products of int16_t integers
-        i32 = _mm256_add_epi32( i32, _mm256_madd_epi16( x16_h, y16_h ) );
-
-        // compute sums of unsigned bytes in bx, by in blocks of 8.
-        // This results in a layout like X100 0000 X200 0000 X300 0000 X400 0000,
-        // which we then interleave as X100 Y100 X200 Y200 X300 Y300 X400 Y400.
-        // so if we then cast to 8 singles, we get 8 floats like [ x0_7, y0_7, x8_15, y8_15, x16_23, y16_23, x24_31, y24_31 ]
-        __m256i xsumi = _mm256_sad_epu8( bx, _mm256_setzero_si256() );
-        __m256i ysumi = _mm256_sad_epu8( by, _mm256_setzero_si256() );
-        __m256i sumsi = _mm256_or_si256( xsumi, _mm256_slli_si256( ysumi, 4 ) );
-        __m256  sums  = _mm256_cvtepi32_ps( sumsi );
-
-        // Convert int32_t to float
-        __m256 p = _mm256_cvtepi32_ps( i32 );
-        // Apply the scale, and accumulate
-        // acc += d0*d1*x*y + d0*m1*x + d1*m0*y
-        acc = _mm256_fmadd_ps( scale_01, p, acc );
-        acc = _mm256_fmadd_ps( cross_scales, sums, acc );
-        // acc_offset += m0*m1 (for each entry in the block)
-        acc_offset += (*m0)*(*m1);
-    }
-
-    // Return horizontal sum of the acc vector
-    __m128 res = _mm256_extractf128_ps( acc, 1 );
-    res = _mm_add_ps( res, _mm256_castps256_ps128( acc ) );
-    res = _mm_add_ps( res, _mm_movehl_ps( res, res ) );
-    res = _mm_add_ss( res, _mm_movehdup_ps( res ) );
-
-    sumf = _mm_cvtss_f32( res ) + acc_offset * QK;
-#elif defined(__ARM_NEON)
-    float sum00 = 0.0f;
-    float sum01 = 0.0f;
-    float sum10 = 0.0f;
-    float sum11 = 0.0f;
-
-    for (int i = 0; i < nb; ++i) {
-        const block_q4_1 * restrict x0 = &x[i + 0];
-        const block_q4_1 * restrict y0 = &y[i + 0];
-
-        const uint8x16_t m4b = vdupq_n_u8(0xf);
-
-        const uint8x16_t v0_0 = vld1q_u8(x0->qs);
-        const uint8x16_t v1_0 = vld1q_u8(y0->qs);
-
-        // and with 0xf
-        const uint8x16_t v0_0l = vandq_u8(v0_0, m4b);
-        const uint8x16_t v1_0l = vandq_u8(v1_0, m4b);
-
-        const uint8x16_t v0_0h = vshrq_n_u8(v0_0, 4);
-        const uint8x16_t v1_0h = vshrq_n_u8(v1_0, 4);
-
-        // dot product into uint16x8_t
-        const uint16x8_t pl0l = vmull_u8(vget_low_u8 (v0_0l), vget_low_u8 (v1_0l));
-        const uint16x8_t pl0h = vmull_u8(vget_high_u8(v0_0l), vget_high_u8(v1_0l));
-
-        const uint16x8_t ph0l = vmull_u8(vget_low_u8 (v0_0h), vget_low_u8 (v1_0h));
-        const uint16x8_t ph0h = vmull_u8(vget_high_u8(v0_0h), vget_high_u8(v1_0h));
-
-        const uint16x8_t pl0 = vaddq_u16(pl0l, pl0h);
-        const uint16x8_t ph0 = vaddq_u16(ph0l, ph0h);
-
-        sum00 += x0->m*y0->m;
-        sum01 += y0->m*x0->d*(vaddvq_u8(v0_0l) + vaddvq_u8(v0_0h));
-        sum10 += x0->m*y0->d*(vaddvq_u8(v1_0l) + vaddvq_u8(v1_0h));
-        sum11 += x0->d*y0->d*vaddvq_u16(vaddq_u16(pl0, ph0));
-    }
-
-    sumf = QK*sum00 + sum01 + sum10 + sum11;
+    // leftovers
+    for (int i = np; i < n; ++i) {
+        y[i] += GGML_FP16_TO_FP32(x[i])*v;
+    }
 #else
     // scalar
-    for (int i = 0; i < nb; i++) {
-        const float d0 = x[i].d;
-        const float d1 = y[i].d;
-
-        const float m0 = x[i].m;
-        const float m1 = y[i].m;
-
-        const uint8_t * restrict p0 = x[i].qs;
-        const uint8_t * restrict p1 = y[i].qs;
-
-        for (int j = 0; j < QK/2; j++) {
-            const uint8_t v0 = p0[j];
-            const uint8_t v1 = p1[j];
-
-            const float f0 = d0*(v0 & 0xf) + m0;
-            const float f1 = d0*(v0 >> 4)  + m0;
-
-            const float f2 = d1*(v1 & 0xf) + m1;
-            const float f3 = d1*(v1 >> 4)  + m1;
-
-            sumf += f0*f2 + f1*f3;
-        }
+    for (int i = 0; i < n; ++i) {
+        y[i] += GGML_FP16_TO_FP32(x[i])*v;
     }
 #endif
-
-    *s = sumf;
 }
 
-// compute GGML_VEC_DOT_UNROLL dot products at once
-// xs - x row stride in bytes
-inline static void ggml_vec_dot_f16_unroll(const int n, const int xs, float * restrict s, void * restrict xv, ggml_fp16_t * restrict y) {
-    ggml_float sumf[GGML_VEC_DOT_UNROLL] = { 0.0 };
-
-    ggml_fp16_t * restrict x[GGML_VEC_DOT_UNROLL];
-
-    for (int i = 0; i < GGML_VEC_DOT_UNROLL; ++i) {
-        x[i] = (ggml_fp16_t *) ((char *) xv + i*xs);
-    }
-
+inline static void ggml_vec_add_f32(const int n, float * z, const float * x, const float * y) {
 #if defined(GGML_SIMD)
-    const int np = (n & ~(GGML_F16_STEP - 1));
-
-    GGML_F16_VEC sum[GGML_VEC_DOT_UNROLL][GGML_F16_ARR] = { { GGML_F16_VEC_ZERO } };
-
-    GGML_F16_VEC ax[GGML_F16_ARR];
-    GGML_F16_VEC ay[GGML_F16_ARR];
+    const int np = (n & ~(GGML_F32_STEP - 1));
 
-    for (int i = 0; i < np; i += GGML_F16_STEP) {
-        for (int j = 0; j < GGML_F16_ARR; j++) {
-            ay[j] = GGML_F16_VEC_LOAD(y + i + j*GGML_F16_EPR, j);
+    GGML_F32_VEC ax[GGML_F32_ARR];
+    GGML_F32_VEC ay[GGML_F32_ARR];
 
-            for (int k = 0; k < GGML_VEC_DOT_UNROLL; ++k) {
-                ax[j] = GGML_F16_VEC_LOAD(x[k] + i + j*GGML_F16_EPR, j);
+    for (int i = 0; i < np; i += GGML_F32_STEP) {
+        for (int j = 0; j < GGML_F32_ARR; j++) {
+            ax[j] = GGML_F32_VEC_LOAD(x + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_LOAD(y + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_ADD(ax[j], ay[j]);
 
-                sum[k][j] = GGML_F16_VEC_FMA(sum[k][j], ax[j], ay[j]);
-            }
+            GGML_F32_VEC_STORE(z + i + j*GGML_F32_EPR, ay[j]);
         }
     }
 
-    // reduce sum0..sum3 to sum0
-    for (int k = 0; k < GGML_VEC_DOT_UNROLL; ++k) {
-        GGML_F16_VEC_REDUCE(sumf[k], sum[k]);
-    }
-
     // leftovers
     for (int i = np; i < n; ++i) {
-        for (int j = 0; j < GGML_VEC_DOT_UNROLL; ++j) {
-            sumf[j] += (ggml_float)(GGML_FP16_TO_FP32(x[j][i])*GGML_FP16_TO_FP32(y[i]));
-        }
+        z[i] = x[i] + y[i];
     }
 #else
+    // scalar
     for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < GGML_VEC_DOT_UNROLL; ++j) {
-            sumf[j] += (ggml_float)(GGML_FP16_TO_FP32(x[j][i])*GGML_FP16_TO_FP32(y[i]));
-        }
+        z[i] = x[i] + y[i];
     }
 #endif
-
-    for (int i = 0; i < GGML_VEC_DOT_UNROLL; ++i) {
-        s[i] = sumf[i];
-    }
 }
 
-inline static void ggml_vec_mad_f32(const int n, float * restrict y, const float * restrict x, const float v) {
+inline static void ggml_vec_mul_f32(const int n, float * z, const float * x, const float * y) {
 #if defined(GGML_SIMD)
     const int np = (n & ~(GGML_F32_STEP - 1));
 
-    GGML_F32_VEC vx = GGML_F32_VEC_SET1(v);
-
     GGML_F32_VEC ax[GGML_F32_ARR];
     GGML_F32_VEC ay[GGML_F32_ARR];
 
@@ -2374,20 +1190,20 @@ inline static void ggml_vec_mad_f32(const int n, float * restrict y, const float
         for (int j = 0; j < GGML_F32_ARR; j++) {
             ax[j] = GGML_F32_VEC_LOAD(x + i + j*GGML_F32_EPR);
             ay[j] = GGML_F32_VEC_LOAD(y + i + j*GGML_F32_EPR);
-            ay[j] = GGML_F32_VEC_FMA(ay[j], ax[j], vx);
+            ay[j] = GGML_F32_VEC_MUL(ax[j], ay[j]);
 
-            GGML_F32_VEC_STORE(y + i + j*GGML_F32_EPR, ay[j]);
+            GGML_F32_VEC_STORE(z + i + j*GGML_F32_EPR, ay[j]);
         }
     }
 
     // leftovers
     for (int i = np; i < n; ++i) {
-        y[i] += x[i]*v;
+        z[i] = x[i]*y[i];
     }
 #else
     // scalar
     for (int i = 0; i < n; ++i) {
-        y[i] += x[i]*v;
+        z[i] = x[i]*y[i];
     }
 #endif
 }
@@ -2473,22 +1289,69 @@ inline static void ggml_vec_silu_f16(const int n, ggml_fp16_t * y, const ggml_fp
     }
 }
 
-#ifdef GGML_SILU_FP16
+// the vectorised f32 kernels are preferred over the fp16 tables when the CPU has them
 inline static void ggml_vec_silu_f32(const int n, float * y, const float * x) {
+    if (g_kernels.vec_silu_f32) {
+        g_kernels.vec_silu_f32(n, y, x);
+        return;
+    }
+#ifdef GGML_SILU_FP16
     uint16_t t;
     for (int i = 0; i < n; ++i) {
         ggml_fp16_t fp16 = GGML_FP32_TO_FP16(x[i]);
         memcpy(&t, &fp16, sizeof(uint16_t));
         y[i] = GGML_FP16_TO_FP32(table_silu_f16[t]);
     }
-}
 #else
-inline static void ggml_vec_silu_f32(const int n, float * y, const float * x) {
     for (int i = 0; i < n; ++i) {
         y[i] = ggml_silu_f32(x[i]);
     }
+#endif
 }
+
+inline static void ggml_vec_silu_mul_f32(const int n, float * z, const float * x, const float * y) {
+    if (g_kernels.vec_silu_mul_f32) {
+        g_kernels.vec_silu_mul_f32(n, z, x, y);
+        return;
+    }
+#ifdef GGML_SILU_FP16
+    uint16_t t;
+    for (int i = 0; i < n; ++i) {
+        ggml_fp16_t fp16 = GGML_FP32_TO_FP16(x[i]);
+        memcpy(&t, &fp16, sizeof(uint16_t));
+        z[i] = GGML_FP16_TO_FP32(table_silu_f16[t])*y[i];
+    }
+#else
+    for (int i = 0; i < n; ++i) {
+        z[i] = ggml_silu_f32(x[i])*y[i];
+    }
 #endif
+}
+
+// y = exp(x - max), returns sum(y) - y can be x
+inline static ggml_float ggml_vec_soft_max_f32(const int n, float * y, const float * x, const float max) {
+    if (g_kernels.vec_soft_max_f32) {
+        return g_kernels.vec_soft_max_f32(n, y, x, max);
+    }
+
+    ggml_float sum = 0.0;
+
+    uint16_t scvt;
+    for (int i = 0; i < n; i++) {
+        if (x[i] == -INFINITY) {
+            y[i] = 0.0f;
+        } else {
+            //const float val = (x[i] == -INFINITY) ? 0.0 : exp(x[i] - max);
+            ggml_fp16_t s = GGML_FP32_TO_FP16(x[i] - max);
+            memcpy(&scvt, &s, sizeof(scvt));
+            const float val = GGML_FP16_TO_FP32(table_exp_f16[scvt]);
+            sum += (ggml_float)val;
+            y[i] = val;
+        }
+    }
+
+    return sum;
+}
 
 inline static void ggml_vec_sum_f32(const int n, float * s, const float * x) {
 #ifndef GGML_USE_ACCELERATE
@@ -2555,9 +1418,34 @@ static const int GGML_BLCK_SIZE[GGML_TYPE_COUNT] = {
     1,
     1,
     1,
+    QK,
+    QK,
+    QK,
+    QK,
+    QK,
+    QK,
+};
+
+static_assert(GGML_TYPE_COUNT == 13, "GGML_TYPE_COUNT != 13");
+
+// rows interleaved in the blocks of the type - the vec_dot_q of the type computes that many rows at once
+static const int GGML_BLCK_ROWS[GGML_TYPE_COUNT] = {
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    8,
+    1,
+    1,
+    1,
+    1,
+    1,
 };
 
-static_assert(GGML_TYPE_COUNT == 7, "GGML_TYPE_COUNT != 5");
+static_assert(GGML_TYPE_COUNT == 13, "GGML_TYPE_COUNT != 13");
 
 static const size_t GGML_TYPE_SIZE[GGML_TYPE_COUNT] = {
     sizeof(block_q4_0),
@@ -2567,10 +1455,16 @@ static const size_t GGML_TYPE_SIZE[GGML_TYPE_COUNT] = {
     sizeof(int32_t),
     sizeof(ggml_fp16_t),
     sizeof(float  ),
+    sizeof(block_q4_0), // per row of a block_q4_0x8
+    sizeof(block_q8_0),
+    sizeof(block_q2_1),
+    sizeof(block_q3_1),
+    sizeof(block_q4_2),
+    sizeof(block_q4_3),
 };
 
-// don't forget to update the array above when adding new types
-static_assert(GGML_TYPE_COUNT == 7, "GGML_TYPE_COUNT != 5");
+// don't forget to update the arrays above when adding new types
+static_assert(GGML_TYPE_COUNT == 13, "GGML_TYPE_COUNT != 13");
 
 static const char * GGML_OP_LABEL[GGML_OP_COUNT] = {
     "NONE",
@@ -2592,10 +1486,12 @@ static const char * GGML_OP_LABEL[GGML_OP_COUNT] = {
     "RELU",
     "GELU",
     "SILU",
+    "SILU_MUL",
     "NORM",
     "RMS_NORM",
 
     "MUL_MAT",
+    "MUL_MAT_ADD",
 
     "SCALE",
     "CPY",
@@ -2614,7 +1510,7 @@ static const char * GGML_OP_LABEL[GGML_OP_COUNT] = {
     "FLASH_FF",
 };
 
-static_assert(GGML_OP_COUNT == 35, "GGML_OP_COUNT != 35");
+static_assert(GGML_OP_COUNT == 37, "GGML_OP_COUNT != 37");
 
 static const char * GGML_OP_SYMBOL[GGML_OP_COUNT] = {
     "none",
@@ -2636,10 +1532,12 @@ static const char * GGML_OP_SYMBOL[GGML_OP_COUNT] = {
     "relu(x)",
     "gelu(x)",
     "silu(x)",
+    "silu(x)*y",
     "norm(x)",
     "rms_norm(x)",
 
     "X*Y",
+    "X*Y+Z",
 
     "x*v",
     "x-\\>y",
@@ -2658,7 +1556,7 @@ static const char * GGML_OP_SYMBOL[GGML_OP_COUNT] = {
     "flash_ff(x)",
 };
 
-static_assert(GGML_OP_COUNT == 35, "GGML_OP_COUNT != 35");
+static_assert(GGML_OP_COUNT == 37, "GGML_OP_COUNT != 37");
 
 //
 // ggml object
@@ -2879,6 +1777,11 @@ static inline bool ggml_can_repeat(const struct ggml_tensor * t0, const struct g
         (t1->ne[3]%t0->ne[3] == 0);
 }
 
+// check if t1 can be represented as a repeatition of whole rows of t0
+static inline bool ggml_can_repeat_rows(const struct ggml_tensor * t0, const struct ggml_tensor * t1) {
+    return (t0->ne[0] == t1->ne[0]) && ggml_can_repeat(t0, t1);
+}
+
 static inline int ggml_up32(int n) {
     return (n + 31) & ~31;
 }
@@ -2899,35 +1802,241 @@ static inline int ggml_up(int n, int m) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-struct ggml_context * ggml_init(struct ggml_init_params params) {
-    // make this function thread safe
-    ggml_critical_section_start();
+//
+// kernel selection
+//
 
-    static bool is_first_call = true;
+static atomic_int g_kernels_selected = 0;
 
-    if (is_first_call) {
-        // initialize time system (required on Windows)
-        ggml_time_init();
+static const quantize_fns_t * const quantize_fns = g_kernels.quantize_fns;
 
-        // initialize GELU, SILU and EXP F32 tables
-        {
-            const uint64_t t_start = ggml_time_us(); UNUSED(t_start);
+#ifdef GGML_USE_DISPATCH
 
-            ggml_fp16_t ii;
-            for (int i = 0; i < (1 << 16); ++i) {
-                uint16_t ui = i;
-                memcpy(&ii, &ui, sizeof(ii));
-                const float f = table_f32_f16[i] = GGML_COMPUTE_FP16_TO_FP32(ii);
-                table_gelu_f16[i] = GGML_FP32_TO_FP16(ggml_gelu_f32(f));
-                table_silu_f16[i] = GGML_FP32_TO_FP16(ggml_silu_f32(f));
-                table_exp_f16[i]  = GGML_FP32_TO_FP16(expf(f));
-            }
+enum ggml_isa {
+    GGML_ISA_GENERIC,
+    GGML_ISA_AVX,
+    GGML_ISA_AVX2,
+    GGML_ISA_AVX512,
+    GGML_ISA_AVX512_VNNI,
 
-            const uint64_t t_end = ggml_time_us(); UNUSED(t_end);
+    GGML_ISA_COUNT,
+};
+
+// in order of increasing ISA level
+static void (* const GGML_ISA_KERNELS_INIT[GGML_ISA_COUNT])(ggml_kernels_t * kernels) = {
+    [GGML_ISA_GENERIC]     = ggml_kernels_init_generic,
+    [GGML_ISA_AVX]         = ggml_kernels_init_avx,
+    [GGML_ISA_AVX2]        = ggml_kernels_init_avx2,
+    [GGML_ISA_AVX512]      = ggml_kernels_init_avx512,
+    [GGML_ISA_AVX512_VNNI] = ggml_kernels_init_avx512_vnni,
+};
+
+static const char * GGML_ISA_NAME[GGML_ISA_COUNT] = {
+    "generic",
+    "avx",
+    "avx2",
+    "avx512",
+    "avx512_vnni",
+};
+
+static void ggml_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int) leaf, (int) subleaf);
+    memcpy(regs, r, sizeof(r));
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t ggml_xgetbv(void) {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax;
+    uint32_t edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t) edx << 32) | eax;
+#endif
+}
+
+// the highest ISA level supported by both the CPU and the OS
+static enum ggml_isa ggml_isa_detect(void) {
+    uint32_t r[4];
+
+    ggml_cpuid(0, 0, r);
+    const uint32_t max_leaf = r[0];
+
+    ggml_cpuid(1, 0, r);
+    const bool fma     = r[2] & (1u << 12);
+    const bool osxsave = r[2] & (1u << 27);
+    const bool avx     = r[2] & (1u << 28);
+    const bool f16c    = r[2] & (1u << 29);
+
+    if (!osxsave || !avx || !f16c) {
+        return GGML_ISA_GENERIC;
+    }
+
+    // the OS has to save the YMM state (and the opmask and ZMM state for AVX-512) on context switches
+    const uint64_t xcr0 = ggml_xgetbv();
+    if ((xcr0 & 0x06) != 0x06) {
+        return GGML_ISA_GENERIC;
+    }
+
+    if (max_leaf < 7) {
+        return GGML_ISA_AVX;
+    }
+
+    ggml_cpuid(7, 0, r);
+    const bool avx2        = r[1] & (1u << 5);
+    const bool avx512f     = r[1] & (1u << 16);
+    const bool avx512bw    = r[1] & (1u << 30);
+    const bool avx512vl    = r[1] & (1u << 31);
+    const bool avx512_vnni = r[2] & (1u << 11);
+
+    if (!avx2 || !fma) {
+        return GGML_ISA_AVX;
+    }
+    if (!avx512f || !avx512bw || !avx512vl || (xcr0 & 0xe6) != 0xe6) {
+        return GGML_ISA_AVX2;
+    }
+    if (!avx512_vnni) {
+        return GGML_ISA_AVX512;
+    }
+
+    return GGML_ISA_AVX512_VNNI;
+}
+
+#endif // GGML_USE_DISPATCH
+
+// not thread safe - ggml_init() calls it from within the critical section
+static void ggml_select_kernels(void) {
+    if (atomic_load(&g_kernels_selected)) {
+        return;
+    }
+
+    // GGML_ISA can request a lower level than the one detected, e.g. to test each set of kernels on one machine
+    const char * isa_env = getenv("GGML_ISA");
+    if (isa_env != NULL && isa_env[0] == '\0') {
+        isa_env = NULL;
+    }
+
+#ifdef GGML_USE_DISPATCH
+    enum ggml_isa isa = ggml_isa_detect();
+
+    if (isa_env != NULL) {
+        int i = 0;
+        while (i < GGML_ISA_COUNT && strcmp(isa_env, GGML_ISA_NAME[i]) != 0) {
+            i++;
+        }
+
+        if (i == GGML_ISA_COUNT) {
+            fprintf(stderr, "%s: unknown GGML_ISA '%s', using %s\n", __func__, isa_env, GGML_ISA_NAME[isa]);
+        } else if (i > (int) isa) {
+            fprintf(stderr, "%s: GGML_ISA '%s' is not supported by this CPU, using %s\n", __func__, isa_env, GGML_ISA_NAME[isa]);
+        } else {
+            isa = (enum ggml_isa) i;
+        }
+    }
+
+    GGML_ISA_KERNELS_INIT[isa](&g_kernels);
+#else
+    if (isa_env != NULL && strcmp(isa_env, "generic") != 0) {
+        fprintf(stderr, "%s: GGML_ISA '%s' needs a build with GGML_USE_DISPATCH, using generic\n", __func__, isa_env);
+    }
+
+    ggml_kernels_init_generic(&g_kernels);
+#endif
+
+    atomic_store(&g_kernels_selected, 1);
+}
+
+static void ggml_ensure_kernels(void) {
+    if (!atomic_load(&g_kernels_selected)) {
+        ggml_critical_section_start();
+        ggml_select_kernels();
+        ggml_critical_section_end();
+    }
+}
+
+// the kernels specialised for rows of n elements - NULL if the length or the type has none
+static vec_dot_q_t ggml_vec_dot_fixed(enum ggml_type type, int n) {
+    for (int i = 0; i < GGML_FIXED_COUNT; ++i) {
+        if (g_kernels.fixed[i].n == n) {
+            switch (type) {
+                case GGML_TYPE_Q4_0: return g_kernels.fixed[i].vec_dot_q4_0;
+                case GGML_TYPE_Q4_1: return g_kernels.fixed[i].vec_dot_q4_1;
+                case GGML_TYPE_F16:  return g_kernels.fixed[i].vec_dot_f16;
+                default:             return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static ggml_vec_norm_sq_f32_t ggml_vec_norm_sq_fixed(int n) {
+    for (int i = 0; i < GGML_FIXED_COUNT; ++i) {
+        if (g_kernels.fixed[i].n == n) {
+            return g_kernels.fixed[i].vec_norm_sq_f32;
+        }
+    }
+
+    return NULL;
+}
+
+void ggml_fp16_to_fp32_row(const ggml_fp16_t * x, float * y, int n) {
+    ggml_ensure_kernels();
+    g_kernels.fp16_to_fp32_row(x, y, n);
+}
+
+void ggml_fp32_to_fp16_row(const float * x, ggml_fp16_t * y, int n) {
+    ggml_ensure_kernels();
+    g_kernels.fp32_to_fp16_row(x, y, n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct ggml_context * ggml_init(struct ggml_init_params params) {
+    // make this function thread safe
+    ggml_critical_section_start();
+
+    static bool is_first_call = true;
+
+    if (is_first_call) {
+        // initialize time system (required on Windows)
+        ggml_time_init();
+
+        // initialize GELU, SILU and EXP F32 tables
+        {
+            const uint64_t t_start = ggml_time_us(); UNUSED(t_start);
+
+            ggml_fp16_t ii;
+            for (int i = 0; i < (1 << 16); ++i) {
+                uint16_t ui = i;
+                memcpy(&ii, &ui, sizeof(ii));
+                const float f = table_f32_f16[i] = GGML_COMPUTE_FP16_TO_FP32(ii);
+                table_gelu_f16[i] = GGML_FP32_TO_FP16(ggml_gelu_f32(f));
+                table_silu_f16[i] = GGML_FP32_TO_FP16(ggml_silu_f32(f));
+                table_exp_f16[i]  = GGML_FP32_TO_FP16(expf(f));
+            }
+
+            const uint64_t t_end = ggml_time_us(); UNUSED(t_end);
 
             GGML_PRINT_DEBUG("%s: GELU, SILU and EXP tables initialized in %f ms\n", __func__, (t_end - t_start)/1000.0f);
         }
 
+        // select the kernels for the CPU
+        {
+            const uint64_t t_start = ggml_time_us(); UNUSED(t_start);
+
+            ggml_select_kernels();
+
+            const uint64_t t_end = ggml_time_us(); UNUSED(t_end);
+
+            GGML_PRINT_DEBUG("%s: %s kernels selected in %f ms\n", __func__, g_kernels.name, (t_end - t_start)/1000.0f);
+        }
+
         // initialize g_state
         {
             const uint64_t t_start = ggml_time_us(); UNUSED(t_start);
@@ -3034,6 +2143,10 @@ size_t ggml_used_mem(const struct ggml_context * ctx) {
     return ctx->objects_end->offs + ctx->objects_end->size;
 }
 
+size_t ggml_tensor_overhead(void) {
+    return GGML_OBJECT_SIZE + sizeof(struct ggml_tensor);
+}
+
 size_t ggml_set_scratch(struct ggml_context * ctx, struct ggml_scratch scratch) {
     const size_t result = ctx->scratch.data ? ctx->scratch.offs : 0;
 
@@ -3092,6 +2205,9 @@ struct ggml_tensor * ggml_new_tensor_impl(
         int    n_dims,
         const int* ne,
         void*  data) {
+    // views may start anywhere in their source tensor, e.g. at a row of 18-byte q4_2 blocks
+    const bool is_view = data != NULL;
+
     // always insert objects at the end of the context's memory pool
     struct ggml_object * obj_cur = ctx->objects_end;
 
@@ -3186,10 +2302,14 @@ struct ggml_tensor * ggml_new_tensor_impl(
         /*.perf_cycles  =*/ 0,
         /*.perf_time_us =*/ 0,
         /*.data         =*/ (data == NULL && !ctx->no_alloc) ? (void *)(result + 1) : data,
+        /*.view_src     =*/ NULL,
+        /*.view_offs    =*/ 0,
         /*.pad          =*/ { 0 },
     };
 
-    ggml_assert_aligned(result->data);
+    if (!is_view) {
+        ggml_assert_aligned(result->data);
+    }
 
     for (int i = 0; i < n_dims; i++) {
         result->ne[i] = ne[i];
@@ -3206,6 +2326,34 @@ struct ggml_tensor * ggml_new_tensor_impl(
     return result;
 }
 
+// records the tensor that owns the memory of a view - for ggml_graph_alloc(), which places the owner
+static void ggml_set_view_src(struct ggml_tensor * view, struct ggml_tensor * src, size_t offs) {
+    if (src->view_src != NULL) {
+        offs += src->view_offs;
+        src   = src->view_src;
+    }
+
+    view->view_src  = src;
+    view->view_offs = offs;
+}
+
+// the operator parameters are written when the graph is built, so they are always in the context's memory -
+// not in the scratch buffer, and not left to ggml_graph_alloc() in a no_alloc context
+static struct ggml_tensor * ggml_new_op_params(struct ggml_context * ctx, enum ggml_type type, int ne0) {
+    const bool no_alloc = ctx->no_alloc;
+
+    ctx->scratch_save = ctx->scratch;
+    ctx->scratch.data = NULL;
+    ctx->no_alloc     = false;
+
+    struct ggml_tensor * result = ggml_new_tensor_impl(ctx, type, 1, &ne0, NULL);
+
+    ctx->scratch  = ctx->scratch_save;
+    ctx->no_alloc = no_alloc;
+
+    return result;
+}
+
 struct ggml_tensor * ggml_new_tensor(
         struct ggml_context * ctx,
         enum   ggml_type type,
@@ -3252,12 +2400,7 @@ struct ggml_tensor * ggml_new_tensor_4d(
 }
 
 struct ggml_tensor * ggml_new_i32(struct ggml_context * ctx, int32_t value) {
-    ctx->scratch_save = ctx->scratch;
-    ctx->scratch.data = NULL;
-
-    struct ggml_tensor * result = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, 1);
-
-    ctx->scratch = ctx->scratch_save;
+    struct ggml_tensor * result = ggml_new_op_params(ctx, GGML_TYPE_I32, 1);
 
     ggml_set_i32(result, value);
 
@@ -3265,12 +2408,7 @@ struct ggml_tensor * ggml_new_i32(struct ggml_context * ctx, int32_t value) {
 }
 
 struct ggml_tensor * ggml_new_f32(struct ggml_context * ctx, float value) {
-    ctx->scratch_save = ctx->scratch;
-    ctx->scratch.data = NULL;
-
-    struct ggml_tensor * result = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 1);
-
-    ctx->scratch = ctx->scratch_save;
+    struct ggml_tensor * result = ggml_new_op_params(ctx, GGML_TYPE_F32, 1);
 
     ggml_set_f32(result, value);
 
@@ -3302,6 +2440,26 @@ struct ggml_tensor * ggml_set_i32 (struct ggml_tensor * tensor, int32_t value) {
             {
                 GGML_ASSERT(false);
             } break;
+        case GGML_TYPE_Q8_0:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q2_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q3_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                GGML_ASSERT(false);
+            } break;
         case GGML_TYPE_I8:
             {
                 assert(tensor->nb[0] == sizeof(int8_t));
@@ -3337,6 +2495,7 @@ struct ggml_tensor * ggml_set_i32 (struct ggml_tensor * tensor, int32_t value) {
                     ggml_vec_set_f32(nc, (float *)(data + i*n1), value);
                 }
             } break;
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -3362,6 +2521,26 @@ struct ggml_tensor * ggml_set_f32(struct ggml_tensor * tensor, float value) {
             {
                 GGML_ASSERT(false);
             } break;
+        case GGML_TYPE_Q8_0:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q2_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q3_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                GGML_ASSERT(false);
+            } break;
         case GGML_TYPE_I8:
             {
                 assert(tensor->nb[0] == sizeof(int8_t));
@@ -3397,6 +2576,7 @@ struct ggml_tensor * ggml_set_f32(struct ggml_tensor * tensor, float value) {
                     ggml_vec_set_f32(nc, (float *)(data + i*n1), value);
                 }
             } break;
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -3416,6 +2596,26 @@ int32_t ggml_get_i32_1d(const struct ggml_tensor * tensor, int i) {
             {
                 GGML_ASSERT(false);
             } break;
+        case GGML_TYPE_Q8_0:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q2_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q3_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                GGML_ASSERT(false);
+            } break;
         case GGML_TYPE_I8:
             {
                 GGML_ASSERT(tensor->nb[0] == sizeof(int8_t));
@@ -3441,6 +2641,7 @@ int32_t ggml_get_i32_1d(const struct ggml_tensor * tensor, int i) {
                 GGML_ASSERT(tensor->nb[0] == sizeof(float));
                 return ((float *)(tensor->data))[i];
             } break;
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -3460,6 +2661,26 @@ void ggml_set_i32_1d(const struct ggml_tensor * tensor, int i, int32_t value) {
             {
                 GGML_ASSERT(false);
             } break;
+        case GGML_TYPE_Q8_0:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q2_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q3_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                GGML_ASSERT(false);
+            } break;
         case GGML_TYPE_I8:
             {
                 GGML_ASSERT(tensor->nb[0] == sizeof(int8_t));
@@ -3485,6 +2706,7 @@ void ggml_set_i32_1d(const struct ggml_tensor * tensor, int i, int32_t value) {
                 GGML_ASSERT(tensor->nb[0] == sizeof(float));
                 ((float *)(tensor->data))[i] = value;
             } break;
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -3502,6 +2724,26 @@ float ggml_get_f32_1d(const struct ggml_tensor * tensor, int i) {
             {
                 GGML_ASSERT(false);
             } break;
+        case GGML_TYPE_Q8_0:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q2_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q3_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                GGML_ASSERT(false);
+            } break;
         case GGML_TYPE_I8:
             {
                 GGML_ASSERT(tensor->nb[0] == sizeof(int8_t));
@@ -3527,6 +2769,7 @@ float ggml_get_f32_1d(const struct ggml_tensor * tensor, int i) {
                 GGML_ASSERT(tensor->nb[0] == sizeof(float));
                 return ((float *)(tensor->data))[i];
             } break;
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -3546,6 +2789,26 @@ void ggml_set_f32_1d(const struct ggml_tensor * tensor, int i, float value) {
             {
                 GGML_ASSERT(false);
             } break;
+        case GGML_TYPE_Q8_0:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q2_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q3_1:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                GGML_ASSERT(false);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                GGML_ASSERT(false);
+            } break;
         case GGML_TYPE_I8:
             {
                 GGML_ASSERT(tensor->nb[0] == sizeof(int8_t));
@@ -3571,6 +2834,7 @@ void ggml_set_f32_1d(const struct ggml_tensor * tensor, int i, float value) {
                 GGML_ASSERT(tensor->nb[0] == sizeof(float));
                 ((float *)(tensor->data))[i] = value;
             } break;
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -3589,8 +2853,16 @@ float * ggml_get_data_f32(const struct ggml_tensor * tensor) {
 
 struct ggml_tensor * ggml_view_tensor(
         struct ggml_context * ctx,
-        const struct ggml_tensor * src) {
-    return ggml_new_tensor_impl(ctx, src->type, src->n_dims, src->ne, src->data);
+        struct ggml_tensor  * src) {
+    struct ggml_tensor * result = ggml_new_tensor_impl(ctx, src->type, src->n_dims, src->ne, src->data);
+    ggml_set_view_src(result, src, 0);
+
+    // keep the strides - src can be a non-contiguous view
+    for (int i = 0; i < GGML_MAX_DIMS; i++) {
+        result->nb[i] = src->nb[i];
+    }
+
+    return result;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3636,7 +2908,7 @@ struct ggml_tensor * ggml_add_impl(
         struct ggml_tensor * a,
         struct ggml_tensor * b,
         bool inplace) {
-    GGML_ASSERT(ggml_are_same_shape(a, b));
+    GGML_ASSERT(ggml_can_repeat_rows(b, a));
 
     bool is_node = false;
 
@@ -3714,7 +2986,7 @@ struct ggml_tensor * ggml_mul_impl(
         struct ggml_tensor * a,
         struct ggml_tensor * b,
         bool inplace) {
-    GGML_ASSERT(ggml_are_same_shape(a, b));
+    GGML_ASSERT(ggml_can_repeat_rows(b, a));
 
     bool is_node = false;
 
@@ -4172,6 +3444,31 @@ struct ggml_tensor * ggml_silu_inplace(
     return ggml_silu_impl(ctx, a, true);
 }
 
+// ggml_silu_mul
+
+struct ggml_tensor * ggml_silu_mul(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * b) {
+    GGML_ASSERT(ggml_are_same_shape(a, b));
+
+    bool is_node = false;
+
+    if (a->grad || b->grad) {
+        GGML_ASSERT(false); // TODO: implement backward
+        is_node = true;
+    }
+
+    struct ggml_tensor * result = ggml_new_tensor(ctx, GGML_TYPE_F32, a->n_dims, a->ne);
+
+    result->op   = GGML_OP_SILU_MUL;
+    result->grad = is_node ? ggml_dup_tensor(ctx, result) : NULL;
+    result->src0 = a;
+    result->src1 = b;
+
+    return result;
+}
+
 // ggml_norm
 
 struct ggml_tensor * ggml_norm_impl(
@@ -4240,14 +3537,39 @@ struct ggml_tensor * ggml_rms_norm_inplace(
     return ggml_rms_norm_impl(ctx, a, true);
 }
 
-// ggml_mul_mat
-
-struct ggml_tensor * ggml_mul_mat(
+struct ggml_tensor * ggml_rms_norm_mul(
         struct ggml_context * ctx,
         struct ggml_tensor  * a,
         struct ggml_tensor  * b) {
-    GGML_ASSERT(ggml_can_mul_mat(a, b));
-    GGML_ASSERT(!ggml_is_transposed(a));
+    GGML_ASSERT(b->type == GGML_TYPE_F32);
+    GGML_ASSERT(b->ne[0] == a->ne[0] && ggml_nrows(b) == 1);
+    GGML_ASSERT(ggml_is_contiguous(b));
+
+    bool is_node = false;
+
+    if (a->grad || b->grad) {
+        GGML_ASSERT(false); // TODO: implement backward
+        is_node = true;
+    }
+
+    struct ggml_tensor * result = ggml_dup_tensor(ctx, a);
+
+    result->op   = GGML_OP_RMS_NORM;
+    result->grad = is_node ? ggml_dup_tensor(ctx, result) : NULL;
+    result->src0 = a;
+    result->src1 = b;
+
+    return result;
+}
+
+// ggml_mul_mat
+
+struct ggml_tensor * ggml_mul_mat(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * b) {
+    GGML_ASSERT(ggml_can_mul_mat(a, b));
+    GGML_ASSERT(!ggml_is_transposed(a));
 
     bool is_node = false;
 
@@ -4266,6 +3588,39 @@ struct ggml_tensor * ggml_mul_mat(
     return result;
 }
 
+// ggml_mul_mat_add
+
+struct ggml_tensor * ggml_mul_mat_add(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * b,
+        struct ggml_tensor  * c) {
+    GGML_ASSERT(ggml_can_mul_mat(a, b));
+    GGML_ASSERT(!ggml_is_transposed(a));
+
+    bool is_node = false;
+
+    if (a->grad || b->grad || c->grad) {
+        GGML_ASSERT(false); // TODO: implement backward
+        is_node = true;
+    }
+
+    const int ne[4] = { a->ne[1], b->ne[1], a->ne[2], b->ne[3] };
+    struct ggml_tensor * result = ggml_new_tensor(ctx, GGML_TYPE_F32, MIN(a->n_dims, b->n_dims), ne);
+
+    GGML_ASSERT(c->type == GGML_TYPE_F32);
+    GGML_ASSERT(ggml_is_contiguous(c));
+    GGML_ASSERT(ggml_are_same_shape(c, result));
+
+    result->op     = GGML_OP_MUL_MAT_ADD;
+    result->grad   = is_node ? ggml_dup_tensor(ctx, result) : NULL;
+    result->src0   = a;
+    result->src1   = b;
+    result->opt[0] = c;
+
+    return result;
+}
+
 // ggml_scale
 
 struct ggml_tensor * ggml_scale_impl(
@@ -4368,6 +3723,7 @@ struct ggml_tensor * ggml_reshape(
     }
 
     struct ggml_tensor * result = ggml_new_tensor_impl(ctx, a->type, b->n_dims, b->ne, a->data);
+    ggml_set_view_src(result, a, 0);
 
     result->op   = GGML_OP_RESHAPE;
     result->grad = is_node ? ggml_dup_tensor(ctx, result) : NULL;
@@ -4394,6 +3750,7 @@ struct ggml_tensor * ggml_reshape_2d(
 
     const int ne[2] = { ne0, ne1 };
     struct ggml_tensor * result = ggml_new_tensor_impl(ctx, a->type, 2, ne, a->data);
+    ggml_set_view_src(result, a, 0);
 
     result->op   = GGML_OP_RESHAPE;
     result->grad = is_node ? ggml_dup_tensor(ctx, result) : NULL;
@@ -4421,6 +3778,7 @@ struct ggml_tensor * ggml_reshape_3d(
 
     const int ne[3] = { ne0, ne1, ne2 };
     struct ggml_tensor * result = ggml_new_tensor_impl(ctx, a->type, 3, ne, a->data);
+    ggml_set_view_src(result, a, 0);
 
     result->op   = GGML_OP_RESHAPE;
     result->grad = is_node ? ggml_dup_tensor(ctx, result) : NULL;
@@ -4442,6 +3800,7 @@ struct ggml_tensor * ggml_view_1d(
     }
 
     struct ggml_tensor * result = ggml_new_tensor_impl(ctx, a->type, 1, &ne0, (char *) a->data + offset);
+    ggml_set_view_src(result, a, offset);
 
     result->op   = GGML_OP_VIEW;
     result->grad = NULL;
@@ -4467,6 +3826,7 @@ struct ggml_tensor * ggml_view_2d(
     const int ne[GGML_MAX_DIMS] = { ne0, ne1, 1, 1 };
 
     struct ggml_tensor * result = ggml_new_tensor_impl(ctx, a->type, 2, ne, (char *) a->data + offset);
+    ggml_set_view_src(result, a, offset);
 
     result->nb[1] = nb1;
     result->nb[2] = result->nb[1]*ne1;
@@ -4480,6 +3840,38 @@ struct ggml_tensor * ggml_view_2d(
     return result;
 }
 
+// ggml_view_3d
+
+struct ggml_tensor * ggml_view_3d(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        int                   ne0,
+        int                   ne1,
+        int                   ne2,
+        size_t                nb1,
+        size_t                nb2,
+        size_t                offset) {
+    if (a->grad) {
+        GGML_ASSERT(false); // gradient propagation is not supported
+    }
+
+    const int ne[GGML_MAX_DIMS] = { ne0, ne1, ne2, 1 };
+
+    struct ggml_tensor * result = ggml_new_tensor_impl(ctx, a->type, 3, ne, (char *) a->data + offset);
+    ggml_set_view_src(result, a, offset);
+
+    result->nb[1] = nb1;
+    result->nb[2] = nb2;
+    result->nb[3] = result->nb[2]*ne2;
+
+    result->op   = GGML_OP_VIEW;
+    result->grad = NULL;
+    result->src0 = a;
+    result->src1 = NULL; // TODO: maybe store the offset here?
+
+    return result;
+}
+
 // ggml_permute
 
 struct ggml_tensor * ggml_permute(
@@ -4666,7 +4058,7 @@ struct ggml_tensor * ggml_rope(
     //struct ggml_tensor * result = inplace ? ggml_view_tensor(ctx, a) : ggml_dup_tensor(ctx, a);
     struct ggml_tensor * result = ggml_view_tensor(ctx, a);
 
-    struct ggml_tensor * b = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, 3);
+    struct ggml_tensor * b = ggml_new_op_params(ctx, GGML_TYPE_I32, 3);
     ((int32_t *) b->data)[0] = n_past;
     ((int32_t *) b->data)[1] = n_dims;
     ((int32_t *) b->data)[2] = mode;
@@ -4742,7 +4134,8 @@ struct ggml_tensor * ggml_flash_attn(
         struct ggml_tensor  * v,
         bool                  masked) {
     GGML_ASSERT(ggml_can_mul_mat(k, q));
-    // TODO: check if vT can be multiplied by (k*qT)
+    GGML_ASSERT(ggml_are_same_shape(k, v));
+    GGML_ASSERT(k->type == v->type);
 
     bool is_node = false;
 
@@ -4815,7 +4208,6 @@ static void ggml_compute_forward_dup_f16(
         const struct ggml_tensor * src0,
         struct ggml_tensor * dst) {
     GGML_ASSERT(params->ith == 0);
-    GGML_ASSERT(ggml_is_contiguous(dst));
     GGML_ASSERT(ggml_nelements(dst) == ggml_nelements(src0));
 
     if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
@@ -4832,11 +4224,65 @@ static void ggml_compute_forward_dup_f16(
     const size_t nb02 = src0->nb[2];
     const size_t nb03 = src0->nb[3];
 
-    if (ggml_is_contiguous(src0) && src0->type == dst->type) {
+    if (ggml_is_contiguous(src0) && ggml_is_contiguous(dst) && src0->type == dst->type) {
         memcpy(dst->data, src0->data, ggml_nelements(dst) * GGML_TYPE_SIZE[src0->type]);
         return;
     }
 
+    // a block-quantized dst (e.g. the quantized kv cache) is written a row at a time, converted to f32 in wdata first
+    quantize_row_q_t const quantize_row_q = GGML_BLCK_SIZE[dst->type] > 1 ? quantize_fns[dst->type].quantize_row_q : NULL;
+
+    if (quantize_row_q) {
+        GGML_ASSERT(ggml_are_same_shape(src0, dst));
+        GGML_ASSERT(nb00 == sizeof(ggml_fp16_t));
+        GGML_ASSERT(params->wsize >= ne00*sizeof(float));
+
+        float * wdata = (float *) params->wdata;
+
+        for (int i03 = 0; i03 < ne03; i03++) {
+            for (int i02 = 0; i02 < ne02; i02++) {
+                for (int i01 = 0; i01 < ne01; i01++) {
+                    const ggml_fp16_t * src0_ptr = (ggml_fp16_t *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                    char * dst_ptr = (char *) dst->data + i01*dst->nb[1] + i02*dst->nb[2] + i03*dst->nb[3];
+
+                    g_kernels.fp16_to_fp32_row(src0_ptr, wdata, ne00);
+                    quantize_row_q(wdata, dst_ptr, ne00);
+                }
+            }
+        }
+
+        return;
+    }
+
+    if (!ggml_is_contiguous(dst)) {
+        // strided dst (e.g. a view into the kv cache) - src and dst must have the same shape
+        GGML_ASSERT(ggml_are_same_shape(src0, dst));
+        GGML_ASSERT(nb00 == sizeof(ggml_fp16_t));
+        GGML_ASSERT(dst->nb[0] == GGML_TYPE_SIZE[dst->type]);
+        GGML_ASSERT(dst->type == GGML_TYPE_F16 || dst->type == GGML_TYPE_F32);
+
+        const size_t nb1 = dst->nb[1];
+        const size_t nb2 = dst->nb[2];
+        const size_t nb3 = dst->nb[3];
+
+        for (int i03 = 0; i03 < ne03; i03++) {
+            for (int i02 = 0; i02 < ne02; i02++) {
+                for (int i01 = 0; i01 < ne01; i01++) {
+                    const ggml_fp16_t * src0_ptr = (ggml_fp16_t *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                    char * dst_ptr = (char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3;
+
+                    if (dst->type == GGML_TYPE_F16) {
+                        memcpy(dst_ptr, src0_ptr, ne00*nb00);
+                    } else {
+                        g_kernels.fp16_to_fp32_row(src0_ptr, (float *) dst_ptr, ne00);
+                    }
+                }
+            }
+        }
+
+        return;
+    }
+
     if (src0->nb[0] == sizeof(ggml_fp16_t)) {
         if (dst->type == GGML_TYPE_F16) {
             size_t id = 0;
@@ -4861,12 +4307,10 @@ static void ggml_compute_forward_dup_f16(
             for (int i03 = 0; i03 < ne03; i03++) {
                 for (int i02 = 0; i02 < ne02; i02++) {
                     for (int i01 = 0; i01 < ne01; i01++) {
-                        for (int i00 = 0; i00 < ne00; i00++) {
-                            const ggml_fp16_t * src0_ptr = (ggml_fp16_t *) ((char *) src0->data + i00*nb00 + i01*nb01 + i02*nb02 + i03*nb03);
+                        const ggml_fp16_t * src0_ptr = (ggml_fp16_t *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                            dst_ptr[id] = GGML_FP16_TO_FP32(*src0_ptr);
-                            id++;
-                        }
+                        g_kernels.fp16_to_fp32_row_strided(src0_ptr, nb00, dst_ptr + id, ne00);
+                        id += ne00;
                     }
                 }
             }
@@ -4883,12 +4327,10 @@ static void ggml_compute_forward_dup_f16(
             for (int i03 = 0; i03 < ne03; i03++) {
                 for (int i02 = 0; i02 < ne02; i02++) {
                     for (int i01 = 0; i01 < ne01; i01++) {
-                        for (int i00 = 0; i00 < ne00; i00++) {
-                            const ggml_fp16_t * src0_ptr = (ggml_fp16_t *) ((char *) src0->data + i00*nb00 + i01*nb01 + i02*nb02 + i03*nb03);
+                        const ggml_fp16_t * src0_ptr = (ggml_fp16_t *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                            dst_ptr[id] = GGML_FP16_TO_FP32(*src0_ptr);
-                            id++;
-                        }
+                        g_kernels.fp16_to_fp32_row_strided(src0_ptr, nb00, dst_ptr + id, ne00);
+                        id += ne00;
                     }
                 }
             }
@@ -4919,7 +4361,6 @@ static void ggml_compute_forward_dup_f32(
         const struct ggml_tensor * src0,
         struct ggml_tensor * dst) {
     GGML_ASSERT(params->ith == 0);
-    GGML_ASSERT(ggml_is_contiguous(dst));
     GGML_ASSERT(ggml_nelements(dst) == ggml_nelements(src0));
 
     if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
@@ -4936,11 +4377,67 @@ static void ggml_compute_forward_dup_f32(
     const size_t nb02 = src0->nb[2];
     const size_t nb03 = src0->nb[3];
 
-    if (ggml_is_contiguous(src0) && src0->type == dst->type) {
+    if (ggml_is_contiguous(src0) && ggml_is_contiguous(dst) && src0->type == dst->type) {
         memcpy(dst->data, src0->data, ggml_nelements(dst) * GGML_TYPE_SIZE[src0->type]);
         return;
     }
 
+    // a block-quantized dst (e.g. the quantized kv cache) is written a row at a time
+    quantize_row_q_t const quantize_row_q = GGML_BLCK_SIZE[dst->type] > 1 ? quantize_fns[dst->type].quantize_row_q : NULL;
+
+    if (quantize_row_q && ggml_is_contiguous(dst)) {
+        GGML_ASSERT(ggml_are_same_shape(src0, dst));
+        GGML_ASSERT(nb00 == sizeof(float));
+
+        const size_t rs = ne00/GGML_BLCK_SIZE[dst->type]*GGML_TYPE_SIZE[dst->type];
+
+        size_t id = 0;
+
+        for (int i03 = 0; i03 < ne03; i03++) {
+            for (int i02 = 0; i02 < ne02; i02++) {
+                for (int i01 = 0; i01 < ne01; i01++) {
+                    const float * src0_ptr = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+                    quantize_row_q(src0_ptr, (char *) dst->data + id*rs, ne00);
+                    id++;
+                }
+            }
+        }
+
+        return;
+    }
+
+    if (!ggml_is_contiguous(dst)) {
+        // strided dst (e.g. a view into the kv cache) - src and dst must have the same shape
+        GGML_ASSERT(ggml_are_same_shape(src0, dst));
+        GGML_ASSERT(nb00 == sizeof(float));
+        GGML_ASSERT(dst->nb[0] == GGML_TYPE_SIZE[dst->type]);
+        GGML_ASSERT(dst->type == GGML_TYPE_F32 || dst->type == GGML_TYPE_F16 || quantize_row_q);
+
+        const size_t nb1 = dst->nb[1];
+        const size_t nb2 = dst->nb[2];
+        const size_t nb3 = dst->nb[3];
+
+        for (int i03 = 0; i03 < ne03; i03++) {
+            for (int i02 = 0; i02 < ne02; i02++) {
+                for (int i01 = 0; i01 < ne01; i01++) {
+                    const float * src0_ptr = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                    char * dst_ptr = (char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3;
+
+                    if (dst->type == GGML_TYPE_F32) {
+                        memcpy(dst_ptr, src0_ptr, ne00*nb00);
+                    } else if (dst->type == GGML_TYPE_F16) {
+                        g_kernels.fp32_to_fp16_row(src0_ptr, (ggml_fp16_t *) dst_ptr, ne00);
+                    } else {
+                        quantize_row_q(src0_ptr, dst_ptr, ne00);
+                    }
+                }
+            }
+        }
+
+        return;
+    }
+
     if (src0->nb[0] == sizeof(float)) {
         if (dst->type == GGML_TYPE_F32) {
             size_t id = 0;
@@ -4965,12 +4462,10 @@ static void ggml_compute_forward_dup_f32(
             for (int i03 = 0; i03 < ne03; i03++) {
                 for (int i02 = 0; i02 < ne02; i02++) {
                     for (int i01 = 0; i01 < ne01; i01++) {
-                        for (int i00 = 0; i00 < ne00; i00++) {
-                            const float * src0_ptr = (float *) ((char *) src0->data + i00*nb00 + i01*nb01 + i02*nb02 + i03*nb03);
+                        const float * src0_ptr = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                            dst_ptr[id] = GGML_FP32_TO_FP16(*src0_ptr);
-                            id++;
-                        }
+                        g_kernels.fp32_to_fp16_row_strided(src0_ptr, nb00, dst_ptr + id, ne00);
+                        id += ne00;
                     }
                 }
             }
@@ -5003,12 +4498,10 @@ static void ggml_compute_forward_dup_f32(
             for (int i03 = 0; i03 < ne03; i03++) {
                 for (int i02 = 0; i02 < ne02; i02++) {
                     for (int i01 = 0; i01 < ne01; i01++) {
-                        for (int i00 = 0; i00 < ne00; i00++) {
-                            const float * src0_ptr = (float *) ((char *) src0->data + i00*nb00 + i01*nb01 + i02*nb02 + i03*nb03);
+                        const float * src0_ptr = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                            dst_ptr[id] = GGML_FP32_TO_FP16(*src0_ptr);
-                            id++;
-                        }
+                        g_kernels.fp32_to_fp16_row_strided(src0_ptr, nb00, dst_ptr + id, ne00);
+                        id += ne00;
                     }
                 }
             }
@@ -5033,9 +4526,15 @@ static void ggml_compute_forward_dup(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5050,7 +4549,7 @@ static void ggml_compute_forward_add_f32(
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
         struct ggml_tensor * dst) {
-    GGML_ASSERT(ggml_are_same_shape(src0, src1) && ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(ggml_can_repeat_rows(src1, src0) && ggml_are_same_shape(src0, dst));
 
     if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
         return;
@@ -5059,40 +4558,60 @@ static void ggml_compute_forward_add_f32(
     const int ith = params->ith;
     const int nth = params->nth;
 
-    const int n  = ggml_nrows(src0);
+    const int nr = ggml_nrows(src0);
     const int nc = src0->ne[0];
 
-    const size_t nb00 = src0->nb[0];
+    const int ne01 = src0->ne[1];
+    const int ne02 = src0->ne[2];
+
+    const int ne11 = src1->ne[1];
+    const int ne12 = src1->ne[2];
+    const int ne13 = src1->ne[3];
+
     const size_t nb01 = src0->nb[1];
+    const size_t nb02 = src0->nb[2];
+    const size_t nb03 = src0->nb[3];
 
     const size_t nb10 = src1->nb[0];
     const size_t nb11 = src1->nb[1];
+    const size_t nb12 = src1->nb[2];
+    const size_t nb13 = src1->nb[3];
 
-    const size_t nb0 = dst->nb[0];
     const size_t nb1 = dst->nb[1];
+    const size_t nb2 = dst->nb[2];
+    const size_t nb3 = dst->nb[3];
 
-    GGML_ASSERT( nb0 == sizeof(float));
-    GGML_ASSERT(nb00 == sizeof(float));
+    GGML_ASSERT( dst->nb[0] == sizeof(float));
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    if (nb10 == sizeof(float)) {
-        const int j0 = (n/nth)*ith;
-        const int j1 = ith == nth - 1 ? n : (n/nth)*(ith + 1);
+    // rows per thread
+    const int dr = (nr + nth - 1)/nth;
 
-        for (int j = j0; j < j1; j++) {
-            ggml_vec_add_f32(nc,
-                    (float *) ((char *) dst->data  + j*nb1),
-                    (float *) ((char *) src0->data + j*nb01),
-                    (float *) ((char *) src1->data + j*nb11));
-        }
-    } else {
-        // src1 is not contiguous
-        for (int j = ith; j < n; j += nth) {
-            float * dst_ptr  = (float *) ((char *) dst->data  + j*nb1);
-            float * src0_ptr = (float *) ((char *) src0->data + j*nb01);
-            for (int i = 0; i < nc; i++) {
-                float * src1_ptr = (float *) ((char *) src1->data + j*nb11 + i*nb10);
-
-                dst_ptr[i] = src0_ptr[i] + *src1_ptr;
+    // row range for this thread
+    const int ir0 = dr*ith;
+    const int ir1 = MIN(ir0 + dr, nr);
+
+    for (int ir = ir0; ir < ir1; ++ir) {
+        // src0 and dst row indices
+        const int i03 = ir/(ne02*ne01);
+        const int i02 = (ir - i03*ne02*ne01)/ne01;
+        const int i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+        // src1 is broadcast across rows
+        const int i13 = i03 % ne13;
+        const int i12 = i02 % ne12;
+        const int i11 = i01 % ne11;
+
+        float * dst_ptr  = (float *) ((char *) dst->data  + i03*nb3  + i02*nb2  + i01*nb1 );
+        float * src0_ptr = (float *) ((char *) src0->data + i03*nb03 + i02*nb02 + i01*nb01);
+        float * src1_ptr = (float *) ((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11);
+
+        if (nb10 == sizeof(float)) {
+            ggml_vec_add_f32(nc, dst_ptr, src0_ptr, src1_ptr);
+        } else {
+            // src1 is not contiguous
+            for (int i0 = 0; i0 < nc; i0++) {
+                dst_ptr[i0] = src0_ptr[i0] + *(float *) ((char *) src1_ptr + i0*nb10);
             }
         }
     }
@@ -5110,10 +4629,16 @@ static void ggml_compute_forward_add(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5162,10 +4687,16 @@ static void ggml_compute_forward_sub(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5180,25 +4711,63 @@ static void ggml_compute_forward_mul_f32(
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
         struct ggml_tensor * dst) {
-    assert(params->ith == 0);
-    assert(ggml_are_same_shape(src0, src1) && ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(ggml_can_repeat_rows(src1, src0) && ggml_are_same_shape(src0, dst));
 
     if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
         return;
     }
 
-    const int n  = ggml_nrows(src0);
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int nr = ggml_nrows(src0);
     const int nc = src0->ne[0];
 
-    assert( dst->nb[0] == sizeof(float));
-    assert(src0->nb[0] == sizeof(float));
-    assert(src1->nb[0] == sizeof(float));
+    const int ne01 = src0->ne[1];
+    const int ne02 = src0->ne[2];
+
+    const int ne11 = src1->ne[1];
+    const int ne12 = src1->ne[2];
+    const int ne13 = src1->ne[3];
+
+    const size_t nb01 = src0->nb[1];
+    const size_t nb02 = src0->nb[2];
+    const size_t nb03 = src0->nb[3];
+
+    const size_t nb11 = src1->nb[1];
+    const size_t nb12 = src1->nb[2];
+    const size_t nb13 = src1->nb[3];
+
+    const size_t nb1 = dst->nb[1];
+    const size_t nb2 = dst->nb[2];
+    const size_t nb3 = dst->nb[3];
+
+    GGML_ASSERT( dst->nb[0] == sizeof(float));
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
+    GGML_ASSERT(src1->nb[0] == sizeof(float));
+
+    // rows per thread
+    const int dr = (nr + nth - 1)/nth;
+
+    // row range for this thread
+    const int ir0 = dr*ith;
+    const int ir1 = MIN(ir0 + dr, nr);
+
+    for (int ir = ir0; ir < ir1; ++ir) {
+        // src0 and dst row indices
+        const int i03 = ir/(ne02*ne01);
+        const int i02 = (ir - i03*ne02*ne01)/ne01;
+        const int i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+        // src1 is broadcast across rows
+        const int i13 = i03 % ne13;
+        const int i12 = i02 % ne12;
+        const int i11 = i01 % ne11;
 
-    for (int i = 0; i < n; i++) {
         ggml_vec_mul_f32(nc,
-                (float *) ((char *) dst->data  + i*( dst->nb[1])),
-                (float *) ((char *) src0->data + i*(src0->nb[1])),
-                (float *) ((char *) src1->data + i*(src1->nb[1])));
+                (float *) ((char *) dst->data  + i03*nb3  + i02*nb2  + i01*nb1 ),
+                (float *) ((char *) src0->data + i03*nb03 + i02*nb02 + i01*nb01),
+                (float *) ((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11));
     }
 }
 
@@ -5214,10 +4783,16 @@ static void ggml_compute_forward_mul(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5266,10 +4841,16 @@ static void ggml_compute_forward_div(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5314,10 +4895,16 @@ static void ggml_compute_forward_sqr(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5362,10 +4949,16 @@ static void ggml_compute_forward_sqrt(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5420,10 +5013,16 @@ static void ggml_compute_forward_sum(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5497,10 +5096,16 @@ static void ggml_compute_forward_mean(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5561,10 +5166,16 @@ static void ggml_compute_forward_repeat(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5609,10 +5220,16 @@ static void ggml_compute_forward_abs(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5657,10 +5274,16 @@ static void ggml_compute_forward_sgn(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5705,10 +5328,16 @@ static void ggml_compute_forward_neg(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5753,10 +5382,16 @@ static void ggml_compute_forward_step(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5801,10 +5436,16 @@ static void ggml_compute_forward_relu(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5866,10 +5507,16 @@ static void ggml_compute_forward_gelu(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5885,7 +5532,8 @@ static void ggml_compute_forward_silu_f32(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
         struct ggml_tensor * dst) {
-    GGML_ASSERT(ggml_is_contiguous(src0));
+    // the rows of a matrix can be strided (e.g. a view into a fused matmul result)
+    GGML_ASSERT(ggml_is_contiguous(src0) || (ggml_is_matrix(src0) && src0->nb[0] == sizeof(float)));
     GGML_ASSERT(ggml_is_contiguous(dst));
     GGML_ASSERT(ggml_are_same_shape(src0, dst));
 
@@ -5933,10 +5581,16 @@ static void ggml_compute_forward_silu(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -5945,40 +5599,107 @@ static void ggml_compute_forward_silu(
 }
 
 
-// ggml_compute_forward_norm
+// ggml_compute_forward_silu_mul
 
-static void ggml_compute_forward_norm_f32(
+static void ggml_compute_forward_silu_mul_f32(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
         struct ggml_tensor * dst) {
-    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+    // the rows of src0 and src1 can be strided (e.g. views into a fused matmul result)
+    GGML_ASSERT(ggml_is_contiguous(src0) || (ggml_is_matrix(src0) && src0->nb[0] == sizeof(float)));
+    GGML_ASSERT(ggml_is_contiguous(src1) || (ggml_is_matrix(src1) && src1->nb[0] == sizeof(float)));
+    GGML_ASSERT(ggml_is_contiguous(dst));
+    GGML_ASSERT(ggml_are_same_shape(src0, src1) && ggml_are_same_shape(src0, dst));
 
     if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
         return;
     }
 
-    GGML_ASSERT(src0->nb[0] == sizeof(float));
-
     const int ith = params->ith;
     const int nth = params->nth;
 
-    const int ne00 = src0->ne[0];
-    const int ne01 = src0->ne[1];
-    const int ne02 = src0->ne[2];
-    const int ne03 = src0->ne[3];
-
-    const size_t nb01 = src0->nb[1];
-    const size_t nb02 = src0->nb[2];
-    const size_t nb03 = src0->nb[3];
+    const int nc = src0->ne[0];
+    const int nr = ggml_nrows(src0);
 
-    const size_t nb1 = dst->nb[1];
-    const size_t nb2 = dst->nb[2];
-    const size_t nb3 = dst->nb[3];
+    // rows per thread
+    const int dr = (nr + nth - 1)/nth;
 
-    const float eps = 1e-5f; // TODO: make this a parameter
+    // row range for this thread
+    const int ir0 = dr*ith;
+    const int ir1 = MIN(ir0 + dr, nr);
 
-    // TODO: optimize
-    for (int i03 = 0; i03 < ne03; i03++) {
+    for (int i1 = ir0; i1 < ir1; i1++) {
+        ggml_vec_silu_mul_f32(nc,
+                (float *) ((char *) dst->data  + i1*( dst->nb[1])),
+                (float *) ((char *) src0->data + i1*(src0->nb[1])),
+                (float *) ((char *) src1->data + i1*(src1->nb[1])));
+    }
+}
+
+static void ggml_compute_forward_silu_mul(
+        const struct ggml_compute_params * params,
+        const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
+        struct ggml_tensor * dst) {
+    switch (src0->type) {
+        case GGML_TYPE_F32:
+            {
+                ggml_compute_forward_silu_mul_f32(params, src0, src1, dst);
+            } break;
+        case GGML_TYPE_Q4_0:
+        case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
+        case GGML_TYPE_I8:
+        case GGML_TYPE_I16:
+        case GGML_TYPE_I32:
+        case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
+        case GGML_TYPE_COUNT:
+            {
+                GGML_ASSERT(false);
+            } break;
+    }
+}
+
+// ggml_compute_forward_norm
+
+static void ggml_compute_forward_norm_f32(
+        const struct ggml_compute_params * params,
+        const struct ggml_tensor * src0,
+        struct ggml_tensor * dst) {
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+
+    if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
+        return;
+    }
+
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int ne00 = src0->ne[0];
+    const int ne01 = src0->ne[1];
+    const int ne02 = src0->ne[2];
+    const int ne03 = src0->ne[3];
+
+    const size_t nb01 = src0->nb[1];
+    const size_t nb02 = src0->nb[2];
+    const size_t nb03 = src0->nb[3];
+
+    const size_t nb1 = dst->nb[1];
+    const size_t nb2 = dst->nb[2];
+    const size_t nb3 = dst->nb[3];
+
+    const float eps = 1e-5f; // TODO: make this a parameter
+
+    // TODO: optimize
+    for (int i03 = 0; i03 < ne03; i03++) {
         for (int i02 = 0; i02 < ne02; i02++) {
             for (int i01 = ith; i01 < ne01; i01 += nth) {
                 const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
@@ -6019,10 +5740,16 @@ static void ggml_compute_forward_norm(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -6030,17 +5757,22 @@ static void ggml_compute_forward_norm(
     }
 }
 
+// the rows are split across the threads - or, when there are fewer rows than threads (e.g. a single token),
+// each row is: the partial sums of squares of the slices of the row are stored in the work buffer by
+// the GGML_TASK_INIT phase, and the GGML_TASK_COMPUTE phase adds them up and scales the slices
 static void ggml_compute_forward_rms_norm_f32(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
         struct ggml_tensor * dst) {
     GGML_ASSERT(ggml_are_same_shape(src0, dst));
 
-    if (params->type == GGML_TASK_INIT || params->type == GGML_TASK_FINALIZE) {
+    if (params->type == GGML_TASK_FINALIZE) {
         return;
     }
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
+    GGML_ASSERT(dst->nb[0]  == sizeof(float));
 
     const int ith = params->ith;
     const int nth = params->nth;
@@ -6048,7 +5780,6 @@ static void ggml_compute_forward_rms_norm_f32(
     const int ne00 = src0->ne[0];
     const int ne01 = src0->ne[1];
     const int ne02 = src0->ne[2];
-    const int ne03 = src0->ne[3];
 
     const size_t nb01 = src0->nb[1];
     const size_t nb02 = src0->nb[2];
@@ -6060,49 +5791,96 @@ static void ggml_compute_forward_rms_norm_f32(
 
     const float eps = 1e-6f; // TODO: make this a parameter
 
-    // TODO: optimize
-    for (int i03 = 0; i03 < ne03; i03++) {
-        for (int i02 = 0; i02 < ne02; i02++) {
-            for (int i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    // the weights, NULL for a plain rms_norm
+    const float * w = src1 ? (const float *) src1->data : NULL;
 
-                ggml_float sum = 0.0;
-                for (int i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)(x[i00] * x[i00]);
-                }
+    const int nr = ggml_nrows(src0);
 
-                float mean = sum/ne00;
+    if (nr >= nth) {
+        if (params->type == GGML_TASK_INIT) {
+            return;
+        }
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+        ggml_vec_norm_sq_f32_t const norm_sq_fixed = ggml_vec_norm_sq_fixed(ne00);
+        ggml_vec_norm_sq_f32_t const norm_sq       = norm_sq_fixed ? norm_sq_fixed : g_kernels.vec_norm_sq_f32;
 
-                memcpy(y, x, ne00 * sizeof(float));
-                // for (int i00 = 0; i00 < ne00; i00++) {
-                //     y[i00] = x[i00];
-                // }
+        for (int ir = ith; ir < nr; ir += nth) {
+            const int i03 = ir/(ne02*ne01);
+            const int i02 = (ir - i03*ne02*ne01)/ne01;
+            const int i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                const float scale = 1.0f/sqrtf(mean + eps);
+            const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                  float * y = (float *) ((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
 
-                ggml_vec_scale_f32(ne00, y, scale);
-            }
+            const float mean  = norm_sq(ne00, x)/ne00;
+            const float scale = 1.0f/sqrtf(mean + eps);
+
+            g_kernels.vec_scale_mul_f32(ne00, y, x, scale, w);
         }
+
+        return;
+    }
+
+    // slice of the rows for this thread, in whole cache lines
+    const int dc = ((ne00 + nth - 1)/nth + CACHE_LINE_SIZE_F32 - 1)/CACHE_LINE_SIZE_F32*CACHE_LINE_SIZE_F32;
+
+    const int ic0 = MIN(dc*ith, ne00);
+    const int ic1 = MIN(ic0 + dc, ne00);
+
+    // partial sums: nr per thread, a cache line apart
+    const int ps = nr + CACHE_LINE_SIZE/sizeof(ggml_float);
+
+    ggml_float * partial = params->wdata;
+
+    for (int ir = 0; ir < nr; ir++) {
+        const int i03 = ir/(ne02*ne01);
+        const int i02 = (ir - i03*ne02*ne01)/ne01;
+        const int i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+        const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+        if (params->type == GGML_TASK_INIT) {
+            partial[ith*ps + ir] = g_kernels.vec_norm_sq_f32(ic1 - ic0, x + ic0);
+            continue;
+        }
+
+        // the same order of summation in all the threads
+        ggml_float sum = 0.0;
+        for (int j = 0; j < nth; j++) {
+            sum += partial[j*ps + ir];
+        }
+
+        const float mean  = sum/ne00;
+        const float scale = 1.0f/sqrtf(mean + eps);
+
+        float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+
+        g_kernels.vec_scale_mul_f32(ic1 - ic0, y + ic0, x + ic0, scale, w ? w + ic0 : NULL);
     }
 }
 
 static void ggml_compute_forward_rms_norm(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
         struct ggml_tensor * dst) {
     switch (src0->type) {
         case GGML_TYPE_F32:
             {
-                ggml_compute_forward_rms_norm_f32(params, src0, dst);
+                ggml_compute_forward_rms_norm_f32(params, src0, src1, dst);
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -6119,7 +5897,7 @@ static void ggml_compute_forward_rms_norm(
 static bool ggml_compute_forward_mul_mat_use_blas(
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
-              struct ggml_tensor * dst) {
+        const struct ggml_tensor * dst) {
     //const int ne00 = src0->ne[0];
     //const int ne01 = src0->ne[1];
 
@@ -6144,6 +5922,7 @@ static void ggml_compute_forward_mul_mat_f32(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
+        const struct ggml_tensor * acc,
               struct ggml_tensor * dst) {
     int64_t t0 = ggml_perf_time_us();
     UNUSED(t0);
@@ -6153,9 +5932,6 @@ static void ggml_compute_forward_mul_mat_f32(
     const int ne02 = src0->ne[2];
     const int ne03 = src0->ne[3];
 
-#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
-    const int ne10 = src1->ne[0];
-#endif
     const int ne11 = src1->ne[1];
 #ifndef NDEBUG
     const int ne12 = src1->ne[2];
@@ -6210,42 +5986,6 @@ static void ggml_compute_forward_mul_mat_f32(
     // nb01 >= nb00 - src0 is not transposed
     //   compute by src0 rows
 
-#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
-    if (ggml_compute_forward_mul_mat_use_blas(src0, src1, dst)) {
-        if (params->ith != 0) {
-            return;
-        }
-
-        if (params->type == GGML_TASK_INIT) {
-            return;
-        }
-
-        if (params->type == GGML_TASK_FINALIZE) {
-            return;
-        }
-
-        for (int i03 = 0; i03 < ne03; i03++) {
-            for (int i02 = 0; i02 < ne02; i02++) {
-                const float * x = (float *) ((char *) src0->data + i02*nb02 + i03*nb03);
-                const float * y = (float *) ((char *) src1->data + i02*nb12 + i03*nb13);
-
-                float * d = (float *) ((char *) dst->data + i02*nb2 + i03*nb3);
-
-                // zT = y * xT
-                cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
-                        ne11, ne01, ne10,
-                        1.0f,    y, ne10,
-                                 x, ne10,
-                        0.0f,    d, ne01);
-            }
-        }
-
-        //printf("CBLAS F32 = %f ms, %d x %d x %d x %d\n", (ggml_perf_time_us() - t0)/1000.0, ne0, ne1, ne2, ne3);
-
-        return;
-    }
-#endif
-
     if (params->type == GGML_TASK_INIT) {
         return;
     }
@@ -6288,6 +6028,12 @@ static void ggml_compute_forward_mul_mat_f32(
                     (float *) ((char *)  dst->data + (i0*nb0 + i1*nb1 + i2*nb2 + i3*nb3)),
                     (float *) ((char *) src0->data + (i01*nb01 + i02*nb02 + i03*nb03)),
                     (float *) ((char *) src1->data + (i11*nb11 + i12*nb12 + i13*nb13)));
+
+            if (acc) {
+                // acc is contiguous and has the shape of dst
+                *(float *) ((char *) dst->data + (i0*nb0 + i1*nb1 + i2*nb2 + i3*nb3)) +=
+                *(float *) ((char *) acc->data + (i0*nb0 + i1*nb1 + i2*nb2 + i3*nb3));
+            }
         }
     }
 
@@ -6309,6 +6055,7 @@ static void ggml_compute_forward_mul_mat_f16_f32(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
+        const struct ggml_tensor * acc,
               struct ggml_tensor * dst) {
     int64_t t0 = ggml_perf_time_us();
     UNUSED(t0);
@@ -6369,55 +6116,6 @@ static void ggml_compute_forward_mul_mat_f16_f32(
     // nb01 >= nb00 - src0 is not transposed
     //   compute by src0 rows
 
-#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
-    if (ggml_compute_forward_mul_mat_use_blas(src0, src1, dst)) {
-        GGML_ASSERT(nb10 == sizeof(float));
-
-        if (params->ith != 0) {
-            return;
-        }
-
-        if (params->type == GGML_TASK_INIT) {
-            return;
-        }
-
-        if (params->type == GGML_TASK_FINALIZE) {
-            return;
-        }
-
-        float * const wdata = params->wdata;
-
-        for (int i03 = 0; i03 < ne03; i03++) {
-            for (int i02 = 0; i02 < ne02; i02++) {
-                {
-                    size_t id = 0;
-                    for (int i01 = 0; i01 < ne01; ++i01) {
-                        for (int i00 = 0; i00 < ne00; ++i00) {
-                            wdata[id++] = GGML_FP16_TO_FP32(*(ggml_fp16_t *) ((char *) src0->data + i03*nb03 + i02*nb02 + i01*nb01 + i00*nb00));
-                        }
-                    }
-                }
-
-                const float * x = wdata;
-                const float * y = (float *) ((char *) src1->data + i02*nb12 + i03*nb13);
-
-                float * d = (float *) ((char *) dst->data + i02*nb2 + i03*nb3);
-
-                // zT = y * xT
-                cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
-                        ne11, ne01, ne10,
-                        1.0f,    y, ne10,
-                                 x, ne10,
-                        0.0f,    d, ne01);
-            }
-        }
-
-        /*printf("CBLAS F16 = %f ms, %d x %d x %d x %d\n", (ggml_perf_time_us() - t0)/1000.0, ne0, ne1, ne2, ne3);*/
-
-        return;
-    }
-#endif
-
     if (params->type == GGML_TASK_INIT) {
         ggml_fp16_t * const wdata = params->wdata;
 
@@ -6425,9 +6123,8 @@ static void ggml_compute_forward_mul_mat_f16_f32(
         for (int i13 = 0; i13 < ne13; ++i13) {
             for (int i12 = 0; i12 < ne12; ++i12) {
                 for (int i11 = 0; i11 < ne11; ++i11) {
-                    for (int i10 = 0; i10 < ne10; ++i10) {
-                        wdata[id++] = GGML_FP32_TO_FP16(*(float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + i10*nb10));
-                    }
+                    g_kernels.fp32_to_fp16_row_strided((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11), nb10, wdata + id, ne10);
+                    id += ne10;
                 }
             }
         }
@@ -6459,6 +6156,8 @@ static void ggml_compute_forward_mul_mat_f16_f32(
 
     ggml_fp16_t * wdata = params->wdata;
 
+    vec_dot_q_t const vec_dot_fixed = ggml_vec_dot_fixed(GGML_TYPE_F16, ne00);
+
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 indices
         const int i03 = ir/(ne02*ne01);
@@ -6477,8 +6176,23 @@ static void ggml_compute_forward_mul_mat_f16_f32(
 
         float * dst_col = (float *) ((char *) dst->data + (i0*nb0 + 0*nb1 + i2*nb2 + i3*nb3));
 
-        for (int ic = 0; ic < ne11; ++ic) {
-            ggml_vec_dot_f16(ne00, &dst_col[ic*ne0], src0_row, src1_col + ic*ne00);
+        if (vec_dot_fixed) {
+            for (int ic = 0; ic < ne11; ++ic) {
+                vec_dot_fixed(ne00, &dst_col[ic*ne0], src0_row, src1_col + ic*ne00);
+            }
+        } else {
+            for (int ic = 0; ic < ne11; ++ic) {
+                ggml_vec_dot_f16(ne00, &dst_col[ic*ne0], src0_row, src1_col + ic*ne00);
+            }
+        }
+
+        if (acc) {
+            // acc is contiguous and has the shape of dst
+            const float * acc_col = (float *) ((char *) acc->data + (i0*nb0 + 0*nb1 + i2*nb2 + i3*nb3));
+
+            for (int ic = 0; ic < ne11; ++ic) {
+                dst_col[ic*ne0] += acc_col[ic*ne0];
+            }
         }
     }
 
@@ -6495,37 +6209,449 @@ static void ggml_compute_forward_mul_mat_f16_f32(
     //}
 }
 
-typedef void (*dequantize_row_q_t)(const void * restrict x, float * restrict y, int k);
-typedef void (*quantize_row_q_t)(const float * restrict x, void * restrict y, int k);
-typedef void (*vec_dot_q_t)(const int n, float * restrict s, const void * restrict x, const void * restrict y);
-
-typedef struct {
-    dequantize_row_q_t dequantize_row_q;
-    quantize_row_q_t   quantize_row_q;
-    vec_dot_q_t        vec_dot_q;
-} quantize_fns_t;
-
-static const quantize_fns_t quantize_fns[GGML_TYPE_COUNT] = {
-    [GGML_TYPE_Q4_0] = {
-        .dequantize_row_q = dequantize_row_q4_0,
-        .quantize_row_q   = quantize_row_q4_0,
-        .vec_dot_q        = ggml_vec_dot_q4_0,
-    },
-    [GGML_TYPE_Q4_1] = {
-        .dequantize_row_q = dequantize_row_q4_1,
-        .quantize_row_q   = quantize_row_q4_1,
-        .vec_dot_q        = ggml_vec_dot_q4_1,
-    },
-};
+// For internal test use
+quantize_fns_t ggml_internal_get_quantize_fn(size_t i) {
+    GGML_ASSERT(i < GGML_TYPE_COUNT);
+    ggml_ensure_kernels();
+    return quantize_fns[i];
+}
+
+vec_dot_q_t ggml_internal_get_vec_dot_fixed(enum ggml_type type, int n) {
+    ggml_ensure_kernels();
+    return ggml_vec_dot_fixed(type, n);
+}
 
 static void ggml_compute_forward_mul_mat_q_f32(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
+        const struct ggml_tensor * acc,
+              struct ggml_tensor * dst) {
+    int64_t t0 = ggml_perf_time_us();
+    UNUSED(t0);
+
+    const int ne00 = src0->ne[0];
+    const int ne01 = src0->ne[1];
+    const int ne02 = src0->ne[2];
+    const int ne03 = src0->ne[3];
+
+    const int ne10 = src1->ne[0];
+    const int ne11 = src1->ne[1];
+    const int ne12 = src1->ne[2];
+    const int ne13 = src1->ne[3];
+
+    const int ne0  = dst->ne[0];
+    const int ne1  = dst->ne[1];
+    const int ne2  = dst->ne[2];
+    const int ne3  = dst->ne[3];
+
+    const int nb00 = src0->nb[0];
+    const int nb01 = src0->nb[1];
+    const int nb02 = src0->nb[2];
+    const int nb03 = src0->nb[3];
+
+    const int nb10 = src1->nb[0];
+    const int nb11 = src1->nb[1];
+    const int nb12 = src1->nb[2];
+    const int nb13 = src1->nb[3];
+
+    const int nb0  = dst->nb[0];
+    const int nb1  = dst->nb[1];
+    const int nb2  = dst->nb[2];
+    const int nb3  = dst->nb[3];
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    GGML_ASSERT(ne02 == ne12);
+    GGML_ASSERT(ne03 == ne13);
+    GGML_ASSERT(ne2  == ne12);
+    GGML_ASSERT(ne3  == ne13);
+
+    const enum ggml_type type = src0->type;
+    quantize_row_q_t const quantize_row_q_dot = quantize_fns[type].quantize_row_q_dot;
+    vec_dot_q_t      const vec_dot_fixed      = ggml_vec_dot_fixed(type, ne00);
+    vec_dot_q_t      const vec_dot_q          = vec_dot_fixed ? vec_dot_fixed : quantize_fns[type].vec_dot_q;
+
+    // rows per vec_dot_q call
+    const int nrb = GGML_BLCK_ROWS[type];
+
+    // we don't support permuted src0 or src1
+    GGML_ASSERT(nb00 == (int) GGML_TYPE_SIZE[type]);
+    GGML_ASSERT(nb10 == sizeof(float));
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    GGML_ASSERT(ne0 == ne01);
+    GGML_ASSERT(ne1 == ne11);
+    GGML_ASSERT(ne2 == ne02);
+    GGML_ASSERT(ne3 == ne03);
+
+    GGML_ASSERT(ne01 % nrb == 0);
+
+    // nb01 >= nb00 - src0 is not transposed
+    //   compute by src0 rows
+
+    if (params->type == GGML_TASK_INIT) {
+        // quantize the src1 rows to 8 bits, the rows are split across the threads
+        char * wdata = params->wdata;
+        const size_t row_size = ne10*sizeof(block_q8_0)/QK;
+
+        // total rows in src1
+        const int nr1 = ne11*ne12*ne13;
+
+        // rows per thread
+        const int dr1 = (nr1 + nth - 1)/nth;
+
+        // row range for this thread
+        const int ir10 = dr1*ith;
+        const int ir11 = MIN(ir10 + dr1, nr1);
+
+        for (int ir = ir10; ir < ir11; ++ir) {
+            const int i13 = ir/(ne12*ne11);
+            const int i12 = (ir - i13*ne12*ne11)/ne11;
+            const int i11 = (ir - i13*ne12*ne11 - i12*ne11);
+
+            quantize_row_q_dot((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11), (void *) (wdata + ir*row_size), ne10);
+        }
+
+        return;
+    }
+
+    if (params->type == GGML_TASK_FINALIZE) {
+        return;
+    }
+
+    // parallelize by src0 rows using ggml_vec_dot_q
+
+    // total rows in src0
+    const int nr = ne01*ne02*ne03;
+
+    // rows per thread, in whole groups of nrb rows
+    const int dr = ((nr/nrb + nth - 1)/nth)*nrb;
+
+    // row range for this thread
+    const int ir0 = dr*ith;
+    const int ir1 = MIN(ir0 + dr, nr);
+
+    void * wdata = params->wdata;
+    const size_t row_size = ne00*sizeof(block_q8_0)/QK;
+
+    for (int ir = ir0; ir < ir1; ir += nrb) {
+        // src0 indices
+        const int i03 = ir/(ne02*ne01);
+        const int i02 = (ir - i03*ne02*ne01)/ne01;
+        const int i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+        const int i13 = i03;
+        const int i12 = i02;
+
+        const int i0 = i01;
+        const int i2 = i02;
+        const int i3 = i03;
+
+        void * src0_row = (void *) ((char *) src0->data + (i01*nb01 + i02*nb02 + i03*nb03));
+        char * src1_col =          ((char *)      wdata + (      (0 + i12*ne11 + i13*ne12*ne11)*row_size));
+
+        float * dst_col = (float *) ((char *) dst->data + (i0*nb0 + 0*nb1 + i2*nb2 + i3*nb3));
+
+        assert(ne00 % 32 == 0);
+
+        for (int ic = 0; ic < ne11; ++ic) {
+            vec_dot_q(ne00, &dst_col[ic*ne0], src0_row, (void *) (src1_col + ic*row_size));
+        }
+
+        if (acc) {
+            // acc is contiguous and has the shape of dst
+            const float * acc_col = (float *) ((char *) acc->data + (i0*nb0 + 0*nb1 + i2*nb2 + i3*nb3));
+
+            for (int ic = 0; ic < ne11; ++ic) {
+                for (int ib = 0; ib < nrb; ++ib) {
+                    dst_col[ic*ne0 + ib] += acc_col[ic*ne0 + ib];
+                }
+            }
+        }
+    }
+
+    //int64_t t1 = ggml_time_us();
+    //static int64_t acc = 0;
+    //acc += t1 - t0;
+    //if (t1 - t0 > 10) {
+    //    printf("\n");
+    //    printf("ne00 = %5d, ne01 = %5d, ne02 = %5d, ne03 = %5d\n", ne00, ne01, ne02, ne03);
+    //    printf("nb00 = %5d, nb01 = %5d, nb02 = %5d, nb03 = %5d\n", nb00, nb01, nb02, nb03);
+    //    printf("ne10 = %5d, ne11 = %5d, ne12 = %5d, ne13 = %5d\n", ne10, ne11, ne12, ne13);
+
+    //    printf("XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX task %d/%d: %d us, acc = %d\n", ith, nth, (int) (t1 - t0), (int) acc);
+    //}
+}
+
+// cache-blocked matrix multiplication for the larger batches of src1 rows (prompt processing)
+//
+// in GGML_TASK_INIT the src1 rows are packed in panels of gemm_nr rows, interleaved along ne10
+// each thread then takes blocks of GGML_GEMM_MC src0 rows, decodes them to f32 GGML_GEMM_KC values at a time,
+// in panels of gemm_mr rows, and runs the register-tiled kernel over all the src1 panels
+// a src0 block is decoded once per GGML_GEMM_KC slice and reused for all the src1 rows
+
+#define GGML_GEMM_MIN_ROWS 32  // minimum number of src1 rows for the blocked kernel
+#define GGML_GEMM_MC       64  // src0 rows per block (multiple of gemm_mr)
+#define GGML_GEMM_KC       256 // values per row and block (multiple of QK)
+
+static bool ggml_compute_forward_mul_mat_use_gemm(
+        const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
+        const struct ggml_tensor * dst) {
+#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
+    if (ggml_compute_forward_mul_mat_use_blas(src0, src1, dst)) {
+        return false;
+    }
+#endif
+    UNUSED(dst);
+
+    if (src1->type != GGML_TYPE_F32 || src1->ne[1] < GGML_GEMM_MIN_ROWS) {
+        return false;
+    }
+
+    // the interleaved types already have a multi-row integer kernel, faster than decoding them to f32
+    return src0->type == GGML_TYPE_F32 || src0->type == GGML_TYPE_F16 ||
+        (quantize_fns[src0->type].dequantize_row_q != NULL && GGML_BLCK_ROWS[src0->type] == 1);
+}
+
+// size of the packed src1 panels
+static size_t ggml_gemm_src1_size(const struct ggml_tensor * src1) {
+    const int nr = g_kernels.gemm_nr;
+
+    return sizeof(float)*src1->ne[0]*((src1->ne[1] + nr - 1)/nr)*nr*src1->ne[2]*src1->ne[3];
+}
+
+// size of the work data of one thread: the decoded src0 block + one decoded row
+static size_t ggml_gemm_thread_size(void) {
+    return sizeof(float)*(GGML_GEMM_MC + 1)*GGML_GEMM_KC + CACHE_LINE_SIZE;
+}
+
+static void ggml_compute_forward_mul_mat_gemm(
+        const struct ggml_compute_params * params,
+        const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
+        const struct ggml_tensor * acc,
+              struct ggml_tensor * dst) {
+    const int ne00 = src0->ne[0];
+    const int ne01 = src0->ne[1];
+    const int ne02 = src0->ne[2];
+    const int ne03 = src0->ne[3];
+
+    const int ne10 = src1->ne[0];
+    const int ne11 = src1->ne[1];
+    const int ne12 = src1->ne[2];
+    const int ne13 = src1->ne[3];
+
+    const int ne0  = dst->ne[0];
+    const int ne1  = dst->ne[1];
+    const int ne2  = dst->ne[2];
+    const int ne3  = dst->ne[3];
+
+    const int nb00 = src0->nb[0];
+    const int nb01 = src0->nb[1];
+    const int nb02 = src0->nb[2];
+    const int nb03 = src0->nb[3];
+
+    const int nb10 = src1->nb[0];
+    const int nb11 = src1->nb[1];
+    const int nb12 = src1->nb[2];
+    const int nb13 = src1->nb[3];
+
+    const int nb0  = dst->nb[0];
+    const int nb1  = dst->nb[1];
+    const int nb2  = dst->nb[2];
+    const int nb3  = dst->nb[3];
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const enum ggml_type type = src0->type;
+
+    const int mr = g_kernels.gemm_mr;
+    const int nr = g_kernels.gemm_nr;
+
+    GGML_ASSERT(ne02 == ne12);
+    GGML_ASSERT(ne03 == ne13);
+    GGML_ASSERT(ne2  == ne12);
+    GGML_ASSERT(ne3  == ne13);
+
+    // we don't support permuted src0
+    GGML_ASSERT(nb00 == (int) GGML_TYPE_SIZE[type]);
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    GGML_ASSERT(ne0 == ne01);
+    GGML_ASSERT(ne1 == ne11);
+    GGML_ASSERT(ne2 == ne02);
+    GGML_ASSERT(ne3 == ne03);
+
+    GGML_ASSERT(ne00 % GGML_BLCK_SIZE[type] == 0);
+    GGML_ASSERT(GGML_GEMM_MC % mr == 0 && mr*nr <= GGML_GEMM_TILE_MAX);
+
+    // src1 panels per src1 matrix
+    const int np1 = (ne11 + nr - 1)/nr;
+
+    float * const wp1 = params->wdata;
+
+    if (params->type == GGML_TASK_INIT) {
+        // pack the src1 panels, split across the threads
+        const int np = np1*ne12*ne13;
+
+        for (int ip = ith; ip < np; ip += nth) {
+            const int i13 = ip/(ne12*np1);
+            const int i12 = (ip - i13*ne12*np1)/np1;
+            const int i11 = (ip - i13*ne12*np1 - i12*np1)*nr;
+
+            float * p = wp1 + (size_t) ip*ne10*nr;
+
+            for (int j = 0; j < nr; ++j) {
+                if (i11 + j < ne11) {
+                    const char * src1_row = (const char *) src1->data + i13*nb13 + i12*nb12 + (i11 + j)*nb11;
+                    for (int l = 0; l < ne10; ++l) {
+                        p[l*nr + j] = *(const float *) (src1_row + l*nb10);
+                    }
+                } else {
+                    for (int l = 0; l < ne10; ++l) {
+                        p[l*nr + j] = 0.0f;
+                    }
+                }
+            }
+        }
+
+        return;
+    }
+
+    if (params->type == GGML_TASK_FINALIZE) {
+        return;
+    }
+
+    float * const wa   = (float *) ((char *) params->wdata + ggml_gemm_src1_size(src1) + ith*ggml_gemm_thread_size());
+    float * const wrow = wa + GGML_GEMM_MC*GGML_GEMM_KC;
+
+    // dst is [ne11][ne01] for every src0 matrix
+    const int ldc = nb1/sizeof(float);
+
+    // blocks of src0 rows, spread across the threads
+    const int nbm = (ne01 + GGML_GEMM_MC - 1)/GGML_GEMM_MC;
+    const int nbt = nbm*ne02*ne03;
+
+    for (int ib = ith; ib < nbt; ib += nth) {
+        const int i03 = ib/(ne02*nbm);
+        const int i02 = (ib - i03*ne02*nbm)/nbm;
+        const int i01 = (ib - i03*ne02*nbm - i02*nbm)*GGML_GEMM_MC;
+
+        const int mc = MIN(GGML_GEMM_MC, ne01 - i01);
+
+        const char  * src0_block = (const char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03;
+        const float * wp1_block  = wp1 + (size_t) (i03*ne12 + i02)*np1*ne10*nr;
+
+        float * dst_block = (float *) ((char *) dst->data + i01*nb0 + i02*nb2 + i03*nb3);
+
+        // the tiles accumulate into dst
+        for (int i1 = 0; i1 < ne11; ++i1) {
+            if (acc) {
+                // acc is contiguous and has the shape of dst
+                memcpy(dst_block + i1*ldc, (char *) acc->data + i01*nb0 + i1*nb1 + i02*nb2 + i03*nb3, mc*sizeof(float));
+            } else {
+                memset(dst_block + i1*ldc, 0, mc*sizeof(float));
+            }
+        }
+
+        for (int l0 = 0; l0 < ne00; l0 += GGML_GEMM_KC) {
+            const int kc = MIN(GGML_GEMM_KC, ne00 - l0);
+
+            // decode the block in panels of mr rows, the rows past ne01 are zero
+            for (int ir = 0; ir < mc; ++ir) {
+                const char * src0_row = src0_block + ir*nb01;
+                const float * x = wrow;
+
+                switch (type) {
+                    case GGML_TYPE_F32:
+                        {
+                            x = (const float *) src0_row + l0;
+                        } break;
+                    case GGML_TYPE_F16:
+                        {
+                            g_kernels.fp16_to_fp32_row((const ggml_fp16_t *) src0_row + l0, wrow, kc);
+                        } break;
+                    default:
+                        {
+                            quantize_fns[type].dequantize_row_q(src0_row + (l0/GGML_BLCK_SIZE[type])*GGML_TYPE_SIZE[type], wrow, kc);
+                        } break;
+                }
+
+                float * pa = wa + (ir/mr)*mr*kc + ir%mr;
+                for (int l = 0; l < kc; ++l) {
+                    pa[l*mr] = x[l];
+                }
+            }
+
+            for (int ir = mc; ir % mr != 0; ++ir) {
+                float * pa = wa + (ir/mr)*mr*kc + ir%mr;
+                for (int l = 0; l < kc; ++l) {
+                    pa[l*mr] = 0.0f;
+                }
+            }
+
+            for (int j = 0; j < ne11; j += nr) {
+                const float * pb = wp1_block + (size_t) (j/nr)*ne10*nr + l0*nr;
+
+                for (int i = 0; i < mc; i += mr) {
+                    const float * pa = wa + i*kc;
+
+                    if (i + mr <= mc && j + nr <= ne11) {
+                        g_kernels.gemm_f32(kc, pa, pb, dst_block + j*ldc + i, ldc);
+                    } else {
+                        // partial tile at the edge of dst
+                        float tile[GGML_GEMM_TILE_MAX] = { 0 };
+
+                        g_kernels.gemm_f32(kc, pa, pb, tile, mr);
+
+                        for (int jj = 0; jj < MIN(nr, ne11 - j); ++jj) {
+                            for (int ii = 0; ii < MIN(mr, mc - i); ++ii) {
+                                dst_block[(j + jj)*ldc + i + ii] += tile[jj*mr + ii];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
+// BLAS matrix multiplication in panels of src0 rows
+//
+// each thread takes panels of GGML_BLAS_MC src0 rows, decodes them to f32 in its part of the work buffer
+// and multiplies them with all the src1 rows with one sgemm call, into the corresponding dst columns
+// the decoded panels stay in the cache and the work buffer does not grow with the size of src0
+// the BLAS library is called from all the threads - it should be limited to one thread per call
+// (e.g. OPENBLAS_NUM_THREADS=1), the parallelism comes from the panels
+
+#define GGML_BLAS_MC 128 // src0 rows per panel (multiple of GGML_BLCK_ROWS)
+
+// size of the work data of one thread
+static size_t ggml_blas_thread_size(const struct ggml_tensor * src0) {
+    return sizeof(float)*GGML_BLAS_MC*src0->ne[0] + CACHE_LINE_SIZE;
+}
+
+static void ggml_compute_forward_mul_mat_blas(
+        const struct ggml_compute_params * params,
+        const struct ggml_tensor * src0,
+        const struct ggml_tensor * src1,
+        const struct ggml_tensor * acc,
               struct ggml_tensor * dst) {
-    int64_t t0 = ggml_perf_time_us();
-    UNUSED(t0);
-
     const int ne00 = src0->ne[0];
     const int ne01 = src0->ne[1];
     const int ne02 = src0->ne[2];
@@ -6547,7 +6673,6 @@ static void ggml_compute_forward_mul_mat_q_f32(
     const int nb03 = src0->nb[3];
 
     const int nb10 = src1->nb[0];
-    const int nb11 = src1->nb[1];
     const int nb12 = src1->nb[2];
     const int nb13 = src1->nb[3];
 
@@ -6559,15 +6684,16 @@ static void ggml_compute_forward_mul_mat_q_f32(
     const int ith = params->ith;
     const int nth = params->nth;
 
+    const enum ggml_type type = src0->type;
+
+    // rows decoded together
+    const int nrb = GGML_BLCK_ROWS[type];
+
     GGML_ASSERT(ne02 == ne12);
     GGML_ASSERT(ne03 == ne13);
     GGML_ASSERT(ne2  == ne12);
     GGML_ASSERT(ne3  == ne13);
 
-    const enum ggml_type type = src0->type;
-    quantize_row_q_t const quantize_row_q = quantize_fns[type].quantize_row_q;
-    vec_dot_q_t      const vec_dot_q      = quantize_fns[type].vec_dot_q;
-
     // we don't support permuted src0 or src1
     GGML_ASSERT(nb00 == (int) GGML_TYPE_SIZE[type]);
     GGML_ASSERT(nb10 == sizeof(float));
@@ -6583,69 +6709,10 @@ static void ggml_compute_forward_mul_mat_q_f32(
     GGML_ASSERT(ne2 == ne02);
     GGML_ASSERT(ne3 == ne03);
 
-    // nb01 >= nb00 - src0 is not transposed
-    //   compute by src0 rows
-
-#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
-    if (ggml_compute_forward_mul_mat_use_blas(src0, src1, dst)) {
-        if (params->ith != 0) {
-            return;
-        }
-
-        if (params->type == GGML_TASK_INIT) {
-            return;
-        }
-
-        if (params->type == GGML_TASK_FINALIZE) {
-            return;
-        }
-
-        float * const wdata = params->wdata;
-        dequantize_row_q_t const dequantize_row_q = quantize_fns[type].dequantize_row_q;
-
-        for (int i03 = 0; i03 < ne03; i03++) {
-            for (int i02 = 0; i02 < ne02; i02++) {
-                {
-                    size_t id = 0;
-                    for (int i01 = 0; i01 < ne01; ++i01) {
-                        dequantize_row_q((char *) src0->data + i03*nb03 + i02*nb02 + i01*nb01, wdata + id, ne00);
-                        id += ne00;
-                    }
-                }
-
-                const float * x = wdata;
-                const float * y = (float *) ((char *) src1->data + i02*nb12 + i03*nb13);
-
-                float * d = (float *) ((char *) dst->data + i02*nb2 + i03*nb3);
-
-                // zT = y * xT
-                cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
-                        ne11, ne01, ne10,
-                        1.0f,    y, ne10,
-                                 x, ne10,
-                        0.0f,    d, ne01);
-            }
-        }
-
-        //printf("CBLAS = %f ms, %d x %d x %d x %d\n", (ggml_perf_time_us() - t0)/1000.0, ne0, ne1, ne2, ne3);
-
-        return;
-    }
-#endif
+    GGML_ASSERT(ne01 % nrb == 0);
+    GGML_ASSERT(GGML_BLAS_MC % nrb == 0);
 
     if (params->type == GGML_TASK_INIT) {
-        char * wdata = params->wdata;
-        const size_t row_size = ne10*GGML_TYPE_SIZE[type]/GGML_BLCK_SIZE[type];
-
-        for (int i13 = 0; i13 < ne13; ++i13) {
-            for (int i12 = 0; i12 < ne12; ++i12) {
-                for (int i11 = 0; i11 < ne11; ++i11) {
-                    quantize_row_q((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11), (void *) wdata, ne10);
-                    wdata += row_size;
-                }
-            }
-        }
-
         return;
     }
 
@@ -6653,77 +6720,107 @@ static void ggml_compute_forward_mul_mat_q_f32(
         return;
     }
 
-    // parallelize by src0 rows using ggml_vec_dot_q
-
-    // total rows in src0
-    const int nr = ne01*ne02*ne03;
+    float * const wdata = (float *) ((char *) params->wdata + ith*ggml_blas_thread_size(src0));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    // dst is [ne11][ne01] for every src0 matrix
+    const int ldc = nb1/sizeof(float);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    // panels of src0 rows, spread across the threads
+    const int npm = (ne01 + GGML_BLAS_MC - 1)/GGML_BLAS_MC;
+    const int npt = npm*ne02*ne03;
 
-    void * wdata = params->wdata;
-    const size_t row_size = ne00*GGML_TYPE_SIZE[type]/GGML_BLCK_SIZE[type];
+    for (int ip = ith; ip < npt; ip += nth) {
+        const int i03 = ip/(ne02*npm);
+        const int i02 = (ip - i03*ne02*npm)/npm;
+        const int i01 = (ip - i03*ne02*npm - i02*npm)*GGML_BLAS_MC;
 
-    for (int ir = ir0; ir < ir1; ++ir) {
-        // src0 indices
-        const int i03 = ir/(ne02*ne01);
-        const int i02 = (ir - i03*ne02*ne01)/ne01;
-        const int i01 = (ir - i03*ne02*ne01 - i02*ne01);
+        const int mc = MIN(GGML_BLAS_MC, ne01 - i01);
 
-        const int i13 = i03;
-        const int i12 = i02;
+        const char * src0_panel = (const char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03;
 
-        const int i0 = i01;
-        const int i2 = i02;
-        const int i3 = i03;
+        // the mc x ne00 panel, row-major with stride ldx
+        const float * x = wdata;
+        int ldx = ne00;
 
-        void * src0_row = (void *) ((char *) src0->data + (i01*nb01 + i02*nb02 + i03*nb03));
-        char * src1_col =          ((char *)      wdata + (      (0 + i12*ne11 + i13*ne12*ne11)*row_size));
+        switch (type) {
+            case GGML_TYPE_F32:
+                {
+                    x   = (const float *) src0_panel;
+                    ldx = nb01/sizeof(float);
+                } break;
+            case GGML_TYPE_F16:
+                {
+                    for (int ir = 0; ir < mc; ++ir) {
+                        g_kernels.fp16_to_fp32_row((const ggml_fp16_t *) (src0_panel + ir*nb01), wdata + ir*ne00, ne00);
+                    }
+                } break;
+            default:
+                {
+                    for (int ir = 0; ir < mc; ir += nrb) {
+                        quantize_fns[type].dequantize_row_q(src0_panel + ir*nb01, wdata + ir*ne00, nrb*ne00);
+                    }
+                } break;
+        }
 
-        float * dst_col = (float *) ((char *) dst->data + (i0*nb0 + 0*nb1 + i2*nb2 + i3*nb3));
+        const float * y = (const float *) ((const char *) src1->data + i02*nb12 + i03*nb13);
 
-        assert(ne00 % 32 == 0);
+        float * d = (float *) ((char *) dst->data + i01*nb0 + i02*nb2 + i03*nb3);
 
-        for (int ic = 0; ic < ne11; ++ic) {
-            vec_dot_q(ne00, &dst_col[ic*ne0], src0_row, (void *) (src1_col + ic*row_size));
+        if (acc) {
+            // acc is contiguous and has the shape of dst
+            for (int i1 = 0; i1 < ne11; ++i1) {
+                memcpy(d + i1*ldc, (char *) acc->data + i01*nb0 + i1*nb1 + i02*nb2 + i03*nb3, mc*sizeof(float));
+            }
         }
-    }
-
-    //int64_t t1 = ggml_time_us();
-    //static int64_t acc = 0;
-    //acc += t1 - t0;
-    //if (t1 - t0 > 10) {
-    //    printf("\n");
-    //    printf("ne00 = %5d, ne01 = %5d, ne02 = %5d, ne03 = %5d\n", ne00, ne01, ne02, ne03);
-    //    printf("nb00 = %5d, nb01 = %5d, nb02 = %5d, nb03 = %5d\n", nb00, nb01, nb02, nb03);
-    //    printf("ne10 = %5d, ne11 = %5d, ne12 = %5d, ne13 = %5d\n", ne10, ne11, ne12, ne13);
 
-    //    printf("XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX task %d/%d: %d us, acc = %d\n", ith, nth, (int) (t1 - t0), (int) acc);
-    //}
+        // zT = y * xT (+ zT)
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
+                ne11, mc, ne10,
+                1.0f,    y, ne10,
+                         x, ldx,
+                acc ? 1.0f : 0.0f, d, ldc);
+    }
 }
+#endif
 
+// acc: optional tensor that is added to the result (ggml_mul_mat_add)
 static void ggml_compute_forward_mul_mat(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * src0,
         const struct ggml_tensor * src1,
+        const struct ggml_tensor * acc,
         struct ggml_tensor * dst) {
+#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
+    if (ggml_compute_forward_mul_mat_use_blas(src0, src1, dst)) {
+        ggml_compute_forward_mul_mat_blas(params, src0, src1, acc, dst);
+        return;
+    }
+#endif
+
+    if (ggml_compute_forward_mul_mat_use_gemm(src0, src1, dst)) {
+        ggml_compute_forward_mul_mat_gemm(params, src0, src1, acc, dst);
+        return;
+    }
+
     switch (src0->type) {
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
+        case GGML_TYPE_Q4_0_X8:
             {
-                ggml_compute_forward_mul_mat_q_f32(params, src0, src1, dst);
+                ggml_compute_forward_mul_mat_q_f32(params, src0, src1, acc, dst);
             } break;
         case GGML_TYPE_F16:
             {
-                ggml_compute_forward_mul_mat_f16_f32(params, src0, src1, dst);
+                ggml_compute_forward_mul_mat_f16_f32(params, src0, src1, acc, dst);
             } break;
         case GGML_TYPE_F32:
             {
-                ggml_compute_forward_mul_mat_f32(params, src0, src1, dst);
+                ggml_compute_forward_mul_mat_f32(params, src0, src1, acc, dst);
             } break;
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
@@ -6812,10 +6909,16 @@ static void ggml_compute_forward_scale(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -6968,6 +7071,11 @@ static void ggml_compute_forward_get_rows(
     switch (src0->type) {
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
             {
                 ggml_compute_forward_get_rows_q(params, src0, src1, dst);
             } break;
@@ -6982,6 +7090,7 @@ static void ggml_compute_forward_get_rows(
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -7057,10 +7166,16 @@ static void ggml_compute_forward_diag_mask_inf(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -7110,21 +7225,7 @@ static void ggml_compute_forward_soft_max_f32(
         float max = -INFINITY;
         ggml_vec_max_f32(nc, &max, p);
 
-        ggml_float sum = 0.0;
-
-        uint16_t scvt;
-        for (int i = 0; i < nc; i++) {
-            if (p[i] == -INFINITY) {
-                p[i] = 0.0f;
-            } else {
-                //const float val = (p[i] == -INFINITY) ? 0.0 : exp(p[i] - max);
-                ggml_fp16_t s = GGML_FP32_TO_FP16(p[i] - max);
-                memcpy(&scvt, &s, sizeof(scvt));
-                const float val = GGML_FP16_TO_FP32(table_exp_f16[scvt]);
-                sum += (ggml_float)val;
-                p[i] = val;
-            }
-        }
+        ggml_float sum = ggml_vec_soft_max_f32(nc, p, p, max);
 
         assert(sum > 0.0);
 
@@ -7151,10 +7252,16 @@ static void ggml_compute_forward_soft_max(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
         case GGML_TYPE_F16:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -7293,9 +7400,15 @@ static void ggml_compute_forward_rope(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -7561,9 +7674,15 @@ static void ggml_compute_forward_conv_1d_1s(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -7829,9 +7948,15 @@ static void ggml_compute_forward_conv_1d_2s(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -7840,6 +7965,13 @@ static void ggml_compute_forward_conv_1d_2s(
 }
 
 // ggml_compute_forward_flash_attn
+//
+// q: [D, N, H, B], k and v: [D, N + P, H, B], dst: [D, N, H, B]
+//
+// each q row streams over the k/v rows in blocks of GGML_FLASH_ATTN_BLOCK using an online softmax:
+// the running max and sum are rescaled when a block raises the max, so the full row of attention
+// scores is never materialized and v is read in the same row layout as k (no transposed copy)
+//
 
 static void ggml_compute_forward_flash_attn_f32(
         const struct ggml_compute_params * params,
@@ -7858,18 +7990,12 @@ static void ggml_compute_forward_flash_attn_f32(
 
     const int nek0 = k->ne[0];
     const int nek1 = k->ne[1];
-    //const int nek2 = k->ne[2];
-    //const int nek3 = k->ne[3];
 
-    //const int nev0 = v->ne[0];
+    const int nev0 = v->ne[0];
     const int nev1 = v->ne[1];
-    //const int nev2 = v->ne[2];
-    //const int nev3 = v->ne[3];
 
     const int ne0  = dst->ne[0];
     const int ne1  = dst->ne[1];
-    //const int ne2  = dst->ne[2];
-    //const int ne3  = dst->ne[3];
 
     const int nbk0 = k->nb[0];
     const int nbk1 = k->nb[1];
@@ -7899,8 +8025,6 @@ static void ggml_compute_forward_flash_attn_f32(
     const int P = nek1 - N;
     const int M = P + N;
 
-    const int Mup = ggml_up(M, GGML_SOFT_MAX_UNROLL);
-
     GGML_ASSERT(ne0 == D);
     GGML_ASSERT(ne1 == N);
     GGML_ASSERT(P >= 0);
@@ -7911,11 +8035,11 @@ static void ggml_compute_forward_flash_attn_f32(
 
     GGML_ASSERT(neq0 == D);
     GGML_ASSERT(nek0 == D);
-    GGML_ASSERT(nev1 == D);
+    GGML_ASSERT(nev0 == D);
 
     GGML_ASSERT(neq1 == N);
     GGML_ASSERT(nek1 == N + P);
-    GGML_ASSERT(nev1 == D);
+    GGML_ASSERT(nev1 == N + P);
 
     // dst cannot be transposed or permuted
     GGML_ASSERT(nb0 == sizeof(float));
@@ -7945,7 +8069,8 @@ static void ggml_compute_forward_flash_attn_f32(
 
     const float scale = 1.0f/sqrtf(D);
 
-    //printf("P=%d N=%d D=%d ir0=%d ir1=%d scale = %f\n", P, N, D, ir0, ir1, scale);
+    float * S = (float *) params->wdata + ith*(GGML_FLASH_ATTN_BLOCK + 2*D + CACHE_LINE_SIZE_F32);
+    float * O = S + GGML_FLASH_ATTN_BLOCK;
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // q indices
@@ -7953,104 +8078,246 @@ static void ggml_compute_forward_flash_attn_f32(
         const int iq2 = (ir - iq3*neq2*neq1)/neq1;
         const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
 
-        float * S = (float *) params->wdata + ith*(Mup + CACHE_LINE_SIZE_F32);
+        // causal: q row iq1 attends to the first P + iq1 + 1 k/v rows
+        const int Mq = masked ? P + iq1 + 1 : M;
 
-        for (int i = M; i < Mup; ++i) {
-            S[i] = -INFINITY;
-        }
+        float max = -INFINITY;
+        ggml_float sum = 0.0;
 
-        for (int ic = 0; ic < nek1; ++ic) {
-            // k indices
-            const int ik3 = iq3;
-            const int ik2 = iq2;
-            const int ik1 = ic;
+        ggml_vec_set_f32(D, O, 0.0f);
 
-            // S indices
-            const int i1 = ik1;
+        for (int ic0 = 0; ic0 < Mq; ic0 += GGML_FLASH_ATTN_BLOCK) {
+            const int nc = MIN(GGML_FLASH_ATTN_BLOCK, Mq - ic0);
 
-            ggml_vec_dot_f32(neq0,
-                    S + i1,
-                    (float *) ((char *) k->data + (ik1*nbk1 + ik2*nbk2 + ik3*nbk3)),
-                    (float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3)));
-        }
+            for (int ic = 0; ic < nc; ++ic) {
+                ggml_vec_dot_f32(D,
+                        S + ic,
+                        (float *) ((char *) k->data + ((ic0 + ic)*nbk1 + iq2*nbk2 + iq3*nbk3)),
+                        (float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3)));
+            }
 
-        // scale
-        ggml_vec_scale_f32(nek1, S, scale);
+            ggml_vec_scale_f32(nc, S, scale);
 
-        if (masked) {
-            for (int i = P; i < M; i++) {
-                if (i > P + iq1) {
-                    S[i] = -INFINITY;
-                }
+            float max_blk = -INFINITY;
+            ggml_vec_max_f32(nc, &max_blk, S);
+
+            if (max_blk > max) {
+                // rescale what has been accumulated so far to the new max
+                const float ms = expf(max - max_blk);
+
+                ggml_vec_scale_f32(D, O, ms);
+                sum *= (ggml_float)ms;
+                max  = max_blk;
+            }
+
+            sum += ggml_vec_soft_max_f32(nc, S, S, max);
+
+            for (int ic = 0; ic < nc; ++ic) {
+                ggml_vec_mad_f32(D, O,
+                        (float *) ((char *) v->data + ((ic0 + ic)*nbv1 + iq2*nbv2 + iq3*nbv3)),
+                        S[ic]);
             }
         }
 
-        // softmax
+        assert(sum > 0.0);
+
+        float * dst_data = (float *) ((char *) dst->data + (iq1*nb1 + iq2*nb2 + iq3*nb3));
+
+        ggml_vec_cpy_f32  (D, dst_data, O);
+        ggml_vec_scale_f32(D, dst_data, 1.0/sum);
+    }
+}
+
+static void ggml_compute_forward_flash_attn_f16(
+        const struct ggml_compute_params * params,
+        const struct ggml_tensor * q,
+        const struct ggml_tensor * k,
+        const struct ggml_tensor * v,
+        const bool masked,
+             struct ggml_tensor * dst) {
+    int64_t t0 = ggml_perf_time_us();
+    UNUSED(t0);
+
+    const int neq0 = q->ne[0];
+    const int neq1 = q->ne[1];
+    const int neq2 = q->ne[2];
+    const int neq3 = q->ne[3];
+
+    const int nek0 = k->ne[0];
+    const int nek1 = k->ne[1];
+
+    const int nev0 = v->ne[0];
+    const int nev1 = v->ne[1];
+
+    const int ne0  = dst->ne[0];
+    const int ne1  = dst->ne[1];
+
+    const int nbk0 = k->nb[0];
+    const int nbk1 = k->nb[1];
+    const int nbk2 = k->nb[2];
+    const int nbk3 = k->nb[3];
+
+    const int nbq0 = q->nb[0];
+    const int nbq1 = q->nb[1];
+    const int nbq2 = q->nb[2];
+    const int nbq3 = q->nb[3];
+
+    const int nbv0 = v->nb[0];
+    const int nbv1 = v->nb[1];
+    const int nbv2 = v->nb[2];
+    const int nbv3 = v->nb[3];
+
+    const int nb0  = dst->nb[0];
+    const int nb1  = dst->nb[1];
+    const int nb2  = dst->nb[2];
+    const int nb3  = dst->nb[3];
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int D = neq0;
+    const int N = neq1;
+    const int P = nek1 - N;
+    const int M = P + N;
+
+    GGML_ASSERT(ne0 == D);
+    GGML_ASSERT(ne1 == N);
+    GGML_ASSERT(P >= 0);
+
+    // q can be either F16 or F32 - it is converted to F16 once per row
+    GGML_ASSERT(nbq0 == (int) GGML_TYPE_SIZE[q->type]);
+    GGML_ASSERT(q->type == GGML_TYPE_F16 || q->type == GGML_TYPE_F32);
+    GGML_ASSERT(nbk0 == sizeof(ggml_fp16_t));
+    GGML_ASSERT(nbv0 == sizeof(ggml_fp16_t));
+
+    GGML_ASSERT(neq0 == D);
+    GGML_ASSERT(nek0 == D);
+    GGML_ASSERT(nev0 == D);
+
+    GGML_ASSERT(neq1 == N);
+    GGML_ASSERT(nek1 == N + P);
+    GGML_ASSERT(nev1 == N + P);
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    if (params->type == GGML_TASK_INIT) {
+        return;
+    }
+
+    if (params->type == GGML_TASK_FINALIZE) {
+        return;
+    }
+
+    // parallelize by q rows using ggml_vec_dot_f16
+
+    // total rows in q
+    const int nr = neq1*neq2*neq3;
+
+    // rows per thread
+    const int dr = (nr + nth - 1)/nth;
+
+    // row range for this thread
+    const int ir0 = dr*ith;
+    const int ir1 = MIN(ir0 + dr, nr);
+
+    const float scale = 1.0f/sqrtf(D);
+
+    float * S = (float *) params->wdata + ith*(GGML_FLASH_ATTN_BLOCK + 2*D + CACHE_LINE_SIZE_F32);
+    float * O = S + GGML_FLASH_ATTN_BLOCK;
+
+    ggml_fp16_t * Q16 = (ggml_fp16_t *) (O + D);
+
+    vec_dot_q_t const vec_dot_fixed = ggml_vec_dot_fixed(GGML_TYPE_F16, D);
+
+    for (int ir = ir0; ir < ir1; ++ir) {
+        // q indices
+        const int iq3 = ir/(neq2*neq1);
+        const int iq2 = (ir - iq3*neq2*neq1)/neq1;
+        const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
+
+        // causal: q row iq1 attends to the first P + iq1 + 1 k/v rows
+        const int Mq = masked ? P + iq1 + 1 : M;
+
         {
-            float max = -INFINITY;
-            ggml_vec_max_f32(M, &max, S);
+            const char * q_data = (char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3);
 
-            ggml_float sum = 0.0;
-            {
-#ifdef GGML_SOFT_MAX_ACCELERATE
-                max = -max;
-                vDSP_vsadd(S, 1, &max, S, 1, Mup);
-                vvexpf(S, S, &Mup);
-                ggml_vec_sum_f32(Mup, &sum, S);
-#else
-                uint16_t   scvt[GGML_SOFT_MAX_UNROLL];
-                ggml_float sump[GGML_SOFT_MAX_UNROLL] = { 0.0 };
-
-                for (int i = 0; i < Mup; i += GGML_SOFT_MAX_UNROLL) {
-                    float * SS = S + i;
-
-                    for (int j = 0; j < GGML_SOFT_MAX_UNROLL; ++j) {
-                        if (SS[j] == -INFINITY) {
-                            SS[j] = 0.0f;
-                        } else {
-                            ggml_fp16_t s = GGML_FP32_TO_FP16(SS[j] - max);
-                            memcpy(&scvt[j], &s, sizeof(uint16_t));
-                            const float val = GGML_FP16_TO_FP32(table_exp_f16[scvt[j]]);
-                            sump[j] += (ggml_float)val;
-                            SS[j] = val;
-                        }
-                    }
-                }
+            if (q->type == GGML_TYPE_F16) {
+                memcpy(Q16, q_data, D*sizeof(ggml_fp16_t));
+            } else {
+                g_kernels.fp32_to_fp16_row((const float *) q_data, Q16, D);
+            }
+        }
+
+        float max = -INFINITY;
+        ggml_float sum = 0.0;
 
-                for (int i = 0; i < GGML_SOFT_MAX_UNROLL; i++) {
-                    sum += sump[i];
+        ggml_vec_set_f32(D, O, 0.0f);
+
+        for (int ic0 = 0; ic0 < Mq; ic0 += GGML_FLASH_ATTN_BLOCK) {
+            const int nc = MIN(GGML_FLASH_ATTN_BLOCK, Mq - ic0);
+
+            if (vec_dot_fixed) {
+                for (int ic = 0; ic < nc; ++ic) {
+                    vec_dot_fixed(D,
+                            S + ic,
+                            (ggml_fp16_t *) ((char *) k->data + ((ic0 + ic)*nbk1 + iq2*nbk2 + iq3*nbk3)),
+                            Q16);
+                }
+            } else if (GGML_VEC_DOT_UNROLL > 2 || nc % GGML_VEC_DOT_UNROLL != 0) {
+                for (int ic = 0; ic < nc; ++ic) {
+                    ggml_vec_dot_f16(D,
+                            S + ic,
+                            (ggml_fp16_t *) ((char *) k->data + ((ic0 + ic)*nbk1 + iq2*nbk2 + iq3*nbk3)),
+                            Q16);
+                }
+            } else {
+                for (int ic = 0; ic < nc; ic += GGML_VEC_DOT_UNROLL) {
+                    ggml_vec_dot_f16_unroll(D, nbk1,
+                            S + ic,
+                            ((char *) k->data + ((ic0 + ic)*nbk1 + iq2*nbk2 + iq3*nbk3)),
+                            Q16);
                 }
-#endif
             }
 
-            assert(sum > 0.0);
+            ggml_vec_scale_f32(nc, S, scale);
+
+            float max_blk = -INFINITY;
+            ggml_vec_max_f32(nc, &max_blk, S);
+
+            if (max_blk > max) {
+                // rescale what has been accumulated so far to the new max
+                const float ms = expf(max - max_blk);
 
-            sum = 1.0/sum;
-            ggml_vec_scale_f32(M, S, sum);
+                ggml_vec_scale_f32(D, O, ms);
+                sum *= (ggml_float)ms;
+                max  = max_blk;
+            }
 
-#ifndef NDEBUG
-            for (int i = 0; i < M; ++i) {
-                assert(!isnan(S[i]));
-                assert(!isinf(S[i]));
+            sum += ggml_vec_soft_max_f32(nc, S, S, max);
+
+            for (int ic = 0; ic < nc; ++ic) {
+                ggml_vec_mad_f32_f16(D, O,
+                        (ggml_fp16_t *) ((char *) v->data + ((ic0 + ic)*nbv1 + iq2*nbv2 + iq3*nbv3)),
+                        S[ic]);
             }
-#endif
         }
 
-        for (int ic = 0; ic < nev1; ++ic) {
-            // dst indices
-            const int i1 = iq1;
-            const int i2 = iq2;
-            const int i3 = iq3;
+        assert(sum > 0.0);
 
-            ggml_vec_dot_f32(nek1,
-                    (float *) ((char *) dst->data + (ic*nb0 + i1*nb1  + i2*nb2  + i3*nb3)),
-                    (float *) ((char *) v->data   + (         ic*nbv1 + i2*nbv2 + i3*nbv3)),
-                    S);
-        }
+        float * dst_data = (float *) ((char *) dst->data + (iq1*nb1 + iq2*nb2 + iq3*nb3));
+
+        ggml_vec_cpy_f32  (D, dst_data, O);
+        ggml_vec_scale_f32(D, dst_data, 1.0/sum);
     }
 }
 
-static void ggml_compute_forward_flash_attn_f16(
+// k and v block-quantized (the quantized kv cache): the q row is quantized once with quantize_row_q_dot, the scores
+// use the vec_dot_q kernels of the matrix multiplication and each v row is dequantized before it is accumulated
+static void ggml_compute_forward_flash_attn_q(
         const struct ggml_compute_params * params,
         const struct ggml_tensor * q,
         const struct ggml_tensor * k,
@@ -8067,18 +8334,12 @@ static void ggml_compute_forward_flash_attn_f16(
 
     const int nek0 = k->ne[0];
     const int nek1 = k->ne[1];
-    //const int nek2 = k->ne[2];
-    //const int nek3 = k->ne[3];
 
-    //const int nev0 = v->ne[0];
+    const int nev0 = v->ne[0];
     const int nev1 = v->ne[1];
-    //const int nev2 = v->ne[2];
-    //const int nev3 = v->ne[3];
 
     const int ne0  = dst->ne[0];
     const int ne1  = dst->ne[1];
-    //const int ne2  = dst->ne[2];
-    //const int ne3  = dst->ne[3];
 
     const int nbk0 = k->nb[0];
     const int nbk1 = k->nb[1];
@@ -8108,23 +8369,32 @@ static void ggml_compute_forward_flash_attn_f16(
     const int P = nek1 - N;
     const int M = P + N;
 
-    const int Mup = ggml_up(M, GGML_SOFT_MAX_UNROLL);
+    const enum ggml_type type = k->type;
+
+    quantize_row_q_t   const quantize_row_q_dot = quantize_fns[type].quantize_row_q_dot;
+    dequantize_row_q_t const dequantize_row_q   = quantize_fns[type].dequantize_row_q;
+    vec_dot_q_t        const vec_dot_fixed      = ggml_vec_dot_fixed(type, D);
+    vec_dot_q_t        const vec_dot_q          = vec_dot_fixed ? vec_dot_fixed : quantize_fns[type].vec_dot_q;
 
     GGML_ASSERT(ne0 == D);
     GGML_ASSERT(ne1 == N);
     GGML_ASSERT(P >= 0);
 
-    GGML_ASSERT(nbq0 == sizeof(ggml_fp16_t));
-    GGML_ASSERT(nbk0 == sizeof(ggml_fp16_t));
-    GGML_ASSERT(nbv0 == sizeof(ggml_fp16_t));
+    GGML_ASSERT(quantize_row_q_dot && dequantize_row_q && vec_dot_q);
+    GGML_ASSERT(D % GGML_BLCK_SIZE[type] == 0);
+
+    GGML_ASSERT(q->type == GGML_TYPE_F32);
+    GGML_ASSERT(nbq0 == sizeof(float));
+    GGML_ASSERT(nbk0 == (int) GGML_TYPE_SIZE[type]);
+    GGML_ASSERT(nbv0 == (int) GGML_TYPE_SIZE[type]);
 
     GGML_ASSERT(neq0 == D);
     GGML_ASSERT(nek0 == D);
-    GGML_ASSERT(nev1 == D);
+    GGML_ASSERT(nev0 == D);
 
     GGML_ASSERT(neq1 == N);
     GGML_ASSERT(nek1 == N + P);
-    GGML_ASSERT(nev1 == D);
+    GGML_ASSERT(nev1 == N + P);
 
     // dst cannot be transposed or permuted
     GGML_ASSERT(nb0 == sizeof(float));
@@ -8140,7 +8410,7 @@ static void ggml_compute_forward_flash_attn_f16(
         return;
     }
 
-    // parallelize by q rows using ggml_vec_dot_f32
+    // parallelize by q rows using vec_dot_q
 
     // total rows in q
     const int nr = neq1*neq2*neq3;
@@ -8154,7 +8424,10 @@ static void ggml_compute_forward_flash_attn_f16(
 
     const float scale = 1.0f/sqrtf(D);
 
-    //printf("P=%d N=%d D=%d ir0=%d ir1=%d scale = %f\n", P, N, D, ir0, ir1, scale);
+    float * S  = (float *) params->wdata + ith*(GGML_FLASH_ATTN_BLOCK + 3*D + CACHE_LINE_SIZE_F32);
+    float * O  = S + GGML_FLASH_ATTN_BLOCK;
+    float * V  = O + D; // dequantized v row
+    void  * Q8 = V + D; // q8_0 copy of the q row
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // q indices
@@ -8162,137 +8435,54 @@ static void ggml_compute_forward_flash_attn_f16(
         const int iq2 = (ir - iq3*neq2*neq1)/neq1;
         const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
 
-        float * S = (float *) params->wdata + ith*(2*Mup + CACHE_LINE_SIZE_F32);
-
-        for (int i = M; i < Mup; ++i) {
-            S[i] = -INFINITY;
-        }
+        // causal: q row iq1 attends to the first P + iq1 + 1 k/v rows
+        const int Mq = masked ? P + iq1 + 1 : M;
 
-        if (GGML_VEC_DOT_UNROLL > 2 || nek1 % GGML_VEC_DOT_UNROLL != 0) {
-            for (int ic = 0; ic < nek1; ++ic) {
-                // k indices
-                const int ik3 = iq3;
-                const int ik2 = iq2;
-                const int ik1 = ic;
+        quantize_row_q_dot((float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3)), Q8, D);
 
-                // S indices
-                const int i1 = ik1;
+        float max = -INFINITY;
+        ggml_float sum = 0.0;
 
-                ggml_vec_dot_f16(neq0,
-                        S + i1,
-                        (ggml_fp16_t *) ((char *) k->data + (ik1*nbk1 + ik2*nbk2 + ik3*nbk3)),
-                        (ggml_fp16_t *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3)));
-            }
-        } else {
-            for (int ic = 0; ic < nek1; ic += GGML_VEC_DOT_UNROLL) {
-                // k indices
-                const int ik3 = iq3;
-                const int ik2 = iq2;
-                const int ik1 = ic;
-
-                // S indices
-                const int i1 = ik1;
-
-                ggml_vec_dot_f16_unroll(neq0, nbk1,
-                        S + i1,
-                        ((char *) k->data + (ik1*nbk1 + ik2*nbk2 + ik3*nbk3)),
-                        (ggml_fp16_t *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3)));
-            }
-        }
+        ggml_vec_set_f32(D, O, 0.0f);
 
-        // scale
-        ggml_vec_scale_f32(nek1, S, scale);
+        for (int ic0 = 0; ic0 < Mq; ic0 += GGML_FLASH_ATTN_BLOCK) {
+            const int nc = MIN(GGML_FLASH_ATTN_BLOCK, Mq - ic0);
 
-        if (masked) {
-            for (int i = P; i < M; i++) {
-                if (i > P + iq1) {
-                    S[i] = -INFINITY;
-                }
+            for (int ic = 0; ic < nc; ++ic) {
+                vec_dot_q(D,
+                        S + ic,
+                        (char *) k->data + ((ic0 + ic)*nbk1 + iq2*nbk2 + iq3*nbk3),
+                        Q8);
             }
-        }
 
-        // softmax
-        {
-            float max = -INFINITY;
-            ggml_vec_max_f32(M, &max, S);
+            ggml_vec_scale_f32(nc, S, scale);
 
-            ggml_float sum = 0.0;
-            {
-#ifdef GGML_SOFT_MAX_ACCELERATE
-                max = -max;
-                vDSP_vsadd(S, 1, &max, S, 1, Mup);
-                vvexpf(S, S, &Mup);
-                ggml_vec_sum_f32(Mup, &sum, S);
-#else
-                uint16_t   scvt[GGML_SOFT_MAX_UNROLL];
-                ggml_float sump[GGML_SOFT_MAX_UNROLL] = { 0.0 };
-
-                for (int i = 0; i < Mup; i += GGML_SOFT_MAX_UNROLL) {
-                    float * SS = S + i;
-
-                    for (int j = 0; j < GGML_SOFT_MAX_UNROLL; ++j) {
-                        if (SS[j] == -INFINITY) {
-                            SS[j] = 0.0f;
-                        } else {
-                            ggml_fp16_t s = GGML_FP32_TO_FP16(SS[j] - max);
-                            memcpy(&scvt[j], &s, sizeof(uint16_t));
-                            const float val = GGML_FP16_TO_FP32(table_exp_f16[scvt[j]]);
-                            sump[j] += (ggml_float)val;
-                            SS[j] = val;
-                        }
-                    }
-                }
+            float max_blk = -INFINITY;
+            ggml_vec_max_f32(nc, &max_blk, S);
 
-                for (int i = 0; i < GGML_SOFT_MAX_UNROLL; i++) {
-                    sum += sump[i];
-                }
-#endif
-            }
+            if (max_blk > max) {
+                // rescale what has been accumulated so far to the new max
+                const float ms = expf(max - max_blk);
 
-            assert(sum > 0.0);
+                ggml_vec_scale_f32(D, O, ms);
+                sum *= (ggml_float)ms;
+                max  = max_blk;
+            }
 
-            sum = 1.0/sum;
-            ggml_vec_scale_f32(M, S, sum);
+            sum += ggml_vec_soft_max_f32(nc, S, S, max);
 
-#ifndef NDEBUG
-            for (int i = 0; i < M; ++i) {
-                assert(!isnan(S[i]));
-                assert(!isinf(S[i]));
+            for (int ic = 0; ic < nc; ++ic) {
+                dequantize_row_q((char *) v->data + ((ic0 + ic)*nbv1 + iq2*nbv2 + iq3*nbv3), V, D);
+                ggml_vec_mad_f32(D, O, V, S[ic]);
             }
-#endif
         }
 
-        ggml_fp16_t * S16 = (ggml_fp16_t *) ((float *) params->wdata + ith*(2*Mup + CACHE_LINE_SIZE_F32) + Mup);
-
-        for (int i = 0; i < M; i++) {
-            S16[i] = GGML_FP32_TO_FP16(S[i]);
-        }
+        assert(sum > 0.0);
 
-        if (GGML_VEC_DOT_UNROLL == 1 || (nev1 % GGML_VEC_DOT_UNROLL != 0)) {
-            for (int ic = 0; ic < nev1; ++ic) {
-                // dst indices
-                const int i1 = iq1;
-                const int i2 = iq2;
-                const int i3 = iq3;
+        float * dst_data = (float *) ((char *) dst->data + (iq1*nb1 + iq2*nb2 + iq3*nb3));
 
-                ggml_vec_dot_f16(nek1,
-                        (float *)       ((char *) dst->data + (ic*nb0 + i1*nb1  + i2*nb2  + i3*nb3)),
-                        (ggml_fp16_t *) ((char *) v->data   + (         ic*nbv1 + i2*nbv2 + i3*nbv3)),
-                        S16);
-            }
-        } else {
-            for (int ic = 0; ic < nev1; ic += GGML_VEC_DOT_UNROLL) {
-                // dst indices
-                const int i1 = iq1;
-                const int i2 = iq2;
-                const int i3 = iq3;
-
-                ggml_vec_dot_f16_unroll(nek1, nbv1,
-                        (float *) ((char *) dst->data + (ic*nb0 + i1*nb1  + i2*nb2  + i3*nb3)),
-                        ((char *) v->data   + (         ic*nbv1 + i2*nbv2 + i3*nbv3)),
-                        S16);
-            }
-        }
+        ggml_vec_cpy_f32  (D, dst_data, O);
+        ggml_vec_scale_f32(D, dst_data, 1.0/sum);
     }
 }
 
@@ -8303,7 +8493,7 @@ static void ggml_compute_forward_flash_attn(
         const struct ggml_tensor * v,
         const bool masked,
         struct ggml_tensor * dst) {
-    switch (q->type) {
+    switch (k->type) {
         case GGML_TYPE_F16:
             {
                 ggml_compute_forward_flash_attn_f16(params, q, k, v, masked, dst);
@@ -8314,9 +8504,18 @@ static void ggml_compute_forward_flash_attn(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
+            {
+                ggml_compute_forward_flash_attn_q(params, q, k, v, masked, dst);
+            } break;
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -8478,9 +8677,7 @@ static void ggml_compute_forward_flash_ff_f16(
 
         ggml_fp16_t * S16 = (ggml_fp16_t *) ((float *) params->wdata + ith*(2*M + CACHE_LINE_SIZE_F32) + M);
 
-        for (int i = 0; i < M; i++) {
-            S16[i] = GGML_FP32_TO_FP16(S[i]);
-        }
+        g_kernels.fp32_to_fp16_row(S, S16, M);
 
         ggml_vec_gelu_f16(neb01, S16, S16);
 
@@ -8525,9 +8722,15 @@ static void ggml_compute_forward_flash_ff(
             } break;
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+        case GGML_TYPE_Q4_2:
+        case GGML_TYPE_Q4_3:
         case GGML_TYPE_I8:
         case GGML_TYPE_I16:
         case GGML_TYPE_I32:
+        case GGML_TYPE_Q4_0_X8:
         case GGML_TYPE_COUNT:
             {
                 GGML_ASSERT(false);
@@ -8609,17 +8812,25 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
             {
                 ggml_compute_forward_silu(params, tensor->src0, tensor);
             } break;
+        case GGML_OP_SILU_MUL:
+            {
+                ggml_compute_forward_silu_mul(params, tensor->src0, tensor->src1, tensor);
+            } break;
         case GGML_OP_NORM:
             {
                 ggml_compute_forward_norm(params, tensor->src0, tensor);
             } break;
         case GGML_OP_RMS_NORM:
             {
-                ggml_compute_forward_rms_norm(params, tensor->src0, tensor);
+                ggml_compute_forward_rms_norm(params, tensor->src0, tensor->src1, tensor);
             } break;
         case GGML_OP_MUL_MAT:
             {
-                ggml_compute_forward_mul_mat(params, tensor->src0, tensor->src1, tensor);
+                ggml_compute_forward_mul_mat(params, tensor->src0, tensor->src1, NULL, tensor);
+            } break;
+        case GGML_OP_MUL_MAT_ADD:
+            {
+                ggml_compute_forward_mul_mat(params, tensor->src0, tensor->src1, tensor->opt[0], tensor);
             } break;
         case GGML_OP_SCALE:
             {
@@ -8691,6 +8902,33 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
     }
 }
 
+// nodes whose GGML_TASK_INIT phase is split across the thread pool instead of running on the main thread
+static bool ggml_compute_forward_init_is_parallel(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_MUL_MAT:
+        case GGML_OP_MUL_MAT_ADD:
+            {
+#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
+                if (ggml_compute_forward_mul_mat_use_blas(node->src0, node->src1, node)) {
+                    return false;
+                }
+#endif
+                // the src1 rows are packed or quantized in parallel
+                if (ggml_compute_forward_mul_mat_use_gemm(node->src0, node->src1, node)) {
+                    return true;
+                }
+                return quantize_fns[node->src0->type].quantize_row_q_dot != NULL && node->src1->type == GGML_TYPE_F32;
+            }
+        case GGML_OP_RMS_NORM:
+            {
+                // the rows are split across the threads (see ggml_compute_forward_rms_norm_f32)
+                return ggml_nrows(node->src0) < node->n_tasks;
+            }
+        default:
+            return false;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 static void ggml_compute_backward(struct ggml_context * ctx, struct ggml_tensor * tensor, bool inplace) {
@@ -8710,6 +8948,7 @@ static void ggml_compute_backward(struct ggml_context * ctx, struct ggml_tensor
                     src0->grad = ggml_add_impl(ctx, src0->grad, tensor->grad, inplace);
                 }
                 if (src1->grad) {
+                    GGML_ASSERT(ggml_are_same_shape(src0, src1)); // TODO: implement backward for broadcast src1
                     src1->grad = ggml_add_impl(ctx, src1->grad, tensor->grad, inplace);
                 }
             } break;
@@ -8728,10 +8967,11 @@ static void ggml_compute_backward(struct ggml_context * ctx, struct ggml_tensor
                     src0->grad =
                         ggml_add_impl(ctx,
                                 src0->grad,
-                                ggml_mul(ctx, src1, tensor->grad),
+                                ggml_mul(ctx, tensor->grad, src1),
                                 inplace);
                 }
                 if (src1->grad) {
+                    GGML_ASSERT(ggml_are_same_shape(src0, src1)); // TODO: implement backward for broadcast src1
                     src1->grad =
                         ggml_add_impl(ctx,
                                 src1->grad,
@@ -8855,6 +9095,10 @@ static void ggml_compute_backward(struct ggml_context * ctx, struct ggml_tensor
             {
                 GGML_ASSERT(false); // TODO: not implemented
             } break;
+        case GGML_OP_SILU_MUL:
+            {
+                GGML_ASSERT(false); // TODO: not implemented
+            } break;
         case GGML_OP_NORM:
             {
                 GGML_ASSERT(false); // TODO: not implemented
@@ -8878,6 +9122,10 @@ static void ggml_compute_backward(struct ggml_context * ctx, struct ggml_tensor
                                 inplace);
                 }
             } break;
+        case GGML_OP_MUL_MAT_ADD:
+            {
+                GGML_ASSERT(false); // TODO: not implemented
+            } break;
         case GGML_OP_SCALE:
             {
                 GGML_ASSERT(false); // TODO: not implemented
@@ -9160,49 +9408,511 @@ struct ggml_compute_state {
 static thread_ret_t ggml_graph_compute_thread(void * data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
 
-    const int n_threads = state->shared->n_threads;
+    const int n_threads = state->shared->n_threads;
+
+    while (true) {
+        if (atomic_fetch_add(&state->shared->n_ready, 1) == n_threads - 1) {
+            atomic_store(&state->shared->has_work, false);
+        } else {
+            while (atomic_load(&state->shared->has_work)) {
+                if (atomic_load(&state->shared->stop)) {
+                    return 0;
+                }
+                ggml_lock_lock  (&state->shared->spin);
+                ggml_lock_unlock(&state->shared->spin);
+            }
+        }
+
+        atomic_fetch_sub(&state->shared->n_ready, 1);
+
+        // wait for work
+        while (!atomic_load(&state->shared->has_work)) {
+            if (atomic_load(&state->shared->stop)) {
+                return 0;
+            }
+            ggml_lock_lock  (&state->shared->spin);
+            ggml_lock_unlock(&state->shared->spin);
+        }
+
+        // check if we should stop
+        if (atomic_load(&state->shared->stop)) {
+            break;
+        }
+
+        if (state->node) {
+            if (state->params.ith < state->params.nth) {
+                ggml_compute_forward(&state->params, state->node);
+            }
+
+            state->node = NULL;
+        } else {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// sets the number of tasks of the nodes for cgraph->n_threads threads and returns the size of the work buffer they need
+static size_t ggml_graph_plan_tasks(struct ggml_cgraph * cgraph) {
+    const int n_threads = cgraph->n_threads;
+
+    size_t work_size = 0;
+
+    // thread scheduling for the different operations
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        struct ggml_tensor * node = cgraph->nodes[i];
+
+        switch (node->op) {
+            case GGML_OP_DUP:
+            case GGML_OP_CPY:
+                {
+                    node->n_tasks = 1;
+
+                    // a f16 row is converted to f32 before it is quantized
+                    if (node->src0->type == GGML_TYPE_F16 && GGML_BLCK_SIZE[node->type] > 1) {
+                        work_size = MAX(work_size, sizeof(float)*node->src0->ne[0]);
+                    }
+                } break;
+            case GGML_OP_ADD:
+            case GGML_OP_MUL:
+                {
+                    node->n_tasks = n_threads;
+                } break;
+            case GGML_OP_SUB:
+            case GGML_OP_DIV:
+            case GGML_OP_SQR:
+            case GGML_OP_SQRT:
+            case GGML_OP_SUM:
+            case GGML_OP_MEAN:
+            case GGML_OP_REPEAT:
+            case GGML_OP_ABS:
+            case GGML_OP_SGN:
+            case GGML_OP_NEG:
+            case GGML_OP_STEP:
+            case GGML_OP_RELU:
+                {
+                    node->n_tasks = 1;
+                } break;
+            case GGML_OP_GELU:
+                {
+                    node->n_tasks = n_threads;
+                } break;
+            case GGML_OP_SILU:
+            case GGML_OP_SILU_MUL:
+                {
+                    node->n_tasks = n_threads;
+                } break;
+            case GGML_OP_NORM:
+                {
+                    node->n_tasks = n_threads;
+                } break;
+            case GGML_OP_RMS_NORM:
+                {
+                    node->n_tasks = n_threads;
+
+                    // partial sums of squares when the rows are split across the threads
+                    const int nr = ggml_nrows(node->src0);
+                    if (nr < node->n_tasks) {
+                        const size_t cur = sizeof(ggml_float)*node->n_tasks*(nr + CACHE_LINE_SIZE/sizeof(ggml_float));
+
+                        work_size = MAX(work_size, cur);
+                    }
+                } break;
+            case GGML_OP_MUL_MAT:
+            case GGML_OP_MUL_MAT_ADD:
+                {
+                    node->n_tasks = n_threads;
+
+                    // TODO: use different scheduling for different matrix sizes
+                    //const int nr0 = ggml_nrows(node->src0);
+                    //const int nr1 = ggml_nrows(node->src1);
+
+                    //node->n_tasks = MIN(n_threads, MAX(1, nr0/128));
+                    //printf("nr0 = %8d, nr1 = %8d, nr0*nr1 = %8d, n_tasks = %d\n", nr0, nr1, nr0*nr1, node->n_tasks);
+
+                    size_t cur = 0;
+
+#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
+                    if (ggml_compute_forward_mul_mat_use_blas(node->src0, node->src1, node)) {
+                        cur = node->n_tasks*ggml_blas_thread_size(node->src0);
+                    } else
+#endif
+                    if (ggml_compute_forward_mul_mat_use_gemm(node->src0, node->src1, node)) {
+                        cur = ggml_gemm_src1_size(node->src1) + node->n_tasks*ggml_gemm_thread_size();
+                    } else if (node->src0->type == GGML_TYPE_F16 && node->src1->type == GGML_TYPE_F32) {
+                        cur = GGML_TYPE_SIZE[GGML_TYPE_F16]*ggml_nelements(node->src1);
+                    } else if (node->src0->type == GGML_TYPE_F32 && node->src1->type == GGML_TYPE_F32) {
+                        cur = 0;
+                    } else if (quantize_fns[node->src0->type].vec_dot_q && node->src1->type == GGML_TYPE_F32) {
+                        cur = sizeof(block_q8_0)*ggml_nelements(node->src1)/QK;
+                    } else {
+                        GGML_ASSERT(false);
+                    }
+
+                    work_size = MAX(work_size, cur);
+                } break;
+            case GGML_OP_SCALE:
+                {
+                    node->n_tasks = n_threads;
+                } break;
+            case GGML_OP_RESHAPE:
+            case GGML_OP_VIEW:
+            case GGML_OP_PERMUTE:
+            case GGML_OP_TRANSPOSE:
+            case GGML_OP_GET_ROWS:
+            case GGML_OP_DIAG_MASK_INF:
+                {
+                    node->n_tasks = 1;
+                } break;
+            case GGML_OP_SOFT_MAX:
+                {
+                    node->n_tasks = n_threads;
+                } break;
+            case GGML_OP_ROPE:
+                {
+                    node->n_tasks = 1;
+                } break;
+            case GGML_OP_CONV_1D_1S:
+            case GGML_OP_CONV_1D_2S:
+                {
+                    node->n_tasks = n_threads;
+
+                    GGML_ASSERT(node->src0->ne[3] == 1);
+                    GGML_ASSERT(node->src1->ne[2] == 1);
+                    GGML_ASSERT(node->src1->ne[3] == 1);
+
+                    size_t cur = 0;
+                    const int nk = node->src0->ne[0];
+
+                    if (node->src0->type == GGML_TYPE_F16 &&
+                        node->src1->type == GGML_TYPE_F32) {
+                        cur = sizeof(ggml_fp16_t)*(
+                                nk*ggml_up32(node->src0->ne[1])*node->src0->ne[2] +
+                                ( 2*(nk/2) + node->src1->ne[0])*node->src1->ne[1]
+                                );
+                    } else if (node->src0->type == GGML_TYPE_F32 &&
+                               node->src1->type == GGML_TYPE_F32) {
+                        cur = sizeof(float)*(
+                                nk*ggml_up32(node->src0->ne[1])*node->src0->ne[2] +
+                                ( 2*(nk/2) + node->src1->ne[0])*node->src1->ne[1]
+                                );
+                    } else {
+                        GGML_ASSERT(false);
+                    }
+
+                    work_size = MAX(work_size, cur);
+                } break;
+            case GGML_OP_FLASH_ATTN:
+                {
+                    node->n_tasks = n_threads;
+
+                    // per thread: block of scores + output accumulator + F16 copy of the q row,
+                    // or with a quantized k/v: a dequantized v row + q8_0 copy of the q row
+                    const int n_rows = GGML_BLCK_SIZE[node->src1->type] > 1 ? 3 : 2;
+
+                    const size_t cur = sizeof(float)*node->n_tasks*
+                        (GGML_FLASH_ATTN_BLOCK + n_rows*node->src0->ne[0] + CACHE_LINE_SIZE_F32);
+
+                    work_size = MAX(work_size, cur);
+                } break;
+            case GGML_OP_FLASH_FF:
+                {
+                    node->n_tasks = n_threads;
+
+                    size_t cur = 0;
+
+                    if (node->src1->type == GGML_TYPE_F32) {
+                        cur  = sizeof(float)*node->src1->ne[1]*node->n_tasks; // TODO: this can become (n_tasks-1)
+                        cur += sizeof(float)*node->src1->ne[1]*node->n_tasks; // this is overestimated by x2
+                    }
+
+                    if (node->src1->type == GGML_TYPE_F16) {
+                        cur  = sizeof(float)*node->src1->ne[1]*node->n_tasks; // TODO: this can become (n_tasks-1)
+                        cur += sizeof(float)*node->src1->ne[1]*node->n_tasks; // this is overestimated by x2
+                    }
+
+                    work_size = MAX(work_size, cur);
+                } break;
+            case GGML_OP_NONE:
+                {
+                    node->n_tasks = 1;
+                } break;
+            case GGML_OP_COUNT:
+                {
+                    GGML_ASSERT(false);
+                } break;
+        }
+    }
+
+    return work_size;
+}
+
+//
+// ggml_graph_alloc
+//
+
+struct ggml_alloc_tensor {
+    const struct ggml_tensor * tensor;
+
+    int  n_children; // consumers that have not been computed yet
+    int  n_views;    // views that are still in use - for the tensors that own their memory
+
+    bool owned;      // placed in the buffer - no data and not a view
+    bool placed;
+    bool released;
+    bool is_input;   // read by a node other than as the destination of a cpy
+
+    size_t offs;
+};
+
+struct ggml_alloc_block {
+    size_t offs;
+    size_t size;
+};
+
+struct ggml_allocr {
+    char * base; // NULL when measuring
+
+    struct ggml_alloc_tensor * hash;
+    int n_hash;
+
+    // the free blocks below end, sorted by offset
+    struct ggml_alloc_block * free_blocks;
+    int n_free;
+
+    size_t end;
+    size_t max_end;
+};
+
+static struct ggml_alloc_tensor * ggml_allocr_get(struct ggml_allocr * alloc, const struct ggml_tensor * t) {
+    int i = (int) (((uintptr_t) t >> 4) % (uintptr_t) alloc->n_hash);
+
+    for (int k = 0; k < alloc->n_hash; k++) {
+        struct ggml_alloc_tensor * e = &alloc->hash[i];
+        if (e->tensor == t) {
+            return e;
+        }
+        if (e->tensor == NULL) {
+            e->tensor = t;
+            return e;
+        }
+        i = (i + 1) % alloc->n_hash;
+    }
+
+    GGML_ASSERT(false);
+    return NULL;
+}
+
+static size_t ggml_allocr_align(size_t size) {
+    return ((size + GGML_MEM_ALIGN - 1)/GGML_MEM_ALIGN)*GGML_MEM_ALIGN;
+}
+
+// the smallest free block that fits, or the end of the buffer
+static size_t ggml_allocr_alloc(struct ggml_allocr * alloc, size_t size) {
+    size = ggml_allocr_align(size);
+
+    int best = -1;
+    for (int i = 0; i < alloc->n_free; i++) {
+        if (alloc->free_blocks[i].size >= size && (best < 0 || alloc->free_blocks[i].size < alloc->free_blocks[best].size)) {
+            best = i;
+        }
+    }
+
+    if (best < 0) {
+        const size_t offs = alloc->end;
+        alloc->end     += size;
+        alloc->max_end  = MAX(alloc->max_end, alloc->end);
+        return offs;
+    }
+
+    struct ggml_alloc_block * block = &alloc->free_blocks[best];
+
+    const size_t offs = block->offs;
+    block->offs += size;
+    block->size -= size;
+
+    if (block->size == 0) {
+        memmove(block, block + 1, (alloc->n_free - best - 1)*sizeof(struct ggml_alloc_block));
+        alloc->n_free--;
+    }
+
+    return offs;
+}
+
+// returns the block to the free list, merged with its neighbours - or to the end of the buffer
+static void ggml_allocr_free(struct ggml_allocr * alloc, size_t offs, size_t size) {
+    size = ggml_allocr_align(size);
+
+    struct ggml_alloc_block * blocks = alloc->free_blocks;
+
+    int i = 0;
+    while (i < alloc->n_free && blocks[i].offs < offs) {
+        i++;
+    }
+
+    if (i > 0 && blocks[i - 1].offs + blocks[i - 1].size == offs) {
+        blocks[i - 1].size += size;
+        if (i < alloc->n_free && blocks[i - 1].offs + blocks[i - 1].size == blocks[i].offs) {
+            blocks[i - 1].size += blocks[i].size;
+            memmove(blocks + i, blocks + i + 1, (alloc->n_free - i - 1)*sizeof(struct ggml_alloc_block));
+            alloc->n_free--;
+        }
+    } else if (i < alloc->n_free && offs + size == blocks[i].offs) {
+        blocks[i].offs  = offs;
+        blocks[i].size += size;
+    } else {
+        memmove(blocks + i + 1, blocks + i, (alloc->n_free - i)*sizeof(struct ggml_alloc_block));
+        blocks[i] = (struct ggml_alloc_block) { offs, size };
+        alloc->n_free++;
+    }
+
+    struct ggml_alloc_block * last = &blocks[alloc->n_free - 1];
+    if (last->offs + last->size == alloc->end) {
+        alloc->end = last->offs;
+        alloc->n_free--;
+    }
+}
+
+static void ggml_allocr_place(struct ggml_allocr * alloc, struct ggml_tensor * t) {
+    struct ggml_tensor * owner = t->view_src ? t->view_src : t;
+
+    struct ggml_alloc_tensor * e = ggml_allocr_get(alloc, owner);
+    if (!e->owned) {
+        return;
+    }
+
+    if (!e->placed) {
+        GGML_ASSERT(!e->released);
+
+        e->offs   = ggml_allocr_alloc(alloc, ggml_nbytes(owner));
+        e->placed = true;
+
+        if (alloc->base) {
+            owner->data = alloc->base + e->offs;
+        }
+    }
+
+    if (t != owner && alloc->base) {
+        t->data = alloc->base + e->offs + t->view_offs;
+    }
+}
+
+// called when a consumer or a view of t is done - the memory is freed after the last one
+static void ggml_allocr_release(struct ggml_allocr * alloc, struct ggml_tensor * t) {
+    struct ggml_alloc_tensor * e = ggml_allocr_get(alloc, t);
+    if (e->n_children > 0 || e->n_views > 0 || e->released) {
+        return;
+    }
+
+    e->released = true;
+
+    if (t->view_src) {
+        ggml_allocr_get(alloc, t->view_src)->n_views--;
+        ggml_allocr_release(alloc, t->view_src);
+    } else if (e->owned && e->placed) {
+        ggml_allocr_free(alloc, e->offs, ggml_nbytes(t));
+    }
+}
+
+size_t ggml_graph_alloc(struct ggml_context * ctx, struct ggml_cgraph * graph, void * buffer, size_t size) {
+    const int n_tensors = graph->n_nodes + graph->n_leafs;
+
+    struct ggml_allocr alloc = {
+        /*.base        =*/ buffer,
+        /*.hash        =*/ calloc(2*n_tensors + 1, sizeof(struct ggml_alloc_tensor)),
+        /*.n_hash      =*/ 2*n_tensors + 1,
+        /*.free_blocks =*/ malloc((n_tensors + 2)*sizeof(struct ggml_alloc_block)),
+        /*.n_free      =*/ 0,
+        /*.end         =*/ 0,
+        /*.max_end     =*/ 0,
+    };
+
+    if (buffer) {
+        ggml_assert_aligned(buffer);
+    }
+
+    for (int i = 0; i < n_tensors; i++) {
+        struct ggml_tensor * t = i < graph->n_nodes ? graph->nodes[i] : graph->leafs[i - graph->n_nodes];
+
+        struct ggml_alloc_tensor * e = ggml_allocr_get(&alloc, t);
+        e->owned = t->data == NULL && t->view_src == NULL;
+
+        if (t->view_src) {
+            ggml_allocr_get(&alloc, t->view_src)->n_views++;
+        }
+
+        if (i < graph->n_nodes) {
+            struct ggml_tensor * srcs[2 + GGML_MAX_OPT] = { t->src0, t->src1 };
+            memcpy(srcs + 2, t->opt, sizeof(t->opt));
+
+            for (int j = 0; j < 2 + GGML_MAX_OPT; j++) {
+                if (srcs[j]) {
+                    struct ggml_alloc_tensor * es = ggml_allocr_get(&alloc, srcs[j]);
+                    es->n_children++;
 
-    while (true) {
-        if (atomic_fetch_add(&state->shared->n_ready, 1) == n_threads - 1) {
-            atomic_store(&state->shared->has_work, false);
-        } else {
-            while (atomic_load(&state->shared->has_work)) {
-                if (atomic_load(&state->shared->stop)) {
-                    return 0;
+                    // the destination of a cpy is written by the graph, the other leafs without data are inputs
+                    es->is_input = es->is_input || !(t->op == GGML_OP_CPY && j == 1);
                 }
-                ggml_lock_lock  (&state->shared->spin);
-                ggml_lock_unlock(&state->shared->spin);
             }
         }
+    }
 
-        atomic_fetch_sub(&state->shared->n_ready, 1);
+    // the work buffer is in use during the whole compute
+    if (graph->work == NULL) {
+        size_t work_size = ggml_graph_plan_tasks(graph);
 
-        // wait for work
-        while (!atomic_load(&state->shared->has_work)) {
-            if (atomic_load(&state->shared->stop)) {
-                return 0;
+        if (work_size > 0) {
+            work_size += CACHE_LINE_SIZE*(graph->n_threads - 1);
+
+            const size_t offs = ggml_allocr_alloc(&alloc, work_size);
+
+            if (buffer) {
+                const int ne = (int) work_size;
+
+                graph->work_size = work_size;
+                graph->work      = ggml_new_tensor_impl(ctx, GGML_TYPE_I8, 1, &ne, alloc.base + offs);
             }
-            ggml_lock_lock  (&state->shared->spin);
-            ggml_lock_unlock(&state->shared->spin);
         }
+    }
 
-        // check if we should stop
-        if (atomic_load(&state->shared->stop)) {
-            break;
+    // the inputs are written before the compute, so they do not share memory with the nodes computed before their use
+    for (int i = 0; i < graph->n_leafs; i++) {
+        if (ggml_allocr_get(&alloc, graph->leafs[i])->is_input) {
+            ggml_allocr_place(&alloc, graph->leafs[i]);
         }
+    }
 
-        if (state->node) {
-            if (state->params.ith < state->params.nth) {
-                ggml_compute_forward(&state->params, state->node);
+    for (int i = 0; i < graph->n_nodes; i++) {
+        struct ggml_tensor * node = graph->nodes[i];
+
+        struct ggml_tensor * srcs[2 + GGML_MAX_OPT] = { node->src0, node->src1 };
+        memcpy(srcs + 2, node->opt, sizeof(node->opt));
+
+        for (int j = 0; j < 2 + GGML_MAX_OPT; j++) {
+            if (srcs[j]) {
+                ggml_allocr_place(&alloc, srcs[j]);
             }
+        }
 
-            state->node = NULL;
-        } else {
-            break;
+        ggml_allocr_place(&alloc, node);
+
+        for (int j = 0; j < 2 + GGML_MAX_OPT; j++) {
+            if (srcs[j]) {
+                ggml_allocr_get(&alloc, srcs[j])->n_children--;
+                ggml_allocr_release(&alloc, srcs[j]);
+            }
         }
     }
 
-    return 0;
+    free(alloc.free_blocks);
+    free(alloc.hash);
+
+    if (buffer) {
+        GGML_ASSERT(alloc.max_end <= size);
+    }
+
+    return alloc.max_end;
 }
 
 void ggml_graph_compute(struct ggml_context * ctx, struct ggml_cgraph * cgraph) {
@@ -9245,196 +9955,7 @@ void ggml_graph_compute(struct ggml_context * ctx, struct ggml_cgraph * cgraph)
 
     // initialize tasks + work buffer
     {
-        size_t work_size = 0;
-
-        // thread scheduling for the different operations
-        for (int i = 0; i < cgraph->n_nodes; i++) {
-            struct ggml_tensor * node = cgraph->nodes[i];
-
-            switch (node->op) {
-                case GGML_OP_DUP:
-                    {
-                        node->n_tasks = 1;
-                    } break;
-                case GGML_OP_ADD:
-                    {
-                        node->n_tasks = n_threads;
-                    } break;
-                case GGML_OP_SUB:
-                case GGML_OP_MUL:
-                case GGML_OP_DIV:
-                case GGML_OP_SQR:
-                case GGML_OP_SQRT:
-                case GGML_OP_SUM:
-                case GGML_OP_MEAN:
-                case GGML_OP_REPEAT:
-                case GGML_OP_ABS:
-                case GGML_OP_SGN:
-                case GGML_OP_NEG:
-                case GGML_OP_STEP:
-                case GGML_OP_RELU:
-                    {
-                        node->n_tasks = 1;
-                    } break;
-                case GGML_OP_GELU:
-                    {
-                        node->n_tasks = n_threads;
-                    } break;
-                case GGML_OP_SILU:
-                    {
-                        node->n_tasks = n_threads;
-                    } break;
-                case GGML_OP_NORM:
-                case GGML_OP_RMS_NORM:
-                    {
-                        node->n_tasks = n_threads;
-                    } break;
-                case GGML_OP_MUL_MAT:
-                    {
-                        node->n_tasks = n_threads;
-
-                        // TODO: use different scheduling for different matrix sizes
-                        //const int nr0 = ggml_nrows(node->src0);
-                        //const int nr1 = ggml_nrows(node->src1);
-
-                        //node->n_tasks = MIN(n_threads, MAX(1, nr0/128));
-                        //printf("nr0 = %8d, nr1 = %8d, nr0*nr1 = %8d, n_tasks = %d\n", nr0, nr1, nr0*nr1, node->n_tasks);
-
-                        size_t cur = 0;
-
-                        if (node->src0->type == GGML_TYPE_F16 && node->src1->type == GGML_TYPE_F32) {
-#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
-                            if (ggml_compute_forward_mul_mat_use_blas(node->src0, node->src1, node)) {
-                                node->n_tasks = 1; // TODO: this actually is doing nothing
-                                                   //       the threads are still spinning
-                                cur = GGML_TYPE_SIZE[GGML_TYPE_F32]*(node->src0->ne[0]*node->src0->ne[1]);
-                                //printf("src0: ne0 = %d, ne1 = %d, ne = %d\n", node->src0->ne[0], node->src0->ne[1], node->src0->ne[0]*node->src0->ne[1]);
-                                //printf("src1: ne0 = %d, ne1 = %d, ne = %d\n", node->src1->ne[0], node->src1->ne[1], node->src1->ne[0]*node->src1->ne[1]);
-                                //printf("cur = %zu\n", cur);
-                            } else {
-                                cur = GGML_TYPE_SIZE[GGML_TYPE_F16]*ggml_nelements(node->src1);
-                            }
-#else
-                            cur = GGML_TYPE_SIZE[GGML_TYPE_F16]*ggml_nelements(node->src1);
-#endif
-                        } else if (node->src0->type == GGML_TYPE_F32 && node->src1->type == GGML_TYPE_F32) {
-                            cur = 0;
-                        } else if (quantize_fns[node->src0->type].vec_dot_q && node->src1->type == GGML_TYPE_F32) {
-#if defined(GGML_USE_ACCELERATE) || defined(GGML_USE_OPENBLAS)
-                            if (ggml_compute_forward_mul_mat_use_blas(node->src0, node->src1, node)) {
-                                node->n_tasks = 1;
-                                cur = GGML_TYPE_SIZE[GGML_TYPE_F32]*(node->src0->ne[0]*node->src0->ne[1]);
-                            } else
-#endif
-                            {
-                                cur = GGML_TYPE_SIZE[node->src0->type]*ggml_nelements(node->src1)/GGML_BLCK_SIZE[node->src0->type];
-                            }
-                        } else {
-                            GGML_ASSERT(false);
-                        }
-
-                        work_size = MAX(work_size, cur);
-                    } break;
-                case GGML_OP_SCALE:
-                    {
-                        node->n_tasks = n_threads;
-                    } break;
-                case GGML_OP_CPY:
-                case GGML_OP_RESHAPE:
-                case GGML_OP_VIEW:
-                case GGML_OP_PERMUTE:
-                case GGML_OP_TRANSPOSE:
-                case GGML_OP_GET_ROWS:
-                case GGML_OP_DIAG_MASK_INF:
-                    {
-                        node->n_tasks = 1;
-                    } break;
-                case GGML_OP_SOFT_MAX:
-                    {
-                        node->n_tasks = n_threads;
-                    } break;
-                case GGML_OP_ROPE:
-                    {
-                        node->n_tasks = 1;
-                    } break;
-                case GGML_OP_CONV_1D_1S:
-                case GGML_OP_CONV_1D_2S:
-                    {
-                        node->n_tasks = n_threads;
-
-                        GGML_ASSERT(node->src0->ne[3] == 1);
-                        GGML_ASSERT(node->src1->ne[2] == 1);
-                        GGML_ASSERT(node->src1->ne[3] == 1);
-
-                        size_t cur = 0;
-                        const int nk = node->src0->ne[0];
-
-                        if (node->src0->type == GGML_TYPE_F16 &&
-                            node->src1->type == GGML_TYPE_F32) {
-                            cur = sizeof(ggml_fp16_t)*(
-                                    nk*ggml_up32(node->src0->ne[1])*node->src0->ne[2] +
-                                    ( 2*(nk/2) + node->src1->ne[0])*node->src1->ne[1]
-                                    );
-                        } else if (node->src0->type == GGML_TYPE_F32 &&
-                                   node->src1->type == GGML_TYPE_F32) {
-                            cur = sizeof(float)*(
-                                    nk*ggml_up32(node->src0->ne[1])*node->src0->ne[2] +
-                                    ( 2*(nk/2) + node->src1->ne[0])*node->src1->ne[1]
-                                    );
-                        } else {
-                            GGML_ASSERT(false);
-                        }
-
-                        work_size = MAX(work_size, cur);
-                    } break;
-                case GGML_OP_FLASH_ATTN:
-                    {
-                        node->n_tasks = n_threads;
-
-                        size_t cur = 0;
-
-                        const int ne11 = ggml_up(node->src1->ne[1], GGML_SOFT_MAX_UNROLL);
-
-                        if (node->src1->type == GGML_TYPE_F32) {
-                            cur  = sizeof(float)*ne11*node->n_tasks; // TODO: this can become (n_tasks-1)
-                            cur += sizeof(float)*ne11*node->n_tasks; // this is overestimated by x2
-                        }
-
-                        if (node->src1->type == GGML_TYPE_F16) {
-                            cur  = sizeof(float)*ne11*node->n_tasks; // TODO: this can become (n_tasks-1)
-                            cur += sizeof(float)*ne11*node->n_tasks; // this is overestimated by x2
-                        }
-
-                        work_size = MAX(work_size, cur);
-                    } break;
-                case GGML_OP_FLASH_FF:
-                    {
-                        node->n_tasks = n_threads;
-
-                        size_t cur = 0;
-
-                        if (node->src1->type == GGML_TYPE_F32) {
-                            cur  = sizeof(float)*node->src1->ne[1]*node->n_tasks; // TODO: this can become (n_tasks-1)
-                            cur += sizeof(float)*node->src1->ne[1]*node->n_tasks; // this is overestimated by x2
-                        }
-
-                        if (node->src1->type == GGML_TYPE_F16) {
-                            cur  = sizeof(float)*node->src1->ne[1]*node->n_tasks; // TODO: this can become (n_tasks-1)
-                            cur += sizeof(float)*node->src1->ne[1]*node->n_tasks; // this is overestimated by x2
-                        }
-
-                        work_size = MAX(work_size, cur);
-                    } break;
-                case GGML_OP_NONE:
-                    {
-                        node->n_tasks = 1;
-                    } break;
-                case GGML_OP_COUNT:
-                    {
-                        GGML_ASSERT(false);
-                    } break;
-            }
-        }
+        const size_t work_size = ggml_graph_plan_tasks(cgraph);
 
         if (cgraph->work != NULL && work_size > cgraph->work_size) {
             GGML_ASSERT(false); // TODO: better handling
@@ -9473,8 +9994,61 @@ void ggml_graph_compute(struct ggml_context * ctx, struct ggml_cgraph * cgraph)
             /*.wdata =*/ cgraph->work ? cgraph->work->data : NULL,
         };
 
+        const bool init_parallel = node->n_tasks > 1 && ggml_compute_forward_init_is_parallel(node);
+
+        if (init_parallel) {
+            if (atomic_fetch_add(&state_shared.n_ready, 1) == n_threads - 1) {
+                atomic_store(&state_shared.has_work, false);
+            }
+
+            while (atomic_load(&state_shared.has_work)) {
+                ggml_lock_lock  (&state_shared.spin);
+                ggml_lock_unlock(&state_shared.spin);
+            }
+
+            // launch thread pool
+            for (int j = 0; j < n_threads - 1; j++) {
+                workers[j].params = (struct ggml_compute_params) {
+                    .type  = GGML_TASK_INIT,
+                    .ith   = j + 1,
+                    .nth   = node->n_tasks,
+                    .wsize = cgraph->work ? ggml_nbytes(cgraph->work) : 0,
+                    .wdata = cgraph->work ? cgraph->work->data : NULL,
+                };
+                workers[j].node = node;
+            }
+
+            atomic_fetch_sub(&state_shared.n_ready, 1);
+
+            while (atomic_load(&state_shared.n_ready) > 0) {
+                ggml_lock_lock  (&state_shared.spin);
+                ggml_lock_unlock(&state_shared.spin);
+            }
+
+            atomic_store(&state_shared.has_work, true);
+        }
+
         ggml_compute_forward(&params, node);
 
+        // wait for thread pool
+        if (init_parallel) {
+            if (atomic_fetch_add(&state_shared.n_ready, 1) == n_threads - 1) {
+                atomic_store(&state_shared.has_work, false);
+            }
+
+            while (atomic_load(&state_shared.has_work)) {
+                ggml_lock_lock  (&state_shared.spin);
+                ggml_lock_unlock(&state_shared.spin);
+            }
+
+            atomic_fetch_sub(&state_shared.n_ready, 1);
+
+            while (atomic_load(&state_shared.n_ready) != 0) {
+                ggml_lock_lock  (&state_shared.spin);
+                ggml_lock_unlock(&state_shared.spin);
+            }
+        }
+
         // COMPUTE
         if (node->n_tasks > 1) {
             if (atomic_fetch_add(&state_shared.n_ready, 1) == n_threads - 1) {
@@ -10499,10 +11073,13 @@ size_t ggml_quantize_q4_0(const float * src, void * dst, int n, int k, int64_t *
     assert(k % QK == 0);
     const int nb = k / QK;
 
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q4_0].quantize_row_q_reference;
+
     for (int j = 0; j < n; j += k) {
         block_q4_0 * restrict y = (block_q4_0 *)dst + j/QK;
 
-        quantize_row_q4_0_reference(src + j, y, k);
+        quantize_row_q_reference(src + j, y, k);
 
         for (int i = 0; i < nb; i++) {
             for (int l = 0; l < QK; l += 2) {
@@ -10522,10 +11099,13 @@ size_t ggml_quantize_q4_1(const float * src, void * dst, int n, int k, int64_t *
     assert(k % QK == 0);
     const int nb = k / QK;
 
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q4_1].quantize_row_q_reference;
+
     for (int j = 0; j < n; j += k) {
         block_q4_1 * restrict y = (block_q4_1 *)dst + j/QK;
 
-        quantize_row_q4_1_reference(src + j, y, k);
+        quantize_row_q_reference(src + j, y, k);
 
         for (int i = 0; i < nb; i++) {
             for (int l = 0; l < QK; l += 2) {
@@ -10541,6 +11121,197 @@ size_t ggml_quantize_q4_1(const float * src, void * dst, int n, int k, int64_t *
     return (n/QK*sizeof(block_q4_1));
 }
 
+size_t ggml_quantize_q8_0(const float * src, void * dst, int n, int k, int64_t * hist) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q8_0].quantize_row_q_reference;
+
+    for (int j = 0; j < n; j += k) {
+        block_q8_0 * restrict y = (block_q8_0 *)dst + j/QK;
+
+        quantize_row_q_reference(src + j, y, k);
+
+        // 16 bins of 16 values, as for the 4-bit types
+        for (int i = 0; i < nb; i++) {
+            for (int l = 0; l < QK; ++l) {
+                hist[(y[i].qs[l] + 128)/16]++;
+            }
+        }
+    }
+
+    return (n/QK*sizeof(block_q8_0));
+}
+
+size_t ggml_quantize_q2_1(const float * src, void * dst, int n, int k, int64_t * hist) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q2_1].quantize_row_q_reference;
+
+    for (int j = 0; j < n; j += k) {
+        block_q2_1 * restrict y = (block_q2_1 *)dst + j/QK;
+
+        quantize_row_q_reference(src + j, y, k);
+
+        for (int i = 0; i < nb; i++) {
+            for (int l = 0; l < QK; l++) {
+                const int vi = (y[i].qs[l%8] >> (2*(l/8))) & 3;
+                hist[vi]++;
+            }
+        }
+    }
+
+    return (n/QK*sizeof(block_q2_1));
+}
+
+size_t ggml_quantize_q3_1(const float * src, void * dst, int n, int k, int64_t * hist) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q3_1].quantize_row_q_reference;
+
+    for (int j = 0; j < n; j += k) {
+        block_q3_1 * restrict y = (block_q3_1 *)dst + j/QK;
+
+        quantize_row_q_reference(src + j, y, k);
+
+        for (int i = 0; i < nb; i++) {
+            for (int l = 0; l < QK; l++) {
+                const int vi = ((y[i].qs[l%8] >> (2*(l/8))) & 3) | (((y[i].qh[l/8] >> (l%8)) & 1) << 2);
+                hist[vi]++;
+            }
+        }
+    }
+
+    return (n/QK*sizeof(block_q3_1));
+}
+
+size_t ggml_quantize_q4_2(const float * src, void * dst, int n, int k, int64_t * hist) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q4_2].quantize_row_q_reference;
+
+    for (int j = 0; j < n; j += k) {
+        block_q4_2 * restrict y = (block_q4_2 *)dst + j/QK;
+
+        quantize_row_q_reference(src + j, y, k);
+
+        for (int i = 0; i < nb; i++) {
+            for (int l = 0; l < QK; l += 2) {
+                const uint8_t vi0 = y[i].qs[l/2] & 0xF;
+                const uint8_t vi1 = y[i].qs[l/2] >> 4;
+
+                hist[vi0]++;
+                hist[vi1]++;
+            }
+        }
+    }
+
+    return (n/QK*sizeof(block_q4_2));
+}
+
+size_t ggml_quantize_q4_3(const float * src, void * dst, int n, int k, int64_t * hist) {
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    ggml_ensure_kernels();
+    quantize_row_q_t const quantize_row_q_reference = quantize_fns[GGML_TYPE_Q4_3].quantize_row_q_reference;
+
+    for (int j = 0; j < n; j += k) {
+        block_q4_3 * restrict y = (block_q4_3 *)dst + j/QK;
+
+        quantize_row_q_reference(src + j, y, k);
+
+        for (int i = 0; i < nb; i++) {
+            for (int l = 0; l < QK; l += 2) {
+                const uint8_t vi0 = y[i].qs[l/2] & 0xF;
+                const uint8_t vi1 = y[i].qs[l/2] >> 4;
+
+                hist[vi0]++;
+                hist[vi1]++;
+            }
+        }
+    }
+
+    return (n/QK*sizeof(block_q4_3));
+}
+
+size_t ggml_convert_q4_0_q4_2(const void * src, void * dst, int n, int64_t * hist) {
+    assert(n % QK == 0);
+    const int nb = n / QK;
+
+    const block_q4_0 * restrict x = src;
+    block_q4_2 * restrict y = dst;
+
+    for (int i = 0; i < nb; i++) {
+        y[i].d = GGML_FP32_TO_FP16(x[i].d);
+        memcpy(y[i].qs, x[i].qs, sizeof(y[i].qs));
+
+        for (int l = 0; l < QK/2; l++) {
+            hist[y[i].qs[l] & 0xF]++;
+            hist[y[i].qs[l] >> 4]++;
+        }
+    }
+
+    return (nb*sizeof(block_q4_2));
+}
+
+size_t ggml_convert_q4_1_q4_3(const void * src, void * dst, int n, int64_t * hist) {
+    assert(n % QK == 0);
+    const int nb = n / QK;
+
+    const block_q4_1 * restrict x = src;
+    block_q4_3 * restrict y = dst;
+
+    for (int i = 0; i < nb; i++) {
+        y[i].d = GGML_FP32_TO_FP16(x[i].d);
+        y[i].m = GGML_FP32_TO_FP16(x[i].m);
+        memcpy(y[i].qs, x[i].qs, sizeof(y[i].qs));
+
+        for (int l = 0; l < QK/2; l++) {
+            hist[y[i].qs[l] & 0xF]++;
+            hist[y[i].qs[l] >> 4]++;
+        }
+    }
+
+    return (nb*sizeof(block_q4_3));
+}
+
+size_t ggml_repack_q4_0_x8(const void * src, void * dst, int nrows, int k) {
+    assert(nrows % 8 == 0);
+    assert(k % QK == 0);
+    const int nb = k / QK;
+
+    for (int j = 0; j < nrows; j += 8) {
+        const block_q4_0 * restrict x = (const block_q4_0 *) src + j*nb;
+        block_q4_0x8     * restrict y = (block_q4_0x8 *)     dst + (j/8)*nb;
+
+        for (int i = 0; i < nb; i++) {
+            for (int r = 0; r < 8; r++) {
+                const block_q4_0 * restrict xr = &x[r*nb + i];
+
+                y[i].d[r] = xr->d;
+
+                // elements l and 16 + l share a byte, see block_q4_0x8
+                for (int l = 0; l < QK/2; l++) {
+                    const uint8_t vi0 = (xr->qs[l/2]          >> 4*(l%2)) & 0xF;
+                    const uint8_t vi1 = (xr->qs[(QK/2 + l)/2] >> 4*(l%2)) & 0xF;
+
+                    y[i].qs[32*(l/4) + 4*r + l%4] = vi0 | (vi1 << 4);
+                }
+            }
+        }
+    }
+
+    return (nrows/8)*nb*sizeof(block_q4_0x8);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 int ggml_cpu_has_avx(void) {
@@ -10567,6 +11338,22 @@ int ggml_cpu_has_avx512(void) {
 #endif
 }
 
+int ggml_cpu_has_avx512_vnni(void) {
+#if defined(__AVX512VNNI__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int ggml_cpu_has_avx_vnni(void) {
+#if defined(__AVXVNNI__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 int ggml_cpu_has_fma(void) {
 #if defined(__FMA__)
     return 1;
@@ -10639,4 +11426,9 @@ int ggml_cpu_has_vsx(void) {
 #endif
 }
 
+const char * ggml_cpu_isa(void) {
+    ggml_ensure_kernels();
+    return g_kernels.name;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
@@ -194,6 +194,10 @@ typedef uint16_t ggml_fp16_t;
 float       ggml_fp16_to_fp32(ggml_fp16_t x);
 ggml_fp16_t ggml_fp32_to_fp16(float x);
 
+// convert rows of n values with the kernels selected for the CPU (call ggml_init() first, as for the above)
+void ggml_fp16_to_fp32_row(const ggml_fp16_t * x, float * y, int n);
+void ggml_fp32_to_fp16_row(const float * x, ggml_fp16_t * y, int n);
+
 struct ggml_object;
 struct ggml_context;
 
@@ -205,6 +209,12 @@ enum ggml_type {
     GGML_TYPE_I32,
     GGML_TYPE_F16,
     GGML_TYPE_F32,
+    GGML_TYPE_Q4_0_X8, // groups of 8 Q4_0 rows, interleaved by ggml_repack_q4_0_x8 - only supported by ggml_mul_mat
+    GGML_TYPE_Q8_0,
+    GGML_TYPE_Q2_1,
+    GGML_TYPE_Q3_1,
+    GGML_TYPE_Q4_2, // GGML_TYPE_Q4_0 with a fp16 delta
+    GGML_TYPE_Q4_3, // GGML_TYPE_Q4_1 with a fp16 delta and min
     GGML_TYPE_COUNT,
 };
 
@@ -229,10 +239,12 @@ enum ggml_op {
     GGML_OP_RELU,
     GGML_OP_GELU,
     GGML_OP_SILU,
+    GGML_OP_SILU_MUL,
     GGML_OP_NORM, // normalize
     GGML_OP_RMS_NORM,
 
     GGML_OP_MUL_MAT,
+    GGML_OP_MUL_MAT_ADD,
 
     GGML_OP_SCALE,
     GGML_OP_CPY,
@@ -283,6 +295,11 @@ struct ggml_tensor {
     int64_t perf_time_us;
 
     void * data;
+
+    // the tensor that owns the memory of a view and the offset of the view in it - views of views refer to the owner
+    struct ggml_tensor * view_src;
+    size_t               view_offs;
+
     char padding[8];
 };
 
@@ -342,6 +359,9 @@ void ggml_free(struct ggml_context * ctx);
 
 size_t ggml_used_mem(const struct ggml_context * ctx);
 
+// context memory taken by the object of a tensor - all of it in a no_alloc context, except for operator parameters
+size_t ggml_tensor_overhead(void);
+
 size_t ggml_set_scratch(struct ggml_context * ctx, struct ggml_scratch scratch);
 
 bool ggml_mlock_supported(void);
@@ -387,7 +407,7 @@ struct ggml_tensor * ggml_new_i32(struct ggml_context * ctx, int32_t value);
 struct ggml_tensor * ggml_new_f32(struct ggml_context * ctx, float value);
 
 struct ggml_tensor * ggml_dup_tensor (struct ggml_context * ctx, const struct ggml_tensor * src);
-struct ggml_tensor * ggml_view_tensor(struct ggml_context * ctx, const struct ggml_tensor * src);
+struct ggml_tensor * ggml_view_tensor(struct ggml_context * ctx, struct ggml_tensor * src);
 
 struct ggml_tensor * ggml_set_zero(struct ggml_tensor * tensor);
 struct ggml_tensor * ggml_set_i32 (struct ggml_tensor * tensor, int32_t value);
@@ -410,6 +430,8 @@ struct ggml_tensor * ggml_dup(
         struct ggml_context * ctx,
         struct ggml_tensor  * a);
 
+// a + b, where b is broadcast over the rows of a
+// b must have the same row size as a and each of its other dims must divide a's
 struct ggml_tensor * ggml_add(
         struct ggml_context * ctx,
         struct ggml_tensor  * a,
@@ -420,6 +442,7 @@ struct ggml_tensor * ggml_sub(
         struct ggml_tensor  * a,
         struct ggml_tensor  * b);
 
+// a*b, with the same broadcasting rules as ggml_add
 struct ggml_tensor * ggml_mul(
         struct ggml_context * ctx,
         struct ggml_tensor  * a,
@@ -485,6 +508,13 @@ struct ggml_tensor * ggml_silu(
         struct ggml_context * ctx,
         struct ggml_tensor  * a);
 
+// silu(a)*b in a single pass
+// the rows of a and b can be strided (e.g. views into a fused matmul result)
+struct ggml_tensor * ggml_silu_mul(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * b);
+
 // normalize along rows
 // TODO: eps is hardcoded to 1e-5 for now
 struct ggml_tensor * ggml_norm(
@@ -495,6 +525,13 @@ struct ggml_tensor * ggml_rms_norm(
         struct ggml_context * ctx,
         struct ggml_tensor  * a);
 
+// ggml_mul(ggml_rms_norm(a), b) in a single pass
+// b is a single row of a->ne[0] elements, applied to every row of a
+struct ggml_tensor * ggml_rms_norm_mul(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * b);
+
 // A: m rows, n columns
 // B: p rows, n columns (i.e. we transpose it internally)
 // result is m columns, p rows
@@ -503,6 +540,14 @@ struct ggml_tensor * ggml_mul_mat(
         struct ggml_tensor  * a,
         struct ggml_tensor  * b);
 
+// ggml_mul_mat(a, b) + c, with c added as each result element is computed
+// c must be contiguous and have the shape of the result
+struct ggml_tensor * ggml_mul_mat_add(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * b,
+        struct ggml_tensor  * c);
+
 //
 // operations on tensors without backpropagation
 //
@@ -558,6 +603,16 @@ struct ggml_tensor * ggml_view_2d(
         size_t                nb1, // row stride in bytes
         size_t                offset);
 
+struct ggml_tensor * ggml_view_3d(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        int                   ne0,
+        int                   ne1,
+        int                   ne2,
+        size_t                nb1, // row   stride in bytes
+        size_t                nb2, // slice stride in bytes
+        size_t                offset);
+
 struct ggml_tensor * ggml_permute(
         struct ggml_context * ctx,
         struct ggml_tensor  * a,
@@ -613,6 +668,9 @@ struct ggml_tensor * ggml_conv_1d_2s(
         struct ggml_tensor  * a,
         struct ggml_tensor  * b);
 
+// softmax(k*q/sqrt(D))*v computed in a single pass with an online softmax
+// q: [D, N, H], k and v: [D, n_past + N, H] (v is not transposed)
+// masked: q row i attends only to the first n_past + i + 1 rows of k and v
 struct ggml_tensor * ggml_flash_attn(
         struct ggml_context * ctx,
         struct ggml_tensor  * q,
@@ -642,6 +700,14 @@ struct ggml_cgraph ggml_build_forward (struct ggml_tensor * tensor);
 struct ggml_cgraph ggml_build_backward(struct ggml_context * ctx, struct ggml_cgraph * gf, bool keep);
 
 void ggml_graph_compute(struct ggml_context * ctx, struct ggml_cgraph * cgraph);
+
+// places the tensors of the graph that have no data - created in a no_alloc context - in buffer, together with the
+// work buffer of ggml_graph_compute() for graph->n_threads threads
+// the memory of a tensor is reused once all its consumers have been computed, views resolve to their source
+// the leafs without data are inputs that can be written after this call, except the ones only written by ggml_cpy()
+// the tensors the graph does not consume, and the ones read by the last node, still hold their data after the compute
+// with buffer == NULL nothing is placed and the size of the buffer needed is returned - the same graph then fits in it
+size_t ggml_graph_alloc(struct ggml_context * ctx, struct ggml_cgraph * graph, void * buffer, size_t size);
 void ggml_graph_reset  (struct ggml_cgraph * cgraph);
 
 // print info and performance information for the graph
@@ -755,6 +821,20 @@ enum ggml_opt_result ggml_opt(
 
 size_t ggml_quantize_q4_0(const float * src, void * dst, int n, int k, int64_t * hist);
 size_t ggml_quantize_q4_1(const float * src, void * dst, int n, int k, int64_t * hist);
+size_t ggml_quantize_q8_0(const float * src, void * dst, int n, int k, int64_t * hist);
+size_t ggml_quantize_q2_1(const float * src, void * dst, int n, int k, int64_t * hist);
+size_t ggml_quantize_q3_1(const float * src, void * dst, int n, int k, int64_t * hist);
+size_t ggml_quantize_q4_2(const float * src, void * dst, int n, int k, int64_t * hist);
+size_t ggml_quantize_q4_3(const float * src, void * dst, int n, int k, int64_t * hist);
+
+// convert n values of Q4_0 to Q4_2, or of Q4_1 to Q4_3, by rounding the delta and min of each block to fp16
+// the quants are kept as they are, returns the number of bytes written
+size_t ggml_convert_q4_0_q4_2(const void * src, void * dst, int n, int64_t * hist);
+size_t ggml_convert_q4_1_q4_3(const void * src, void * dst, int n, int64_t * hist);
+
+// interleave the blocks of each group of 8 rows of a Q4_0 matrix with nrows rows of k values, for GGML_TYPE_Q4_0_X8
+// nrows must be a multiple of 8, src and dst must not overlap, returns the number of bytes written
+size_t ggml_repack_q4_0_x8(const void * src, void * dst, int nrows, int k);
 
 //
 // system info
@@ -763,6 +843,8 @@ size_t ggml_quantize_q4_1(const float * src, void * dst, int n, int k, int64_t *
 int ggml_cpu_has_avx(void);
 int ggml_cpu_has_avx2(void);
 int ggml_cpu_has_avx512(void);
+int ggml_cpu_has_avx512_vnni(void);
+int ggml_cpu_has_avx_vnni(void);
 int ggml_cpu_has_fma(void);
 int ggml_cpu_has_neon(void);
 int ggml_cpu_has_arm_fma(void);
@@ -773,6 +855,37 @@ int ggml_cpu_has_blas(void);
 int ggml_cpu_has_sse3(void);
 int ggml_cpu_has_vsx(void);
 
+// name of the kernel set selected at runtime: "generic" (the flags of the build) or, with GGML_USE_DISPATCH,
+// "avx", "avx2", "avx512" or "avx512_vnni" - the environment variable GGML_ISA can request a lower level
+const char * ggml_cpu_isa(void);
+
+//
+// Internal types and functions exposed for tests and benchmarks
+//
+
+#ifdef  __cplusplus
+// restrict not standard in C++
+#define GGML_RESTRICT
+#else
+#define GGML_RESTRICT restrict
+#endif
+typedef void (*dequantize_row_q_t)(const void * GGML_RESTRICT x, float * GGML_RESTRICT y, int k);
+typedef void (*quantize_row_q_t)  (const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int k);
+typedef void (*vec_dot_q_t)       (const int n, float * GGML_RESTRICT s, const void * GGML_RESTRICT x, const void * GGML_RESTRICT y);
+
+typedef struct {
+    dequantize_row_q_t dequantize_row_q;
+    quantize_row_q_t   quantize_row_q;
+    quantize_row_q_t   quantize_row_q_reference; // deterministic, used for the model files
+    quantize_row_q_t   quantize_row_q_dot; // quantizes the src1 rows into the format vec_dot_q expects (8-bit blocks)
+    vec_dot_q_t        vec_dot_q;          // GGML_TYPE_Q4_0_X8: the dot products of the 8 rows, into s[0] .. s[7]
+} quantize_fns_t;
+
+quantize_fns_t ggml_internal_get_quantize_fn(size_t i);
+
+// the dot product specialised for rows of n elements (Q4_0, Q4_1 and F16 types), NULL if there is none
+vec_dot_q_t ggml_internal_get_vec_dot_fixed(enum ggml_type type, int n);
+
 #ifdef  __cplusplus
 }
 #endif
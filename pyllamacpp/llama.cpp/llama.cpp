@@ -8,9 +8,15 @@
 #include <map>
 #include <unordered_map>
 #include <queue>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <regex>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 
 #if defined(_WIN32) && !defined(_POSIX_MAPPED_FILES)
 #define WIN32_LEAN_AND_MEAN
@@ -25,9 +31,6 @@
 #define Min(X, Y) ((Y) > (X) ? (X) : (Y))
 #define Max(X, Y) ((Y) < (X) ? (X) : (Y))
 
-#define LLAMA_USE_SCRATCH
-#define LLAMA_MAX_SCRATCH_BUFFERS 16
-
 #define LLAMA_ASSERT(x) \
     do { \
         if (!(x)) { \
@@ -56,39 +59,152 @@ enum e_model {
 
 static const size_t MB = 1024*1024;
 
-// computed for n_ctx == 2048
-// TODO: dynamically determine these sizes
-//       needs modifications in ggml
+static size_t llama_page_size() {
+#if defined(_WIN32) && !defined(_POSIX_MAPPED_FILES)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwPageSize;
+#else
+    return sysconf(_SC_PAGESIZE);
+#endif
+}
 
-static const std::map<e_model, size_t> MEM_REQ_SCRATCH0 = {
-    { MODEL_7B,    512ull*MB },
-    { MODEL_13B,   512ull*MB },
-    { MODEL_30B,   512ull*MB },
-    { MODEL_65B,   512ull*MB },
-};
+// the huge page size of x86-64 and arm64 with 4 KB base pages
+static const size_t LLAMA_HUGE_PAGE_SIZE = 2*MB;
 
-static const std::map<e_model, size_t> MEM_REQ_SCRATCH1 = {
-    { MODEL_7B,    512ull*MB },
-    { MODEL_13B,   512ull*MB },
-    { MODEL_30B,   512ull*MB },
-    { MODEL_65B,   512ull*MB },
-};
+// the size of the reads of the model warm-up
+static const size_t LLAMA_WARMUP_CHUNK_SIZE = 4*MB;
 
-// 2*n_embd*n_ctx*n_layer*sizeof(float16)
-static const std::map<e_model, size_t> MEM_REQ_KV_SELF = {
-    { MODEL_7B,   1026ull*MB },
-    { MODEL_13B,  1608ull*MB },
-    { MODEL_30B,  3124ull*MB },
-    { MODEL_65B,  5120ull*MB },
-};
+// anonymous memory for the kv cache and the compute buffers - the pages are committed by the OS on first use,
+// where a std::vector would zero all of them up front
+struct llama_buffer {
+    uint8_t * addr = NULL;
+    size_t    len  = 0;
+
+    // the mapping, larger than the buffer when it is aligned for huge pages
+    void * map_addr = NULL;
+    size_t map_len  = 0;
+
+    const char * pages = "4 KB"; // the kind of pages backing the buffer, for the logs
+
+    llama_buffer() = default;
+
+    llama_buffer(const llama_buffer &) = delete;
+    llama_buffer & operator=(const llama_buffer &) = delete;
+
+    ~llama_buffer() {
+        free();
+    }
+
+    uint8_t * data() const { return addr; }
+    size_t    size() const { return len; }
+
+    // the contents are not kept
+    // with huge_pages the buffer is backed by hugetlbfs pages if some are reserved (vm.nr_hugepages), by
+    // transparent huge pages otherwise - ignored on Windows, where large pages need a privilege
+    bool resize(size_t n, bool huge_pages = false) {
+        free();
+
+        if (n == 0) {
+            return true;
+        }
+
+        pages = "4 KB";
+
+#if defined(_WIN32) && !defined(_POSIX_MAPPED_FILES)
+        (void) huge_pages;
+
+        void * p = VirtualAlloc(NULL, n, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (p == NULL) {
+            return false;
+        }
+
+        map_addr = p;
+        map_len  = n;
+        addr     = (uint8_t *) p;
+#else
+#if defined(MAP_HUGETLB)
+        if (huge_pages) {
+            const size_t n_huge = (n + LLAMA_HUGE_PAGE_SIZE - 1)/LLAMA_HUGE_PAGE_SIZE*LLAMA_HUGE_PAGE_SIZE;
+
+            void * p = mmap(NULL, n_huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                map_addr = p;
+                map_len  = n_huge;
+                addr     = (uint8_t *) p;
+                len      = n;
+                pages    = "hugetlbfs";
+                return true;
+            }
+        }
+#endif
+
+        // the huge pages of THP are aligned to their size - map one more so that the buffer can start at one
+        const size_t n_map = huge_pages ? n + LLAMA_HUGE_PAGE_SIZE : n;
+
+        void * p = mmap(NULL, n_map, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+
+        map_addr = p;
+        map_len  = n_map;
+        addr     = (uint8_t *) p;
+
+#if defined(MADV_HUGEPAGE)
+        if (huge_pages) {
+            addr = (uint8_t *) (((uintptr_t) p + LLAMA_HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (LLAMA_HUGE_PAGE_SIZE - 1));
+            if (madvise(addr, n, MADV_HUGEPAGE) == 0) {
+                pages = "transparent huge pages";
+            }
+        }
+#endif
+#endif
+
+        len = n;
+
+        return true;
+    }
+
+    void free() {
+        if (map_addr == NULL) {
+            return;
+        }
+
+#if defined(_WIN32) && !defined(_POSIX_MAPPED_FILES)
+        VirtualFree(map_addr, 0, MEM_RELEASE);
+#else
+        munmap(map_addr, map_len);
+#endif
+
+        map_addr = NULL;
+        map_len  = 0;
+        addr     = NULL;
+        len      = 0;
+    }
+
+    // commits all the pages now, writing one byte per page on n_threads threads
+    void prefault(int n_threads) {
+        const size_t page    = llama_page_size();
+        const size_t n_pages = (len + page - 1)/page;
+
+        auto touch = [&](size_t i0, size_t i1) {
+            for (size_t i = i0; i < i1; i++) {
+                ((volatile uint8_t *) addr)[i*page] = 0;
+            }
+        };
 
-// this is mostly needed for temporary mul_mat buffers to dequantize the data
-// not actually needed if BLAS is disabled
-static const std::map<e_model, size_t> MEM_REQ_EVAL = {
-    { MODEL_7B,   768ull*MB },
-    { MODEL_13B, 1024ull*MB },
-    { MODEL_30B, 1280ull*MB },
-    { MODEL_65B, 1536ull*MB },
+        std::vector<std::thread> workers;
+        for (int i = 1; i < n_threads; i++) {
+            workers.emplace_back(touch, n_pages*i/n_threads, n_pages*(i + 1)/n_threads);
+        }
+
+        touch(0, n_pages/n_threads);
+
+        for (auto & w : workers) {
+            w.join();
+        }
+    }
 };
 
 // default hparams (LLaMA 7B)
@@ -120,15 +236,24 @@ struct llama_layer {
     struct ggml_tensor * w1;
     struct ggml_tensor * w2;
     struct ggml_tensor * w3;
+
+    // optional fused weights, packed at load time:
+    //   wqkv = [wq; wk; wv] - [n_embd, 3*n_embd]
+    //   w13  = [w1; w3]     - [n_embd, 2*n_ff]
+    // wq/wk/wv and w1/w3 then point into them
+    struct ggml_tensor * wqkv = NULL;
+    struct ggml_tensor * w13  = NULL;
 };
 
+// k and v are stored head-major: [n_layer][n_head][n_ctx][n_embd/n_head]
+// so the history of each head is a contiguous block that attention reads with unit stride
 struct llama_kv_cache {
     struct ggml_tensor * k;
     struct ggml_tensor * v;
 
     struct ggml_context * ctx;
 
-    std::vector<uint8_t> buf;
+    llama_buffer buf;
 
     int n; // number of tokens currently in the cache
 };
@@ -155,10 +280,19 @@ struct llama_model {
     // the model memory buffer
     std::vector<uint8_t> buf;
 
+    // storage for the fused weights (empty unless fuse_weights is set)
+    std::vector<uint8_t> buf_fused;
+
+    // storage for the repacked weights (empty unless repack_weights is set)
+    std::vector<uint8_t> buf_repacked;
+
     // model memory mapped file
     void * mm_addr = NULL;
     uint64_t mm_length = 0;
 
+    // the contents of the file when the weights are copied out of the mapping (mm_addr is NULL then)
+    llama_buffer buf_weights;
+
     // tensors
     int n_loaded;
     std::unordered_map<std::string, struct ggml_tensor *> tensors;
@@ -177,6 +311,20 @@ struct llama_vocab {
     std::vector<token_score> id_to_token;
 };
 
+// reads the weights of the file mapping into memory on several threads, before or while the first evals use them
+struct llama_warmup {
+    // page aligned pieces of the byte ranges of the weights
+    std::vector<std::pair<uint8_t *, size_t>> chunks;
+    size_t n_bytes = 0;
+
+    std::atomic<size_t> i_next { 0 }; // the next chunk to read
+    std::atomic<size_t> n_done { 0 }; // bytes read
+    std::atomic<bool>   stop   { false };
+
+    // runs the warm-up when it is asynchronous
+    std::thread thread;
+};
+
 struct llama_context {
     std::mt19937 rng;
 
@@ -206,42 +354,12 @@ struct llama_context {
 
     // memory buffers used to evaluate the model
     // TODO: move in llama_state
-    std::vector<uint8_t> buf_compute;
-    std::vector<uint8_t> buf_scratch[LLAMA_MAX_SCRATCH_BUFFERS];
-
-    int    buf_last = 0;
-    size_t buf_max_size[LLAMA_MAX_SCRATCH_BUFFERS] = { 0 };
-
-    void use_buf(struct ggml_context * ctx, int i) {
-#if defined(LLAMA_USE_SCRATCH)
-        size_t last_size = 0;
+    llama_buffer buf_compute; // the tensor objects of the graph
+    llama_buffer buf_alloc;   // the data of the graph, placed by ggml_graph_alloc()
 
-        if (i == -1) {
-            last_size = ggml_set_scratch(ctx, { 0, 0, nullptr, });
-        } else {
-            auto & buf = buf_scratch[i];
-            last_size = ggml_set_scratch(ctx, { 0, buf.size(), buf.data(), });
-        }
-
-        if (buf_last >= 0) {
-            buf_max_size[buf_last] = Max(buf_max_size[buf_last], last_size);
-        }
-
-        buf_last = i;
-#else
-        (void) i;
-        (void) ctx;
-#endif
-    }
+    bool huge_pages = false;  // buf_alloc is backed by huge pages
 
-    size_t get_buf_max_mem(int i) const {
-#if defined(LLAMA_USE_SCRATCH)
-        return buf_max_size[i];
-#else
-        (void) i;
-        return 0;
-#endif
-    }
+    llama_warmup warmup;
 };
 
 //
@@ -252,14 +370,24 @@ static bool kv_cache_init(
         const struct llama_hparams & hparams,
              struct llama_kv_cache & cache,
                          ggml_type   wtype,
-                               int   n_ctx) {
+                               int   n_ctx,
+                              bool   huge_pages) {
     const int n_embd  = hparams.n_embd;
     const int n_layer = hparams.n_layer;
 
     const int n_mem      = n_layer*n_ctx;
     const int n_elements = n_embd*n_mem;
 
-    cache.buf.resize(2u*n_elements*ggml_type_size(wtype) + 2u*MB);
+    // the rows of the cache are the heads of the k and v vectors
+    if ((n_embd/hparams.n_head) % ggml_blck_size(wtype) != 0) {
+        fprintf(stderr, "%s: the head size %d is not a multiple of the block size of the kv cache type\n", __func__, n_embd/hparams.n_head);
+        return false;
+    }
+
+    if (!cache.buf.resize(2u*n_elements/ggml_blck_size(wtype)*ggml_type_size(wtype) + 2u*MB, huge_pages)) {
+        fprintf(stderr, "%s: failed to allocate memory for kv cache\n", __func__);
+        return false;
+    }
 
     struct ggml_init_params params;
     params.mem_size   = cache.buf.size();
@@ -289,13 +417,22 @@ static void kv_cache_free(struct llama_kv_cache & cache) {
 struct llama_context_params llama_context_default_params() {
     struct llama_context_params result = {
         /*.n_ctx                       =*/ 512,
+        /*.n_batch                     =*/ 512,
         /*.n_parts                     =*/ -1,
         /*.seed                        =*/ 0,
         /*.f16_kv                      =*/ false,
+        /*.kv_type                     =*/ -1,
         /*.logits_all                  =*/ false,
         /*.vocab_only                  =*/ false,
         /*.use_mlock                   =*/ false,
+        /*.prefault                    =*/ false,
+        /*.huge_pages                  =*/ false,
+        /*.copy_weights                =*/ false,
+        /*.warmup                      =*/ false,
+        /*.warmup_async                =*/ false,
         /*.embedding                   =*/ false,
+        /*.fuse_weights                =*/ false,
+        /*.repack_weights              =*/ false,
         /*.progress_callback           =*/ nullptr,
         /*.progress_callback_user_data =*/ nullptr,
     };
@@ -359,6 +496,179 @@ static bool report_bad_magic(const char *path, uint32_t got, uint32_t want) {
     return false;
 }
 
+// the ggml_type of the ftype of a tensor in the model file - GGML_TYPE_COUNT if the ftype is unknown
+static ggml_type llama_ftype_to_type(int32_t ftype) {
+    switch (ftype) {
+        case 0: return GGML_TYPE_F32;
+        case 1: return GGML_TYPE_F16;
+        case 2: return GGML_TYPE_Q4_0;
+        case 3: return GGML_TYPE_Q4_1;
+        case 5: return GGML_TYPE_Q4_2;
+        case 6: return GGML_TYPE_Q4_3;
+        case 7: return GGML_TYPE_Q8_0;
+        case 8: return GGML_TYPE_Q2_1;
+        case 9: return GGML_TYPE_Q3_1;
+        default: return GGML_TYPE_COUNT;
+    }
+}
+
+static const char * llama_ftype_name(int32_t ftype) {
+    static const char * ftype_str[] = { "f32", "f16", "q4_0", "q4_1", "", "q4_2", "q4_3", "q8_0", "q2_1", "q3_1", };
+    return llama_ftype_to_type(ftype) == GGML_TYPE_COUNT ? "?" : ftype_str[ftype];
+}
+
+// change the type of a model tensor whose data is not loaded yet
+static void llama_set_tensor_type(struct ggml_tensor * t, ggml_type type) {
+    t->type  = type;
+    t->nb[0] = ggml_type_size(type);
+    t->nb[1] = t->nb[0]*(t->ne[0]/ggml_blck_size(type));
+    for (int i = 2; i < GGML_MAX_DIMS; i++) {
+        t->nb[i] = t->nb[i - 1]*t->ne[i - 1];
+    }
+}
+
+// copy the rows of srcs back to back into dst and make the srcs views into it
+static void llama_pack_rows(struct ggml_tensor * dst, std::initializer_list<struct ggml_tensor *> srcs) {
+    char * data = (char *) dst->data;
+
+    for (auto * src : srcs) {
+        LLAMA_ASSERT(src->type == dst->type);
+        LLAMA_ASSERT(src->ne[0] == dst->ne[0]);
+
+        const size_t size = ggml_nbytes(src);
+        memcpy(data, src->data, size);
+        src->data = data;
+        data += size;
+    }
+
+    LLAMA_ASSERT(data == (char *) dst->data + ggml_nbytes(dst));
+}
+
+// pack wq/wk/wv and w1/w3 of each layer into single tensors, so that the
+// attention input and the feed-forward input are each multiplied by one matrix
+// the matrices of a group are packed only if they have the same type, which a quantization plan may not give them
+static void llama_model_fuse_weights(llama_model & model) {
+    const auto & hparams = model.hparams;
+
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int n_ff    = model.layers[0].w1->ne[1];
+
+    auto & ctx = model.ctx;
+
+    auto can_fuse_qkv = [](const llama_layer & layer) {
+        return layer.wq->type == layer.wk->type && layer.wq->type == layer.wv->type;
+    };
+
+    auto can_fuse_w13 = [](const llama_layer & layer) {
+        return layer.w1->type == layer.w3->type;
+    };
+
+    size_t size = 0;
+    for (int i = 0; i < n_layer; ++i) {
+        const auto & layer = model.layers[i];
+
+        if (can_fuse_qkv(layer)) {
+            size += ggml_nbytes(layer.wq) + ggml_nbytes(layer.wk) + ggml_nbytes(layer.wv);
+        }
+        if (can_fuse_w13(layer)) {
+            size += ggml_nbytes(layer.w1) + ggml_nbytes(layer.w3);
+        }
+    }
+
+    model.buf_fused.resize(size);
+
+    char * data = (char *) model.buf_fused.data();
+
+    for (int i = 0; i < n_layer; ++i) {
+        auto & layer = model.layers[i];
+
+        if (can_fuse_qkv(layer)) {
+            layer.wqkv = ggml_new_tensor_2d(ctx, layer.wq->type, n_embd, 3*n_embd);
+            layer.wqkv->data = data;
+            data += ggml_nbytes(layer.wqkv);
+
+            llama_pack_rows(layer.wqkv, { layer.wq, layer.wk, layer.wv });
+        }
+
+        if (can_fuse_w13(layer)) {
+            layer.w13 = ggml_new_tensor_2d(ctx, layer.w1->type, n_embd, 2*n_ff);
+            layer.w13->data = data;
+            data += ggml_nbytes(layer.w13);
+
+            llama_pack_rows(layer.w13, { layer.w1, layer.w3 });
+        }
+    }
+
+    fprintf(stderr, "%s: fused weights = %7.2f MB\n", __func__, size/1024.0/1024.0);
+}
+
+// interleave the rows of the Q4_0 matrices in groups of 8 (GGML_TYPE_Q4_0_X8), so that the
+// matrix multiplications compute 8 rows for each pass over the activations
+static void llama_model_repack_weights(llama_model & model) {
+    auto can_repack = [](const ggml_tensor * t) {
+        return t->type == GGML_TYPE_Q4_0 && t->ne[1] % 8 == 0;
+    };
+
+    // the matrices used by llama_eval(), copied out of the mmap
+    std::vector<ggml_tensor *> tensors = { model.output };
+    for (const auto & layer : model.layers) {
+        if (!layer.wqkv) {
+            tensors.insert(tensors.end(), { layer.wq, layer.wk, layer.wv });
+        }
+        tensors.push_back(layer.wo);
+        if (!layer.w13) {
+            tensors.insert(tensors.end(), { layer.w1, layer.w3 });
+        }
+        tensors.push_back(layer.w2);
+    }
+
+    tensors.erase(std::remove_if(tensors.begin(), tensors.end(),
+                [&](const ggml_tensor * t) { return !can_repack(t); }), tensors.end());
+
+    size_t size = 0;
+    for (const auto * t : tensors) {
+        size += ggml_nbytes(t);
+    }
+
+    model.buf_repacked.resize(size);
+
+    char * data = (char *) model.buf_repacked.data();
+
+    for (auto * t : tensors) {
+        ggml_repack_q4_0_x8(t->data, data, t->ne[1], t->ne[0]);
+        t->data = data;
+        t->type = GGML_TYPE_Q4_0_X8;
+        data += ggml_nbytes(t);
+    }
+
+    // the fused weights are repacked in place - the views into them stay valid, as they cover whole groups of 8 rows
+    std::vector<uint8_t> tmp;
+
+    auto repack_in_place = [&](ggml_tensor * t, std::initializer_list<ggml_tensor *> views) {
+        if (!t || !can_repack(t)) {
+            return;
+        }
+
+        tmp.resize(ggml_nbytes(t));
+        memcpy(tmp.data(), t->data, tmp.size());
+
+        ggml_repack_q4_0_x8(tmp.data(), t->data, t->ne[1], t->ne[0]);
+
+        t->type = GGML_TYPE_Q4_0_X8;
+        for (auto * v : views) {
+            v->type = GGML_TYPE_Q4_0_X8;
+        }
+    };
+
+    for (auto & layer : model.layers) {
+        repack_in_place(layer.wqkv, { layer.wq, layer.wk, layer.wv });
+        repack_in_place(layer.w13,  { layer.w1, layer.w3 });
+    }
+
+    fprintf(stderr, "%s: repacked weights = %7.2f MB\n", __func__, size/1024.0/1024.0);
+}
+
 static bool llama_model_load(
         const std::string & fname,
         llama_context & lctx,
@@ -366,6 +676,8 @@ static bool llama_model_load(
         int n_parts,
         ggml_type memory_type,
         bool vocab_only,
+        bool fuse_weights,
+        bool repack_weights,
         llama_progress_callback progress_callback,
         void *progress_callback_user_data) {
     fprintf(stderr, "%s: loading model from '%s' - please wait ...\n", __func__, fname.c_str());
@@ -506,6 +818,7 @@ static bool llama_model_load(
     // for the big tensors, we have the option to store the data in 16-bit floats or quantized
     // in order to save memory and also to speed up the computation
     // wtype is for per-layer weights, while vtype is for other weights
+    // these are the types of most tensors - each tensor gets the type of its own ftype when loading
     ggml_type wtype, vtype;
     switch (model.hparams.f16) {
         case 0: wtype = vtype = GGML_TYPE_F32;  break;
@@ -513,6 +826,11 @@ static bool llama_model_load(
         case 2: wtype = vtype = GGML_TYPE_Q4_0; break;
         case 3: wtype = vtype = GGML_TYPE_Q4_1; break;
         case 4: wtype = GGML_TYPE_Q4_1; vtype = GGML_TYPE_F16; break;
+        case 5: wtype = vtype = GGML_TYPE_Q4_2; break;
+        case 6: wtype = vtype = GGML_TYPE_Q4_3; break;
+        case 7: wtype = vtype = GGML_TYPE_Q8_0; break;
+        case 8: wtype = vtype = GGML_TYPE_Q2_1; break;
+        case 9: wtype = vtype = GGML_TYPE_Q3_1; break;
         default:
                 {
                     fprintf(stderr, "%s: invalid model file '%s' (bad f16 value %d)\n",
@@ -537,25 +855,22 @@ static bool llama_model_load(
     {
         const auto &hparams = model.hparams;
         const int n_layer = hparams.n_layer;
-        ctx_size += (5 + 10*n_layer)*256; // object overhead
+        ctx_size += (5 + 12*n_layer)*256; // object overhead (incl. the optional fused tensors)
         fprintf(stderr, "%s: ggml ctx size = %6.2f KB\n", __func__, ctx_size/1024.0);
     }
 
     // print memory requirements
     {
-        const size_t scale = memory_type == GGML_TYPE_F32 ? 2 : 1;
+        const auto & hparams = model.hparams;
 
-        // this is the total memory required to run the inference
+        // the memory of the model - the compute buffer is measured on the graph when the context is created
         const size_t mem_required =
             ctx_size +
-            model.mm_length +
-            MEM_REQ_SCRATCH0.at(model.type) +
-            MEM_REQ_SCRATCH1.at(model.type) +
-            MEM_REQ_EVAL.at    (model.type);
+            model.mm_length;
 
-        // this is the memory required by one llama_state
+        // this is the memory required by one llama_state - the kv cache
         const size_t mem_required_state =
-            scale*MEM_REQ_KV_SELF.at(model.type);
+            2*(size_t) hparams.n_layer*hparams.n_ctx*hparams.n_embd*ggml_type_size(memory_type)/ggml_blck_size(memory_type);
 
         fprintf(stderr, "%s: mem required  = %7.2f MB (+ %7.2f MB per state)\n", __func__,
                 mem_required / 1024.0 / 1024.0, mem_required_state / 1024.0 / 1024.0);
@@ -674,6 +989,21 @@ static bool llama_model_load(
 
             auto tensor = model.tensors[name.data()];
 
+            const ggml_type type = llama_ftype_to_type(ftype);
+            if (type == GGML_TYPE_COUNT) {
+                fprintf(stderr, "%s: unknown ftype %d in model file\n", __func__, ftype);
+                return false;
+            }
+
+            // the model can mix types (see llama_model_quantize_plan), and the 1D tensors stay in f32
+            if (tensor->type != type) {
+                if (tensor->n_dims != 2) {
+                    fprintf(stderr, "%s: tensor '%s' has type %s in model file, expected f32\n", __func__, name.data(), llama_ftype_name(ftype));
+                    return false;
+                }
+                llama_set_tensor_type(tensor, type);
+            }
+
             if (ggml_nelements(tensor) != nelements) {
                 fprintf(stderr, "%s: tensor '%s' has wrong size in model file\n", __func__, name.data());
                 return false;
@@ -684,22 +1014,14 @@ static bool llama_model_load(
                 return false;
             }
             if (0) {
-                static const char * ftype_str[] = { "f32", "f16", "q4_0", "q4_1", };
-                fprintf(stderr, "%24s - [%5d, %5d], type = %6s\n", name.data(), ne[0], ne[1], ftype_str[ftype]);
+                fprintf(stderr, "%24s - [%5d, %5d], type = %6s\n", name.data(), ne[0], ne[1], llama_ftype_name(ftype));
             }
 
-            switch (ftype) {
-                case 0:  // f32
-                case 1:  // f16
-                    break;
-                case 2:  // q4_0
-                case 3:  // q4_1
-                    assert(ne[0] % 64 == 0);
-                    break;
-                default:
-                    fprintf(stderr, "%s: unknown ftype %d in model file\n", __func__, ftype);
-                    return false;
-            };
+            if (ne[0] % ggml_blck_size(type) != 0) {
+                fprintf(stderr, "%s: tensor '%s' has %d columns, not a multiple of the block size of %s\n",
+                        __func__, name.data(), ne[0], llama_ftype_name(ftype));
+                return false;
+            }
 
             // load the tensor data into memory without copying or reading it
             size_t offset = fin.tellg();
@@ -728,6 +1050,14 @@ static bool llama_model_load(
         }
     }
 
+    if (fuse_weights && model.n_loaded > 0) {
+        llama_model_fuse_weights(model);
+    }
+
+    if (repack_weights && model.n_loaded > 0) {
+        llama_model_repack_weights(model);
+    }
+
     // loading time will be recalculate after the first eval, so
     // we take page faults deferred by mmap() into consideration
     lctx.t_load_us = ggml_time_us() - lctx.t_start_us;
@@ -739,221 +1069,411 @@ static bool llama_model_load(
     return true;
 }
 
-// evaluate the transformer
-//
-//   - lctx:      llama context
-//   - tokens:    new batch of tokens to process
-//   - n_past:    the context size so far
-//   - n_threads: number of threads to use
-//
-static bool llama_eval_internal(
-        llama_context & lctx,
-    const llama_token * tokens,
-            const int   n_tokens,
-            const int   n_past,
-            const int   n_threads) {
+// copies the model file into anonymous memory - possibly backed by huge pages, where the page cache uses 4 KB pages -
+// and points the weights to the copy
+static bool llama_copy_weights(llama_model & model, bool huge_pages) {
     const int64_t t_start_us = ggml_time_us();
 
-    const int N = n_tokens;
+    auto & buf = model.buf_weights;
 
-    const auto & model   = lctx.model;
-    const auto & hparams = model.hparams;
+    if (!buf.resize(model.mm_length, huge_pages)) {
+        fprintf(stderr, "%s: failed to allocate %.2f MB for the weights\n", __func__, model.mm_length/1024.0/1024.0);
+        return false;
+    }
 
-    auto & kv_self = model.kv_self;
+    const char * src = (const char *) model.mm_addr;
+    char       * dst = (char *) buf.data();
 
-    LLAMA_ASSERT(!!kv_self.ctx);
+    // the reads of the mapping fault the file in, so they are spread over the cores
+    {
+        const int    n_threads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t n_chunks  = (model.mm_length + LLAMA_HUGE_PAGE_SIZE - 1)/LLAMA_HUGE_PAGE_SIZE;
+
+        auto copy = [&](size_t i0, size_t i1) {
+            const size_t offs = i0*LLAMA_HUGE_PAGE_SIZE;
+            const size_t end  = std::min<size_t>(i1*LLAMA_HUGE_PAGE_SIZE, model.mm_length);
+            if (end > offs) {
+                memcpy(dst + offs, src + offs, end - offs);
+            }
+        };
 
-    const int n_embd  = hparams.n_embd;
-    const int n_layer = hparams.n_layer;
-    const int n_ctx   = hparams.n_ctx;
-    const int n_head  = hparams.n_head;
-    const int n_vocab = hparams.n_vocab;
-    const int n_rot   = hparams.n_embd/hparams.n_head;
+        std::vector<std::thread> workers;
+        for (int i = 1; i < n_threads; i++) {
+            workers.emplace_back(copy, n_chunks*i/n_threads, n_chunks*(i + 1)/n_threads);
+        }
 
-    auto & mem_per_token = lctx.mem_per_token;
-    auto & buf_compute   = lctx.buf_compute;
+        copy(0, n_chunks/n_threads);
 
-    struct ggml_init_params params = {
-        /*.mem_size   =*/ buf_compute.size(),
-        /*.mem_buffer =*/ buf_compute.data(),
-        /*.no_alloc   =*/ false,
-    };
+        for (auto & w : workers) {
+            w.join();
+        }
+    }
 
-    struct ggml_context * ctx0 = ggml_init(params);
+    // the fused and repacked weights are already outside of the mapping
+    for (auto & it : model.tensors) {
+        struct ggml_tensor * tensor = it.second;
 
-    // for big prompts, if BLAS is enabled, it is better to use only one thread
-    // otherwise, the threads are spin-lock waiting for the BLAS calls and are degrading the performance
-    ggml_cgraph gf = {};
-    gf.n_threads = N >= 32 && ggml_cpu_has_blas() ? 1 : n_threads;
+        const char * data = (const char *) tensor->data;
+        if (data >= src && data < src + model.mm_length) {
+            tensor->data = dst + (data - src);
+        }
+    }
 
-    struct ggml_tensor * embd = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, N);
-    memcpy(embd->data, tokens, N*ggml_element_size(embd));
+    munmap_file(model.mm_addr, model.mm_length);
+    model.mm_addr = NULL;
 
-    struct ggml_tensor * inpL = ggml_get_rows(ctx0, model.tok_embeddings, embd);
+    fprintf(stderr, "%s: copied %.2f MB of weights in %.2f ms (%s)\n", __func__,
+            model.mm_length/1024.0/1024.0, (ggml_time_us() - t_start_us)/1000.0, buf.pages);
 
-    for (int il = 0; il < n_layer; ++il) {
-        struct ggml_tensor * inpSA = inpL;
+    return true;
+}
 
-        struct ggml_tensor * cur;
+// splits the ranges of the weights that are in the file mapping into chunks - the weights that were fused or
+// repacked out of the mapping are not read, the ones that replaced them are
+static void llama_warmup_init(llama_warmup & warmup, const llama_model & model) {
+    const size_t page = llama_page_size();
 
-        lctx.use_buf(ctx0, 0);
+    uint8_t * base = (uint8_t *) model.mm_addr;
 
-        // norm
-        {
-            cur = ggml_rms_norm(ctx0, inpL);
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (const auto & it : model.tensors) {
+        const struct ggml_tensor * tensor = it.second;
 
-            // cur = attention_norm*cur
-            cur = ggml_mul(ctx0,
-                        ggml_repeat(ctx0, model.layers[il].attention_norm, cur),
-                        cur);
+        const uint8_t * data = (const uint8_t *) tensor->data;
+        if (data >= base && data < base + model.mm_length) {
+            const size_t offs = data - base;
+            ranges.emplace_back(offs/page*page, std::min<size_t>(offs + ggml_nbytes(tensor), model.mm_length));
         }
+    }
 
-        // self-attention
-        {
-            struct ggml_tensor * Qcur = ggml_mul_mat(ctx0, model.layers[il].wq, cur);
-            struct ggml_tensor * Kcur = ggml_mul_mat(ctx0, model.layers[il].wk, cur);
-            struct ggml_tensor * Vcur = ggml_mul_mat(ctx0, model.layers[il].wv, cur);
-
-            // store key and value to memory
-            if (N >= 1) {
-                struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd, (ggml_element_size(kv_self.k)*n_embd)*(il*n_ctx + n_past));
-                struct ggml_tensor * v = ggml_view_1d(ctx0, kv_self.v, N*n_embd, (ggml_element_size(kv_self.v)*n_embd)*(il*n_ctx + n_past));
-
-                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, Kcur, k));
-                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, Vcur, v));
-            }
+    std::sort(ranges.begin(), ranges.end());
 
-            // Q = Qcur.contiguous().view(n_embd/n_head, n_head, N).permute(0, 2, 1, 3)
-            struct ggml_tensor * Q =
-                ggml_permute(ctx0,
-                        ggml_rope(ctx0,
-                            ggml_cpy(ctx0,
-                                Qcur,
-                                ggml_new_tensor_3d(ctx0, GGML_TYPE_F32, n_embd/n_head, n_head, N)),
-                            n_past, n_rot, 0),
-                        0, 2, 1, 3);
-
-            // K = Kmem.view(n_embd/n_head, n_head, n_past + N).permute(0, 2, 1, 3)
-            struct ggml_tensor * K =
-                ggml_permute(ctx0,
-                        ggml_rope(ctx0,
-                            ggml_reshape_3d(ctx0,
-                                ggml_view_1d(ctx0, kv_self.k, (n_past + N)*n_embd, il*n_ctx*ggml_element_size(kv_self.k)*n_embd),
-                                n_embd/n_head, n_head, n_past + N),
-                            n_past, n_rot, 1),
-                        0, 2, 1, 3);
-
-            // K * Q
-            struct ggml_tensor * KQ = ggml_mul_mat(ctx0, K, Q);
-
-            // KQ_scaled = KQ / sqrt(n_embd/n_head)
-            struct ggml_tensor * KQ_scaled =
-                ggml_scale(ctx0,
-                        KQ,
-                        ggml_new_f32(ctx0, 1.0f/sqrtf(float(n_embd)/n_head)));
-
-            // KQ_masked = mask_past(KQ_scaled)
-            struct ggml_tensor * KQ_masked = ggml_diag_mask_inf(ctx0, KQ_scaled, n_past);
-
-            // KQ = soft_max(KQ_masked)
-            struct ggml_tensor * KQ_soft_max = ggml_soft_max(ctx0, KQ_masked);
-
-            // V_trans = Vmem.view(n_embd/n_head, n_head, n_past + N).permute(1, 2, 0, 3).contiguous()
-            struct ggml_tensor * V_trans =
-                ggml_cpy(ctx0,
-                    ggml_permute(ctx0,
-                            ggml_reshape_3d(ctx0,
-                                ggml_view_1d(ctx0, kv_self.v, (n_past + N)*n_embd, il*n_ctx*ggml_element_size(kv_self.v)*n_embd),
-                                n_embd/n_head, n_head, n_past + N),
-                            1, 2, 0, 3),
-                    ggml_new_tensor_3d(ctx0, kv_self.v->type, n_past + N, n_embd/n_head, n_head));
-
-            // KQV = transpose(V) * KQ_soft_max
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V_trans, KQ_soft_max);
+    // the ranges start on a page, so reading one byte per page of a chunk reads all of it
+    for (size_t i = 0; i < ranges.size(); ) {
+        size_t offs = ranges[i].first;
+        size_t end  = ranges[i].second;
+        for (i++; i < ranges.size() && ranges[i].first <= end; i++) {
+            end = std::max(end, ranges[i].second);
+        }
 
-            // KQV_merged = KQV.permute(0, 2, 1, 3)
-            struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
+        for (; offs < end; offs += LLAMA_WARMUP_CHUNK_SIZE) {
+            const size_t size = std::min(end - offs, LLAMA_WARMUP_CHUNK_SIZE);
+            warmup.chunks.emplace_back(base + offs, size);
+            warmup.n_bytes += size;
+        }
+    }
+}
 
-            // cur = KQV_merged.contiguous().view(n_embd, N)
-            cur = ggml_cpy(ctx0,
-                    KQV_merged,
-                    ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_embd, N));
+// reads the chunks on n_threads threads - each chunk is read ahead with madvise() first, so the file is read in large
+// requests instead of the few pages around each page fault
+static void llama_warmup_run(
+        llama_warmup & warmup,
+                 int   n_threads,
+        llama_progress_callback progress_callback,
+        void * progress_callback_user_data) {
+    const int64_t t_start_us = ggml_time_us();
 
-            // projection (no bias)
-            cur = ggml_mul_mat(ctx0,
-                    model.layers[il].wo,
-                    cur);
-        }
+    const size_t page = llama_page_size();
 
-        lctx.use_buf(ctx0, 1);
+    auto touch = [&](bool report) {
+        while (!warmup.stop) {
+            const size_t i = warmup.i_next++;
+            if (i >= warmup.chunks.size()) {
+                break;
+            }
 
-        struct ggml_tensor * inpFF = ggml_add(ctx0, cur, inpSA);
+            uint8_t * data = warmup.chunks[i].first;
+            size_t    size = warmup.chunks[i].second;
 
-        // feed-forward network
-        {
-            // norm
-            {
-                cur = ggml_rms_norm(ctx0, inpFF);
+#if !defined(_WIN32) || defined(_POSIX_MAPPED_FILES)
+            madvise(data, size, MADV_WILLNEED);
+#endif
 
-                // cur = ffn_norm*cur
-                cur = ggml_mul(ctx0,
-                        ggml_repeat(ctx0, model.layers[il].ffn_norm, cur),
-                        cur);
+            uint8_t sum = 0;
+            for (size_t offs = 0; offs < size; offs += page) {
+                sum += ((volatile const uint8_t *) data)[offs];
             }
+            (void) sum;
 
-            struct ggml_tensor * tmp = ggml_mul_mat(ctx0,
-                    model.layers[il].w3,
-                    cur);
+            const size_t n_done = warmup.n_done += size;
 
-            cur = ggml_mul_mat(ctx0,
-                    model.layers[il].w1,
-                    cur);
+            // the callback is only called from the thread that runs the warm-up
+            if (report && progress_callback) {
+                progress_callback(float(n_done)/warmup.n_bytes, progress_callback_user_data);
+            }
+        }
+    };
 
-            // SILU activation
-            cur = ggml_silu(ctx0, cur);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < n_threads; i++) {
+        workers.emplace_back(touch, false);
+    }
 
-            cur = ggml_mul(ctx0, cur, tmp);
+    touch(true);
 
-            cur = ggml_mul_mat(ctx0,
-                    model.layers[il].w2,
-                    cur);
+    for (auto & w : workers) {
+        w.join();
+    }
+
+    if (warmup.stop) {
+        return;
+    }
+
+    if (progress_callback) {
+        progress_callback(1.0f, progress_callback_user_data);
+    }
+
+    fprintf(stderr, "%s: read %.2f MB of weights in %.2f ms on %d threads\n", __func__,
+            warmup.n_bytes/1024.0/1024.0, (ggml_time_us() - t_start_us)/1000.0, n_threads);
+}
+
+// the tensors of the graph of a llama_eval() call
+struct llama_graph {
+    struct ggml_tensor * embd;       // the input tokens
+    struct ggml_tensor * embeddings; // the normalized output of the last layer
+    struct ggml_tensor * logits;
+};
+
+// builds the graph of N tokens after n_past in ctx0 - in a no_alloc context the tensors are placed with
+// ggml_graph_alloc() and the tokens are written to embd after that
+static llama_graph llama_build_graph(
+  const llama_context & lctx,
+  struct ggml_context * ctx0,
+          ggml_cgraph & gf,
+            const int   N,
+            const int   n_past) {
+    const auto & model   = lctx.model;
+    const auto & hparams = model.hparams;
+
+    const auto & kv_self = model.kv_self;
+
+    LLAMA_ASSERT(!!kv_self.ctx);
+
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int n_ctx   = hparams.n_ctx;
+    const int n_head  = hparams.n_head;
+    const int n_rot   = hparams.n_embd/hparams.n_head;
+
+    struct ggml_tensor * embd = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, N);
+
+    struct ggml_tensor * inpL = ggml_get_rows(ctx0, model.tok_embeddings, embd);
+
+    for (int il = 0; il < n_layer; ++il) {
+        struct ggml_tensor * inpSA = inpL;
+
+        struct ggml_tensor * cur;
+
+        // norm
+        {
+            // cur = attention_norm*rms_norm(inpL)
+            cur = ggml_rms_norm_mul(ctx0, inpL, model.layers[il].attention_norm);
+        }
+
+        // self-attention
+        {
+            const int n_embd_head = n_embd/n_head;
+
+            // Qcur, Kcur and Vcur as [n_embd/n_head, n_head, N] views into the projection result(s)
+            struct ggml_tensor * Qcur;
+            struct ggml_tensor * Kcur;
+            struct ggml_tensor * Vcur;
+
+            if (model.layers[il].wqkv) {
+                // one matmul for all three, split with views
+                struct ggml_tensor * QKV = ggml_mul_mat(ctx0, model.layers[il].wqkv, cur);
+
+                const size_t es = ggml_element_size(QKV);
+
+                Qcur = ggml_view_3d(ctx0, QKV, n_embd_head, n_head, N, es*n_embd_head, QKV->nb[1], 0*es*n_embd);
+                Kcur = ggml_view_3d(ctx0, QKV, n_embd_head, n_head, N, es*n_embd_head, QKV->nb[1], 1*es*n_embd);
+                Vcur = ggml_view_3d(ctx0, QKV, n_embd_head, n_head, N, es*n_embd_head, QKV->nb[1], 2*es*n_embd);
+            } else {
+                Qcur = ggml_reshape_3d(ctx0, ggml_mul_mat(ctx0, model.layers[il].wq, cur), n_embd_head, n_head, N);
+                Kcur = ggml_reshape_3d(ctx0, ggml_mul_mat(ctx0, model.layers[il].wk, cur), n_embd_head, n_head, N);
+                Vcur = ggml_reshape_3d(ctx0, ggml_mul_mat(ctx0, model.layers[il].wv, cur), n_embd_head, n_head, N);
+            }
+
+            // bytes per row of the cache - the rows of a quantized cache are whole blocks
+            const size_t k_rsize = ggml_type_size(kv_self.k->type)*n_embd_head/ggml_blck_size(kv_self.k->type);
+            const size_t v_rsize = ggml_type_size(kv_self.v->type)*n_embd_head/ggml_blck_size(kv_self.v->type);
+
+            // store key and value to memory
+            if (N >= 1) {
+                // Krot = rope(Kcur).permute(0, 2, 1, 3)
+                struct ggml_tensor * Krot = ggml_permute(ctx0, ggml_rope(ctx0, Kcur, n_past, n_rot, 0), 0, 2, 1, 3);
+
+                // Vhead = Vcur.permute(0, 2, 1, 3)
+                struct ggml_tensor * Vhead = ggml_permute(ctx0, Vcur, 0, 2, 1, 3);
+
+                struct ggml_tensor * k = ggml_view_3d(ctx0, kv_self.k, n_embd_head, N, n_head,
+                        k_rsize, k_rsize*n_ctx,
+                        k_rsize*(il*n_head*n_ctx + n_past));
+                struct ggml_tensor * v = ggml_view_3d(ctx0, kv_self.v, n_embd_head, N, n_head,
+                        v_rsize, v_rsize*n_ctx,
+                        v_rsize*(il*n_head*n_ctx + n_past));
+
+                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, Krot, k));
+                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, Vhead, v));
+            }
+
+            // Q = rope(Qcur).permute(0, 2, 1, 3)
+            struct ggml_tensor * Q = ggml_permute(ctx0, ggml_rope(ctx0, Qcur, n_past, n_rot, 0), 0, 2, 1, 3);
+
+            // K = Kmem[il].view(n_embd/n_head, n_past + N, n_head) - already rotated, no copy
+            struct ggml_tensor * K =
+                ggml_view_3d(ctx0, kv_self.k, n_embd_head, n_past + N, n_head,
+                        k_rsize, k_rsize*n_ctx,
+                        k_rsize*il*n_head*n_ctx);
+
+            // V = Vmem[il].view(n_embd/n_head, n_past + N, n_head) - no copy
+            struct ggml_tensor * V =
+                ggml_view_3d(ctx0, kv_self.v, n_embd_head, n_past + N, n_head,
+                        v_rsize, v_rsize*n_ctx,
+                        v_rsize*il*n_head*n_ctx);
+
+            // KQV = soft_max(mask_past(K*Q/sqrt(n_embd/n_head)))*V
+            // fused: streams over K and V once per head with an online softmax, no KQ or V_trans intermediates
+            struct ggml_tensor * KQV = ggml_flash_attn(ctx0, Q, K, V, true);
+
+            // KQV_merged = KQV.permute(0, 2, 1, 3)
+            struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
+
+            // cur = KQV_merged.contiguous().view(n_embd, N)
+            cur = ggml_cpy(ctx0,
+                    KQV_merged,
+                    ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_embd, N));
+
+            // projection (no bias) + residual
+            cur = ggml_mul_mat_add(ctx0,
+                    model.layers[il].wo,
+                    cur,
+                    inpSA);
         }
 
-        cur = ggml_add(ctx0, cur, inpFF);
+        struct ggml_tensor * inpFF = cur;
+
+        // feed-forward network
+        {
+            // norm
+            {
+                // cur = ffn_norm*rms_norm(inpFF)
+                cur = ggml_rms_norm_mul(ctx0, inpFF, model.layers[il].ffn_norm);
+            }
+
+            struct ggml_tensor * tmp;
+
+            if (model.layers[il].w13) {
+                // one matmul for w1 and w3, split with views
+                struct ggml_tensor * h13 = ggml_mul_mat(ctx0, model.layers[il].w13, cur);
+
+                const int n_ff = model.layers[il].w1->ne[1];
+
+                cur = ggml_view_2d(ctx0, h13, n_ff, N, h13->nb[1], 0);
+                tmp = ggml_view_2d(ctx0, h13, n_ff, N, h13->nb[1], n_ff*ggml_element_size(h13));
+            } else {
+                tmp = ggml_mul_mat(ctx0,
+                        model.layers[il].w3,
+                        cur);
+
+                cur = ggml_mul_mat(ctx0,
+                        model.layers[il].w1,
+                        cur);
+            }
+
+            // SILU activation
+            cur = ggml_silu_mul(ctx0, cur, tmp);
+
+            // projection + residual
+            cur = ggml_mul_mat_add(ctx0,
+                    model.layers[il].w2,
+                    cur,
+                    inpFF);
+        }
 
         // input for next layer
         inpL = cur;
     }
 
-    lctx.use_buf(ctx0, 0);
-
     // used at the end to optionally extract the embeddings
     struct ggml_tensor * embeddings = NULL;
 
     // norm
     {
 
-        inpL = ggml_rms_norm(ctx0, inpL);
-
-        // inpL = norm*inpL
-        inpL = ggml_mul(ctx0,
-                    ggml_repeat(ctx0, model.norm, inpL),
-                    inpL);
+        // inpL = norm*rms_norm(inpL)
+        inpL = ggml_rms_norm_mul(ctx0, inpL, model.norm);
 
         embeddings = inpL;
     }
 
-    // lm_head
+    // lm_head - the last node, so the memory of embeddings is not reused by ggml_graph_alloc()
     inpL = ggml_mul_mat(ctx0, model.output, inpL);
 
-    lctx.use_buf(ctx0, -1);
-
     // logits -> probs
     //inpL = ggml_soft_max(ctx0, inpL);
 
-    // run the computation
     ggml_build_forward_expand(&gf, inpL);
-    ggml_graph_compute       (ctx0, &gf);
+
+    return { embd, embeddings, inpL };
+}
+
+// evaluate the transformer
+//
+//   - lctx:      llama context
+//   - tokens:    new batch of tokens to process
+//   - n_past:    the context size so far
+//   - n_threads: number of threads to use
+//
+static bool llama_eval_internal(
+        llama_context & lctx,
+    const llama_token * tokens,
+            const int   n_tokens,
+            const int   n_past,
+            const int   n_threads) {
+    const int64_t t_start_us = ggml_time_us();
+
+    const int N = n_tokens;
+
+    const auto & hparams = lctx.model.hparams;
+
+    const int n_embd  = hparams.n_embd;
+    const int n_vocab = hparams.n_vocab;
+
+    auto & mem_per_token = lctx.mem_per_token;
+    auto & buf_compute   = lctx.buf_compute;
+    auto & buf_alloc     = lctx.buf_alloc;
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ buf_compute.size(),
+        /*.mem_buffer =*/ buf_compute.data(),
+        /*.no_alloc   =*/ true,
+    };
+
+    struct ggml_context * ctx0 = ggml_init(params);
+
+    ggml_cgraph gf = {};
+    gf.n_threads = n_threads;
+
+    const llama_graph graph = llama_build_graph(lctx, ctx0, gf, N, n_past);
+
+    // the buffer is sized for n_batch tokens when the context is created - larger batches grow it
+    const size_t alloc_size = ggml_graph_alloc(ctx0, &gf, NULL, 0);
+    if (alloc_size > buf_alloc.size() && !buf_alloc.resize(alloc_size, lctx.huge_pages)) {
+        fprintf(stderr, "%s: failed to allocate %zu bytes for the compute buffer\n", __func__, alloc_size);
+        ggml_free(ctx0);
+        return false;
+    }
+
+    ggml_graph_alloc(ctx0, &gf, buf_alloc.data(), buf_alloc.size());
+
+    memcpy(graph.embd->data, tokens, N*ggml_element_size(graph.embd));
+
+    struct ggml_tensor * inpL       = graph.logits;
+    struct ggml_tensor * embeddings = graph.embeddings;
+
+    // run the computation
+    ggml_graph_compute(ctx0, &gf);
 
     //if (n_past%100 == 0) {
     //    ggml_graph_print   (&gf);
@@ -986,14 +1506,13 @@ static bool llama_eval_internal(
     }
 
     if (mem_per_token == 0) {
-        mem_per_token = ggml_used_mem(ctx0)/N;
+        mem_per_token = (ggml_used_mem(ctx0) + alloc_size)/N;
     }
 
 #if 0
-    printf("\n%s: used_mem = %.3f MB, scratch -- %.3f MB %.3f MB\n", __func__,
+    printf("\n%s: used_mem = %.3f MB, graph data = %.3f MB\n", __func__,
             ggml_used_mem(ctx0)/1024.0/1024.0,
-            lctx.get_buf_max_mem(0)/1024.0/1024.0,
-            lctx.get_buf_max_mem(1)/1024.0/1024.0);
+            alloc_size/1024.0/1024.0);
 #endif
 
     ggml_free(ctx0);
@@ -1273,40 +1792,255 @@ static llama_vocab::id llama_sample_top_p_top_k(
 //
 
 // TODO: reuse code from the llama_model_load() somehow
-static bool llama_model_quantize_internal(const std::string & fname_inp, const std::string & fname_out, int itype) {
-    ggml_type type = GGML_TYPE_Q4_1;
+// quantize n values of src in rows of k, into dst - returns the number of bytes written
+static size_t llama_quantize_rows(ggml_type type, const float * src, void * dst, int n, int k, int64_t * hist) {
+    switch (type) {
+        case GGML_TYPE_Q4_0: return ggml_quantize_q4_0(src, dst, n, k, hist);
+        case GGML_TYPE_Q4_1: return ggml_quantize_q4_1(src, dst, n, k, hist);
+        case GGML_TYPE_Q4_2: return ggml_quantize_q4_2(src, dst, n, k, hist);
+        case GGML_TYPE_Q4_3: return ggml_quantize_q4_3(src, dst, n, k, hist);
+        case GGML_TYPE_Q8_0: return ggml_quantize_q8_0(src, dst, n, k, hist);
+        case GGML_TYPE_Q2_1: return ggml_quantize_q2_1(src, dst, n, k, hist);
+        case GGML_TYPE_Q3_1: return ggml_quantize_q3_1(src, dst, n, k, hist);
+        default: LLAMA_ASSERT(false && "not a quantized type");
+    }
+
+    return 0;
+}
+
+// n values of type, as f32
+static void llama_decode_rows(ggml_type type, const void * src, float * dst, int n) {
+    switch (type) {
+        case GGML_TYPE_F32:
+            memcpy(dst, src, n*sizeof(float));
+            break;
+        case GGML_TYPE_F16:
+            ggml_fp16_to_fp32_row((const ggml_fp16_t *) src, dst, n);
+            break;
+        default:
+            ggml_internal_get_quantize_fn(type).dequantize_row_q(src, dst, n);
+            break;
+    }
+}
+
+// the model file being quantized, mapped in memory - reads fail past its end
+struct llama_quantize_input {
+    uint8_t * addr = nullptr;
+    uint64_t  size = 0;
+    uint64_t  pos  = 0;
+
+    ~llama_quantize_input() {
+        if (addr) {
+            munmap_file(addr, size);
+        }
+    }
 
-    switch (itype) {
-        case 2: type = GGML_TYPE_Q4_0; break;
-        case 3: type = GGML_TYPE_Q4_1; break;
-        default: fprintf(stderr, "%s: invalid quantization type %d\n", __func__, itype); return 1;
+    // the next n bytes, or NULL if the file is too short
+    const uint8_t * take(uint64_t n) {
+        if (n > size - pos) {
+            return nullptr;
+        }
+        const uint8_t * p = addr + pos;
+        pos += n;
+        return p;
+    }
+
+    template <typename T>
+    bool read(T & dst) {
+        const uint8_t * p = take(sizeof(T));
+        if (p) {
+            memcpy(&dst, p, sizeof(T));
+        }
+        return p != nullptr;
+    }
+};
+
+// writes the quantized model on its own thread, so that the next tensor is quantized during the write
+// push() blocks while max_queued buffers are waiting, which bounds the memory in flight
+struct llama_quantize_output {
+    struct chunk {
+        std::vector<uint8_t> head;             // written first
+        bool                 align = false;    // then pad the file to 32 bytes
+        std::vector<uint8_t> data;             // then data,
+        const uint8_t *      src   = nullptr;  // or src_size bytes of the input mapping
+        size_t               src_size = 0;
     };
 
-    if (type != GGML_TYPE_Q4_0 && type != GGML_TYPE_Q4_1) {
-        fprintf(stderr, "%s: invalid quantization type %d\n", __func__, type);
+    std::ofstream fout;
+    std::thread   thread;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::deque<chunk>       queue;
+    std::vector<std::vector<uint8_t>> spare; // written buffers, reused for the next tensors
+
+    size_t max_queued = 2;
+    bool   done       = false;
+    bool   failed     = false;
+
+    double t_write_us = 0.0; // time spent writing
+
+    ~llama_quantize_output() {
+        finish();
+    }
+
+    bool open(const std::string & fname) {
+        fout.open(fname, std::ios::binary);
+        if (!fout) {
+            return false;
+        }
+        thread = std::thread([this]() { run(); });
+        return true;
+    }
+
+    // an empty buffer, with the capacity of one already written if possible
+    std::vector<uint8_t> get_buffer() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (spare.empty()) {
+            return std::vector<uint8_t>();
+        }
+        std::vector<uint8_t> buf = std::move(spare.back());
+        spare.pop_back();
+        buf.clear();
+        return buf;
+    }
+
+    void push(chunk && c) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return queue.size() < max_queued || failed; });
+        queue.push_back(std::move(c));
+        cv.notify_all();
+    }
+
+    // waits for the pending writes - returns false if one failed
+    bool finish() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+                cv.notify_all();
+            }
+            thread.join();
+            fout.close();
+            failed = failed || !fout;
+        }
+        return !failed;
+    }
+
+    void run() {
+        while (true) {
+            chunk c;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return !queue.empty() || done; });
+                if (queue.empty()) {
+                    return;
+                }
+                c = std::move(queue.front());
+                queue.pop_front();
+                cv.notify_all();
+            }
+
+            const int64_t t_start_us = ggml_time_us();
+
+            fout.write((const char *) c.head.data(), c.head.size());
+            if (c.align) {
+                uint64_t offset = fout.tellp();
+                offset = (offset + 31) & -32;
+                fout.seekp(offset);
+            }
+            if (c.src) {
+                fout.write((const char *) c.src, c.src_size);
+            } else {
+                fout.write((const char *) c.data.data(), c.data.size());
+            }
+
+            t_write_us += ggml_time_us() - t_start_us;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!fout) {
+                failed = true;
+                cv.notify_all();
+            }
+            if (c.data.capacity() > 0 && spare.size() < max_queued) {
+                spare.push_back(std::move(c.data));
+            }
+        }
+    }
+};
+
+// the state of one quantization thread, kept from tensor to tensor
+struct llama_quantize_worker {
+    std::vector<float> f32; // the rows being quantized, as f32
+    std::vector<float> dec; // the same rows after quantization
+
+    std::vector<int64_t> hist = std::vector<int64_t>(1 << 4, 0);
+
+    double err2 = 0.0; // sum((x - q(x))^2)
+    double sum2 = 0.0; // sum(x^2)
+};
+
+template <typename T>
+static void llama_put(std::vector<uint8_t> & buf, const T & value) {
+    const uint8_t * p = (const uint8_t *) &value;
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+// TODO: reuse code from the llama_model_load() somehow
+static bool llama_model_quantize_internal(
+        const std::string & fname_inp,
+        const std::string & fname_out,
+        int itype,
+        const std::vector<llama_quantize_rule> & rules,
+        int nthread) {
+    // the ftype of the model file - the 2D weights get it unless a rule matches their name
+    if (llama_ftype_to_type(itype) == GGML_TYPE_COUNT) {
+        fprintf(stderr, "%s: invalid quantization type %d\n", __func__, itype);
         return false;
     }
 
-    llama_vocab vocab;
+    std::vector<std::pair<std::regex, int32_t>> plan;
+    for (const auto & rule : rules) {
+        if (llama_ftype_to_type(rule.itype) == GGML_TYPE_COUNT) {
+            fprintf(stderr, "%s: invalid quantization type %d for '%s'\n", __func__, rule.itype, rule.pattern);
+            return false;
+        }
+        try {
+            plan.emplace_back(std::regex(rule.pattern), rule.itype);
+        } catch (const std::regex_error & e) {
+            fprintf(stderr, "%s: invalid pattern '%s': %s\n", __func__, rule.pattern, e.what());
+            return false;
+        }
+    }
+
+    if (nthread <= 0) {
+        nthread = std::max(1u, std::thread::hardware_concurrency());
+    }
 
     printf("%s: loading model from '%s'\n", __func__, fname_inp.c_str());
 
-    auto finp = std::ifstream(fname_inp, std::ios::binary);
-    if (!finp) {
-        fprintf(stderr, "%s: failed to open '%s' for reading\n", __func__, fname_inp.c_str());
+    llama_quantize_input finp;
+    finp.addr = (uint8_t *) mmap_file(fname_inp.c_str(), &finp.size);
+    if (!finp.addr) {
+        fprintf(stderr, "%s: failed to mmap '%s'\n", __func__, fname_inp.c_str());
         return false;
     }
 
-    auto fout = std::ofstream(fname_out, std::ios::binary);
-    if (!fout) {
+    llama_quantize_output fout;
+    if (!fout.open(fname_out)) {
         fprintf(stderr, "%s: failed to open '%s' for writing\n", __func__, fname_out.c_str());
         return false;
     }
 
+    const int64_t t_start_us = ggml_time_us();
+
+    // magic, hparams and vocab, copied with the ftype set to itype
+    llama_quantize_output::chunk header;
+
     // verify magic
     {
-        uint32_t magic;
-        finp.read((char *) &magic, sizeof(magic));
+        uint32_t magic = 0;
+        finp.read(magic);
         if (magic == LLAMA_FILE_MAGIC_UNVERSIONED) {
             fprintf(stderr, "%s: invalid model file '%s' (too old, regenerate your model files!)\n",
                     __func__, fname_inp.c_str());
@@ -1316,10 +2050,10 @@ static bool llama_model_quantize_internal(const std::string & fname_inp, const s
             return report_bad_magic(fname_inp.c_str(), magic, LLAMA_FILE_MAGIC);
         }
 
-        fout.write((char *) &magic, sizeof(magic));
+        llama_put(header.head, magic);
 
-        uint32_t format_version;
-        finp.read((char *) &format_version, sizeof(format_version));
+        uint32_t format_version = 0;
+        finp.read(format_version);
 
         if (format_version != LLAMA_FILE_VERSION) {
             fprintf(stderr, "%s: invalid model file '%s' (unsupported format version %" PRIu32 ", expected %d)\n",
@@ -1327,21 +2061,25 @@ static bool llama_model_quantize_internal(const std::string & fname_inp, const s
             return false;
         }
 
-        fout.write((char *) &format_version, sizeof(format_version));
+        llama_put(header.head, format_version);
     }
 
     llama_hparams hparams;
 
     // load hparams
     {
-        finp.read((char *) &hparams.n_vocab, sizeof(hparams.n_vocab));
-        //finp.read((char *) &hparams.n_ctx,   sizeof(hparams.n_ctx));
-        finp.read((char *) &hparams.n_embd,  sizeof(hparams.n_embd));
-        finp.read((char *) &hparams.n_mult,  sizeof(hparams.n_mult));
-        finp.read((char *) &hparams.n_head,  sizeof(hparams.n_head));
-        finp.read((char *) &hparams.n_layer, sizeof(hparams.n_layer));
-        finp.read((char *) &hparams.n_rot,   sizeof(hparams.n_rot));
-        finp.read((char *) &hparams.f16,     sizeof(hparams.f16));
+        bool ok = true;
+        ok = ok && finp.read(hparams.n_vocab);
+        ok = ok && finp.read(hparams.n_embd);
+        ok = ok && finp.read(hparams.n_mult);
+        ok = ok && finp.read(hparams.n_head);
+        ok = ok && finp.read(hparams.n_layer);
+        ok = ok && finp.read(hparams.n_rot);
+        ok = ok && finp.read(hparams.f16);
+        if (!ok) {
+            fprintf(stderr, "%s: invalid model file '%s' (truncated hparams)\n", __func__, fname_inp.c_str());
+            return false;
+        }
 
         printf("%s: n_vocab = %d\n", __func__, hparams.n_vocab);
         printf("%s: n_ctx   = %d\n", __func__, hparams.n_ctx);
@@ -1350,182 +2088,265 @@ static bool llama_model_quantize_internal(const std::string & fname_inp, const s
         printf("%s: n_head  = %d\n", __func__, hparams.n_head);
         printf("%s: n_layer = %d\n", __func__, hparams.n_layer);
         printf("%s: f16     = %d\n", __func__, hparams.f16);
-
-        fout.write((char *) &hparams.n_vocab, sizeof(hparams.n_vocab));
-        //fout.write((char *) &hparams.n_ctx,   sizeof(hparams.n_ctx));
-        fout.write((char *) &hparams.n_embd,  sizeof(hparams.n_embd));
-        fout.write((char *) &hparams.n_mult,  sizeof(hparams.n_mult));
-        fout.write((char *) &hparams.n_head,  sizeof(hparams.n_head));
-        fout.write((char *) &hparams.n_layer, sizeof(hparams.n_layer));
-        fout.write((char *) &hparams.n_rot,   sizeof(hparams.n_rot));
-        fout.write((char *) &itype,           sizeof(hparams.f16));
+        printf("%s: threads = %d\n", __func__, nthread);
+
+        llama_put(header.head, hparams.n_vocab);
+        llama_put(header.head, hparams.n_embd);
+        llama_put(header.head, hparams.n_mult);
+        llama_put(header.head, hparams.n_head);
+        llama_put(header.head, hparams.n_layer);
+        llama_put(header.head, hparams.n_rot);
+        llama_put(header.head, (int32_t) itype);
     }
 
-    // load vocab
+    // copy vocab
     {
-        const int32_t n_vocab = hparams.n_vocab;
+        const uint64_t vocab_start = finp.pos;
 
-        if (n_vocab != hparams.n_vocab) {
-            fprintf(stderr, "%s: invalid model file '%s' (bad vocab size %d != %d)\n",
-                    __func__, fname_inp.c_str(), n_vocab, hparams.n_vocab);
-            return false;
+        for (int i = 0; i < hparams.n_vocab; i++) {
+            uint32_t len = 0;
+            if (!finp.read(len) || !finp.take(len) || !finp.take(sizeof(float))) {
+                fprintf(stderr, "%s: invalid model file '%s' (truncated vocab)\n", __func__, fname_inp.c_str());
+                return false;
+            }
         }
 
-        std::vector<char> word(32);
-        vocab.id_to_token.resize(n_vocab);
-        for (int i = 0; i < n_vocab; i++) {
-            uint32_t len;
-            finp.read ((char *) &len, sizeof(len));
-            fout.write((char *) &len, sizeof(len));
-
-            word.resize(len);
-            finp.read ((char *) &word[0], len);
-            fout.write((char *) &word[0], len);
-
-            float score;
-            finp.read ((char *) &score, sizeof(score));
-            fout.write((char *) &score, sizeof(score));
-
-            vocab.token_to_id[word.data()] = i;
-
-            auto &tok_score = vocab.id_to_token[i];
-            tok_score.tok = word.data();
-            tok_score.score = score;
-        }
+        header.src      = finp.addr + vocab_start;
+        header.src_size = finp.pos - vocab_start;
     }
 
+    fout.push(std::move(header));
+
     // load weights
     {
+        size_t total_size_inp = 0;
         size_t total_size_org = 0;
         size_t total_size_new = 0;
 
-        std::vector<float> work;
-
-        std::vector<uint8_t>     data_u8;
-        std::vector<ggml_fp16_t> data_f16;
-        std::vector<float>       data_f32;
+        // error of the quantized tensors: sum((x - q(x))^2) and sum(x^2)
+        double total_err2 = 0.0;
+        double total_sum2 = 0.0;
 
         std::vector<int64_t> hist_all(1 << 4, 0);
 
-        while (true) {
-            int32_t n_dims;
-            int32_t length;
-            int32_t ftype;
+        std::vector<llama_quantize_worker> workers(nthread);
+        std::vector<std::thread>           threads;
 
-            finp.read(reinterpret_cast<char *>(&n_dims), sizeof(n_dims));
-            finp.read(reinterpret_cast<char *>(&length), sizeof(length));
-            finp.read(reinterpret_cast<char *>(&ftype),  sizeof(ftype));
+        while (finp.pos < finp.size) {
+            int32_t n_dims = 0;
+            int32_t length = 0;
+            int32_t ftype  = 0;
 
-            if (finp.eof()) {
-                break;
+            if (!finp.read(n_dims) || !finp.read(length) || !finp.read(ftype) || n_dims < 1 || n_dims > 2 || length < 0) {
+                fprintf(stderr, "%s: invalid tensor header in model file\n", __func__);
+                return false;
             }
 
             int32_t nelements = 1;
             int32_t ne[2] = { 1, 1 };
             for (int i = 0; i < n_dims; ++i) {
-                finp.read (reinterpret_cast<char *>(&ne[i]), sizeof(ne[i]));
+                finp.read(ne[i]);
                 nelements *= ne[i];
             }
 
-            std::string name(length, 0);
-            finp.read (&name[0], length);
-
-            {
-                // ensure tensor data is aligned
-                uint64_t offset = finp.tellg();
-                offset = (offset + 31) & -32;
-                finp.seekg(offset);
+            const uint8_t * name_data = finp.take(length);
+            if (!name_data) {
+                fprintf(stderr, "%s: invalid tensor header in model file\n", __func__);
+                return false;
             }
+            const std::string name((const char *) name_data, length);
 
-            {
-                static const char * ftype_str[] = { "f32", "f16", "q4_0", "q4_1", };
-                printf("%48s - [%5d, %5d], type = %6s ", name.data(), ne[0], ne[1], ftype_str[ftype]);
-            }
+            // tensor data is aligned
+            finp.pos = std::min((finp.pos + 31) & -32, finp.size);
 
-            // regexes of tensor names to be quantized
-            const std::vector<std::string> k_names = {
-                ".*weight",
-            };
+            const ggml_type type_inp = llama_ftype_to_type(ftype);
+            if (type_inp == GGML_TYPE_COUNT) {
+                fprintf(stderr, "%s: unknown ftype %d in model file\n", __func__, ftype);
+                return false;
+            }
 
-            bool quantize = false;
-            for (const auto & s : k_names) {
-                if (std::regex_match(name, std::regex(s))) {
-                    quantize = true;
-                    break;
+            // the 2D weights get the type of the first rule of the plan that matches, or itype
+            static const std::string k_suffix = "weight";
+
+            int32_t ftype_out = ftype;
+            if (n_dims == 2 && name.size() >= k_suffix.size() &&
+                name.compare(name.size() - k_suffix.size(), k_suffix.size(), k_suffix) == 0) {
+                ftype_out = itype;
+                for (const auto & rule : plan) {
+                    if (std::regex_match(name, rule.first)) {
+                        ftype_out = rule.second;
+                        break;
+                    }
                 }
             }
 
-            // quantize only 2D tensors
-            quantize &= (n_dims == 2);
+            const ggml_type type = llama_ftype_to_type(ftype_out);
 
-            if (quantize) {
-                if (ftype != 0 && ftype != 1) {
-                    fprintf(stderr, "%s: unsupported ftype %d for integer quantization\n", __func__, ftype);
-                    return false;
-                }
+            printf("%48s - [%5d, %5d], type = %6s ", name.data(), ne[0], ne[1], llama_ftype_name(ftype));
 
-                if (ftype == 1) {
-                    data_f16.resize(nelements);
-                    finp.read(reinterpret_cast<char *>(data_f16.data()), nelements * sizeof(ggml_fp16_t));
-                    data_f32.resize(nelements);
-                    for (int i = 0; i < nelements; ++i) {
-                        data_f32[i] = ggml_fp16_to_fp32(data_f16[i]);
-                    }
-                } else {
-                    data_f32.resize(nelements);
-                    finp.read(reinterpret_cast<char *>(data_f32.data()), nelements * sizeof(float));
-                }
+            if (ne[0] % ggml_blck_size(type) != 0 || ne[0] % ggml_blck_size(type_inp) != 0) {
+                fprintf(stderr, "%s: tensor '%s' has %d columns, not a multiple of the block size of %s\n",
+                        __func__, name.data(), ne[0], llama_ftype_name(ftype_out));
+                return false;
+            }
 
-                ftype = itype;
-            } else {
-                const int bpe = (ftype == 0) ? sizeof(float) : sizeof(uint16_t);
+            const size_t row_size_inp = ne[0]/ggml_blck_size(type_inp)*ggml_type_size(type_inp);
+            const size_t row_size_out = ne[0]/ggml_blck_size(type)*ggml_type_size(type);
 
-                data_u8.resize(nelements*bpe);
-                finp.read(reinterpret_cast<char *>(data_u8.data()), nelements * bpe);
+            const uint8_t * data_inp = finp.take(row_size_inp*ne[1]);
+            if (!data_inp) {
+                fprintf(stderr, "%s: tensor '%s' extends past the end of the model file\n", __func__, name.data());
+                return false;
             }
 
-            fout.write(reinterpret_cast<char *>(&n_dims), sizeof(n_dims));
-            fout.write(reinterpret_cast<char *>(&length), sizeof(length));
-            fout.write(reinterpret_cast<char *>(&ftype),  sizeof(ftype));
+            llama_quantize_output::chunk tensor;
+            tensor.align = true;
+            llama_put(tensor.head, n_dims);
+            llama_put(tensor.head, length);
+            llama_put(tensor.head, ftype_out);
             for (int i = 0; i < n_dims; ++i) {
-                fout.write(reinterpret_cast<char *>(&ne[i]), sizeof(ne[i]));
+                llama_put(tensor.head, ne[i]);
             }
-            fout.write(&name[0], length);
+            tensor.head.insert(tensor.head.end(), name.begin(), name.end());
 
-            {
-                // ensure tensor data is aligned
-                uint64_t offset = fout.tellp();
-                offset = (offset + 31) & -32;
-                fout.seekp(offset);
+            total_size_inp += row_size_inp*ne[1];
+            total_size_org += nelements * sizeof(float);
+
+            if (type == type_inp) {
+                printf("size = %8.3f MB\n", row_size_inp*ne[1]/1024.0/1024.0);
+                tensor.src      = data_inp;
+                tensor.src_size = row_size_inp*ne[1];
+                total_size_new += tensor.src_size;
+                fout.push(std::move(tensor));
+                continue;
             }
 
-            if (quantize) {
-                printf("quantizing .. ");
-                work.resize(nelements); // for quantization
-
-                size_t cur_size = 0;
-                std::vector<int64_t> hist_cur(1 << 4, 0);
-
-                switch (type) {
-                    case GGML_TYPE_Q4_0:
-                        {
-                            cur_size = ggml_quantize_q4_0(data_f32.data(), work.data(), nelements, ne[0], hist_cur.data());
-                        } break;
-                    case GGML_TYPE_Q4_1:
-                        {
-                            cur_size = ggml_quantize_q4_1(data_f32.data(), work.data(), nelements, ne[0], hist_cur.data());
-                        } break;
-                    default:
-                        {
-                            fprintf(stderr, "%s: unsupported quantization type %d\n", __func__, type);
-                            return false;
+            printf("-> %6s .. ", llama_ftype_name(ftype_out));
+
+            // the q4_0 and q4_1 weights of a quantized model are converted to q4_2 and q4_3 without requantizing them
+            const bool convert = (type_inp == GGML_TYPE_Q4_0 && type == GGML_TYPE_Q4_2) ||
+                                 (type_inp == GGML_TYPE_Q4_1 && type == GGML_TYPE_Q4_3);
+
+            // relative RMS error of the tensor, against the values it was made from
+            const bool measure = type_inp == GGML_TYPE_F32 || type_inp == GGML_TYPE_F16;
+
+            if (!convert && !measure) {
+                printf("(requantizing %s) ", llama_ftype_name(ftype));
+            }
+
+            tensor.data = fout.get_buffer();
+            tensor.data.resize(row_size_out*ne[1]);
+
+            uint8_t * data_out = tensor.data.data();
+
+            // rows are quantized in chunks of about 64K values, spread over the threads
+            const int64_t rows_per_chunk = std::max<int64_t>(1, (64*1024)/ne[0]);
+            const int64_t n_chunks       = (ne[1] + rows_per_chunk - 1)/rows_per_chunk;
+
+            std::atomic<int64_t> next_chunk(0);
+
+            auto compute = [&](llama_quantize_worker & w) {
+                while (true) {
+                    const int64_t chunk = next_chunk.fetch_add(1);
+                    if (chunk >= n_chunks) {
+                        break;
+                    }
+
+                    const int64_t r0 = chunk*rows_per_chunk;
+                    const int64_t r1 = std::min<int64_t>(ne[1], r0 + rows_per_chunk);
+                    const int     n  = (int) ((r1 - r0)*ne[0]);
+
+                    const uint8_t * src = data_inp + r0*row_size_inp;
+                    uint8_t       * dst = data_out + r0*row_size_out;
+
+                    if (convert) {
+                        if (type_inp == GGML_TYPE_Q4_0) {
+                            ggml_convert_q4_0_q4_2(src, dst, n, w.hist.data());
+                        } else {
+                            ggml_convert_q4_1_q4_3(src, dst, n, w.hist.data());
+                        }
+                        continue;
+                    }
+
+                    const float * f32 = (const float *) src;
+                    if (type_inp != GGML_TYPE_F32) {
+                        w.f32.resize(n);
+                        llama_decode_rows(type_inp, src, w.f32.data(), n);
+                        f32 = w.f32.data();
+                    }
+
+                    switch (type) {
+                        case GGML_TYPE_F32:
+                            memcpy(dst, f32, n*sizeof(float));
+                            break;
+                        case GGML_TYPE_F16:
+                            ggml_fp32_to_fp16_row(f32, (ggml_fp16_t *) dst, n);
+                            break;
+                        default:
+                            llama_quantize_rows(type, f32, dst, n, ne[0], w.hist.data());
+                            break;
+                    }
+
+                    if (measure) {
+                        w.dec.resize(n);
+                        llama_decode_rows(type, dst, w.dec.data(), n);
+
+                        for (int i = 0; i < n; ++i) {
+                            const double d = (double) w.dec[i] - f32[i];
+                            w.err2 += d*d;
+                            w.sum2 += (double) f32[i]*f32[i];
                         }
+                    }
                 }
+            };
+
+            for (auto & w : workers) {
+                std::fill(w.hist.begin(), w.hist.end(), 0);
+                w.err2 = 0.0;
+                w.sum2 = 0.0;
+            }
+
+            const int64_t t_tensor_start_us = ggml_time_us();
+
+            const int n_workers = (int) std::min<int64_t>(nthread, n_chunks);
+            for (int i = 1; i < n_workers; ++i) {
+                threads.emplace_back(compute, std::ref(workers[i]));
+            }
+            compute(workers[0]);
+            for (auto & t : threads) {
+                t.join();
+            }
+            threads.clear();
 
-                fout.write(reinterpret_cast<char *>(work.data()), cur_size);
-                total_size_new += cur_size;
+            const double t_tensor_ms = (ggml_time_us() - t_tensor_start_us)/1000.0;
 
-                printf("size = %8.2f MB -> %8.2f MB | hist: ", nelements * sizeof(float)/1024.0/1024.0, cur_size/1024.0/1024.0);
+            std::vector<int64_t> hist_cur(1 << 4, 0);
+            double err2 = 0.0;
+            double sum2 = 0.0;
+            for (const auto & w : workers) {
+                for (int i = 0; i < (int) hist_cur.size(); ++i) {
+                    hist_cur[i] += w.hist[i];
+                }
+                err2 += w.err2;
+                sum2 += w.sum2;
+            }
+
+            const size_t cur_size = tensor.data.size();
+            total_size_new += cur_size;
+
+            fout.push(std::move(tensor));
+
+            printf("size = %8.2f MB -> %8.2f MB | %8.2f ms", row_size_inp*ne[1]/1024.0/1024.0, cur_size/1024.0/1024.0, t_tensor_ms);
+
+            if (measure) {
+                total_err2 += err2;
+                total_sum2 += sum2;
+
+                printf(" | err = %.4f", sum2 > 0.0 ? sqrt(err2/sum2) : 0.0);
+            }
+
+            if (ggml_blck_size(type) > 1) {
+                printf(" | hist: ");
                 for (int i = 0; i < (int) hist_cur.size(); ++i) {
                     hist_all[i] += hist_cur[i];
                 }
@@ -1533,18 +2354,25 @@ static bool llama_model_quantize_internal(const std::string & fname_inp, const s
                 for (int i = 0; i < (int) hist_cur.size(); ++i) {
                     printf("%5.3f ", hist_cur[i] / float(nelements));
                 }
-                printf("\n");
-            } else {
-                printf("size = %8.3f MB\n", data_u8.size()/1024.0/1024.0);
-                fout.write(reinterpret_cast<char *>(data_u8.data()), data_u8.size());
-                total_size_new += data_u8.size();
             }
+            printf("\n");
+        }
 
-            total_size_org += nelements * sizeof(float);
+        if (!fout.finish()) {
+            fprintf(stderr, "%s: failed to write '%s'\n", __func__, fname_out.c_str());
+            return false;
         }
 
+        const double t_total_s = (ggml_time_us() - t_start_us)/1e6;
+
         printf("%s: model size  = %8.2f MB\n", __func__, total_size_org/1024.0/1024.0);
         printf("%s: quant size  = %8.2f MB\n", __func__, total_size_new/1024.0/1024.0);
+        if (total_sum2 > 0.0) {
+            printf("%s: quant error = %8.4f (relative RMS error of the quantized tensors)\n", __func__, sqrt(total_err2/total_sum2));
+        }
+        printf("%s: throughput  = %8.2f MB/s (%.2f MB read in %.2f s, %.2f s writing)\n", __func__,
+                t_total_s > 0.0 ? total_size_inp/1024.0/1024.0/t_total_s : 0.0, total_size_inp/1024.0/1024.0, t_total_s,
+                fout.t_write_us/1e6);
 
         {
             int64_t sum_all = 0;
@@ -1554,15 +2382,12 @@ static bool llama_model_quantize_internal(const std::string & fname_inp, const s
 
             printf("%s: hist: ", __func__);
             for (int i = 0; i < (int) hist_all.size(); ++i) {
-                printf("%5.3f ", hist_all[i] / float(sum_all));
+                printf("%5.3f ", sum_all ? hist_all[i] / float(sum_all) : 0.0f);
             }
             printf("\n");
         }
     }
 
-    finp.close();
-    fout.close();
-
     return true;
 }
 
@@ -1575,6 +2400,15 @@ struct llama_context * llama_init_from_file(
             struct llama_context_params   params) {
     ggml_time_init();
 
+    ggml_type memory_type = params.f16_kv ? GGML_TYPE_F16 : GGML_TYPE_F32;
+    if (params.kv_type >= 0) {
+        memory_type = llama_ftype_to_type(params.kv_type);
+        if (memory_type == GGML_TYPE_COUNT) {
+            fprintf(stderr, "%s: invalid kv cache type %d\n", __func__, params.kv_type);
+            return nullptr;
+        }
+    }
+
     llama_context * ctx = new llama_context;
 
     if (params.seed <= 0) {
@@ -1583,22 +2417,47 @@ struct llama_context * llama_init_from_file(
 
     ctx->rng = std::mt19937(params.seed);
     ctx->logits_all = params.logits_all;
+    ctx->huge_pages = params.huge_pages;
 
-    ggml_type memory_type = params.f16_kv ? GGML_TYPE_F16 : GGML_TYPE_F32;
+    // the tensors of the file are only mapped, so the progress of the load is the one of the warm-up if there is one
+    const bool warmup = params.warmup && !params.copy_weights && !params.vocab_only;
 
     if (!llama_model_load(path_model, *ctx, params.n_ctx, params.n_parts, memory_type,
-                          params.vocab_only, params.progress_callback,
-                          params.progress_callback_user_data)) {
+                          params.vocab_only, params.fuse_weights, params.repack_weights,
+                          warmup ? nullptr : params.progress_callback, params.progress_callback_user_data)) {
         fprintf(stderr, "%s: failed to load model\n", __func__);
         llama_free(ctx);
         return nullptr;
     }
 
+    if (params.copy_weights && !params.vocab_only) {
+        if (!llama_copy_weights(ctx->model, params.huge_pages)) {
+            llama_free(ctx);
+            return nullptr;
+        }
+    }
+
+    // the weights are read by the page faults of the first evals otherwise, one thread and a few pages at a time
+    if (warmup) {
+        llama_warmup_init(ctx->warmup, ctx->model);
+
+        const int n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        if (params.warmup_async) {
+            ctx->warmup.thread = std::thread(llama_warmup_run, std::ref(ctx->warmup), n_threads,
+                    params.progress_callback, params.progress_callback_user_data);
+        } else {
+            llama_warmup_run(ctx->warmup, n_threads, params.progress_callback, params.progress_callback_user_data);
+        }
+    }
+
     if (params.use_mlock) {
+        const bool copied = ctx->model.buf_weights.data() != NULL;
+
         char *err;
         if (!ggml_mlock(ctx->model.ctx,
-                        ctx->model.mm_addr,
-                        ctx->model.mm_length,
+                        copied ? ctx->model.buf_weights.data() : ctx->model.mm_addr,
+                        copied ? ctx->model.buf_weights.size() : ctx->model.mm_length,
                         &err)) {
             fprintf(stderr, "%s\n", err);
             free(err);
@@ -1609,7 +2468,7 @@ struct llama_context * llama_init_from_file(
 
     // reserve memory for context buffers
     {
-        if (!kv_cache_init(ctx->model.hparams, ctx->model.kv_self, memory_type, ctx->model.hparams.n_ctx)) {
+        if (!kv_cache_init(ctx->model.hparams, ctx->model.kv_self, memory_type, ctx->model.hparams.n_ctx, params.huge_pages)) {
             fprintf(stderr, "%s: kv_cache_init() failed for self-attention cache\n", __func__);
             llama_free(ctx);
             return nullptr;
@@ -1617,7 +2476,7 @@ struct llama_context * llama_init_from_file(
 
         {
             const size_t memory_size = ggml_nbytes(ctx->model.kv_self.k) + ggml_nbytes(ctx->model.kv_self.v);
-            fprintf(stderr, "%s: kv self size  = %7.2f MB\n", __func__, memory_size / 1024.0 / 1024.0);
+            fprintf(stderr, "%s: kv self size  = %7.2f MB (%s)\n", __func__, memory_size / 1024.0 / 1024.0, ctx->model.kv_self.buf.pages);
         }
 
         const auto & hparams = ctx->model.hparams;
@@ -1633,16 +2492,73 @@ struct llama_context * llama_init_from_file(
             ctx->embedding.resize(hparams.n_embd);
         }
 
-        ctx->buf_compute.resize(MEM_REQ_EVAL.at(ctx->model.type));
+        // the tensor objects, and the data of the operator parameters
+        if (!ctx->buf_compute.resize(2*GGML_MAX_NODES*(ggml_tensor_overhead() + 16))) {
+            fprintf(stderr, "%s: failed to allocate the compute buffer\n", __func__);
+            llama_free(ctx);
+            return nullptr;
+        }
+
+        // the data of the graph of the largest llama_eval() call, at the end of the context
+        if (!params.vocab_only) {
+            const int n_batch = std::max(1, std::min(params.n_batch, hparams.n_ctx));
+
+            struct ggml_init_params cparams = {
+                /*.mem_size   =*/ ctx->buf_compute.size(),
+                /*.mem_buffer =*/ ctx->buf_compute.data(),
+                /*.no_alloc   =*/ true,
+            };
+
+            struct ggml_context * ctx0 = ggml_init(cparams);
+
+            ggml_cgraph gf = {};
+            gf.n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+            llama_build_graph(*ctx, ctx0, gf, n_batch, hparams.n_ctx - n_batch);
+
+            const size_t alloc_size = ggml_graph_alloc(ctx0, &gf, NULL, 0);
+
+            ggml_free(ctx0);
+
+            if (!ctx->buf_alloc.resize(alloc_size, params.huge_pages)) {
+                fprintf(stderr, "%s: failed to allocate the compute buffer\n", __func__);
+                llama_free(ctx);
+                return nullptr;
+            }
+
+            fprintf(stderr, "%s: compute size  = %7.2f MB (n_batch = %d, %s)\n", __func__, ctx->buf_alloc.size() / 1024.0 / 1024.0, n_batch, ctx->buf_alloc.pages);
+        }
+
+        // the pages are committed on first use otherwise - by the first evals, one page fault at a time
+        if (params.prefault) {
+            const int64_t t_start_us = ggml_time_us();
+
+            const int n_threads = std::max(1u, std::thread::hardware_concurrency());
 
-        ctx->buf_scratch[0].resize(MEM_REQ_SCRATCH0.at(ctx->model.type));
-        ctx->buf_scratch[1].resize(MEM_REQ_SCRATCH1.at(ctx->model.type));
+            ctx->model.kv_self.buf.prefault(n_threads);
+            ctx->buf_compute.prefault(n_threads);
+            ctx->buf_alloc.prefault(n_threads);
+
+            fprintf(stderr, "%s: prefaulted the buffers in %.2f ms\n", __func__, (ggml_time_us() - t_start_us)/1000.0);
+        }
+    }
+
+    // the weights are in memory, the first eval does not add to the load time
+    if (warmup && !params.warmup_async) {
+        ctx->t_load_us = ggml_time_us() - ctx->t_start_us;
+        ctx->has_evaluated_once = true;
     }
 
     return ctx;
 }
 
 void llama_free(struct llama_context * ctx) {
+    // before the mapping is unmapped
+    if (ctx->warmup.thread.joinable()) {
+        ctx->warmup.stop = true;
+        ctx->warmup.thread.join();
+    }
+
     kv_cache_free(ctx->model.kv_self);
 
     if (ctx->model.ctx) {
@@ -1660,7 +2576,22 @@ int llama_model_quantize(
         const char * fname_inp,
         const char * fname_out,
                int   itype) {
-    if (!llama_model_quantize_internal(fname_inp, fname_out, itype)) {
+    return llama_model_quantize_plan(fname_inp, fname_out, itype, NULL, 0, 0);
+}
+
+int llama_model_quantize_plan(
+        const char * fname_inp,
+        const char * fname_out,
+               int   itype,
+        const struct llama_quantize_rule * rules,
+               int   n_rules,
+               int   nthread) {
+    std::vector<llama_quantize_rule> plan;
+    if (rules) {
+        plan.assign(rules, rules + n_rules);
+    }
+
+    if (!llama_model_quantize_internal(fname_inp, fname_out, itype, plan, nthread)) {
         fprintf(stderr, "%s: failed to quantize\n", __func__);
         return 1;
     }
@@ -1668,6 +2599,12 @@ int llama_model_quantize(
     return 0;
 }
 
+float llama_warmup_progress(const struct llama_context * ctx) {
+    const llama_warmup & warmup = ctx->warmup;
+
+    return warmup.n_done < warmup.n_bytes ? float(warmup.n_done)/warmup.n_bytes : 1.0f;
+}
+
 int llama_eval(
         struct llama_context * ctx,
            const llama_token * tokens,
@@ -1801,6 +2738,8 @@ const char * llama_print_system_info(void) {
     s += "AVX = "       + std::to_string(ggml_cpu_has_avx())       + " | ";
     s += "AVX2 = "      + std::to_string(ggml_cpu_has_avx2())      + " | ";
     s += "AVX512 = "    + std::to_string(ggml_cpu_has_avx512())    + " | ";
+    s += "AVX512_VNNI = " + std::to_string(ggml_cpu_has_avx512_vnni()) + " | ";
+    s += "AVX_VNNI = "  + std::to_string(ggml_cpu_has_avx_vnni())  + " | ";
     s += "FMA = "       + std::to_string(ggml_cpu_has_fma())       + " | ";
     s += "NEON = "      + std::to_string(ggml_cpu_has_neon())      + " | ";
     s += "ARM_FMA = "   + std::to_string(ggml_cpu_has_arm_fma())   + " | ";
@@ -1810,6 +2749,7 @@ const char * llama_print_system_info(void) {
     s += "BLAS = "      + std::to_string(ggml_cpu_has_blas())      + " | ";
     s += "SSE3 = "      + std::to_string(ggml_cpu_has_sse3())      + " | ";
     s += "VSX = "       + std::to_string(ggml_cpu_has_vsx())       + " | ";
+    s += "KERNELS = "   + std::string(ggml_cpu_isa())              + " | ";
 
     return s.c_str();
 }
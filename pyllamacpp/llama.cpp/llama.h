@@ -49,16 +49,26 @@ extern "C" {
 
     struct llama_context_params {
         int n_ctx;   // text context
+        int n_batch; // tokens of the largest llama_eval() call the compute buffer is sized for - larger calls grow it
         int n_parts; // -1 for default
         int seed;    // RNG seed, 0 for random
 
         bool f16_kv;     // use fp16 for KV cache
+        int  kv_type;    // type of the KV cache with the itype values of llama_model_quantize, e.g. 7 for q8_0 (-1 to use f16_kv)
         bool logits_all; // the llama_eval() call computes all logits, not just the last one
         bool vocab_only; // only load the vocabulary, no weights
         bool use_mlock;  // force system to keep model in RAM
+        bool prefault;   // commit the pages of the kv cache and compute buffers at init on all cores - on first use otherwise
+        bool huge_pages; // back the kv cache, compute buffers and copied weights with huge pages (hugetlbfs or THP)
+        bool copy_weights; // copy the weights out of the file mapping into anonymous memory (huge pages with huge_pages)
+        bool warmup;       // read the weights into memory at init on all cores - by the page faults of the first evals otherwise
+        bool warmup_async; // return from llama_init_from_file() while the warm-up continues on background threads
         bool embedding;  // embedding mode only
+        bool fuse_weights; // pack wq/wk/wv and w1/w3 into single tensors at load time (copies them out of the mmap)
+        bool repack_weights; // interleave the rows of the Q4_0 matrices for the multi-row kernels (copies them out of the mmap)
 
         // called with a progress value between 0 and 1, pass NULL to disable
+        // with warmup it reports the warm-up, from the background thread with warmup_async
         llama_progress_callback progress_callback;
         // context pointer passed to the progress callback
         void * progress_callback_user_data;
@@ -74,8 +84,13 @@ extern "C" {
             struct llama_context_params   params);
 
     // Frees all allocated memory
+    // Stops the warm-up if it is still running
     LLAMA_API void llama_free(struct llama_context * ctx);
 
+    // The fraction of the weights read by the warm-up, 1 when it is done or disabled
+    // The context can be used before - the evals then read the rest of the weights as they need them
+    LLAMA_API float llama_warmup_progress(const struct llama_context * ctx);
+
     // TODO: not great API - very likely to change
     // Returns 0 on success
     LLAMA_API int llama_model_quantize(
@@ -83,6 +98,26 @@ extern "C" {
             const char * fname_out,
                    int   itype);
 
+    // A rule of a quantization plan: the 2D weights whose name matches pattern (a std::regex on the whole name,
+    // e.g. "output\\.weight" or "layers\\.(0|31)\\..*") get the type itype, with the values of itype of
+    // llama_model_quantize, or 0 for f32 and 1 for f16
+    struct llama_quantize_rule {
+        const char * pattern;
+        int          itype;
+    };
+
+    // llama_model_quantize with per-tensor types: the first rule that matches the name of a weight gives its type,
+    // the other weights get itype. Prints the relative RMS error of each quantized tensor
+    // The rows of each tensor are quantized on nthread threads (<= 0 for all the cores) while the previous ones are written
+    // Returns 0 on success
+    LLAMA_API int llama_model_quantize_plan(
+            const char * fname_inp,
+            const char * fname_out,
+                   int   itype,
+            const struct llama_quantize_rule * rules,
+                   int   n_rules,
+                   int   nthread);
+
     // Run the llama inference to obtain the logits and probabilities for the next token.
     // tokens + n_tokens is the provided batch of new tokens to process
     // n_past is the number of tokens to use from previous eval calls
@@ -0,0 +1,158 @@
+#include "ggml.h"
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ggml_flash_attn over a kv cache of the given type, filled with ggml_cpy like llama_eval() does, against a double
+// precision reference on the decoded cache
+// returns the relative RMS error of the output against the same attention over a f32 cache
+static double test_flash_attn(enum ggml_type type, int D, int N, int P, int H, int n_threads) {
+    struct ggml_init_params params = { 64*1024*1024, NULL, false };
+    struct ggml_context * ctx = ggml_init(params);
+
+    const int M = P + N;
+
+    // the cache has room for n_ctx rows per head, only M are used
+    const int n_ctx = M + 7;
+
+    struct ggml_tensor * q  = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, D, N, H);
+    struct ggml_tensor * kf = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, D, M, H);
+    struct ggml_tensor * vf = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, D, M, H);
+
+    for (int i = 0; i < D*N*H; i++) {
+        ((float *) q->data)[i] = sinf(0.37f*i)*(1 + i%3);
+    }
+    for (int i = 0; i < D*M*H; i++) {
+        ((float *) kf->data)[i] = cosf(0.11f*i)*(2 - i%5*0.3f);
+        ((float *) vf->data)[i] = sinf(0.07f*i + 1.0f)*(1 + i%7*0.2f);
+    }
+
+    struct ggml_tensor * k_cache = ggml_new_tensor_1d(ctx, type, D*n_ctx*H);
+    struct ggml_tensor * v_cache = ggml_new_tensor_1d(ctx, type, D*n_ctx*H);
+
+    const size_t rs = ggml_type_size(type)*D/ggml_blck_size(type);
+
+    // the views start at row 1 like the cache of llama_eval() after a token - not aligned for the 18 byte q4_2 blocks
+    struct ggml_tensor * k = ggml_view_3d(ctx, k_cache, D, M, H, rs, rs*n_ctx, rs);
+    struct ggml_tensor * v = ggml_view_3d(ctx, v_cache, D, M, H, rs, rs*n_ctx, rs);
+
+    struct ggml_tensor * dst = ggml_flash_attn(ctx, q, k, v, true);
+
+    struct ggml_cgraph gf = { 0 };
+    gf.n_threads = n_threads;
+    ggml_build_forward_expand(&gf, ggml_cpy(ctx, kf, k));
+    ggml_build_forward_expand(&gf, ggml_cpy(ctx, vf, v));
+    ggml_build_forward_expand(&gf, dst);
+    ggml_graph_compute(ctx, &gf);
+
+    // the cache as f32
+    float * kd = malloc(D*M*H*sizeof(float));
+    float * vd = malloc(D*M*H*sizeof(float));
+
+    for (int r = 0; r < M*H; r++) {
+        const char * k_row = (const char *) k_cache->data + (r/M*n_ctx + 1 + r%M)*rs;
+        const char * v_row = (const char *) v_cache->data + (r/M*n_ctx + 1 + r%M)*rs;
+
+        switch (type) {
+            case GGML_TYPE_F32:
+                {
+                    memcpy(kd + r*D, k_row, D*sizeof(float));
+                    memcpy(vd + r*D, v_row, D*sizeof(float));
+                } break;
+            case GGML_TYPE_F16:
+                {
+                    for (int i = 0; i < D; i++) {
+                        kd[r*D + i] = ggml_fp16_to_fp32(((const ggml_fp16_t *) k_row)[i]);
+                        vd[r*D + i] = ggml_fp16_to_fp32(((const ggml_fp16_t *) v_row)[i]);
+                    }
+                } break;
+            default:
+                {
+                    const quantize_fns_t fns = ggml_internal_get_quantize_fn(type);
+                    fns.dequantize_row_q(k_row, kd + r*D, D);
+                    fns.dequantize_row_q(v_row, vd + r*D, D);
+                } break;
+        }
+    }
+
+    double err2 = 0.0;
+    double sum2 = 0.0;
+
+    double * s = malloc(M*sizeof(double));
+
+    for (int h = 0; h < H; h++) {
+        for (int iq = 0; iq < N; iq++) {
+            const float * q_row = (const float *) q->data + (h*N + iq)*D;
+
+            // causal mask
+            const int Mq = P + iq + 1;
+
+            // with the decoded cache (e) and with the f32 values (f)
+            for (int pass = 0; pass < 2; pass++) {
+                const float * ks = pass == 0 ? kd : (const float *) kf->data;
+                const float * vs = pass == 0 ? vd : (const float *) vf->data;
+
+                double max = -INFINITY;
+                for (int ic = 0; ic < Mq; ic++) {
+                    double dot = 0.0;
+                    for (int i = 0; i < D; i++) {
+                        dot += (double) q_row[i]*(double) ks[(h*M + ic)*D + i];
+                    }
+                    s[ic] = dot/sqrt(D);
+                    max = s[ic] > max ? s[ic] : max;
+                }
+
+                double sum = 0.0;
+                for (int ic = 0; ic < Mq; ic++) {
+                    s[ic] = exp(s[ic] - max);
+                    sum += s[ic];
+                }
+
+                for (int i = 0; i < D; i++) {
+                    double expected = 0.0;
+                    for (int ic = 0; ic < Mq; ic++) {
+                        expected += s[ic]*(double) vs[(h*M + ic)*D + i];
+                    }
+                    expected /= sum;
+
+                    const double got = ((const float *) dst->data)[(h*N + iq)*D + i];
+
+                    if (pass == 0) {
+                        // the softmax may use the fp16 exp table, and q is quantized to q8_0 for a quantized cache
+                        const double tol = ggml_blck_size(type) > 1 ? 2e-2 : 2e-3;
+                        assert(fabs(got - expected) <= tol*(1.0 + fabs(expected)));
+                    } else {
+                        err2 += (got - expected)*(got - expected);
+                        sum2 += expected*expected;
+                    }
+                }
+            }
+        }
+    }
+
+    free(s);
+    free(kd);
+    free(vd);
+    ggml_free(ctx);
+
+    return sqrt(err2/sum2);
+}
+
+int main(void) {
+    const enum ggml_type types[] = { GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0, GGML_TYPE_Q4_1, GGML_TYPE_Q4_2, GGML_TYPE_Q4_3, GGML_TYPE_Q2_1, GGML_TYPE_Q3_1 };
+    const char *         names[] = { "f32",         "f16",         "q8_0",         "q4_0",         "q4_1",         "q4_2",         "q4_3",         "q2_1",         "q3_1"         };
+
+    for (int i = 0; i < (int) (sizeof(types)/sizeof(types[0])); i++) {
+        // prompt, then single tokens - the head size of the LLaMA models and a smaller one
+        const double err0 = test_flash_attn(types[i], 128, 37, 0, 4, 3);
+        const double err1 = test_flash_attn(types[i], 128, 1, 200, 3, 2);
+        const double err2 = test_flash_attn(types[i], 64, 5, 70, 2, 1);
+
+        printf("%5s: relative RMS error against a f32 cache = %.5f %.5f %.5f\n", names[i], err0, err1, err2);
+    }
+
+    return 0;
+}
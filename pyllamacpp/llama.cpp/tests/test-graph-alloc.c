@@ -0,0 +1,131 @@
+#include "ggml.h"
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { D = 64, H = 4, F = 96, N = 7, N_LAYER = 3 };
+
+// layers shaped like the ones of llama_eval() - views, reshapes, in-place ops and cpy destinations
+static struct ggml_tensor * build_graph(struct ggml_context * ctx, struct ggml_tensor * x, struct ggml_tensor ** w) {
+    struct ggml_tensor * cur = x;
+
+    for (int il = 0; il < N_LAYER; il++) {
+        struct ggml_tensor ** wl = w + 6*il;
+
+        struct ggml_tensor * h = ggml_rms_norm(ctx, cur);
+
+        struct ggml_tensor * q = ggml_rope(ctx, ggml_reshape_3d(ctx, ggml_mul_mat(ctx, wl[0], h), D/H, H, N), 0, D/H, 0);
+        struct ggml_tensor * k = ggml_rope(ctx, ggml_reshape_3d(ctx, ggml_mul_mat(ctx, wl[1], h), D/H, H, N), 0, D/H, 0);
+
+        struct ggml_tensor * kq = ggml_mul_mat(ctx, ggml_permute(ctx, k, 0, 2, 1, 3), ggml_permute(ctx, q, 0, 2, 1, 3));
+        kq = ggml_soft_max(ctx, ggml_diag_mask_inf(ctx, ggml_scale(ctx, kq, ggml_new_f32(ctx, 1.0f/sqrtf(D/H))), 0));
+
+        struct ggml_tensor * v = ggml_cpy(ctx,
+                ggml_permute(ctx, ggml_reshape_3d(ctx, ggml_mul_mat(ctx, wl[2], h), D/H, H, N), 1, 2, 0, 3),
+                ggml_new_tensor_3d(ctx, GGML_TYPE_F32, N, D/H, H));
+
+        struct ggml_tensor * kqv = ggml_cpy(ctx,
+                ggml_permute(ctx, ggml_mul_mat(ctx, v, kq), 0, 2, 1, 3),
+                ggml_new_tensor_2d(ctx, GGML_TYPE_F32, D, N));
+
+        cur = ggml_add(ctx, cur, ggml_mul_mat(ctx, wl[3], kqv));
+
+        struct ggml_tensor * ff = ggml_mul(ctx, ggml_silu(ctx, ggml_mul_mat(ctx, wl[4], cur)), ggml_mul_mat(ctx, wl[4], h));
+
+        cur = ggml_add(ctx, cur, ggml_mul_mat(ctx, wl[5], ff));
+    }
+
+    return cur;
+}
+
+static void fill_input(struct ggml_tensor * x) {
+    for (int i = 0; i < D*N; i++) {
+        ((float *) x->data)[i] = sinf(0.13f*i)*(1 + i%3);
+    }
+}
+
+// the graph in a no_alloc context placed by ggml_graph_alloc() against the same graph with the tensors in the context
+static void test_graph_alloc(struct ggml_tensor ** w, int n_threads) {
+    struct ggml_init_params params_ref = { 16*1024*1024, NULL, false };
+    struct ggml_context * ctx_ref = ggml_init(params_ref);
+
+    struct ggml_tensor * x_ref = ggml_new_tensor_2d(ctx_ref, GGML_TYPE_F32, D, N);
+    fill_input(x_ref);
+
+    struct ggml_tensor * out_ref = build_graph(ctx_ref, x_ref, w);
+
+    struct ggml_cgraph gf_ref = ggml_build_forward(out_ref);
+    gf_ref.n_threads = n_threads;
+    ggml_graph_compute(ctx_ref, &gf_ref);
+
+    struct ggml_init_params params = { 2*GGML_MAX_NODES*(ggml_tensor_overhead() + 16), NULL, true };
+    struct ggml_context * ctx = ggml_init(params);
+
+    struct ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, D, N);
+    struct ggml_tensor * out = build_graph(ctx, x, w);
+
+    struct ggml_cgraph gf = ggml_build_forward(out);
+    gf.n_threads = n_threads;
+
+    const size_t size = ggml_graph_alloc(ctx, &gf, NULL, 0);
+
+    // without reuse the planned tensors take the sum of their sizes
+    size_t size_all = gf.work_size;
+    for (int i = 0; i < gf.n_nodes; i++) {
+        if (gf.nodes[i]->view_src == NULL) {
+            size_all += ggml_nbytes(gf.nodes[i]);
+        }
+    }
+    for (int i = 0; i < gf.n_leafs; i++) {
+        if (gf.leafs[i]->data == NULL) {
+            size_all += ggml_nbytes(gf.leafs[i]);
+        }
+    }
+
+    printf("n_threads = %d: %zu bytes planned, %zu bytes without reuse\n", n_threads, size, size_all);
+    assert(size < size_all/2);
+
+    void * buffer = malloc(size);
+    assert(ggml_graph_alloc(ctx, &gf, buffer, size) == size);
+
+    fill_input(x);
+    ggml_graph_compute(ctx, &gf);
+
+    assert(memcmp(out->data, out_ref->data, ggml_nbytes(out)) == 0);
+
+    free(buffer);
+    ggml_free(ctx);
+    ggml_free(ctx_ref);
+}
+
+int main(void) {
+    struct ggml_init_params params = { 16*1024*1024, NULL, false };
+    struct ggml_context * ctx = ggml_init(params);
+
+    struct ggml_tensor * w[6*N_LAYER];
+    for (int il = 0; il < N_LAYER; il++) {
+        w[6*il + 0] = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, D, D);
+        w[6*il + 1] = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, D, D);
+        w[6*il + 2] = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, D, D);
+        w[6*il + 3] = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, D, D);
+        w[6*il + 4] = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, D, F);
+        w[6*il + 5] = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, F, D);
+    }
+
+    for (int i = 0; i < 6*N_LAYER; i++) {
+        const int n = ggml_nelements(w[i]);
+        for (int j = 0; j < n; j++) {
+            ggml_set_f32_1d(w[i], j, 0.2f*cosf(0.07f*j + i));
+        }
+    }
+
+    test_graph_alloc(w, 1);
+    test_graph_alloc(w, 3);
+
+    ggml_free(ctx);
+
+    return 0;
+}
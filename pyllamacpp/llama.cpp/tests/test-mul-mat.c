@@ -0,0 +1,95 @@
+#include "ggml.h"
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the batched ggml_mul_mat (cache-blocked kernel) against a double precision reference on the decoded src0
+// the sizes are not multiples of the register tiles and blocks, so that the edges are exercised
+static void test_mul_mat(enum ggml_type type, int ne00, int ne01, int ne11, int ne02, bool with_acc, int n_threads) {
+    struct ggml_init_params params = { 64*1024*1024, NULL, false };
+    struct ggml_context * ctx = ggml_init(params);
+
+    const int n0 = ne00*ne01*ne02;
+
+    float * x  = malloc(n0*sizeof(float));
+    float * xd = malloc(n0*sizeof(float));
+
+    for (int i = 0; i < n0; i++) {
+        x[i] = sinf(0.37f*i)*(1 + i%5);
+    }
+
+    struct ggml_tensor * src0 = ggml_new_tensor_3d(ctx, type, ne00, ne01, ne02);
+
+    switch (type) {
+        case GGML_TYPE_F32:
+            {
+                memcpy(src0->data, x, n0*sizeof(float));
+                memcpy(xd, x, n0*sizeof(float));
+            } break;
+        case GGML_TYPE_F16:
+            {
+                for (int i = 0; i < n0; i++) {
+                    ((ggml_fp16_t *) src0->data)[i] = ggml_fp32_to_fp16(x[i]);
+                    xd[i] = ggml_fp16_to_fp32(((ggml_fp16_t *) src0->data)[i]);
+                }
+            } break;
+        default:
+            {
+                const quantize_fns_t fns = ggml_internal_get_quantize_fn(type);
+                fns.quantize_row_q  (x, src0->data, n0);
+                fns.dequantize_row_q(src0->data, xd, n0);
+            } break;
+    }
+
+    struct ggml_tensor * src1 = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, ne00, ne11, ne02);
+    for (int i = 0; i < ne00*ne11*ne02; i++) {
+        ((float *) src1->data)[i] = cosf(0.11f*i)*(2 - i%3);
+    }
+
+    struct ggml_tensor * acc = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, ne01, ne11, ne02);
+    for (int i = 0; i < ne01*ne11*ne02; i++) {
+        ((float *) acc->data)[i] = 0.5f*i;
+    }
+
+    struct ggml_tensor * dst = with_acc ? ggml_mul_mat_add(ctx, src0, src1, acc) : ggml_mul_mat(ctx, src0, src1);
+
+    struct ggml_cgraph gf = ggml_build_forward(dst);
+    gf.n_threads = n_threads;
+    ggml_graph_compute(ctx, &gf);
+
+    for (int i02 = 0; i02 < ne02; i02++) {
+        for (int i11 = 0; i11 < ne11; i11++) {
+            for (int i01 = 0; i01 < ne01; i01++) {
+                const int id = (i02*ne11 + i11)*ne01 + i01;
+
+                double expected = with_acc ? (double) ((float *) acc->data)[id] : 0.0;
+                double scale    = fabs(expected);
+                for (int i00 = 0; i00 < ne00; i00++) {
+                    const double p = (double) xd[(i02*ne01 + i01)*ne00 + i00]*(double) ((float *) src1->data)[(i02*ne11 + i11)*ne00 + i00];
+                    expected += p;
+                    scale    += fabs(p);
+                }
+
+                assert(fabs((double) ((float *) dst->data)[id] - expected) <= 1e-5*scale);
+            }
+        }
+    }
+
+    free(x);
+    free(xd);
+    ggml_free(ctx);
+}
+
+int main(void) {
+    const enum ggml_type types[] = { GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q4_1, GGML_TYPE_Q8_0, GGML_TYPE_Q2_1, GGML_TYPE_Q3_1, GGML_TYPE_Q4_2, GGML_TYPE_Q4_3 };
+
+    for (int i = 0; i < (int) (sizeof(types)/sizeof(types[0])); i++) {
+        test_mul_mat(types[i], 320, 72, 37, 1, false, 3);
+        test_mul_mat(types[i], 512, 136, 64, 2, true, 2);
+        test_mul_mat(types[i], 96, 200, 33, 3, false, 1);
+    }
+
+    return 0;
+}
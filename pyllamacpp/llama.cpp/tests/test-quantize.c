@@ -2,13 +2,334 @@
 #undef NDEBUG
 #include <assert.h>
 #include <math.h>
+#include <string.h>
+
+#define QK 32
+
+// scalar decoding of element i of a quantized row, straight from the block layout
+static float dequantize_scalar(enum ggml_type type, const uint8_t * row, int i) {
+    const int ib = i / QK;
+    const int il = i % QK;
+
+    float d = 0.0f;
+    float m = 0.0f;
+    const uint8_t * qs = NULL;
+
+    switch (type) {
+        case GGML_TYPE_Q4_0:
+            {
+                const uint8_t * b = row + ib*(sizeof(float) + QK/2);
+                memcpy(&d, b, sizeof(float));
+                m  = -8.0f*d;
+                qs = b + sizeof(float);
+            } break;
+        case GGML_TYPE_Q4_1:
+            {
+                const uint8_t * b = row + ib*(2*sizeof(float) + QK/2);
+                memcpy(&d, b, sizeof(float));
+                memcpy(&m, b + sizeof(float), sizeof(float));
+                qs = b + 2*sizeof(float);
+            } break;
+        case GGML_TYPE_Q4_2:
+            {
+                const uint8_t * b = row + ib*(sizeof(ggml_fp16_t) + QK/2);
+                ggml_fp16_t h;
+                memcpy(&h, b, sizeof(h));
+                d  = ggml_fp16_to_fp32(h);
+                m  = -8.0f*d;
+                qs = b + sizeof(h);
+            } break;
+        case GGML_TYPE_Q4_3:
+            {
+                const uint8_t * b = row + ib*(2*sizeof(ggml_fp16_t) + QK/2);
+                ggml_fp16_t h[2];
+                memcpy(h, b, sizeof(h));
+                d  = ggml_fp16_to_fp32(h[0]);
+                m  = ggml_fp16_to_fp32(h[1]);
+                qs = b + sizeof(h);
+            } break;
+        case GGML_TYPE_Q8_0:
+            {
+                const uint8_t * b = row + ib*(sizeof(float) + QK);
+                memcpy(&d, b, sizeof(float));
+                return d*(int8_t) b[sizeof(float) + il];
+            }
+        case GGML_TYPE_Q2_1:
+        case GGML_TYPE_Q3_1:
+            {
+                const int bits = type == GGML_TYPE_Q2_1 ? 2 : 3;
+                const uint8_t * b = row + ib*(2*sizeof(ggml_fp16_t) + bits*QK/8);
+
+                ggml_fp16_t h[2];
+                memcpy(h, b, sizeof(h));
+
+                const uint8_t * bq = b + sizeof(h);
+
+                int q = (bq[il%8] >> (2*(il/8))) & 3;
+                if (bits == 3) {
+                    q |= ((bq[QK/4 + il/8] >> (il%8)) & 1) << 2;
+                }
+
+                return ggml_fp16_to_fp32(h[0])*q + ggml_fp16_to_fp32(h[1]);
+            }
+        default:
+            assert(false);
+    }
+
+    const uint8_t q = (il % 2) ? (qs[il/2] >> 4) : (qs[il/2] & 0xF);
+
+    return type == GGML_TYPE_Q4_0 ? d*((int) q - 8) : d*q + m;
+}
+
+// the src1 side of the quantized dot products: one float delta and QK int8 quants per block
+static float dequantize_scalar_q8(const uint8_t * row, int i, float * delta) {
+    const uint8_t * b = row + (i/QK)*(sizeof(float) + QK);
+
+    float d;
+    memcpy(&d, b, sizeof(float));
+    *delta = d;
+
+    return d*(int8_t) b[sizeof(float) + i%QK];
+}
+
+// check the (possibly SIMD) kernels of a quantization type against the scalar decoding above
+static void test_quantize_fns(enum ggml_type type) {
+    #define NK (8*QK)
+    float x[NK];
+    float y[NK];
+    float xd[NK];
+    uint8_t qx[2*NK];
+    uint8_t qy[2*NK];
+
+    for (int i = 0; i < NK; i++) {
+        x[i] = sinf(0.37f*i)*(1 + i%7);
+        y[i] = cosf(0.11f*i)*(2 - i%5) + 0.1f;
+    }
+
+    const quantize_fns_t fns = ggml_internal_get_quantize_fn(type);
+
+    fns.quantize_row_q    (x, qx, NK);
+    fns.quantize_row_q_dot(y, qy, NK);
+
+    // dequantization
+    fns.dequantize_row_q(qx, xd, NK);
+    for (int i = 0; i < NK; i++) {
+        const float expected = dequantize_scalar(type, qx, i);
+        assert(fabsf(xd[i] - expected) <= 1e-5f*(1.0f + fabsf(expected)));
+    }
+
+    // 8-bit quantization of the dot product operand rounds to the nearest step
+    for (int i = 0; i < NK; i++) {
+        float d;
+        const float v = dequantize_scalar_q8(qy, i, &d);
+        assert(fabsf(v - y[i]) <= 0.5f*d + 1e-6f);
+    }
+
+    // dot product
+    double expected = 0.0;
+    double scale    = 0.0;
+    for (int i = 0; i < NK; i++) {
+        float d;
+        const double p = (double) dequantize_scalar(type, qx, i)*(double) dequantize_scalar_q8(qy, i, &d);
+        expected += p;
+        scale    += fabs(p);
+    }
+
+    float result;
+    fns.vec_dot_q(NK, &result, qx, qy);
+    assert(fabs((double) result - expected) <= 1e-5*scale);
+    #undef NK
+}
+
+// the conversion to fp16 scales keeps the quants, so only the rounding of the scales changes the values
+static void test_convert_q4_fp16(void) {
+    #define NK (4*QK)
+    float x[NK];
+    float xd[NK];
+    float xc[NK];
+    uint8_t qx[2*NK];
+    uint8_t qc[2*NK];
+    int64_t hist[16] = { 0 };
+
+    for (int i = 0; i < NK; i++) {
+        x[i] = sinf(0.21f*i)*(2 + i%9);
+    }
+
+    ggml_quantize_q4_0(x, qx, NK, NK, hist);
+    ggml_convert_q4_0_q4_2(qx, qc, NK, hist);
+    ggml_internal_get_quantize_fn(GGML_TYPE_Q4_0).dequantize_row_q(qx, xd, NK);
+    ggml_internal_get_quantize_fn(GGML_TYPE_Q4_2).dequantize_row_q(qc, xc, NK);
+    for (int i = 0; i < NK; i++) {
+        assert(fabsf(xc[i] - xd[i]) <= 1e-3f*fabsf(xd[i]));
+    }
+
+    ggml_quantize_q4_1(x, qx, NK, NK, hist);
+    ggml_convert_q4_1_q4_3(qx, qc, NK, hist);
+    ggml_internal_get_quantize_fn(GGML_TYPE_Q4_1).dequantize_row_q(qx, xd, NK);
+    ggml_internal_get_quantize_fn(GGML_TYPE_Q4_3).dequantize_row_q(qc, xc, NK);
+    for (int i = 0; i < NK; i++) {
+        assert(fabsf(xc[i] - xd[i]) <= 1e-2f);
+    }
+    #undef NK
+}
+
+// the interleaved Q4_0 layout must give the results of the 8 rows it was made from
+static void test_repack_q4_0_x8(void) {
+    #define NK (4*QK)
+    float x[8*NK];
+    float xd[8*NK];
+    float y[NK];
+    uint8_t qx[8*NK];
+    uint8_t qx8[8*NK];
+    uint8_t qy[2*NK];
+    int64_t hist[16] = { 0 };
+
+    for (int i = 0; i < 8*NK; i++) {
+        x[i] = sinf(0.13f*i)*(1 + i%11);
+    }
+    for (int i = 0; i < NK; i++) {
+        y[i] = cosf(0.29f*i)*(3 - i%4);
+    }
+
+    const size_t row_size = ggml_quantize_q4_0(x, qx, NK, NK, hist);
+    for (int r = 1; r < 8; r++) {
+        ggml_quantize_q4_0(x + r*NK, qx + r*row_size, NK, NK, hist);
+    }
+
+    const size_t size = ggml_repack_q4_0_x8(qx, qx8, 8, NK);
+    assert(size == 8*row_size);
+
+    const quantize_fns_t fns = ggml_internal_get_quantize_fn(GGML_TYPE_Q4_0_X8);
+
+    fns.quantize_row_q_dot(y, qy, NK);
+
+    fns.dequantize_row_q(qx8, xd, 8*NK);
+    for (int r = 0; r < 8; r++) {
+        for (int i = 0; i < NK; i++) {
+            assert(xd[r*NK + i] == dequantize_scalar(GGML_TYPE_Q4_0, qx + r*row_size, i));
+        }
+    }
+
+    float result[8];
+    fns.vec_dot_q(NK, result, qx8, qy);
+    for (int r = 0; r < 8; r++) {
+        double expected = 0.0;
+        double scale    = 0.0;
+        for (int i = 0; i < NK; i++) {
+            float d;
+            const double p = (double) dequantize_scalar(GGML_TYPE_Q4_0, qx + r*row_size, i)*(double) dequantize_scalar_q8(qy, i, &d);
+            expected += p;
+            scale    += fabs(p);
+        }
+        assert(fabs((double) result[r] - expected) <= 1e-5*scale);
+    }
+    #undef NK
+}
+
+// ggml_cpy from f16 into a quantized tensor and into a strided view of one, against the same copy from f32 - the values
+// are exact in f16, so the blocks must be the same
+static void test_cpy_f16_quantized(enum ggml_type type) {
+    enum { NE0 = 2*QK, NE1 = 3 };
+
+    struct ggml_init_params params = { 1024*1024, NULL, false };
+    struct ggml_context * ctx = ggml_init(params);
+
+    struct ggml_tensor * x32 = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, NE0, NE1);
+    struct ggml_tensor * x16 = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, NE0, NE1);
+    for (int i = 0; i < NE0*NE1; i++) {
+        ((ggml_fp16_t *) x16->data)[i] = ggml_fp32_to_fp16(sinf(0.13f*i)*(1 + i%5));
+        ((float *) x32->data)[i] = ggml_fp16_to_fp32(((ggml_fp16_t *) x16->data)[i]);
+    }
+
+    // the strided views skip every other row of the destination
+    const size_t rs = ggml_type_size(type)*NE0/ggml_blck_size(type);
+
+    struct ggml_tensor * q32 = ggml_new_tensor_2d(ctx, type, NE0, 2*NE1);
+    struct ggml_tensor * q16 = ggml_new_tensor_2d(ctx, type, NE0, 2*NE1);
+    memset(q32->data, 0, ggml_nbytes(q32));
+    memset(q16->data, 0, ggml_nbytes(q16));
+
+    struct ggml_tensor * c32 = ggml_new_tensor_2d(ctx, type, NE0, NE1);
+    struct ggml_tensor * c16 = ggml_new_tensor_2d(ctx, type, NE0, NE1);
+
+    struct ggml_cgraph gf = { 0 };
+    gf.n_threads = 1;
+    ggml_build_forward_expand(&gf, ggml_cpy(ctx, x32, ggml_view_2d(ctx, q32, NE0, NE1, 2*rs, rs)));
+    ggml_build_forward_expand(&gf, ggml_cpy(ctx, x16, ggml_view_2d(ctx, q16, NE0, NE1, 2*rs, rs)));
+    ggml_build_forward_expand(&gf, ggml_cpy(ctx, x32, c32));
+    ggml_build_forward_expand(&gf, ggml_cpy(ctx, x16, c16));
+    ggml_graph_compute(ctx, &gf);
+
+    assert(memcmp(q16->data, q32->data, ggml_nbytes(q32)) == 0);
+    assert(memcmp(c16->data, c32->data, ggml_nbytes(c32)) == 0);
+
+    ggml_free(ctx);
+}
+
+// the kernels specialised for a row length must agree with the generic ones
+static void test_vec_dot_fixed(enum ggml_type type, int n) {
+    static float x[4096];
+    static float y[4096];
+    static uint8_t qx[4096*sizeof(float)];
+    static uint8_t qy[4096*sizeof(float)];
+
+    assert(n <= 4096);
+
+    for (int i = 0; i < n; i++) {
+        x[i] = sinf(0.21f*i)*(1 + i%9);
+        y[i] = cosf(0.17f*i)*(2 - i%3);
+    }
+
+    const vec_dot_q_t vec_dot_fixed = ggml_internal_get_vec_dot_fixed(type, n);
+    if (vec_dot_fixed == NULL) {
+        // the kernel set has no specialisation for this length
+        return;
+    }
+
+    double expected;
+    if (type == GGML_TYPE_F16) {
+        // the row conversions do not need the tables of ggml_init()
+        ggml_fp32_to_fp16_row(x, (ggml_fp16_t *) qx, n);
+        ggml_fp32_to_fp16_row(y, (ggml_fp16_t *) qy, n);
+        ggml_fp16_to_fp32_row((ggml_fp16_t *) qx, x, n);
+        ggml_fp16_to_fp32_row((ggml_fp16_t *) qy, y, n);
+
+        expected = 0.0;
+        for (int i = 0; i < n; i++) {
+            expected += (double) x[i]*(double) y[i];
+        }
+    } else {
+        const quantize_fns_t fns = ggml_internal_get_quantize_fn(type);
+        fns.quantize_row_q    (x, qx, n);
+        fns.quantize_row_q_dot(y, qy, n);
+
+        float result;
+        fns.vec_dot_q(n, &result, qx, qy);
+        expected = result;
+    }
+
+    double scale = 0.0;
+    for (int i = 0; i < n; i++) {
+        scale += fabs((double) x[i]*(double) y[i]);
+    }
+
+    float result;
+    vec_dot_fixed(n, &result, qx, qy);
+    assert(fabs((double) result - expected) <= 1e-5*scale);
+}
 
 int main(void) {
-    #define QK 32
     float src[QK];
-    uint8_t dst[24];
+    uint8_t dst[36];
     int64_t hist[16];
 
+    // needed to initialize f16 tables
+    {
+        struct ggml_init_params params = { 0, NULL, false };
+        struct ggml_context * ctx = ggml_init(params);
+        ggml_free(ctx);
+    }
+
     for (int i = 0; i < QK; i++) {
         src[i] = (float)(i + 1);
     }
@@ -38,5 +359,34 @@ int main(void) {
         assert(q4_result == q4_expected);
     }
 
+    size = ggml_quantize_q8_0(src, dst, QK, QK, hist);
+    assert(size == 36);
+    float amax_result = ((float *)dst)[0];
+    float amax_expected = src[31] / ((1 << 7) - 1);
+    assert(amax_result == amax_expected);
+    for (int i = 0; i < QK; i++) {
+        int8_t q8_result = (int8_t) dst[sizeof(float) + i];
+        int8_t q8_expected = roundf(src[i] / amax_expected);
+        assert(q8_result == q8_expected);
+    }
+
+    test_quantize_fns(GGML_TYPE_Q4_0);
+    test_quantize_fns(GGML_TYPE_Q4_1);
+    test_quantize_fns(GGML_TYPE_Q8_0);
+    test_quantize_fns(GGML_TYPE_Q2_1);
+    test_quantize_fns(GGML_TYPE_Q3_1);
+    test_quantize_fns(GGML_TYPE_Q4_2);
+    test_quantize_fns(GGML_TYPE_Q4_3);
+    test_convert_q4_fp16();
+    test_repack_q4_0_x8();
+    test_cpy_f16_quantized(GGML_TYPE_Q4_0);
+    test_cpy_f16_quantized(GGML_TYPE_Q4_2);
+    test_cpy_f16_quantized(GGML_TYPE_Q8_0);
+
+    test_vec_dot_fixed(GGML_TYPE_Q4_0, 4096);
+    test_vec_dot_fixed(GGML_TYPE_Q4_1, 4096);
+    test_vec_dot_fixed(GGML_TYPE_F16,  128);
+    test_vec_dot_fixed(GGML_TYPE_F16,  4096);
+
     return 0;
 }
@@ -17,6 +17,12 @@ LLAMA_CONTEXT_PARAMS_SCHEMA = {
         'options': None,
         'default': -1
     },
+    'n_batch': {
+        'type': int,
+        'description': "tokens of the largest llama_eval() call the compute buffer is sized for",
+        'options': None,
+        'default': 512
+    },
     'n_parts': {
         'type': int,
         'description': "",
@@ -35,6 +41,12 @@ LLAMA_CONTEXT_PARAMS_SCHEMA = {
         'options': None,
         'default': 0
     },
+    'kv_type': {
+        'type': int,
+        'description': "type of the KV cache, -1 to use f16_kv",
+        'options': [-1, 0, 1, 2, 3, 5, 6, 7, 8, 9],
+        'default': -1
+    },
     'logits_all': {
         'type': bool,
         'description': "the llama_eval() call computes all logits, not just the last one",
@@ -53,11 +65,53 @@ LLAMA_CONTEXT_PARAMS_SCHEMA = {
         'options': None,
         'default': 0
     },
+    'prefault': {
+        'type': bool,
+        'description': "commit the kv cache and compute buffers at startup instead of on first use",
+        'options': None,
+        'default': 0
+    },
+    'huge_pages': {
+        'type': bool,
+        'description': "back the kv cache, compute buffers and copied weights with huge pages",
+        'options': None,
+        'default': 0
+    },
+    'copy_weights': {
+        'type': bool,
+        'description': "copy the weights out of the file mapping into anonymous memory",
+        'options': None,
+        'default': 0
+    },
+    'warmup': {
+        'type': bool,
+        'description': "read the weights into memory at init on all cores",
+        'options': None,
+        'default': 0
+    },
+    'warmup_async': {
+        'type': bool,
+        'description': "read the weights into memory in the background while the model is used",
+        'options': None,
+        'default': 0
+    },
     'embedding': {
         'type': bool,
         'description': "embedding mode only",
         'options': None,
         'default': 0
+    },
+    'fuse_weights': {
+        'type': bool,
+        'description': "pack the q/k/v and w1/w3 weights into single tensors at load time",
+        'options': None,
+        'default': 0
+    },
+    'repack_weights': {
+        'type': bool,
+        'description': "interleave the rows of the q4_0 weights for the multi-row kernels at load time",
+        'options': None,
+        'default': 0
     }
 }
 
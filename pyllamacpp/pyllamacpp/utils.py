@@ -172,11 +172,13 @@ def quantize(ggml_model_path: str, output_model_path: str = None, itype: int = 2
 
     :param ggml_model_path: path of the ggml model
     :param output_model_path: output file path for the qunatized model
-    :param itype: quantization type: 2 -> Q4_0, 3 -> Q4_1
+    :param itype: quantization type: 2 -> Q4_0, 3 -> Q4_1, 5 -> Q4_2, 6 -> Q4_3, 7 -> Q8_0,
+        8 -> Q2_1, 9 -> Q3_1
     :return: quantized model path
     """
     if output_model_path is None:
-        output_model_path = ggml_model_path + f'-q4_{0 if itype == 2 else 1}.bin'
+        type_names = {2: 'q4_0', 3: 'q4_1', 5: 'q4_2', 6: 'q4_3', 7: 'q8_0', 8: 'q2_1', 9: 'q3_1'}
+        output_model_path = ggml_model_path + f'-{type_names[itype]}.bin'
     logging.info("Quantization will start soon ... (This my take a while)")
     pp.llama_quantize(ggml_model_path, output_model_path, itype)
     logging.info(f"Quantized model is created successfully {output_model_path}")
@@ -46,9 +46,15 @@ struct llama_context_wrapper llama_init_from_file_wrapper(const char * path_mode
 
 
 void llama_free_wrapper(struct llama_context_wrapper * ctx_w){
+    // llama_free waits for the warm-up thread, which takes the GIL to call the progress callback
+    py::gil_scoped_release release;
     llama_free(ctx_w->ptr);
 }
 
+float llama_warmup_progress_wrapper(struct llama_context_wrapper * ctx_w){
+    return llama_warmup_progress(ctx_w->ptr);
+}
+
 int llama_eval_wrapper(struct llama_context_wrapper * ctx_w,
                const llama_token * tokens,
                int   n_tokens,
@@ -635,17 +641,28 @@ PYBIND11_MODULE(_pyllamacpp, m) {
     py::class_<llama_context_params>(m,"llama_context_params")
         .def(py::init<>())
         .def_readwrite("n_ctx", &llama_context_params::n_ctx)
+        .def_readwrite("n_batch", &llama_context_params::n_batch)
         .def_readwrite("n_parts", &llama_context_params::n_parts)
         .def_readwrite("seed", &llama_context_params::seed)
         .def_readwrite("f16_kv", &llama_context_params::f16_kv)
+        .def_readwrite("kv_type", &llama_context_params::kv_type)
         .def_readwrite("logits_all", &llama_context_params::logits_all)
         .def_readwrite("vocab_only", &llama_context_params::vocab_only)
         .def_readwrite("use_mlock", &llama_context_params::use_mlock)
+        .def_readwrite("prefault", &llama_context_params::prefault)
+        .def_readwrite("huge_pages", &llama_context_params::huge_pages)
+        .def_readwrite("copy_weights", &llama_context_params::copy_weights)
+        .def_readwrite("warmup", &llama_context_params::warmup)
+        .def_readwrite("warmup_async", &llama_context_params::warmup_async)
         .def_readwrite("embedding", &llama_context_params::embedding)
+        .def_readwrite("fuse_weights", &llama_context_params::fuse_weights)
+        .def_readwrite("repack_weights", &llama_context_params::repack_weights)
         .def_property("progress_callback", [](llama_context_params &self) {},
             [](llama_context_params &self, py::function callback) {
             py_llama_progress_callback = callback;
             self.progress_callback = [](float progress, void *ctx) {
+                // called from the warm-up thread with warmup_async
+                py::gil_scoped_acquire acquire;
 //                struct llama_context_wrapper ctx_w;
 //                ctx_w->ptr = ctx;
                 py_llama_progress_callback(progress, ctx);
@@ -655,6 +672,7 @@ PYBIND11_MODULE(_pyllamacpp, m) {
     m.def("llama_context_default_params", &llama_context_default_params);
     m.def("llama_init_from_file", &llama_init_from_file_wrapper);
     m.def("llama_free", &llama_free_wrapper);
+    m.def("llama_warmup_progress", &llama_warmup_progress_wrapper);
     m.def("llama_model_quantize", &llama_model_quantize);
     m.def("llama_eval", &llama_eval_wrapper);
     m.def("llama_tokenize", &llama_tokenize_wrapper);